@@ -0,0 +1,177 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host backend of the Teensy 4.1 core - the part of the Arduino API the firmware uses, running
+// on the virtual clock of host_sim.h. Timing calls advance the clock instead of waiting, interrupt
+// sources are clock events, and the analog inputs read the injector plant.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+#include "host_sim.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define BIN 2
+#define BUILTIN_SDCARD 254
+
+#define F_CPU_ACTUAL HOST_CPU_HZ
+#define F_BUS_ACTUAL HOST_BUS_HZ
+#define ARM_DWT_CYCCNT (hostCycleCount())
+
+// Memory placement has no meaning on the host
+#define DMAMEM
+#define EXTMEM
+#define FASTRUN
+#define FLASHMEM
+#define PROGMEM
+#define F(string) string
+
+// The core's min/max/constrain are macros, these keep their mixed-type use compiling
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+  return b < a ? b : a;
+}
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+  return a < b ? b : a;
+}
+template <class T, class L, class H>
+inline T constrain(T x, L low, H high) {
+  return x < low ? low : (x > high ? high : x);
+}
+
+class String {
+ public:
+  String(const char *text = "") : text(text ? text : "") {}
+  String(const std::string &text) : text(text) {}
+  explicit String(int value) : text(std::to_string(value)) {}
+  explicit String(unsigned int value) : text(std::to_string(value)) {}
+  explicit String(long value) : text(std::to_string(value)) {}
+  explicit String(unsigned long value) : text(std::to_string(value)) {}
+
+  String &operator+=(const String &other) { text += other.text; return *this; }
+  String &operator+=(const char *other) { text += other; return *this; }
+  String &operator+=(char c) { text += c; return *this; }
+  String &operator+=(int value) { text += std::to_string(value); return *this; }
+  String &operator+=(unsigned int value) { text += std::to_string(value); return *this; }
+  String &operator+=(long value) { text += std::to_string(value); return *this; }
+  String &operator+=(unsigned long value) { text += std::to_string(value); return *this; }
+  friend String operator+(String a, const String &b) { return a += b; }
+  friend String operator+(String a, const char *b) { return a += b; }
+  friend String operator+(const char *a, const String &b) { return String(a) += b; }
+  bool operator==(const String &other) const { return text == other.text; }
+  bool operator==(const char *other) const { return text == other; }
+  bool operator!=(const char *other) const { return text != other; }
+
+  const char *c_str() const { return text.c_str(); }
+  unsigned int length() const { return text.size(); }
+  char charAt(unsigned int index) const { return index < text.size() ? text[index] : 0; }
+  bool startsWith(const char *prefix) const { return text.compare(0, strlen(prefix), prefix) == 0; }
+  bool endsWith(const char *suffix) const {
+    size_t n = strlen(suffix);
+    return text.size() >= n && text.compare(text.size() - n, n, suffix) == 0;
+  }
+  long toInt() const { return atol(text.c_str()); }
+  float toFloat() const { return atof(text.c_str()); }
+
+ private:
+  std::string text;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t print(const String &text) { return print(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = DEC) { return printNumber(value, base, false); }
+  size_t print(int value, int base = DEC) { return printNumber(value, base, true); }
+  size_t print(unsigned int value, int base = DEC) { return printNumber(value, base, false); }
+  size_t print(long value, int base = DEC) { return printNumber(value, base, true); }
+  size_t print(unsigned long value, int base = DEC) { return printNumber(value, base, false); }
+  size_t print(long long value, int base = DEC) { return printNumber(value, base, true); }
+  size_t print(unsigned long long value, int base = DEC) { return printNumber(value, base, false); }
+  size_t print(double value, int digits = 2);
+
+  size_t println() { return write((const uint8_t *)"\r\n", 2); }
+  template <class T>
+  size_t println(T value) { return print(value) + println(); }
+  template <class T>
+  size_t println(T value, int format) { return print(value, format) + println(); }
+
+ private:
+  size_t printNumber(unsigned long long value, int base, bool isSigned);
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// USB serial, backed by a pseudo terminal or stdin/stdout (host_serial.cpp)
+class usb_serial_class : public Stream {
+ public:
+  void begin(unsigned long baud) { (void)baud; }
+  operator bool() { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override;
+  void flush() override;
+};
+
+extern usb_serial_class Serial;
+
+// Timer ISR on a clock event, the PIT's interval rounding is not modelled
+class IntervalTimer {
+ public:
+  bool begin(void (*function)(), float microseconds);
+  void end();
+  void priority(uint8_t level) { event.priority = level; }
+
+ private:
+  HostEvent event;
+};
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+void analogReadResolution(unsigned int bits);
+void analogReadAveraging(unsigned int samples);
+
+void __disable_irq();
+void __enable_irq();
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include <Arduino.h>
+#include <memory>
+
+// Host backend of the SD library - the card is a directory (host_sd.cpp). Reads and writes take
+// HOST_SD_ACCESS_NS plus HOST_SD_BYTE_NS per byte of virtual time, with interrupts running.
+
+#define FILE_READ 0
+#define FILE_WRITE 1        // Read and write, created if missing, positioned at the end
+#define FILE_WRITE_BEGIN 2  // The same, positioned at the start
+
+struct HostFile;
+
+// Copies share one open file, as the core's File handles do
+class File : public Stream {
+ public:
+  File() {}
+  explicit File(std::shared_ptr<HostFile> file) : file(file) {}
+  operator bool() const;
+
+  int read(void *buffer, size_t size);
+  int read() override;
+  int peek() override;
+  int available() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  void flush() override;
+  bool seek(uint64_t position);
+  uint64_t position();
+  uint64_t size();
+  void close();
+  const char *name();
+  bool isDirectory();
+  File openNextFile();
+
+ private:
+  std::shared_ptr<HostFile> file;
+};
+
+class SDClass {
+ public:
+  bool begin(uint8_t csPin);
+  File open(const char *path, uint8_t mode = FILE_READ);
+  bool exists(const char *path);
+  bool remove(const char *path);
+};
+
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+// The built-in SD card is on SDIO, nothing of SPI is used
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+
+// Virtual clock and interrupt sources of the host build.
+//
+// Time only moves when the firmware spends it: every clock read, analogRead(), SD access and
+// loop() pass costs a fixed amount (below), and delay() jumps straight to its end. Interrupt
+// sources are events on the clock. When time moves past an event's due time the event's handler
+// runs at that time, in due order and by priority for ties, as an ISR would. Events wait while
+// interrupts are masked and while another handler runs (no preemption), then run late. Runs are
+// deterministic and as fast as the host allows, or paced to the wall clock with hostSetRealtime().
+
+// Host Simulation Configuration
+const uint32_t HOST_CPU_HZ = 600000000;       // ARM_DWT_CYCCNT rate, as F_CPU_ACTUAL
+const uint32_t HOST_BUS_HZ = 150000000;       // F_BUS_ACTUAL, also the GPT2 edge timer rate
+const uint32_t HOST_CLOCK_READ_NS = 20;       // micros(), millis(), ARM_DWT_CYCCNT
+const uint32_t HOST_ANALOG_READ_NS = 2000;    // One analogRead() conversion
+const uint32_t HOST_LOOP_NS = 1000;           // One pass of loop() with nothing else to pay for
+const uint32_t HOST_YIELD_NS = 100;           // yield() in a wait
+const uint32_t HOST_SD_ACCESS_NS = 5000;      // Fixed part of an SD read or write
+const uint32_t HOST_SD_BYTE_NS = 50;          // 20MB/s SDIO
+
+// Interrupt source on the clock
+struct HostEvent {
+  void (*handler)() = nullptr;
+  uint64_t dueNs = 0;
+  uint64_t periodNs = 0;    // Due again this long after it ran, 0 for one shot
+  uint8_t priority = 128;   // Lower runs first when due together, as on the NVIC
+  bool armed = false;
+  bool listed = false;
+  HostEvent *next = nullptr;
+};
+
+void hostEventStart(HostEvent &event, uint64_t dueNs, uint64_t periodNs = 0);
+void hostEventStop(HostEvent &event);
+
+uint64_t hostNowNs();
+uint32_t hostCycleCount();
+
+// Time taken by the caller, events falling due on the way run at their due time
+void hostSpend(uint64_t ns);
+void hostSpendUntil(uint64_t ns);
+
+// Interrupt mask, events due while masked run when it is lifted
+void hostIrqDisable();
+void hostIrqEnable();
+bool hostIrqMasked();
+bool hostInInterrupt();
+
+// Keep virtual time from running ahead of the wall clock
+void hostSetRealtime(bool realtime);
+
+#endif
@@ -0,0 +1,104 @@
+#include "adc_scan.h"
+#include "injector_plant.h"
+
+// Host copy of the scan engine: the QuadTimer trigger is a clock event at the same rounded period,
+// each trigger converts all five inputs from the plant. The per-sample handler runs from that event
+// like the ADC_ETC ISR, and every full half buffer goes to the block handler like the DMA ISR.
+
+// Host Scan Configuration
+const uint32_t SCAN_CONVERSION_NS = 1200;  // Trigger to both conversion pairs done
+
+static int currentInputs[4];
+static int supplyInput = PLANT_SUPPLY;
+static ScanBlockHandler blockHandler = nullptr;
+static ScanSampleHandler sampleHandler = nullptr;
+static ScanSampleHandler activeSampleHandler = nullptr;
+static uint16_t decoded[ADC_SCAN_BLOCK_SAMPLES][ADC_SCAN_CODES];
+static int blockSamples = ADC_SCAN_BLOCK_SAMPLES;
+static int filled = 0;
+static HostEvent triggerEvent;
+static uint64_t startNs = 0;
+static uint64_t triggerCount = 0;
+static uint64_t lastTriggerNs = 0;
+static uint32_t periodBusTicks = 0;
+static bool scanning = false;
+
+// Trigger n is at startNs + n periods, computed from bus ticks so the period doesn't drift
+static uint64_t triggerNs(uint64_t n) {
+  return startNs + n * periodBusTicks * 1000000000ull / HOST_BUS_HZ;
+}
+
+static void scanTrigger() {
+  lastTriggerNs = triggerEvent.dueNs;
+  hostEventStart(triggerEvent, triggerNs(++triggerCount));
+
+  hostSpend(SCAN_CONVERSION_NS);
+  uint16_t *codes = decoded[filled];
+  for (int ch = 0; ch < 4; ch++) {
+    codes[ch] = plantReadCode(currentInputs[ch]);
+  }
+  codes[4] = plantReadCode(supplyInput);
+  if (activeSampleHandler) activeSampleHandler(codes);
+  if (++filled == blockSamples) {
+    filled = 0;
+    blockHandler(decoded, blockSamples);
+  }
+}
+
+bool adcScanBegin(const int pins[4], int supplyPin) {
+  for (int ch = 0; ch < 4; ch++) {
+    currentInputs[ch] = plantSenseChannel(pins[ch]);
+    if (currentInputs[ch] < 0) return false;
+  }
+  supplyInput = plantSenseChannel(supplyPin);
+  triggerEvent.handler = scanTrigger;
+  triggerEvent.priority = ADC_SCAN_SAMPLE_IRQ_PRIORITY;
+  return supplyInput == PLANT_SUPPLY;
+}
+
+void adcScanSetSampleHandler(ScanSampleHandler handler) {
+  sampleHandler = handler;
+}
+
+uint32_t adcScanStart(uint32_t rateHz, ScanBlockHandler handler) {
+  if (scanning) adcScanStop();
+  rateHz = min(rateHz, ADC_SCAN_MAX_RATE);
+  blockHandler = handler;
+  activeSampleHandler = sampleHandler;
+  blockSamples = constrain((int)(rateHz / ADC_SCAN_BLOCK_HZ) & ~3, 4, ADC_SCAN_BLOCK_SAMPLES);
+  filled = 0;
+
+  // Same rounding as the QuadTimer, a toggle every half period, first rising edge one half in
+  uint32_t halfPeriod = F_BUS_ACTUAL / (2 * rateHz);
+  periodBusTicks = 2 * halfPeriod;
+  uint32_t startCycles = ARM_DWT_CYCCNT;
+  startNs = hostNowNs() + (uint64_t)halfPeriod * 1000000000ull / HOST_BUS_HZ;
+  triggerCount = 0;
+  lastTriggerNs = hostNowNs();
+  hostEventStart(triggerEvent, startNs);
+  scanning = true;
+  return startCycles + (F_CPU_ACTUAL / F_BUS_ACTUAL) * halfPeriod;
+}
+
+void adcScanStop() {
+  if (!scanning) return;
+  hostEventStop(triggerEvent);
+  scanning = false;
+}
+
+int adcScanBlockSamples() {
+  return blockSamples;
+}
+
+uint32_t adcScanPeriodCycles() {
+  return (F_CPU_ACTUAL / F_BUS_ACTUAL) * periodBusTicks;
+}
+
+uint32_t adcScanTriggerAgeCycles() {
+  return (uint32_t)((hostNowNs() - lastTriggerNs) * (HOST_CPU_HZ / 1000000) / 1000);
+}
+
+// Half buffers are handed over inside the trigger event, none can be overwritten unread
+uint32_t adcScanMissedBlocks() {
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "hal.h"
+#include "injector_plant.h"
+
+// Host backend of hal.h and the core's pin and analog calls, wired to the injector plant
+
+// The core's PSRAM size, the bench Teensy has both chips fitted
+extern "C" uint8_t external_psram_size;
+uint8_t external_psram_size = 16;
+
+// Edge timer (GPT2) - a count of the virtual clock, the compare and pend are clock events
+static HostEvent compareEvent;
+static HostEvent pendEvent;
+static void (*edgeIsr)() = nullptr;
+static bool compareEnabled = false;
+static bool compareFlag = false;
+static bool captureEnabled = false;
+static bool captureFlag = false;
+static uint32_t captureTick = 0;
+static bool driveLevels[4] = {false, false, false, false};
+
+static uint32_t ticksAt(uint64_t ns) {
+  return (uint32_t)(ns * (HAL_EDGE_TIMER_HZ / 1000000) / 1000);
+}
+
+static void compareMatch() {
+  compareFlag = true;
+  if (compareEnabled) edgeIsr();
+}
+
+void halPinBegin(HalPin &pin, int number) {
+  pin.number = number;
+  digitalWrite(number, LOW);
+}
+
+void halPinWrite(const HalPin &pin, bool high) {
+  digitalWrite(pin.number, high);
+}
+
+uint32_t halIrqSave() {
+  bool wasMasked = hostIrqMasked();
+  hostIrqDisable();
+  return wasMasked;
+}
+
+void halIrqRestore(uint32_t state) {
+  if (!state) hostIrqEnable();
+}
+
+void halEdgeTimerBegin(void (*isr)(), uint8_t priority) {
+  edgeIsr = isr;
+  compareEvent.handler = compareMatch;
+  compareEvent.priority = priority;
+  pendEvent.handler = isr;
+  pendEvent.priority = priority;
+}
+
+uint32_t halEdgeTimerNow() {
+  hostSpend(HOST_CLOCK_READ_NS);
+  return ticksAt(hostNowNs());
+}
+
+// A compare already passed only matches again when the count wraps, as on the hardware
+void halEdgeTimerCompare(uint32_t tick) {
+  uint64_t now = hostNowNs();
+  uint32_t ahead = tick - ticksAt(now);
+  uint64_t dueNs = now + ((uint64_t)ahead * 1000000000ull + HAL_EDGE_TIMER_HZ - 1) / HAL_EDGE_TIMER_HZ;
+  hostEventStart(compareEvent, dueNs);
+}
+
+void halEdgeTimerAck() {
+  compareFlag = false;
+}
+
+void halEdgeTimerEnable(bool enable) {
+  compareEnabled = enable;
+  if (enable && compareFlag) halEdgeTimerPend();
+}
+
+void halEdgeTimerPend() {
+  hostEventStart(pendEvent, hostNowNs());
+}
+
+void halEdgeTimerCaptureEnable(bool enable) {
+  captureEnabled = enable;
+  if (enable) captureFlag = false;
+}
+
+bool halEdgeTimerCaptured(uint32_t &tick) {
+  if (!captureFlag) return false;
+  captureFlag = false;
+  tick = captureTick;
+  return true;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+// Drive pins switch their injector, an edge on the loopback pin also latches a capture
+void digitalWrite(uint8_t pin, uint8_t value) {
+  int channel = plantDriveChannel(pin);
+  if (channel < 0 || driveLevels[channel] == (value != LOW)) return;
+  driveLevels[channel] = value != LOW;
+  plantSetDrive(channel, value != LOW);
+  if (pin == PLANT_LOOPBACK_PIN) {
+    captureTick = ticksAt(hostNowNs());
+    captureFlag = true;
+    if (captureEnabled) halEdgeTimerPend();
+  }
+}
+
+int analogRead(uint8_t pin) {
+  int input = plantSenseChannel(pin);
+  hostSpend(HOST_ANALOG_READ_NS);
+  return input == PLANT_UNWIRED ? 0 : plantReadCode(input);
+}
+
+void analogReadResolution(unsigned int bits) {
+  (void)bits;
+}
+
+void analogReadAveraging(unsigned int samples) {
+  (void)samples;
+}
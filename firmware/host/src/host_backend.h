@@ -0,0 +1,12 @@
+#ifndef HOST_BACKEND_H
+#define HOST_BACKEND_H
+
+// Set-up calls of the host backend, made by host_main.cpp before the firmware's setup()
+
+// Serial on a new pseudo terminal, or stdin/stdout. False if no pty could be made.
+bool hostSerialBegin(bool useStdio);
+
+// Directory standing in for the card
+void hostSdSetRoot(const char *directory);
+
+#endif
@@ -0,0 +1,156 @@
+#include <Arduino.h>
+#include <time.h>
+
+// Virtual clock, event dispatch and the core's timing calls (see host_sim.h)
+
+static uint64_t nowNs = 0;
+static HostEvent *events = nullptr;
+static bool masked = false;
+static bool inInterrupt = false;
+static bool realtime = false;
+static uint64_t wallStartNs = 0;
+
+static uint64_t wallNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void hostEventStart(HostEvent &event, uint64_t dueNs, uint64_t periodNs) {
+  if (!event.listed) {
+    event.next = events;
+    events = &event;
+    event.listed = true;
+  }
+  event.dueNs = dueNs;
+  event.periodNs = periodNs;
+  event.armed = true;
+}
+
+void hostEventStop(HostEvent &event) {
+  event.armed = false;
+}
+
+// Earliest armed event due by limit, the lower priority number on a tie
+static HostEvent *nextDue(uint64_t limit) {
+  HostEvent *best = nullptr;
+  for (HostEvent *event = events; event; event = event->next) {
+    if (!event->armed || event->dueNs > limit) continue;
+    if (!best || event->dueNs < best->dueNs ||
+        (event->dueNs == best->dueNs && event->priority < best->priority)) {
+      best = event;
+    }
+  }
+  return best;
+}
+
+static void runDue(uint64_t limit) {
+  if (masked || inInterrupt) return;
+  HostEvent *event;
+  while (!masked && (event = nextDue(limit)) != nullptr) {
+    if (event->dueNs > nowNs) nowNs = event->dueNs;
+    if (event->periodNs) {
+      // A periodic source latches one pending interrupt, periods it ran late past are lost
+      event->dueNs += event->periodNs;
+      if (event->dueNs <= nowNs) event->dueNs += ((nowNs - event->dueNs) / event->periodNs + 1) * event->periodNs;
+    } else {
+      event->armed = false;
+    }
+    inInterrupt = true;
+    event->handler();
+    inInterrupt = false;
+  }
+}
+
+static void pace() {
+  if (!realtime || inInterrupt) return;
+  uint64_t wall = wallNs() - wallStartNs;
+  if (nowNs > wall + 1000000) {
+    uint64_t ahead = nowNs - wall;
+    timespec ts = {(time_t)(ahead / 1000000000ull), (long)(ahead % 1000000000ull)};
+    nanosleep(&ts, nullptr);
+  }
+}
+
+uint64_t hostNowNs() {
+  return nowNs;
+}
+
+uint32_t hostCycleCount() {
+  hostSpend(HOST_CLOCK_READ_NS);
+  return (uint32_t)(nowNs * (HOST_CPU_HZ / 1000000) / 1000);
+}
+
+void hostSpend(uint64_t ns) {
+  hostSpendUntil(nowNs + ns);
+}
+
+void hostSpendUntil(uint64_t ns) {
+  runDue(ns);
+  if (ns > nowNs) nowNs = ns;
+  pace();
+}
+
+void hostIrqDisable() {
+  masked = true;
+}
+
+void hostIrqEnable() {
+  masked = false;
+  runDue(nowNs);
+}
+
+bool hostIrqMasked() {
+  return masked;
+}
+
+bool hostInInterrupt() {
+  return inInterrupt;
+}
+
+void hostSetRealtime(bool enable) {
+  realtime = enable;
+  wallStartNs = wallNs() - nowNs;
+}
+
+unsigned long micros() {
+  hostSpend(HOST_CLOCK_READ_NS);
+  return (unsigned long)(uint32_t)(nowNs / 1000);
+}
+
+unsigned long millis() {
+  hostSpend(HOST_CLOCK_READ_NS);
+  return (unsigned long)(uint32_t)(nowNs / 1000000);
+}
+
+void delay(unsigned long ms) {
+  hostSpend((uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostSpend((uint64_t)us * 1000);
+}
+
+void yield() {
+  hostSpend(HOST_YIELD_NS);
+}
+
+void __disable_irq() {
+  hostIrqDisable();
+}
+
+void __enable_irq() {
+  hostIrqEnable();
+}
+
+bool IntervalTimer::begin(void (*function)(), float microseconds) {
+  if (microseconds <= 0) return false;
+  uint64_t periodNs = (uint64_t)(microseconds * 1000.0f + 0.5f);
+  event.handler = function;
+  hostEventStart(event, hostNowNs() + periodNs, periodNs);
+  return true;
+}
+
+void IntervalTimer::end() {
+  hostEventStop(event);
+}
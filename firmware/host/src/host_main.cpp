@@ -0,0 +1,90 @@
+#include <Arduino.h>
+#include <signal.h>
+#include <time.h>
+#include "host_backend.h"
+#include "injector_plant.h"
+
+// Entry point of the native build: the firmware's setup() and loop() on the simulated bench.
+//
+//   firmware [--stdio] [--sd <dir>] [--seconds <s>] [--realtime] [--supply <V>] [--noise <mV>] [--seed <n>]
+//
+// Serial is a pty unless --stdio, the card is the directory given (default ./sd). Without
+// --realtime the clock runs as fast as the host allows. --seconds stops after that much virtual
+// time, the way a scripted run ends: printf 'fire ch=1 n=50\n' | firmware --stdio --seconds 5
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+  stopRequested = 1;
+}
+
+static double wallSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--stdio] [--sd <dir>] [--seconds <s>] [--realtime] [--supply <V>] [--noise <mV>] "
+          "[--seed <n>]\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  bool useStdio = false;
+  bool realtime = false;
+  double seconds = 0;
+  PlantConfig plant = PLANT_DEFAULTS;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--stdio") == 0) {
+      useStdio = true;
+    } else if (strcmp(arg, "--realtime") == 0) {
+      realtime = true;
+    } else if (strcmp(arg, "--sd") == 0 && value) {
+      hostSdSetRoot(value);
+      i++;
+    } else if (strcmp(arg, "--seconds") == 0 && value) {
+      seconds = atof(value);
+      i++;
+    } else if (strcmp(arg, "--supply") == 0 && value) {
+      plant.supplyVolts = atof(value);
+      i++;
+    } else if (strcmp(arg, "--noise") == 0 && value) {
+      plant.sensorNoiseVolts = atof(value) / 1000;
+      i++;
+    } else if (strcmp(arg, "--seed") == 0 && value) {
+      plant.seed = strtoul(value, nullptr, 0);
+      i++;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (!hostSerialBegin(useStdio)) {
+    perror("pty");
+    return 1;
+  }
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  signal(SIGPIPE, SIG_IGN);
+  plantBegin(plant);
+  hostSetRealtime(realtime);
+
+  double wallStart = wallSeconds();
+  uint64_t endNs = seconds > 0 ? (uint64_t)(seconds * 1e9) : UINT64_MAX;
+  setup();
+  while (!stopRequested && hostNowNs() < endNs) {
+    loop();
+    hostSpend(HOST_LOOP_NS);
+  }
+
+  double simulated = hostNowNs() * 1e-9;
+  double wall = wallSeconds() - wallStart;
+  fprintf(stderr, "Simulated %.3f s in %.3f s (%.1fx real time)\n", simulated, wall,
+          wall > 0 ? simulated / wall : 0.0);
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include <Arduino.h>
+
+// Print formatting of the core, numbers in any base and floats to a fixed number of digits
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  while (written < size && write(buffer[written])) written++;
+  return written;
+}
+
+size_t Print::printNumber(unsigned long long value, int base, bool isSigned) {
+  char text[66];
+  char *p = text + sizeof(text) - 1;
+  *p = 0;
+  bool negative = isSigned && (long long)value < 0;
+  if (negative) value = -(long long)value;
+  if (base < 2) base = DEC;
+  do {
+    int digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) *--p = '-';
+  return print(p);
+}
+
+size_t Print::print(double value, int digits) {
+  if (isnan(value)) return print("nan");
+  if (isinf(value)) return print(value > 0 ? "inf" : "-inf");
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return print(text);
+}
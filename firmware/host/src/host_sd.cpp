@@ -0,0 +1,163 @@
+#include <SD.h>
+#include "host_backend.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+
+struct HostFile {
+  FILE *stream = nullptr;
+  DIR *directory = nullptr;
+  std::string path;
+  std::string name;
+
+  ~HostFile() {
+    close();
+  }
+
+  void close() {
+    if (stream) fclose(stream);
+    if (directory) closedir(directory);
+    stream = nullptr;
+    directory = nullptr;
+  }
+};
+
+SDClass SD;
+static std::string root = "sd";
+static bool mounted = false;
+
+static std::string hostPath(const char *path) {
+  while (*path == '/') path++;
+  return root + "/" + path;
+}
+
+static void spendAccess(size_t bytes) {
+  hostSpend(HOST_SD_ACCESS_NS + (uint64_t)bytes * HOST_SD_BYTE_NS);
+}
+
+void hostSdSetRoot(const char *directory) {
+  root = directory;
+}
+
+bool SDClass::begin(uint8_t csPin) {
+  (void)csPin;
+  mkdir(root.c_str(), 0755);
+  struct stat info;
+  mounted = stat(root.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+  return mounted;
+}
+
+File SDClass::open(const char *path, uint8_t mode) {
+  if (!mounted) return File();
+  auto file = std::make_shared<HostFile>();
+  file->path = hostPath(path);
+  const char *base = strrchr(path, '/');
+  file->name = base ? base + 1 : path;
+
+  struct stat info;
+  bool found = stat(file->path.c_str(), &info) == 0;
+  if (found && S_ISDIR(info.st_mode)) {
+    file->directory = opendir(file->path.c_str());
+    if (!file->directory) return File();
+    return File(file);
+  }
+  if (mode == FILE_READ) {
+    file->stream = fopen(file->path.c_str(), "rb");
+  } else {
+    file->stream = fopen(file->path.c_str(), found ? "rb+" : "wb+");
+    if (file->stream && mode == FILE_WRITE) fseek(file->stream, 0, SEEK_END);
+  }
+  if (!file->stream) return File();
+  spendAccess(0);
+  return File(file);
+}
+
+bool SDClass::exists(const char *path) {
+  struct stat info;
+  return mounted && stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool SDClass::remove(const char *path) {
+  return mounted && ::remove(hostPath(path).c_str()) == 0;
+}
+
+File::operator bool() const {
+  return file && (file->stream || file->directory);
+}
+
+int File::read(void *buffer, size_t size) {
+  if (!file || !file->stream) return -1;
+  size_t got = fread(buffer, 1, size, file->stream);
+  spendAccess(got);
+  return got;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  if (!file || !file->stream) return -1;
+  int c = fgetc(file->stream);
+  if (c != EOF) ungetc(c, file->stream);
+  return c == EOF ? -1 : c;
+}
+
+int File::available() {
+  if (!file || !file->stream) return 0;
+  uint64_t remaining = size() - position();
+  return remaining > INT32_MAX ? INT32_MAX : (int)remaining;
+}
+
+// Reads and writes share the position, so the stream is repositioned between them as C requires
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!file || !file->stream) return 0;
+  fseek(file->stream, 0, SEEK_CUR);
+  size_t written = fwrite(buffer, 1, size, file->stream);
+  fseek(file->stream, 0, SEEK_CUR);
+  spendAccess(written);
+  return written;
+}
+
+void File::flush() {
+  if (file && file->stream) fflush(file->stream);
+}
+
+bool File::seek(uint64_t position) {
+  return file && file->stream && fseeko(file->stream, position, SEEK_SET) == 0;
+}
+
+uint64_t File::position() {
+  return file && file->stream ? ftello(file->stream) : 0;
+}
+
+uint64_t File::size() {
+  if (!file || !file->stream) return 0;
+  fflush(file->stream);
+  struct stat info;
+  return fstat(fileno(file->stream), &info) == 0 ? info.st_size : 0;
+}
+
+void File::close() {
+  if (file) file->close();
+  file.reset();
+}
+
+const char *File::name() {
+  return file ? file->name.c_str() : "";
+}
+
+bool File::isDirectory() {
+  return file && file->directory;
+}
+
+File File::openNextFile() {
+  if (!file || !file->directory) return File();
+  while (dirent *entry = readdir(file->directory)) {
+    if (entry->d_name[0] == '.') continue;
+    std::string path = file->path.substr(root.size()) + "/" + entry->d_name;
+    return SD.open(path.c_str());
+  }
+  return File();
+}
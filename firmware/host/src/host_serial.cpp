@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include "host_backend.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// USB serial on a pseudo terminal (the GUI or a terminal opens the slave it names) or on
+// stdin/stdout for scripted runs
+
+// Host Serial Configuration
+const int HOST_SERIAL_RX_BUFFER = 4096;
+const int HOST_SERIAL_TX_FREE = 4096;        // availableForWrite(), the host takes what it is sent
+const int HOST_SERIAL_WRITE_TIMEOUT_MS = 100; // Output is dropped after this if nothing reads it
+const uint64_t HOST_SERIAL_POLL_NS = 125000;  // Input is looked for once per USB microframe
+const uint32_t HOST_SERIAL_CALL_NS = 200;     // Cost of available()/read() to the caller
+
+usb_serial_class Serial;
+static int inFd = -1;
+static int outFd = -1;
+static uint8_t rxBuffer[HOST_SERIAL_RX_BUFFER];
+static int rxHead = 0;
+static int rxCount = 0;
+static uint64_t nextPollNs = 0;
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Open the port, printing the pty's name to stderr. False if no pty could be made.
+bool hostSerialBegin(bool useStdio) {
+  if (useStdio) {
+    inFd = STDIN_FILENO;
+    outFd = STDOUT_FILENO;
+    setNonBlocking(inFd);
+    return true;
+  }
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return false;
+  const char *slaveName = ptsname(master);
+
+  // Raw like a USB CDC port, and held open so output waits in the pty until a client connects
+  int slave = open(slaveName, O_RDWR | O_NOCTTY);
+  if (slave < 0) return false;
+  termios settings;
+  tcgetattr(slave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(slave, TCSANOW, &settings);
+
+  setNonBlocking(master);
+  inFd = outFd = master;
+  fprintf(stderr, "Serial on %s\n", slaveName);
+  return true;
+}
+
+static void fill() {
+  hostSpend(HOST_SERIAL_CALL_NS);
+  if (inFd < 0 || rxCount > 0 || hostNowNs() < nextPollNs) return;
+  nextPollNs = hostNowNs() + HOST_SERIAL_POLL_NS;
+  int tail = (rxHead + rxCount) % HOST_SERIAL_RX_BUFFER;
+  int space = min(HOST_SERIAL_RX_BUFFER - rxCount, HOST_SERIAL_RX_BUFFER - tail);
+  ssize_t got = ::read(inFd, rxBuffer + tail, space);
+  if (got > 0) rxCount += got;
+}
+
+int usb_serial_class::available() {
+  fill();
+  return rxCount;
+}
+
+int usb_serial_class::read() {
+  fill();
+  if (rxCount == 0) return -1;
+  uint8_t c = rxBuffer[rxHead];
+  rxHead = (rxHead + 1) % HOST_SERIAL_RX_BUFFER;
+  rxCount--;
+  return c;
+}
+
+int usb_serial_class::peek() {
+  fill();
+  return rxCount ? rxBuffer[rxHead] : -1;
+}
+
+size_t usb_serial_class::write(const uint8_t *buffer, size_t size) {
+  if (outFd < 0) return 0;
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = ::write(outFd, buffer + sent, size - sent);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+    pollfd ready = {outFd, POLLOUT, 0};
+    if (poll(&ready, 1, HOST_SERIAL_WRITE_TIMEOUT_MS) <= 0) break;
+  }
+  return sent;
+}
+
+int usb_serial_class::availableForWrite() {
+  return HOST_SERIAL_TX_FREE;
+}
+
+void usb_serial_class::flush() {
+}
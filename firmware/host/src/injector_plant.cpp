@@ -0,0 +1,144 @@
+#include "injector_plant.h"
+
+struct PlantChannel {
+  InjectorModel model;
+  bool driven;
+  double flux;       // Flux linkage (Wb turns)
+  double current;
+  double lift;       // 0 seated, 1 full lift
+  double velocity;   // Lift per second
+  double sensed;     // Current through the sensor bandwidth
+  uint64_t timeNs;   // Integrated up to here
+};
+
+static PlantConfig plant = PLANT_DEFAULTS;
+static PlantChannel channels[4];
+static double supplyVolts = 0;
+static uint64_t noiseState = 1;
+
+// xorshift64*, so a seed gives the same run every time
+static double uniformNoise() {
+  noiseState ^= noiseState >> 12;
+  noiseState ^= noiseState << 25;
+  noiseState ^= noiseState >> 27;
+  return ((noiseState * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussianNoise() {
+  double u = uniformNoise();
+  double v = uniformNoise();
+  if (u < 1e-12) u = 1e-12;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static bool atRest(const PlantChannel &c) {
+  return !c.driven && c.flux == 0 && c.lift == 0 && c.velocity == 0 && fabs(c.sensed) < 1e-6;
+}
+
+static void step(PlantChannel &c, double dt) {
+  const InjectorModel &m = c.model;
+  double inductance = m.seatedHenries + (m.liftedHenries - m.seatedHenries) * c.lift;
+
+  // The clamp only conducts while current flows, then the diode blocks
+  double volts = c.driven ? supplyVolts : (c.current > 0 ? -m.clampVolts : 0);
+  c.flux += (volts - m.ohms * c.current) * dt;
+  if (!c.driven && c.flux < 0) c.flux = 0;
+  c.current = c.flux / inductance;
+
+  double ratio = c.current / m.pullInAmps;
+  double force = ratio * ratio * (1 + (m.gapGain - 1) * c.lift) - (1 + m.springGain * c.lift);
+  bool heldSeated = c.lift <= 0 && force <= 0;
+  bool heldOpen = c.lift >= 1 && force >= 0;
+  if (heldSeated || heldOpen) {
+    c.velocity = 0;
+  } else {
+    c.velocity += (m.travelRate * force - m.damping * c.velocity) * dt;
+    c.lift += c.velocity * dt;
+    if (c.lift <= 0 || c.lift >= 1) {
+      c.lift = c.lift <= 0 ? 0 : 1;
+      c.velocity = 0;
+    }
+  }
+
+  double tau = 1.0 / (2 * M_PI * plant.sensorBandwidthHz);
+  c.sensed += (c.current - c.sensed) * dt / (tau + dt);
+  if (atRest(c)) c.sensed = 0;
+}
+
+// Bring every channel up to now, the supply sag is taken from the currents one step back
+static void advance() {
+  uint64_t now = hostNowNs();
+  for (int ch = 0; ch < 4; ch++) {
+    PlantChannel &c = channels[ch];
+    while (c.timeNs < now) {
+      if (atRest(c)) {
+        c.timeNs = now;
+        break;
+      }
+      uint64_t dtNs = min(now - c.timeNs, (uint64_t)PLANT_STEP_NS);
+      double load = 0;
+      for (int other = 0; other < 4; other++) {
+        if (channels[other].driven) load += channels[other].current;
+      }
+      supplyVolts = plant.supplyVolts - plant.supplyOhms * load;
+      step(c, dtNs * 1e-9);
+      c.timeNs += dtNs;
+    }
+  }
+}
+
+void plantBegin(const PlantConfig &config) {
+  plant = config;
+  noiseState = config.seed ? config.seed : 1;
+  supplyVolts = config.supplyVolts;
+  for (int ch = 0; ch < 4; ch++) {
+    PlantChannel &c = channels[ch];
+    memset(&c, 0, sizeof(c));
+    c.model = config.injector;
+    c.model.ohms *= 1 + PLANT_CHANNEL_SPREAD * (2 * uniformNoise() - 1);
+    c.model.pullInAmps *= 1 + PLANT_CHANNEL_SPREAD * (2 * uniformNoise() - 1);
+    c.timeNs = hostNowNs();
+  }
+}
+
+void plantSetDrive(int channel, bool on) {
+  advance();
+  channels[channel].driven = on;
+}
+
+int plantDriveChannel(int pin) {
+  for (int ch = 0; ch < 4; ch++) {
+    if (PLANT_DRIVE_PINS[ch] == pin) return ch;
+  }
+  return -1;
+}
+
+int plantSenseChannel(int pin) {
+  for (int ch = 0; ch < 4; ch++) {
+    if (PLANT_SENSE_PINS[ch] == pin) return ch;
+  }
+  return pin == PLANT_SUPPLY_PIN ? PLANT_SUPPLY : PLANT_UNWIRED;
+}
+
+uint16_t plantReadCode(int input) {
+  advance();
+  double volts;
+  if (input == PLANT_SUPPLY) {
+    volts = supplyVolts / plant.supplyDividerRatio;
+  } else {
+    volts = plant.sensorZeroVolts + plant.sensorVoltsPerAmp * channels[input].sensed +
+            plant.sensorNoiseVolts * gaussianNoise();
+  }
+  long code = lround(volts / plant.adcReferenceVolts * 4096);
+  return constrain(code, 0L, 4095L);
+}
+
+float plantCurrent(int channel) {
+  advance();
+  return channels[channel].current;
+}
+
+float plantLift(int channel) {
+  advance();
+  return channels[channel].lift;
+}
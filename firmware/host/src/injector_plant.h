@@ -0,0 +1,79 @@
+#ifndef INJECTOR_PLANT_H
+#define INJECTOR_PLANT_H
+
+#include <Arduino.h>
+
+// Simulated bench: four injectors on their drivers, each through an ACS712 into the ADC, and the
+// injector supply through its divider.
+//
+// The coil is an RL circuit whose inductance rises as the pintle lifts. The model integrates the
+// flux linkage (supply minus IR drop while driven, the flyback clamp after switch-off), so the
+// current is flux over inductance and dips while the pintle travels - the opening bump the
+// waveform features look for. The pintle is a normalized mass: magnetic force goes with current
+// squared and rises as the gap closes, against a spring preload, with end stops at seated and
+// full lift. The sensor adds its bandwidth and Gaussian noise, the ADC quantizes to 12 bits.
+//
+// The state is integrated lazily up to the virtual clock whenever a drive switches or a code is
+// read, in PLANT_STEP_NS steps, and channels at rest are skipped.
+
+// Bench Wiring (see README Hardware)
+const int PLANT_DRIVE_PINS[4] = {2, 3, 4, 5};
+const int PLANT_SENSE_PINS[4] = {21, 20, 19, 18};  // A7-A4
+const int PLANT_SUPPLY_PIN = 24;                    // A10
+const int PLANT_LOOPBACK_PIN = 2;                   // Jumpered to the edge timer capture (pin 15)
+
+// Plant Configuration
+const uint32_t PLANT_STEP_NS = 500;          // Integration step
+const float PLANT_CHANNEL_SPREAD = 0.02;     // Part-to-part spread of resistance and pull-in current
+
+struct InjectorModel {
+  float ohms;            // Coil and driver resistance
+  float seatedHenries;   // Inductance with the pintle seated
+  float liftedHenries;   // At full lift
+  float pullInAmps;      // Magnetic force equals the spring preload with the pintle seated
+  float gapGain;         // Magnetic force at full lift relative to seated, same current
+  float springGain;      // Extra spring force at full lift relative to the preload
+  float travelRate;      // Pintle acceleration per unit of net force (lift 0-1 per s^2)
+  float damping;         // Fuel damping of the pintle velocity (1/s)
+  float clampVolts;      // Flyback clamp across the coil after the driver switches off
+};
+
+struct PlantConfig {
+  InjectorModel injector;
+  float supplyVolts;
+  float supplyOhms;          // Source resistance, the supply sags under load
+  float sensorVoltsPerAmp;
+  float sensorZeroVolts;
+  float sensorNoiseVolts;    // RMS
+  float sensorBandwidthHz;
+  float adcReferenceVolts;
+  float supplyDividerRatio;
+  uint32_t seed;
+};
+
+// A low impedance peak and hold injector on a 12V bench supply, read by an ACS712-20A
+const PlantConfig PLANT_DEFAULTS = {
+    {2.5, 0.0030, 0.0036, 1.7, 4.0, 0.3, 1.8e8, 2000, 30.0},
+    12.2, 0.05, 0.066, 1.65, 0.002, 80000, 3.3, 11.0, 1};
+
+void plantBegin(const PlantConfig &config);
+
+// Driver input of a channel, takes effect at the current virtual time
+void plantSetDrive(int channel, bool on);
+
+// Channel driven by a pin, or -1
+int plantDriveChannel(int pin);
+
+// ADC input wired to a pin: a current channel, PLANT_SUPPLY or PLANT_UNWIRED
+const int PLANT_SUPPLY = -1;
+const int PLANT_UNWIRED = -2;
+int plantSenseChannel(int pin);
+
+// 12-bit ADC code of a current channel or PLANT_SUPPLY now, sensor noise included
+uint16_t plantReadCode(int input);
+
+// Model state now, for checks
+float plantCurrent(int channel);
+float plantLift(int channel);
+
+#endif
@@ -0,0 +1,165 @@
+#include "adaptive_log.h"
+#include "log_writer.h"
+
+// Two runs: the previous one is held back until the filling one shows whether it leads into an edge
+static LogSampleRecord runs[2][ADAPTIVE_MAX_DECIMATION];
+static int fillRun = 0;
+static int fillCount = 0;
+static bool fillFull = false;
+static bool heldValid = false;
+static bool heldFull = false;
+
+static int decimation = ADAPTIVE_DEFAULT_DECIMATION;
+static uint32_t holdUs = ADAPTIVE_DEFAULT_HOLD_US;
+static bool holdActive = false;
+static uint32_t holdUntilUs = 0;
+static uint8_t lastMask = 0;
+static uint32_t lastDriveEdgeUs = 0;
+
+// Means of the last two runs, for the slope check
+static int32_t runMeans[2][LOG_CHANNELS];
+static int meanCount = 0;
+
+static uint32_t samplesIn = 0;
+static uint32_t samplesKept = 0;
+static uint32_t recordsOut = 0;
+
+void adaptiveLogStart(int runLength, uint32_t fullRateHoldUs) {
+  decimation = constrain(runLength, 2, ADAPTIVE_MAX_DECIMATION);
+  holdUs = fullRateHoldUs;
+  fillRun = 0;
+  fillCount = 0;
+  fillFull = false;
+  heldValid = false;
+  holdActive = false;
+  lastMask = 0;
+  lastDriveEdgeUs = micros();
+  meanCount = 0;
+  samplesIn = 0;
+  samplesKept = 0;
+  recordsOut = 0;
+}
+
+static void writeSamples(const LogSampleRecord *run, int count) {
+  for (int i = 0; i < count; i++) {
+    logWriterAppendRecord(run[i]);
+  }
+  samplesKept += count;
+  recordsOut += count;
+}
+
+static void writeDecimated(const LogSampleRecord *run, int count) {
+  LogSampleRecord mean = run[0];
+  LogSampleRecord low = run[0];
+  LogSampleRecord high = run[0];
+  uint32_t sums[LOG_CHANNELS + 1] = {};
+  for (int i = 0; i < count; i++) {
+    const LogSampleRecord &record = run[i];
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      sums[ch] += record.adc[ch];
+      low.adc[ch] = min(low.adc[ch], record.adc[ch]);
+      high.adc[ch] = max(high.adc[ch], record.adc[ch]);
+    }
+    sums[LOG_CHANNELS] += record.aux;
+    low.aux = min(low.aux, record.aux);
+    high.aux = max(high.aux, record.aux);
+    mean.injectorMask |= record.injectorMask;
+  }
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    mean.adc[ch] = (sums[ch] + count / 2) / count;
+  }
+  mean.aux = (sums[LOG_CHANNELS] + count / 2) / count;
+  low.injectorMask = high.injectorMask = mean.injectorMask;
+  mean.flags = LOG_RECORD_MEAN;
+  low.flags = LOG_RECORD_MIN;
+  high.flags = LOG_RECORD_MAX;
+
+  logWriterAppendRecord(mean);
+  logWriterAppendRecord(low);
+  logWriterAppendRecord(high);
+  recordsOut += 3;
+}
+
+// True when the run means bend by more than the slope threshold on any channel
+static bool slopeChanged(const LogSampleRecord *run, int count) {
+  bool changed = false;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++) {
+      sum += run[i].adc[ch];
+    }
+    int32_t mean = sum / count;
+    if (meanCount >= 2) {
+      int32_t bend = mean - 2 * runMeans[1][ch] + runMeans[0][ch];
+      if (bend > ADAPTIVE_SLOPE_CODES || bend < -ADAPTIVE_SLOPE_CODES) changed = true;
+    }
+    runMeans[0][ch] = runMeans[1][ch];
+    runMeans[1][ch] = mean;
+  }
+  if (meanCount < 2) meanCount++;
+  return changed;
+}
+
+static void completeRun() {
+  if (slopeChanged(runs[fillRun], fillCount)) fillFull = true;
+
+  // The held run leads into a full-rate stretch, keep it whole too
+  if (heldValid) {
+    const LogSampleRecord *held = runs[fillRun ^ 1];
+    if (heldFull || fillFull) {
+      writeSamples(held, decimation);
+    } else {
+      writeDecimated(held, decimation);
+    }
+  }
+
+  heldValid = true;
+  heldFull = fillFull;
+  fillRun ^= 1;
+  fillCount = 0;
+  fillFull = false;
+}
+
+void adaptiveLogAppend(const RawSample &sample) {
+  LogSampleRecord &record = runs[fillRun][fillCount++];
+  logWriterMakeRecord(sample, record);
+  samplesIn++;
+
+  // Gate changes always count, drive edges only after a stable stretch
+  uint8_t changed = sample.injectorMask ^ lastMask;
+  lastMask = sample.injectorMask;
+  bool edge = (changed & LOG_MASK_SHOT) != 0;
+  if (changed & LOG_MASK_DRIVE) {
+    if (sample.timestamp - lastDriveEdgeUs >= ADAPTIVE_STABLE_US) edge = true;
+    lastDriveEdgeUs = sample.timestamp;
+  }
+  if (edge) {
+    holdActive = true;
+    holdUntilUs = sample.timestamp + holdUs;
+  }
+  if (holdActive) {
+    if ((int32_t)(sample.timestamp - holdUntilUs) < 0) fillFull = true;
+    else holdActive = false;
+  }
+
+  if (fillCount == decimation) completeRun();
+}
+
+void adaptiveLogStop() {
+  if (heldValid) writeSamples(runs[fillRun ^ 1], decimation);
+  writeSamples(runs[fillRun], fillCount);
+  heldValid = false;
+  fillCount = 0;
+}
+
+void adaptiveLogPrintSummary() {
+  Serial.print("[LOG]Adaptive: ");
+  Serial.print(samplesIn);
+  Serial.print(" samples in ");
+  Serial.print(recordsOut);
+  Serial.print(" records (");
+  Serial.print(recordsOut > 0 ? (float)samplesIn / recordsOut : 0, 1);
+  Serial.print(":1), ");
+  Serial.print(samplesIn > 0 ? 100.0f * samplesKept / samplesIn : 0, 1);
+  Serial.println("% at full rate");
+}
@@ -0,0 +1,38 @@
+#ifndef ADAPTIVE_LOG_H
+#define ADAPTIVE_LOG_H
+
+#include <Arduino.h>
+#include "sampler.h"
+#include "log_format.h"
+
+// Adaptive-rate logging: the sampler keeps running at its full rate, and the log keeps every
+// sample only around edges and slope changes. Everything else is cut into runs of `decimation`
+// samples, each written as a mean, min and max record (LOG_RECORD_* in flags).
+//
+// Full rate is kept for holdUs after a shot gate changes or after a drive edge that follows a
+// stable stretch of ADAPTIVE_STABLE_US. Peak & hold PWM edges come faster than that, so a steady
+// hold phase is decimated while the switch from peak to hold is not. A run is also kept whole
+// when the slope of the run means bends by more than ADAPTIVE_SLOPE_CODES on any channel. One
+// run is held back, so every full-rate stretch starts at least a run before its trigger.
+
+// Adaptive Logging Configuration
+const int ADAPTIVE_MAX_DECIMATION = 64;
+const int ADAPTIVE_DEFAULT_DECIMATION = 16;
+const uint32_t ADAPTIVE_DEFAULT_HOLD_US = 500;
+const uint32_t ADAPTIVE_MAX_HOLD_US = 100000;
+const uint32_t ADAPTIVE_STABLE_US = 200;   // Drive unchanged this long before an edge counts
+const int32_t ADAPTIVE_SLOPE_CODES = 24;   // Second difference of run means that forces full rate
+
+// decimation is the run length, 2 to ADAPTIVE_MAX_DECIMATION samples
+void adaptiveLogStart(int decimation, uint32_t holdUs);
+
+// Acquisition side - called with every consumed sample, writes records to the log writer
+void adaptiveLogAppend(const RawSample &sample);
+
+// Write the held back and partial runs as samples
+void adaptiveLogStop();
+
+// Print what the adaptive log saved as a [LOG] line
+void adaptiveLogPrintSummary();
+
+#endif
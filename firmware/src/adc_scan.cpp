@@ -0,0 +1,257 @@
+#include "adc_scan.h"
+#include <DMAChannel.h>
+
+// ADC input for Teensy 4.1 pins 14-23 (A0-A9), identical on ADC1 and ADC2
+static const uint8_t ANALOG_PIN_CHANNEL[10] = {7, 8, 12, 11, 6, 5, 15, 0, 13, 14};
+const int FIRST_ANALOG_PIN = 14;
+const int DUAL_ADC_PIN_COUNT = 10;
+
+// Pins 24-25 (A10-A11) are only on ADC1
+static const uint8_t ADC1_ONLY_PIN_CHANNEL[2] = {1, 2};
+const int FIRST_ADC1_ONLY_PIN = 24;
+
+// Each sample is two words: TRIG0 result (ADC1: ch1, ch3) and TRIG4 result (ADC2: ch2, ch4)
+const int SCAN_WORDS_PER_SAMPLE = 2;
+const int SCAN_BUFFER_WORDS = 2 * ADC_SCAN_BLOCK_SAMPLES * SCAN_WORDS_PER_SAMPLE;
+
+static DMAChannel scanDma;
+static DMAChannel supplyDma;
+DMAMEM static uint32_t scanBuffer[SCAN_BUFFER_WORDS] __attribute__((aligned(32)));
+DMAMEM static uint16_t supplyBuffer[2 * ADC_SCAN_BLOCK_SAMPLES] __attribute__((aligned(32)));
+static uint16_t decoded[ADC_SCAN_BLOCK_SAMPLES][ADC_SCAN_CODES];
+
+static uint8_t scanChannels[4];
+static uint8_t supplyChannel = 0;
+static ScanBlockHandler blockHandler = nullptr;
+static ScanSampleHandler sampleHandler = nullptr;
+static uint32_t savedCfg[2] = {0, 0};
+static uint32_t savedGc[2] = {0, 0};
+static bool scanning = false;
+static uint32_t periodCycles = 0;
+static int blockSamples = ADC_SCAN_BLOCK_SAMPLES;
+static uint32_t triggerHalfPeriod = 0;        // Bus clocks between trigger timer toggles
+static int expectedHalf = 0;
+static volatile uint32_t missedBlocks = 0;
+
+static void xbarConnect(unsigned int input, unsigned int output) {
+  volatile uint16_t *xbar = &XBARA1_SEL0 + (output / 2);
+  uint16_t val = *xbar;
+  if (!(output & 1)) {
+    val = (val & 0xFF00) | input;
+  } else {
+    val = (val & 0x00FF) | (input << 8);
+  }
+  *xbar = val;
+}
+
+static void scanDmaISR() {
+  scanDma.clearInterrupt();
+
+  // DMA is writing the other half, so this half is complete
+  uintptr_t writePos = (uintptr_t)scanDma.TCD->DADDR - (uintptr_t)scanBuffer;
+  int half = (writePos >= (uintptr_t)blockSamples * SCAN_WORDS_PER_SAMPLE * 4) ? 0 : 1;
+  if (half != expectedHalf) missedBlocks++;
+  expectedHalf = half ^ 1;
+
+  const uint32_t *words = scanBuffer + half * blockSamples * SCAN_WORDS_PER_SAMPLE;
+  const uint16_t *supply = supplyBuffer + half * blockSamples;
+  arm_dcache_delete((void *)words, blockSamples * SCAN_WORDS_PER_SAMPLE * 4);
+  arm_dcache_delete((void *)supply, blockSamples * 2);
+
+  for (int i = 0; i < blockSamples; i++) {
+    uint32_t adc1 = words[i * 2];
+    uint32_t adc2 = words[i * 2 + 1];
+    decoded[i][0] = adc1 & 0xFFF;
+    decoded[i][1] = adc2 & 0xFFF;
+    decoded[i][2] = (adc1 >> 16) & 0xFFF;
+    decoded[i][3] = (adc2 >> 16) & 0xFFF;
+    decoded[i][4] = supply[i] & 0xFFF;
+  }
+  blockHandler(decoded, blockSamples);
+  asm("DSB");
+}
+
+// Both chains raise DONE0 on their last conversion. The line stays asserted until both flags are
+// cleared, so an entry with only one set just returns and comes straight back for the other.
+FASTRUN static void scanSampleISR() {
+  const uint32_t bothDone = (1 << 0) | (1 << 4);  // TRIG0_DONE0 | TRIG4_DONE0
+  if ((ADC_ETC_DONE0_1_IRQ & bothDone) != bothDone) return;
+  ADC_ETC_DONE0_1_IRQ = bothDone;
+
+  uint32_t adc1 = ADC_ETC_TRIG0_RESULT_1_0;
+  uint32_t adc2 = ADC_ETC_TRIG4_RESULT_1_0;
+  uint16_t codes[4] = {(uint16_t)(adc1 & 0xFFF), (uint16_t)(adc2 & 0xFFF), (uint16_t)((adc1 >> 16) & 0xFFF),
+                       (uint16_t)((adc2 >> 16) & 0xFFF)};
+  sampleHandler(codes);
+  asm("DSB");
+}
+
+bool adcScanBegin(const int pins[4], int supplyPin) {
+  for (int ch = 0; ch < 4; ch++) {
+    int index = pins[ch] - FIRST_ANALOG_PIN;
+    if (index < 0 || index >= DUAL_ADC_PIN_COUNT) return false;
+    scanChannels[ch] = ANALOG_PIN_CHANNEL[index];
+  }
+  if (supplyPin >= FIRST_ANALOG_PIN && supplyPin < FIRST_ANALOG_PIN + DUAL_ADC_PIN_COUNT) {
+    supplyChannel = ANALOG_PIN_CHANNEL[supplyPin - FIRST_ANALOG_PIN];
+  } else if (supplyPin == FIRST_ADC1_ONLY_PIN || supplyPin == FIRST_ADC1_ONLY_PIN + 1) {
+    supplyChannel = ADC1_ONLY_PIN_CHANNEL[supplyPin - FIRST_ADC1_ONLY_PIN];
+  } else {
+    return false;
+  }
+
+  scanDma.begin(true);
+  supplyDma.begin(true);
+  scanDma.attachInterrupt(scanDmaISR);
+  NVIC_SET_PRIORITY(IRQ_DMA_CH0 + scanDma.channel, 32);
+  attachInterruptVector(IRQ_ADC_ETC0, scanSampleISR);
+  NVIC_SET_PRIORITY(IRQ_ADC_ETC0, ADC_SCAN_SAMPLE_IRQ_PRIORITY);
+  return true;
+}
+
+void adcScanSetSampleHandler(ScanSampleHandler handler) {
+  sampleHandler = handler;
+}
+
+// Configure one ADC for ETC hardware triggers on HC0/HC1 at 12 bits, no averaging
+static void configureScanAdc(volatile uint32_t &cfg, volatile uint32_t &gc, volatile uint32_t &hc0,
+                             volatile uint32_t &hc1) {
+  cfg = ADC_CFG_ADICLK(1) | ADC_CFG_ADIV(2) | ADC_CFG_MODE(2) | ADC_CFG_ADSTS(1) | ADC_CFG_ADHSC | ADC_CFG_ADTRG;
+  gc = 0;
+  hc0 = ADC_HC_ADCH(16);  // Channel supplied by ADC_ETC
+  hc1 = ADC_HC_ADCH(16);
+}
+
+uint32_t adcScanStart(uint32_t rateHz, ScanBlockHandler handler) {
+  if (scanning) adcScanStop();
+  rateHz = min(rateHz, ADC_SCAN_MAX_RATE);
+  blockHandler = handler;
+  missedBlocks = 0;
+  expectedHalf = 0;
+
+  // ~1ms per half buffer, in multiples of 4 samples so halves stay cache-line aligned
+  blockSamples = constrain((int)(rateHz / ADC_SCAN_BLOCK_HZ) & ~3, 4, ADC_SCAN_BLOCK_SAMPLES);
+
+  CCM_CCGR2 |= CCM_CCGR2_XBAR1(CCM_CCGR_ON);
+  CCM_CCGR6 |= CCM_CCGR6_QTIMER4(CCM_CCGR_ON);
+
+  savedCfg[0] = ADC1_CFG;
+  savedCfg[1] = ADC2_CFG;
+  savedGc[0] = ADC1_GC;
+  savedGc[1] = ADC2_GC;
+  configureScanAdc(ADC1_CFG, ADC1_GC, ADC1_HC0, ADC1_HC1);
+  configureScanAdc(ADC2_CFG, ADC2_GC, ADC2_HC0, ADC2_HC1);
+  ADC1_HC2 = ADC_HC_ADCH(16);  // Supply, third in ADC1's chain
+
+  // Trigger 0 drives ADC1 and, in SYNC mode, trigger 4 on ADC2 from the same edge
+  ADC_ETC_CTRL = ADC_ETC_CTRL_SOFTRST;
+  ADC_ETC_CTRL = 0;
+  ADC_ETC_CTRL = ADC_ETC_CTRL_TSC_BYPASS | ADC_ETC_CTRL_DMA_MODE_SEL | ADC_ETC_CTRL_TRIG_ENABLE(0x01);
+  ADC_ETC_TRIG0_CTRL = ADC_ETC_TRIG_CTRL_TRIG_CHAIN(2) | ADC_ETC_TRIG_CTRL_SYNC_MODE;
+  ADC_ETC_TRIG0_COUNTER = 0;
+  uint32_t doneIrq = sampleHandler ? ADC_ETC_TRIG_CHAIN_IE1(1) : 0;
+  ADC_ETC_TRIG0_CHAIN_1_0 = ADC_ETC_TRIG_CHAIN_CSEL0(scanChannels[0]) | ADC_ETC_TRIG_CHAIN_HWTS0(1) |
+                            ADC_ETC_TRIG_CHAIN_B2B0 | ADC_ETC_TRIG_CHAIN_CSEL1(scanChannels[2]) |
+                            ADC_ETC_TRIG_CHAIN_HWTS1(2) | ADC_ETC_TRIG_CHAIN_B2B1 | doneIrq;
+  ADC_ETC_TRIG0_CHAIN_3_2 = ADC_ETC_TRIG_CHAIN_CSEL0(supplyChannel) | ADC_ETC_TRIG_CHAIN_HWTS0(4);
+  ADC_ETC_TRIG4_CTRL = ADC_ETC_TRIG_CTRL_TRIG_CHAIN(1);
+  ADC_ETC_TRIG4_COUNTER = 0;
+  ADC_ETC_TRIG4_CHAIN_1_0 = ADC_ETC_TRIG_CHAIN_CSEL0(scanChannels[1]) | ADC_ETC_TRIG_CHAIN_HWTS0(1) |
+                            ADC_ETC_TRIG_CHAIN_B2B0 | ADC_ETC_TRIG_CHAIN_CSEL1(scanChannels[3]) |
+                            ADC_ETC_TRIG_CHAIN_HWTS1(2) | doneIrq;
+  ADC_ETC_DONE0_1_IRQ = 0xFFFFFFFF;
+  if (sampleHandler) NVIC_ENABLE_IRQ(IRQ_ADC_ETC0);
+  ADC_ETC_DMA_CTRL = 1 << 0;  // DMA request when trigger 0's chain completes
+
+  // Each request copies TRIG0 then TRIG4 result words, the minor loop offset rewinds the source
+  int32_t stride = (uintptr_t)&ADC_ETC_TRIG4_RESULT_1_0 - (uintptr_t)&ADC_ETC_TRIG0_RESULT_1_0;
+  scanDma.TCD->SADDR = &ADC_ETC_TRIG0_RESULT_1_0;
+  scanDma.TCD->SOFF = stride;
+  scanDma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);
+  scanDma.TCD->NBYTES_MLOFFYES = DMA_TCD_NBYTES_SMLOE |
+                                 DMA_TCD_NBYTES_MLOFFYES_MLOFF(-SCAN_WORDS_PER_SAMPLE * stride) |
+                                 DMA_TCD_NBYTES_MLOFFYES_NBYTES(SCAN_WORDS_PER_SAMPLE * 4);
+  scanDma.TCD->SLAST = 0;
+  scanDma.TCD->DADDR = scanBuffer;
+  scanDma.TCD->DOFF = 4;
+  scanDma.TCD->CITER_ELINKNO = 2 * blockSamples;
+  scanDma.TCD->BITER_ELINKNO = 2 * blockSamples;
+  scanDma.TCD->DLASTSGA = -(int32_t)(2 * blockSamples * SCAN_WORDS_PER_SAMPLE * 4);
+  scanDma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR;
+  scanDma.triggerAtHardwareEvent(DMAMUX_SOURCE_ADC_ETC);
+
+  // Every scan minor loop starts one supply copy, the chain has finished so segment 2 is current
+  supplyDma.TCD->SADDR = &ADC_ETC_TRIG0_RESULT_3_2;
+  supplyDma.TCD->SOFF = 0;
+  supplyDma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(1) | DMA_TCD_ATTR_DSIZE(1);
+  supplyDma.TCD->NBYTES = 2;
+  supplyDma.TCD->SLAST = 0;
+  supplyDma.TCD->DADDR = supplyBuffer;
+  supplyDma.TCD->DOFF = 2;
+  supplyDma.TCD->CITER_ELINKNO = 2 * blockSamples;
+  supplyDma.TCD->BITER_ELINKNO = 2 * blockSamples;
+  supplyDma.TCD->DLASTSGA = -(int32_t)(2 * blockSamples * 2);
+  supplyDma.TCD->CSR = 0;
+  supplyDma.triggerAtTransfersOf(scanDma);
+  scanDma.enable();
+
+  // QuadTimer toggles its output on every compare, so one rising edge per period
+  uint32_t halfPeriod = F_BUS_ACTUAL / (2 * rateHz);
+  triggerHalfPeriod = halfPeriod;
+  TMR4_CTRL0 = 0;
+  TMR4_SCTRL0 = TMR_SCTRL_OEN | TMR_SCTRL_FORCE;
+  TMR4_CSCTRL0 = TMR_CSCTRL_CL1(1);
+  TMR4_LOAD0 = 0;
+  TMR4_CNTR0 = 0;
+  TMR4_COMP10 = halfPeriod - 1;
+  TMR4_CMPLD10 = halfPeriod - 1;
+  xbarConnect(XBARA1_IN_QIN4_TIMER0, XBARA1_OUT_ADC_ETC_TRIG00);
+
+  scanning = true;
+  uint32_t cyclesPerHalfPeriod = (F_CPU_ACTUAL / F_BUS_ACTUAL) * halfPeriod;
+  periodCycles = 2 * cyclesPerHalfPeriod;
+  uint32_t startCycles = ARM_DWT_CYCCNT;
+  TMR4_CTRL0 = TMR_CTRL_CM(1) | TMR_CTRL_PCS(8) | TMR_CTRL_LENGTH | TMR_CTRL_OUTMODE(3);
+  return startCycles + cyclesPerHalfPeriod;
+}
+
+void adcScanStop() {
+  if (!scanning) return;
+
+  TMR4_CTRL0 = 0;
+  NVIC_DISABLE_IRQ(IRQ_ADC_ETC0);
+  scanDma.disable();
+  supplyDma.disable();
+  ADC_ETC_CTRL = ADC_ETC_CTRL_SOFTRST;
+  ADC_ETC_CTRL = 0;
+
+  // Hand the ADCs back to analogRead()
+  ADC1_CFG = savedCfg[0];
+  ADC2_CFG = savedCfg[1];
+  ADC1_GC = savedGc[0];
+  ADC2_GC = savedGc[1];
+  scanning = false;
+}
+
+int adcScanBlockSamples() {
+  return blockSamples;
+}
+
+uint32_t adcScanPeriodCycles() {
+  return periodCycles;
+}
+
+// The trigger is the rising edge of the toggling timer output, so the output level says which half we're in
+uint32_t adcScanTriggerAgeCycles() {
+  uint16_t high, count;
+  do {
+    high = TMR4_SCTRL0 & TMR_SCTRL_OFLAG;
+    count = TMR4_CNTR0;
+  } while (high != (TMR4_SCTRL0 & TMR_SCTRL_OFLAG));
+  uint32_t ticks = high ? count : triggerHalfPeriod + count;
+  return ticks * (F_CPU_ACTUAL / F_BUS_ACTUAL);
+}
+
+uint32_t adcScanMissedBlocks() {
+  return missedBlocks;
+}
@@ -0,0 +1,57 @@
+#ifndef ADC_SCAN_H
+#define ADC_SCAN_H
+
+#include <Arduino.h>
+
+// Hardware-paced scanning of the four current channels on both ADC modules.
+//
+// QuadTimer TMR4 channel 0 paces ADC_ETC trigger 0 through XBAR. The trigger runs
+// in SYNC mode, so ADC1 and ADC2 start together: channels 1+2 convert
+// simultaneously, then channels 3+4 back to back. DMA copies both result
+// registers into a ping-pong buffer and the half-complete ISR hands over
+// decoded codes, so the CPU never touches a conversion.
+//
+// The supply voltage divider is a third conversion on ADC1's chain. A second DMA
+// channel, linked to every minor loop of the first, copies its result into a
+// parallel buffer, so it is decoded alongside the currents of the same sample.
+//
+// Closed-loop control can't wait for a block, so an optional per-sample handler
+// runs from the ADC_ETC done interrupt as soon as each conversion pair lands.
+
+// ADC Scan Configuration
+const int ADC_SCAN_BLOCK_SAMPLES = 128;       // Largest DMA half buffer (samples)
+const uint32_t ADC_SCAN_BLOCK_HZ = 1000;      // Half buffers per second, keeps hand-over latency ~1ms
+const uint32_t ADC_SCAN_MAX_RATE = 150000;    // Highest supported scan rate, three conversions on ADC1 (Hz)
+const int ADC_SCAN_CODES = 5;                 // Codes per sample: four currents, then the supply
+const int ADC_SCAN_BITS = 12;                 // Resolution used while scanning
+const uint8_t ADC_SCAN_SAMPLE_IRQ_PRIORITY = 16; // Per-sample handler, above the DMA and sampler ISRs
+
+// Called from the DMA ISR with decoded codes in CURRENT_PINS order followed by the supply
+typedef void (*ScanBlockHandler)(const uint16_t (*codes)[ADC_SCAN_CODES], int samples);
+
+// Called from the ADC_ETC ISR after every conversion of all four channels
+typedef void (*ScanSampleHandler)(const uint16_t codes[4]);
+
+// Validate pins (currents must be A0-A9, available on both ADCs, the supply on ADC1) and remember them
+bool adcScanBegin(const int pins[4], int supplyPin);
+
+// Install the per-sample handler, takes effect from the next adcScanStart()
+void adcScanSetSampleHandler(ScanSampleHandler handler);
+
+// Start pacing at rateHz; returns the DWT cycle count of the first trigger
+uint32_t adcScanStart(uint32_t rateHz, ScanBlockHandler handler);
+void adcScanStop();
+
+// Samples per half buffer at the current rate
+int adcScanBlockSamples();
+
+// Actual sample period in CPU cycles (rate is rounded to whole bus clocks)
+uint32_t adcScanPeriodCycles();
+
+// CPU cycles since the latest conversion trigger, for measuring sample-to-output latency
+uint32_t adcScanTriggerAgeCycles();
+
+// Half buffers the ISR was too late to read before DMA overwrote them
+uint32_t adcScanMissedBlocks();
+
+#endif
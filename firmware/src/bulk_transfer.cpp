@@ -0,0 +1,155 @@
+#include "bulk_transfer.h"
+
+const int BULK_NAME_SIZE = 64;
+const uint32_t BULK_FRAME_MAX = sizeof(BulkFrameHeader) + BULK_CHUNK_BYTES + 4;
+
+// COBS adds a byte per 254, plus the two delimiters
+static uint8_t frame[BULK_FRAME_MAX];
+static uint8_t encoded[BULK_FRAME_MAX + BULK_FRAME_MAX / 254 + 3];
+
+static File transferFile;
+static bool active = false;
+static uint8_t transferNumber = 0;
+static uint32_t transferOffset = 0;
+static uint32_t transferSize = 0;
+
+static uint32_t crcTable[256];
+static bool crcTableReady = false;
+
+uint32_t bulkCrc32(uint32_t crc, const uint8_t *data, size_t length) {
+  if (!crcTableReady) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      crcTable[i] = c;
+    }
+    crcTableReady = true;
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Consistent overhead byte stuffing, returns the encoded length (no delimiters)
+static size_t cobsEncode(const uint8_t *data, size_t length, uint8_t *out) {
+  size_t codeIndex = 0;
+  size_t write = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != 0) {
+      out[write++] = data[i];
+      code++;
+    }
+    if (data[i] == 0 || code == 0xFF) {
+      out[codeIndex] = code;
+      codeIndex = write++;
+      code = 1;
+    }
+  }
+  out[codeIndex] = code;
+  return write;
+}
+
+void bulkSendFrame(uint8_t type, uint8_t transfer, uint32_t offset, const uint8_t *data, uint16_t dataLength) {
+  // File data is read straight into frame[], anything else is copied in after the header
+  if (dataLength > BULK_CHUNK_BYTES) return;
+  if (data != frame + sizeof(BulkFrameHeader)) memcpy(frame + sizeof(BulkFrameHeader), data, dataLength);
+  BulkFrameHeader header;
+  header.type = type;
+  header.transfer = transfer;
+  header.length = dataLength;
+  header.offset = offset;
+  memcpy(frame, &header, sizeof(header));
+  size_t length = sizeof(header) + dataLength;
+  uint32_t crc = bulkCrc32(0, frame, length);
+  memcpy(frame + length, &crc, sizeof(crc));
+  length += sizeof(crc);
+
+  encoded[0] = 0;
+  size_t size = 1 + cobsEncode(frame, length, encoded + 1);
+  encoded[size++] = 0;
+  Serial.write(encoded, size);
+}
+
+uint32_t bulkFrameWireBytes(uint16_t dataLength) {
+  uint32_t length = sizeof(BulkFrameHeader) + dataLength + 4;
+  return length + length / 254 + 3;
+}
+
+// Frame the header and dataLength bytes already in frame[] after it, then send
+static void sendFrame(uint8_t type, uint32_t offset, uint16_t dataLength) {
+  bulkSendFrame(type, transferNumber, offset, frame + sizeof(BulkFrameHeader), dataLength);
+}
+
+static void sendError(const char *reason) {
+  size_t length = strlen(reason);
+  memcpy(frame + sizeof(BulkFrameHeader), reason, length);
+  sendFrame(BULK_FRAME_ERROR, transferOffset, length);
+}
+
+const char *bulkTransferStart(const char *filename, uint32_t offset) {
+  if (strlen(filename) >= BULK_NAME_SIZE) return "file name too long";
+  bulkTransferAbort();
+  transferNumber++;
+
+  transferFile = SD.open(filename);
+  if (!transferFile) return "file not found";
+  uint64_t size = transferFile.size();
+  if (size > 0xFFFFFFFFULL) {
+    transferFile.close();
+    return "file too large";
+  }
+  transferSize = size;
+  if (offset > transferSize) {
+    transferFile.close();
+    return "offset past end of file";
+  }
+  transferOffset = offset;
+  transferFile.seek(offset);
+  active = true;
+
+  uint8_t *data = frame + sizeof(BulkFrameHeader);
+  size_t nameLength = strlen(filename);
+  memcpy(data, &transferSize, sizeof(transferSize));
+  memcpy(data + sizeof(transferSize), filename, nameLength);
+  sendFrame(BULK_FRAME_OPEN, offset, sizeof(transferSize) + nameLength);
+  return nullptr;
+}
+
+bool bulkTransferService() {
+  if (!active) return false;
+
+  for (int n = 0; n < BULK_FRAMES_PER_SERVICE; n++) {
+    uint32_t remaining = transferSize - transferOffset;
+    if (remaining == 0) {
+      sendFrame(BULK_FRAME_END, transferOffset, 0);
+      bulkTransferAbort();
+      return false;
+    }
+
+    uint32_t length = min(remaining, BULK_CHUNK_BYTES);
+    int got = transferFile.read(frame + sizeof(BulkFrameHeader), length);
+    if (got != (int)length) {
+      sendError("SD read failed");
+      bulkTransferAbort();
+      return false;
+    }
+    sendFrame(BULK_FRAME_DATA, transferOffset, length);
+    transferOffset += length;
+  }
+  return true;
+}
+
+void bulkTransferAbort() {
+  if (!active) return;
+  transferFile.close();
+  active = false;
+}
+
+bool bulkTransferActive() {
+  return active;
+}
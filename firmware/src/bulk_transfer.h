@@ -0,0 +1,58 @@
+#ifndef BULK_TRANSFER_H
+#define BULK_TRANSFER_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+// Binary transfer of log files over the native USB serial port.
+//
+// A file goes out as frames of up to BULK_CHUNK_BYTES. Each frame is COBS encoded and sent
+// between two 0x00 bytes. COBS output never contains 0x00 and text lines never do either,
+// so the host can pick frames out of the stream while [ACK]/[LOG] lines keep arriving in
+// between. A frame's payload is a BulkFrameHeader, its data and a CRC-32 of both.
+//
+// The host checks every frame's CRC and offset. On a bad or missing frame it aborts and
+// restarts from the last good offset with `get file=<name> offset=<n>`, and the transfer
+// number in every frame lets it ignore whatever the old transfer still had in flight.
+// Frames are sent from loop() a few at a time, so commands are still read during a transfer.
+
+// Bulk Transfer Configuration
+const uint32_t BULK_CHUNK_BYTES = 4096;      // File bytes per data frame
+const int BULK_FRAMES_PER_SERVICE = 8;       // Frames sent per call before returning to loop()
+
+enum BulkFrameType {
+  BULK_FRAME_OPEN = 1,       // Data: uint32_t file size, then the file name
+  BULK_FRAME_DATA = 2,       // Data: file bytes from offset
+  BULK_FRAME_END = 3,        // Offset is the file size, no data
+  BULK_FRAME_ERROR = 4,      // Data: reason as text
+  BULK_FRAME_TELEMETRY = 5,  // Live samples, see telemetry.h - offset is the first point's sequence
+};
+
+struct __attribute__((packed)) BulkFrameHeader {
+  uint8_t type;          // BulkFrameType
+  uint8_t transfer;      // Increments with every get
+  uint16_t length;       // Data bytes after the header
+  uint32_t offset;       // File offset of the data
+};
+
+// Start sending filename from offset, replacing any transfer in progress. Returns nullptr or the
+// reason it was refused; errors found once the transfer has started are sent as an ERROR frame.
+const char *bulkTransferStart(const char *filename, uint32_t offset);
+
+// Send the next frames of the active transfer, returns false when idle
+bool bulkTransferService();
+
+void bulkTransferAbort();
+bool bulkTransferActive();
+
+// Frame and send up to BULK_CHUNK_BYTES of data. Other binary streams share the framing, their
+// frames carry their own type and the host routes on that.
+void bulkSendFrame(uint8_t type, uint8_t transfer, uint32_t offset, const uint8_t *data, uint16_t dataLength);
+
+// Bytes a frame with dataLength bytes of data takes on the wire, worst case
+uint32_t bulkFrameWireBytes(uint16_t dataLength);
+
+// CRC-32 (IEEE 802.3), continue from a previous value or start from 0
+uint32_t bulkCrc32(uint32_t crc, const uint8_t *data, size_t length);
+
+#endif
@@ -0,0 +1,179 @@
+#include "capture_buffer.h"
+#include "log_writer.h"
+#include "ring_buffer.h"
+
+// Teensy core, megabytes of PSRAM found at startup (0 if none is fitted)
+extern "C" uint8_t external_psram_size;
+
+struct CaptureWindow {
+  uint32_t start;   // Ring index of the first record
+  uint32_t end;     // One past the last record
+  LogWindowInfo info;
+};
+
+// Records are kept in log format so a window is copied to the writer unchanged
+EXTMEM static LogSampleRecord ring[CAPTURE_RING_RECORDS];
+
+static SpscRing<CaptureWindow, CAPTURE_WINDOW_QUEUE> closedWindows;
+
+// Ring indices count every record since capture started, wrapping with uint32_t
+static uint32_t writeIndex = 0;
+static uint32_t lastWindowEnd = 0;
+static uint32_t preRecords = 0;
+static uint32_t postRecords = 0;
+static uint32_t postTriggerUs = 0;
+static bool capturing = false;
+
+static bool windowOpen = false;
+static CaptureWindow openWindow;
+static uint32_t closeIndex = 0;  // Open window ends here once every gate is low
+static uint8_t lastGates = 0;
+static uint32_t shotSequence = 0;
+
+static bool drainActive = false;
+static CaptureWindow drainWindow;
+static uint32_t drainIndex = 0;
+static bool headerWritten = false;
+
+static uint32_t windowsWritten = 0;
+static uint32_t droppedWindows = 0;
+static uint32_t droppedRecords = 0;
+
+bool captureStart(uint32_t rateHz, uint32_t preUs, uint32_t postUs) {
+  if ((uint32_t)external_psram_size * 1048576UL < sizeof(ring)) return false;
+
+  preRecords = (uint64_t)preUs * rateHz / 1000000;
+  postRecords = (uint64_t)postUs * rateHz / 1000000;
+  postTriggerUs = postUs;
+  writeIndex = 0;
+  lastWindowEnd = 0;
+  windowOpen = false;
+  lastGates = 0;
+  shotSequence = 0;
+  drainActive = false;
+  closedWindows.clear();
+  windowsWritten = 0;
+  droppedWindows = 0;
+  droppedRecords = 0;
+  capturing = true;
+  return true;
+}
+
+static void startWindow(uint32_t index, uint32_t timestamp, uint8_t started) {
+  // Reach back preRecords, but not into the previous window
+  uint32_t pre = index - lastWindowEnd;
+  if (pre > preRecords) pre = preRecords;
+
+  openWindow = CaptureWindow();
+  openWindow.start = index - pre;
+  openWindow.info.triggerTimestamp = timestamp;
+  openWindow.info.preTriggerRecords = pre;
+  openWindow.info.postTriggerUs = postTriggerUs;
+  openWindow.info.triggerMask = started;
+  openWindow.info.shotSequence = shotSequence;
+  windowOpen = true;
+}
+
+static void closeWindow(uint32_t end, bool truncated) {
+  openWindow.end = end;
+  openWindow.info.recordCount = end - openWindow.start;
+  openWindow.info.truncated = truncated ? 1 : 0;
+  if (!closedWindows.push(openWindow)) droppedWindows++;
+  lastWindowEnd = end;
+  windowOpen = false;
+}
+
+void captureAppend(const RawSample &sample) {
+  uint32_t index = writeIndex;
+  logWriterMakeRecord(sample, ring[index & (CAPTURE_RING_RECORDS - 1)]);
+  writeIndex = index + 1;
+
+  uint8_t gates = sample.injectorMask >> 4;
+  uint8_t started = gates & ~lastGates;
+  lastGates = gates;
+
+  if (started) {
+    if (!windowOpen) startWindow(index, sample.timestamp, started);
+    else openWindow.info.triggerMask |= started;
+    openWindow.info.shots += __builtin_popcount(started);
+    shotSequence += __builtin_popcount(started);
+  }
+  if (!windowOpen) return;
+
+  if (gates) closeIndex = writeIndex + postRecords;
+  if (!gates && (int32_t)(writeIndex - closeIndex) >= 0) {
+    closeWindow(writeIndex, false);
+  } else if (writeIndex - openWindow.start >= CAPTURE_MAX_WINDOW_RECORDS) {
+    closeWindow(writeIndex, true);  // A gate still high stays quiet until its next rising edge
+  }
+}
+
+// Write the window header, dropping whatever the ring has already lapped
+static void writeWindowHeader() {
+  LogWindowInfo &info = drainWindow.info;
+  uint32_t age = writeIndex - drainWindow.start;
+  if (age > CAPTURE_RING_RECORDS) {
+    uint32_t lost = age - CAPTURE_RING_RECORDS;
+    if (lost > info.recordCount) lost = info.recordCount;
+    drainWindow.start += lost;
+    info.recordCount -= lost;
+    info.preTriggerRecords = info.preTriggerRecords > lost ? info.preTriggerRecords - lost : 0;
+    info.droppedRecords = lost;
+    droppedRecords += lost;
+  }
+  info.window = windowsWritten++;
+  logWriterAppendWindow(info);
+  drainIndex = drainWindow.start;
+  headerWritten = true;
+}
+
+bool captureService() {
+  if (!drainActive) {
+    if (!closedWindows.pop(drainWindow)) return false;
+    drainActive = true;
+    headerWritten = false;
+  }
+
+  // Header and the partial block it closes both need a buffer
+  if (!headerWritten) {
+    if (logWriterFreeBuffers() < 2) return true;
+    writeWindowHeader();
+  }
+
+  // At most one block per call so commands and the sampler are serviced in between
+  for (int n = 0; n < LOG_SAMPLE_BLOCK_RECORDS && drainIndex != drainWindow.end; n++) {
+    if (logWriterFreeBuffers() < 1) return true;
+    if (writeIndex - drainIndex > CAPTURE_RING_RECORDS) {
+      // Lapped after the header went out, the next window block ends this one
+      droppedRecords += drainWindow.end - drainIndex;
+      drainIndex = drainWindow.end;
+      break;
+    }
+    logWriterAppendRecord(ring[drainIndex & (CAPTURE_RING_RECORDS - 1)]);
+    drainIndex++;
+  }
+
+  if (drainIndex == drainWindow.end) drainActive = false;
+  return true;
+}
+
+void captureStop() {
+  if (!capturing) return;
+  if (windowOpen) closeWindow(writeIndex, false);
+  while (captureService()) {
+    logWriterService();
+  }
+  capturing = false;
+}
+
+uint32_t captureWindowCount() {
+  return windowsWritten;
+}
+
+uint32_t captureDroppedWindows() {
+  return droppedWindows;
+}
+
+uint32_t captureDroppedRecords() {
+  return droppedRecords;
+}
@@ -0,0 +1,44 @@
+#ifndef CAPTURE_BUFFER_H
+#define CAPTURE_BUFFER_H
+
+#include <Arduino.h>
+#include "sampler.h"
+#include "log_format.h"
+
+// Triggered capture: every sample goes into a large ring in the external PSRAM, and only
+// the windows around shots are copied into the log.
+//
+// A shot's gate bit rising opens a window that reaches back preUs before it. The window
+// stays open while any shot is running and closes postUs after the last one ended, so
+// shots close together share one window. A window never reaches back into the previous
+// one and is cut at CAPTURE_MAX_WINDOW_RECORDS. Closed windows are queued and copied to
+// the log writer in idle time, a block at a time as buffers free up. A window the writer
+// fell so far behind on that the ring lapped it loses its oldest records (counted in
+// droppedRecords); records lost after its header went out simply end it early.
+
+// Capture Configuration
+const uint32_t CAPTURE_RING_RECORDS = 1 << 18;        // 4MB of PSRAM, 2.6s at 100kHz (power of two)
+const uint32_t CAPTURE_MAX_WINDOW_RECORDS = 1 << 16;  // Longest window, 0.65s at 100kHz
+const uint32_t CAPTURE_WINDOW_QUEUE = 16;             // Closed windows waiting for the writer (power of two)
+const uint32_t CAPTURE_DEFAULT_PRE_US = 500;
+const uint32_t CAPTURE_DEFAULT_POST_US = 2000;
+const uint32_t CAPTURE_MAX_PRE_US = 100000;
+const uint32_t CAPTURE_MAX_POST_US = 100000;
+
+// Arm capture at the sampler's rate, returns false if the board has no PSRAM for the ring
+bool captureStart(uint32_t rateHz, uint32_t preUs, uint32_t postUs);
+
+// Acquisition side - called with every consumed sample while capturing
+void captureAppend(const RawSample &sample);
+
+// Idle side - copies queued windows into the log writer while it has room, returns false when idle
+bool captureService();
+
+// Close the open window and hand everything queued to the writer
+void captureStop();
+
+uint32_t captureWindowCount();     // Windows written
+uint32_t captureDroppedWindows();  // Closed while the window queue was full
+uint32_t captureDroppedRecords();  // Overwritten in the ring before they were written
+
+#endif
@@ -0,0 +1,103 @@
+#include "coil_thermal.h"
+
+struct CoilThermal {
+  float riseC;
+  float powerW;
+  float energyJ;        // Total since reset
+  uint32_t updatedMs;
+  bool overLimit;
+};
+
+static CoilThermal coils[4];
+static float riseLimit = THERMAL_DEFAULT_RISE_LIMIT;
+static float powerLimit = THERMAL_DEFAULT_POWER_LIMIT;
+
+// Let both estimates decay from the last update to nowMs
+static void decayTo(CoilThermal &coil, uint32_t nowMs) {
+  float elapsed = (uint32_t)(nowMs - coil.updatedMs) * 0.001f;
+  coil.updatedMs = nowMs;
+  if (elapsed <= 0) return;
+  coil.riseC *= expf(-elapsed / THERMAL_TIME_CONSTANT);
+  coil.powerW *= expf(-elapsed / THERMAL_POWER_WINDOW);
+}
+
+void coilThermalReset() {
+  uint32_t now = millis();
+  for (int ch = 0; ch < 4; ch++) {
+    coils[ch] = CoilThermal();
+    coils[ch].updatedMs = now;
+  }
+}
+
+// Power limit 0 is off
+static bool overLimit(const CoilThermal &coil) {
+  return coil.riseC > riseLimit || (powerLimit > 0 && coil.powerW > powerLimit);
+}
+
+bool coilThermalAddShot(int channel, float energyJ, uint32_t nowMs) {
+  CoilThermal &coil = coils[channel];
+  decayTo(coil, nowMs);
+  coil.riseC += energyJ * THERMAL_RESISTANCE / THERMAL_TIME_CONSTANT;  // E / Cth
+  coil.powerW += energyJ / THERMAL_POWER_WINDOW;
+  coil.energyJ += energyJ;
+
+  bool over = overLimit(coil);
+  bool tripped = over && !coil.overLimit;
+  coil.overLimit = over;
+  return tripped;
+}
+
+float coilThermalRise(int channel, uint32_t nowMs) {
+  decayTo(coils[channel], nowMs);
+  return coils[channel].riseC;
+}
+
+float coilThermalPower(int channel, uint32_t nowMs) {
+  decayTo(coils[channel], nowMs);
+  return coils[channel].powerW;
+}
+
+bool coilThermalOverLimit(int channel, uint32_t nowMs) {
+  CoilThermal &coil = coils[channel];
+  decayTo(coil, nowMs);
+  coil.overLimit = overLimit(coil);
+  return coil.overLimit;
+}
+
+void coilThermalSetLimits(float riseLimitC, float powerLimitW) {
+  riseLimit = riseLimitC;
+  powerLimit = powerLimitW;
+}
+
+float coilThermalRiseLimit() {
+  return riseLimit;
+}
+
+float coilThermalPowerLimit() {
+  return powerLimit;
+}
+
+void coilThermalPrint() {
+  uint32_t now = millis();
+  Serial.print("[THERMAL]{\"riseLimitC\":");
+  Serial.print(riseLimit, 1);
+  Serial.print(",\"powerLimitW\":");
+  Serial.print(powerLimit, 2);
+  Serial.print(",\"injectors\":[");
+  for (int ch = 0; ch < 4; ch++) {
+    if (ch > 0) Serial.print(",");
+    Serial.print("{\"injector\":");
+    Serial.print(ch + 1);
+    Serial.print(",\"riseC\":");
+    Serial.print(coilThermalRise(ch, now), 2);
+    Serial.print(",\"powerW\":");
+    Serial.print(coilThermalPower(ch, now), 3);
+    Serial.print(",\"energyJ\":");
+    Serial.print(coils[ch].energyJ, 3);
+    Serial.print(",\"overLimit\":");
+    Serial.print(coilThermalOverLimit(ch, now) ? "true" : "false");
+    Serial.print("}");
+  }
+  Serial.print("]}");
+  Serial.println();
+}
@@ -0,0 +1,42 @@
+#ifndef COIL_THERMAL_H
+#define COIL_THERMAL_H
+
+#include <Arduino.h>
+
+// First-order thermal model of each injector coil, fed with the energy of every shot.
+//
+// The coil is one thermal RC to ambient: a shot's energy E raises the coil by
+// E / Cth, and the rise decays towards ambient with time constant Rth * Cth.
+// Everything drawn from the supply while the drive is on counts as coil heat,
+// which errs on the safe side (some of it ends up in the flyback path). A second,
+// much shorter average of the same energy gives the drive power. A power limit can guard
+// against bursts, but it is off by default: a 1s average trips long before the coil warms
+// (50 x 20ms shots at 12V average over 10W for a 1C rise), so the temperature rise is the
+// default trip. State persists across runs, it models the hardware, not a run.
+
+// Coil Thermal Configuration
+const float THERMAL_RESISTANCE = 8.0;         // Coil to ambient (C/W)
+const float THERMAL_TIME_CONSTANT = 90.0;     // Rth * Cth (s)
+const float THERMAL_POWER_WINDOW = 1.0;       // Averaging time of the power estimate (s)
+const float THERMAL_DEFAULT_RISE_LIMIT = 60.0;  // Rise above ambient that stops a run (C)
+const float THERMAL_DEFAULT_POWER_LIMIT = 0.0;  // Average drive power that stops a run (W), 0 is off
+
+// Reset every channel to ambient, limits unchanged
+void coilThermalReset();
+
+// Add one shot's energy at millis() nowMs. Returns true when this shot took the channel over a limit.
+bool coilThermalAddShot(int channel, float energyJ, uint32_t nowMs);
+
+// Estimates decayed to nowMs
+float coilThermalRise(int channel, uint32_t nowMs);
+float coilThermalPower(int channel, uint32_t nowMs);
+bool coilThermalOverLimit(int channel, uint32_t nowMs);
+
+void coilThermalSetLimits(float riseLimitC, float powerLimitW);
+float coilThermalRiseLimit();
+float coilThermalPowerLimit();
+
+// Print every channel's state as [THERMAL] JSON
+void coilThermalPrint();
+
+#endif
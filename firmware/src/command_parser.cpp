@@ -0,0 +1,127 @@
+#include "command_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Line being assembled - bytes past the buffer are dropped until the newline
+static char pending[COMMAND_LINE_SIZE];
+static int pendingLength = 0;
+static bool pendingOverflow = false;
+
+bool commandReadByte(char c, CommandLine &line) {
+  if (c == '\n' || c == '\r') {
+    if (pendingLength == 0 && !pendingOverflow) return false;  // Blank line or the \n of \r\n
+    memcpy(line.text, pending, pendingLength);
+    line.text[pendingLength] = '\0';
+    line.length = pendingLength;
+    line.overflow = pendingOverflow;
+    line.hasId = false;
+    line.id = 0;
+    line.verb = 0;
+    line.argc = 0;
+    pendingLength = 0;
+    pendingOverflow = false;
+    return true;
+  }
+
+  if (pendingLength < COMMAND_LINE_SIZE - 1) {
+    pending[pendingLength++] = c;
+  } else {
+    pendingOverflow = true;
+  }
+  return false;
+}
+
+bool commandFindId(CommandLine &line) {
+  const char *p = line.text;
+  bool quoted = false;
+  bool tokenStart = true;
+  for (; *p; p++) {
+    if (*p == '"') quoted = !quoted;
+    if (!quoted && tokenStart && strncasecmp(p, "id=", 3) == 0) {
+      char *end;
+      unsigned long id = strtoul(p + 3, &end, 10);
+      if (end == p + 3 || (*end && *end != ' ')) return false;
+      line.id = id;
+      line.hasId = true;
+      return true;
+    }
+    tokenStart = !quoted && *p == ' ';
+  }
+  return false;
+}
+
+const char *commandParse(CommandLine &line) {
+  char *text = line.text;
+  char *p = text;
+  line.argc = 0;
+
+  while (*p == ' ') p++;
+  if (!*p) return "empty command";
+  line.verb = p - text;
+  while (*p && *p != ' ') p++;
+  if (*p) *p++ = '\0';
+
+  while (true) {
+    while (*p == ' ') p++;
+    if (!*p) break;
+
+    char *key = p;
+    while (*p && *p != '=' && *p != ' ') p++;
+    if (*p != '=') return "expected key=value";
+    *p++ = '\0';
+
+    char *value;
+    if (*p == '"') {
+      value = ++p;
+      while (*p && *p != '"') p++;
+      if (!*p) return "unterminated quote";
+      *p++ = '\0';
+      if (*p && *p != ' ') return "expected a space after a quoted value";
+    } else {
+      value = p;
+      while (*p && *p != ' ') p++;
+      if (*p) *p++ = '\0';
+    }
+
+    if (strcasecmp(key, "id") == 0) {
+      char *end;
+      line.id = strtoul(value, &end, 10);
+      if (end == value || *end) return "id must be a number";
+      line.hasId = true;
+      continue;
+    }
+    if (line.argc >= COMMAND_MAX_ARGS) return "too many arguments";
+    line.args[line.argc].key = key - text;
+    line.args[line.argc].value = value - text;
+    line.argc++;
+  }
+  return nullptr;
+}
+
+const char *commandArg(const CommandLine &line, const char *key) {
+  for (int i = 0; i < line.argc; i++) {
+    if (strcasecmp(line.text + line.args[i].key, key) == 0) return line.text + line.args[i].value;
+  }
+  return nullptr;
+}
+
+bool commandArgLong(const CommandLine &line, const char *key, long &value) {
+  const char *text = commandArg(line, key);
+  if (!text || !*text) return false;
+  char *end;
+  long parsed = strtol(text, &end, 10);
+  if (*end) return false;
+  value = parsed;
+  return true;
+}
+
+bool commandArgFloat(const CommandLine &line, const char *key, float &value) {
+  const char *text = commandArg(line, key);
+  if (!text || !*text) return false;
+  char *end;
+  float parsed = strtof(text, &end);
+  if (*end) return false;
+  value = parsed;
+  return true;
+}
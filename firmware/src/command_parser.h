@@ -0,0 +1,58 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+
+// Line-based serial commands without blocking or heap allocation.
+//
+// Received bytes are assembled into fixed-size lines as they arrive. A line is
+// either a legacy single-character command, a reply to a pending prompt, or a
+// structured command:
+//
+//   <verb> [key=value ...] [id=<n>]        e.g. fire ch=2 n=500 mode=ph pw=3.5 id=17
+//
+// Values containing spaces are double-quoted. commandParse() tokenizes in place
+// and keeps offsets rather than pointers, so parsed lines can be copied through
+// the command queue.
+
+// Command Parser Configuration
+const int COMMAND_LINE_SIZE = 128;            // Longest line including the terminator
+const int COMMAND_MAX_ARGS = 12;              // key=value pairs per command, id excluded
+
+struct CommandArg {
+  uint8_t key;    // Offsets into CommandLine::text
+  uint8_t value;
+};
+
+struct CommandLine {
+  char text[COMMAND_LINE_SIZE];
+  uint8_t length;
+  bool overflow;    // Line was longer than COMMAND_LINE_SIZE - 1 and has been cut
+  bool hasId;
+  uint32_t id;
+  uint8_t verb;     // Filled by commandParse()
+  uint8_t argc;
+  CommandArg args[COMMAND_MAX_ARGS];
+};
+
+// Feed one received byte, returns true when line holds a complete, non-empty line
+bool commandReadByte(char c, CommandLine &line);
+
+// Find id=<n> without modifying the line, so it can be acknowledged before it is run
+bool commandFindId(CommandLine &line);
+
+// Split a structured command into verb and arguments, returns nullptr or an error message
+const char *commandParse(CommandLine &line);
+
+inline const char *commandVerb(const CommandLine &line) {
+  return line.text + line.verb;
+}
+
+// Argument value, nullptr when the key wasn't given
+const char *commandArg(const CommandLine &line, const char *key);
+
+// Numeric arguments - false when missing or not a number (value untouched)
+bool commandArgLong(const CommandLine &line, const char *key, long &value);
+bool commandArgFloat(const CommandLine &line, const char *key, float &value);
+
+#endif
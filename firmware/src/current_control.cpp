@@ -0,0 +1,166 @@
+#include "current_control.h"
+#include "adc_scan.h"
+#include "hal.h"
+#include "current_lut.h"
+#include "ring_buffer.h"
+
+enum RegulationPhase : uint8_t {
+  REG_PEAK,
+  REG_HOLD,
+};
+
+struct ControlChannel {
+  HalPin pin;
+  volatile bool active;
+  uint8_t phase;
+  bool driven;
+  bool settled;                 // Hold current has come down into the band
+  uint16_t highMa;              // Hold band edges
+  uint16_t lowMa;
+  uint32_t startCycles;
+  RegulationResult result;
+};
+
+static ControlChannel channels[4];
+static volatile uint8_t activeChannels = 0;
+static volatile uint8_t inhibitedChannels = 0;
+static ControlEdgeHandler edgeHandler = nullptr;
+static SpscRing<RegulationResult, CONTROL_RESULT_QUEUE> results;
+static volatile uint32_t droppedResults = 0;
+
+// One sample of one channel, interrupts off so a pulse engine edge can't land between decision and write
+static inline void regulate(int ch, uint16_t code, uint32_t now) {
+  ControlChannel &c = channels[ch];
+  if (!c.active) return;
+
+  RegulationResult &r = c.result;
+  uint16_t milliamps = currentLutMilliamps(ch, code);
+  if (milliamps > r.maxMa) r.maxMa = milliamps;
+  r.samples++;
+
+  bool drive = c.driven;
+  if (c.phase == REG_PEAK) {
+    if (milliamps >= r.peakThresholdMa) {
+      drive = false;
+      c.phase = REG_HOLD;
+      r.peakReached = true;
+      r.timeToPeakCycles = now - c.startCycles;
+    }
+  } else {
+    if (!c.settled && milliamps <= c.highMa) c.settled = true;
+    if (c.settled) {
+      int32_t error = (int32_t)milliamps - r.holdMa;
+      uint32_t magnitude = abs(error);
+      r.holdSamples++;
+      r.holdErrorSumMa += error;
+      r.holdErrorSqSumMa += (uint64_t)(magnitude * magnitude);
+      if (magnitude > r.holdMaxErrorMa) r.holdMaxErrorMa = magnitude;
+    }
+    if (c.driven && milliamps >= c.highMa) drive = false;
+    else if (!c.driven && milliamps <= c.lowMa) drive = true;
+  }
+  if (drive == c.driven) return;
+
+  halPinWrite(c.pin, drive);
+  uint32_t latency = adcScanTriggerAgeCycles();
+  c.driven = drive;
+  r.switches++;
+  r.latencyCount++;
+  r.latencySumCycles += latency;
+  if (latency > r.latencyMaxCycles) r.latencyMaxCycles = latency;
+  if (edgeHandler) edgeHandler(ch, drive);
+}
+
+FASTRUN void currentControlSample(const uint16_t codes[4]) {
+  uint8_t pending = activeChannels & ~inhibitedChannels;
+  if (!pending) return;
+
+  uint32_t now = ARM_DWT_CYCCNT;
+  while (pending) {
+    int ch = __builtin_ctz(pending);
+    pending &= pending - 1;
+    __disable_irq();
+    regulate(ch, codes[ch], now);
+    __enable_irq();
+  }
+}
+
+void currentControlBegin(const int pins[4], ControlEdgeHandler handler) {
+  edgeHandler = handler;
+  for (int ch = 0; ch < 4; ch++) {
+    halPinBegin(channels[ch].pin, pins[ch]);
+    channels[ch].active = false;
+  }
+}
+
+void currentControlStart(int channel, const WaveStep &step) {
+  ControlChannel &c = channels[channel];
+  memset(&c.result, 0, sizeof(c.result));
+  c.result.channel = channel;
+  c.result.peakThresholdMa = step.peakMa;
+  c.result.holdMa = step.holdMa;
+  c.highMa = step.holdMa + step.bandMa / 2;
+  c.lowMa = step.holdMa - step.bandMa / 2;
+  c.phase = REG_PEAK;
+  c.driven = true;  // The pulse engine has just switched the pin on
+  c.settled = false;
+  c.startCycles = ARM_DWT_CYCCNT;
+  c.active = true;
+  activeChannels |= 1 << channel;
+}
+
+void currentControlStop(int channel) {
+  ControlChannel &c = channels[channel];
+  if (!c.active) return;
+  c.active = false;
+  activeChannels &= ~(1 << channel);
+  if (!results.push(c.result)) droppedResults++;
+}
+
+void currentControlInhibit(uint8_t mask) {
+  inhibitedChannels = mask;
+}
+
+void currentControlPrintResults() {
+  const float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  RegulationResult r;
+  while (results.pop(r)) {
+    float meanError = r.holdSamples > 0 ? (float)r.holdErrorSumMa / r.holdSamples : 0;
+    float rmsError = r.holdSamples > 0 ? sqrtf((float)r.holdErrorSqSumMa / r.holdSamples) : 0;
+    int overshoot = r.peakReached ? (int)r.maxMa - r.peakThresholdMa : 0;
+
+    Serial.print("[REGULATION]{");
+    Serial.print("\"injector\":");
+    Serial.print(r.channel + 1);
+    Serial.print(",\"peakReached\":");
+    Serial.print(r.peakReached ? "true" : "false");
+    Serial.print(",\"timeToPeakUs\":");
+    Serial.print(r.timeToPeakCycles / cyclesPerUs, 1);
+    Serial.print(",\"peakThresholdMa\":");
+    Serial.print(r.peakThresholdMa);
+    Serial.print(",\"maxMa\":");
+    Serial.print(r.maxMa);
+    Serial.print(",\"overshootMa\":");
+    Serial.print(overshoot);
+    Serial.print(",\"holdMa\":");
+    Serial.print(r.holdMa);
+    Serial.print(",\"holdMeanErrorMa\":");
+    Serial.print(meanError, 1);
+    Serial.print(",\"holdRmsErrorMa\":");
+    Serial.print(rmsError, 1);
+    Serial.print(",\"holdMaxErrorMa\":");
+    Serial.print(r.holdMaxErrorMa);
+    Serial.print(",\"switches\":");
+    Serial.print(r.switches);
+    Serial.print(",\"samples\":");
+    Serial.print(r.samples);
+    Serial.print(",\"meanLatencyUs\":");
+    Serial.print(r.latencyCount > 0 ? r.latencySumCycles / cyclesPerUs / r.latencyCount : 0, 2);
+    Serial.print(",\"maxLatencyUs\":");
+    Serial.print(r.latencyMaxCycles / cyclesPerUs, 2);
+    Serial.print(",\"dropped\":");
+    Serial.print(droppedResults);
+    Serial.print("}");
+    Serial.println();
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef CURRENT_CONTROL_H
+#define CURRENT_CONTROL_H
+
+#include <Arduino.h>
+#include "waveform.h"
+
+// Hysteretic current regulation for REG waveform segments.
+//
+// The pulse engine switches the injector on at the start of a REG segment and
+// calls currentControlStart(). From then on every scan sample (ADC_ETC done
+// interrupt, not the DMA block) goes through currentControlSample(), is
+// converted through the current LUT and the regulator drives the pin itself: on until the current reaches the peak
+// threshold, then on/off to keep it inside the hold band. The segment's
+// closing edge calls currentControlStop(), which queues a per-shot result.
+//
+// Latency is timed from the conversion trigger to the pin write, so it
+// includes the conversion, the ISR entry and the control decision.
+
+// Current Control Configuration
+const uint32_t CONTROL_RESULT_QUEUE = 16;     // Shot results awaiting currentControlPrintResults()
+
+// Called from the regulator ISR after each switch it makes
+typedef void (*ControlEdgeHandler)(int channel, bool on);
+
+// Outcome of one regulated segment
+struct RegulationResult {
+  uint8_t channel;
+  bool peakReached;
+  uint16_t peakThresholdMa;
+  uint16_t holdMa;
+  uint16_t maxMa;               // Highest sample of the shot, threshold + overshoot
+  uint32_t timeToPeakCycles;    // Segment start to the sample that crossed the threshold
+  uint32_t samples;
+  uint32_t holdSamples;         // Samples after the current first settled into the band
+  int32_t holdErrorSumMa;       // Sample minus hold target
+  uint64_t holdErrorSqSumMa;
+  uint16_t holdMaxErrorMa;
+  uint32_t switches;
+  uint32_t latencyCount;        // Switches with a latency measurement
+  uint32_t latencySumCycles;
+  uint32_t latencyMaxCycles;
+};
+
+// Store the drive pins
+void currentControlBegin(const int pins[4], ControlEdgeHandler handler);
+
+// Regulate the active channels on one sample, from the sampler's per-sample handler
+void currentControlSample(const uint16_t codes[4]);
+
+// Channels in mask are left alone (off) until the mask is cleared, called from protection trips
+void currentControlInhibit(uint8_t mask);
+
+// Pulse engine edge hooks, called from its ISR
+void currentControlStart(int channel, const WaveStep &step);
+void currentControlStop(int channel);
+
+// Print queued shot results as [REGULATION] JSON
+void currentControlPrintResults();
+
+#endif
@@ -0,0 +1,13 @@
+#include "current_lut.h"
+
+// Lives in DTCM with the rest of .bss, so lookups never miss the cache
+uint16_t currentLut[LOG_CHANNELS][CURRENT_LUT_CODES];
+
+void currentLutBuild(const LogFileHeader &calibration) {
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    for (int code = 0; code < CURRENT_LUT_CODES; code++) {
+      float milliamps = logCodeToCurrent(calibration, ch, code) * 1000.0f + 0.5f;
+      currentLut[ch][code] = milliamps > 65535.0f ? 65535 : (uint16_t)milliamps;
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef CURRENT_LUT_H
+#define CURRENT_LUT_H
+
+#include <Arduino.h>
+#include "log_format.h"
+
+// Per-channel ADC code -> milliamp tables, rebuilt whenever calibration changes.
+//
+// Each entry is the full float conversion (offset, sensitivity, gain correction)
+// evaluated once, so the sampling paths only do an indexed load. Convert to amps
+// with currentMilliampsToAmps() when reporting.
+
+// Current LUT Configuration
+const int CURRENT_LUT_BITS = 12;                       // Matches ADC_SCAN_BITS / analogReadResolution
+const int CURRENT_LUT_CODES = 1 << CURRENT_LUT_BITS;   // Entries per channel (8KB each)
+
+extern uint16_t currentLut[LOG_CHANNELS][CURRENT_LUT_CODES];
+
+// Evaluate logCodeToCurrent() for every code so the table and the log decoders agree
+void currentLutBuild(const LogFileHeader &calibration);
+
+inline uint16_t currentLutMilliamps(int channel, uint16_t code) {
+  return currentLut[channel][code & (CURRENT_LUT_CODES - 1)];
+}
+
+inline float currentMilliampsToAmps(uint32_t milliamps) {
+  return milliamps * 0.001f;
+}
+
+#endif
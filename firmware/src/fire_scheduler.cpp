@@ -0,0 +1,111 @@
+#include "fire_scheduler.h"
+
+static FiringPlan activePlan;
+static const WaveProgram *planProgram = nullptr;
+static bool running = false;
+
+static uint32_t firstCycleTick = 0;
+static uint32_t cycleTicks = 0;
+static uint32_t phaseTicks[4];
+static uint32_t nextCycle[4];       // Next cycle to arm per channel
+static uint32_t shots[4];
+static uint32_t skippedShots = 0;
+static uint32_t endTick = 0;
+
+static uint32_t shotStartTick(int channel, uint32_t cycle) {
+  return firstCycleTick + cycle * cycleTicks + phaseTicks[channel];
+}
+
+bool schedulerStart(const FiringPlan &plan, const WaveProgram &program) {
+  if (running) schedulerStop();
+  if (plan.rpm < SCHEDULER_MIN_RPM || plan.rpm > SCHEDULER_MAX_RPM) return false;
+  if (plan.cycles == 0 || !(plan.channelMask & 0x0F)) return false;
+  if (program.count == 0) return false;
+
+  // Two revolutions per cycle, a shot must end before the same injector fires again
+  cycleTicks = (uint32_t)(120ULL * PULSE_TICKS_PER_US * 1000000ULL / plan.rpm);
+  if (program.totalTicks >= cycleTicks) return false;
+
+  activePlan = plan;
+  planProgram = &program;
+
+  firstCycleTick = pulseEngineNow() + pulseUsToTicks(SCHEDULER_START_DELAY_US);
+  endTick = firstCycleTick;
+  skippedShots = 0;
+  for (int ch = 0; ch < 4; ch++) {
+    phaseTicks[ch] = (uint32_t)((uint64_t)(plan.phaseDeg[ch] % 720) * cycleTicks / 720);
+    nextCycle[ch] = (plan.channelMask & (1 << ch)) ? 0 : plan.cycles;
+    shots[ch] = 0;
+  }
+
+  running = true;
+  schedulerService();
+  return true;
+}
+
+bool schedulerService() {
+  if (!running) return false;
+
+  uint32_t horizon = pulseEngineNow() + pulseUsToTicks(SCHEDULER_LOOKAHEAD_US);
+  bool armedAny = true;
+
+  // Arm in time order across channels so one channel can't starve the queue
+  while (armedAny) {
+    armedAny = false;
+    int best = -1;
+    for (int ch = 0; ch < 4; ch++) {
+      if (nextCycle[ch] >= activePlan.cycles) continue;
+      if (best < 0 || (int32_t)(shotStartTick(ch, nextCycle[ch]) - shotStartTick(best, nextCycle[best])) < 0) {
+        best = ch;
+      }
+    }
+    if (best < 0) break;
+
+    uint32_t start = shotStartTick(best, nextCycle[best]);
+    if ((int32_t)(start - horizon) > 0) break;
+    if (pulseEngineQueueFree(best) == 0) break;
+
+    if (pulseEngineArm(best, start, *planProgram)) {
+      shots[best]++;
+      uint32_t last = start + planProgram->totalTicks;
+      if ((int32_t)(last - endTick) > 0) endTick = last;
+    } else {
+      skippedShots++;  // Main loop fell behind and the slot has passed
+    }
+    nextCycle[best]++;
+    armedAny = true;
+  }
+
+  for (int ch = 0; ch < 4; ch++) {
+    if (nextCycle[ch] < activePlan.cycles) return true;
+  }
+  if (!pulseEngineIdle()) return true;
+
+  running = false;
+  return false;
+}
+
+void schedulerStop() {
+  pulseEngineStop();
+  running = false;
+}
+
+bool schedulerRunning() {
+  return running;
+}
+
+uint32_t schedulerCycleTicks() {
+  return cycleTicks;
+}
+
+uint32_t schedulerEndTick() {
+  return endTick;
+}
+
+uint32_t schedulerShots(int channel) {
+  return shots[channel];
+}
+
+uint32_t schedulerSkippedShots() {
+  return skippedShots;
+}
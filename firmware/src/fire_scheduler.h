@@ -0,0 +1,46 @@
+#ifndef FIRE_SCHEDULER_H
+#define FIRE_SCHEDULER_H
+
+#include <Arduino.h>
+#include "pulse_engine.h"
+
+// Engine-style firing on all four channels at once.
+//
+// Each injector fires the same waveform once per 720° four-stroke cycle at its
+// own crank angle. Shots are armed on the pulse engine a little ahead of time
+// from schedulerService(), so pulses on different channels overlap exactly as
+// the plan says while the main loop keeps consuming samples.
+
+// Fire Scheduler Configuration
+const uint32_t SCHEDULER_LOOKAHEAD_US = 20000;  // Arm shots whose first edge is this close
+const uint32_t SCHEDULER_START_DELAY_US = 1000; // First cycle starts this long after schedulerStart()
+const uint32_t SCHEDULER_MIN_RPM = 100;         // Keeps a cycle well inside the 32-bit tick range
+const uint32_t SCHEDULER_MAX_RPM = 20000;
+
+struct FiringPlan {
+  uint32_t rpm;
+  uint32_t cycles;          // Engine cycles (two revolutions each)
+  uint16_t phaseDeg[4];     // Crank angle of each injector's first edge, 0-719
+  uint8_t channelMask;      // Bit n set if injector n+1 takes part
+};
+
+// Validate the plan against the waveform and start arming, false if it can't run.
+// The program must stay unchanged until the run has finished.
+bool schedulerStart(const FiringPlan &plan, const WaveProgram &program);
+
+// Arm shots that have come inside the lookahead, returns true until every shot has fired
+bool schedulerService();
+
+// Cancel remaining shots and drive all channels low
+void schedulerStop();
+bool schedulerRunning();
+
+// Ticks per 720° cycle and tick of the last edge armed so far
+uint32_t schedulerCycleTicks();
+uint32_t schedulerEndTick();
+
+// Shots armed per channel, and shots armed too late to keep their slot (skipped)
+uint32_t schedulerShots(int channel);
+uint32_t schedulerSkippedShots();
+
+#endif
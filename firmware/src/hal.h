@@ -0,0 +1,133 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+
+// Hardware below the Arduino API, so the firing, logging and command code builds unchanged for the
+// Teensy and for the host simulator (PlatformIO env:native, see firmware/host).
+//
+// Everything else the firmware uses - Serial, SD, micros(), delay(), analogRead(), IntervalTimer,
+// ARM_DWT_CYCCNT - is the Teensy core's API, which the host backend implements against a virtual
+// clock. What is left here is what the core has no portable call for: a drive pin written with
+// one store, saving and restoring the interrupt mask, and the GPT2 timer the pulse engine runs on.
+// The ADC scan engine (adc_scan.h) is the other hardware driver, the host has its own copy.
+//
+// On the Teensy it is all inline register access (hal_teensy.cpp only configures GPT2), so none of
+// it costs a call in the ISRs.
+
+// HAL Configuration
+const uint32_t HAL_EDGE_TIMER_HZ = 150000000;  // GPT2 runs from the 150MHz IPG clock
+
+#ifdef HOST_BUILD
+
+// Host backend, implemented in firmware/host/src against the injector plant and virtual clock
+struct HalPin {
+  int number;
+};
+
+void halPinBegin(HalPin &pin, int number);
+void halPinWrite(const HalPin &pin, bool high);
+uint32_t halIrqSave();
+void halIrqRestore(uint32_t state);
+inline void halIsrEnd() {}
+uint32_t halEdgeTimerNow();
+void halEdgeTimerCompare(uint32_t tick);
+void halEdgeTimerAck();
+void halEdgeTimerEnable(bool enable);
+void halEdgeTimerPend();
+void halEdgeTimerCaptureEnable(bool enable);
+bool halEdgeTimerCaptured(uint32_t &tick);
+
+#else
+
+// Drive pin written through its GPIO DR_SET/DR_CLEAR register, one store per edge
+struct HalPin {
+  volatile uint32_t *setReg;
+  volatile uint32_t *clearReg;
+  uint32_t mask;
+};
+
+// Configure as an output, driven low
+inline void halPinBegin(HalPin &pin, int number) {
+  pinMode(number, OUTPUT);
+  digitalWrite(number, LOW);
+  pin.setReg = portSetRegister(number);
+  pin.clearReg = portClearRegister(number);
+  pin.mask = digitalPinToBitMask(number);
+}
+
+inline void halPinWrite(const HalPin &pin, bool high) {
+  *(high ? pin.setReg : pin.clearReg) = pin.mask;
+}
+
+// Disable interrupts, returning whether they were already masked
+inline uint32_t halIrqSave() {
+  uint32_t primask;
+  __asm__ volatile("mrs %0, primask" : "=r"(primask));
+  __disable_irq();
+  return primask;
+}
+
+inline void halIrqRestore(uint32_t state) {
+  if (!state) __enable_irq();
+}
+
+// Last statement of an ISR that cleared its flag, so the clear lands before the return and the
+// interrupt isn't taken again
+inline void halIsrEnd() {
+  asm("DSB");
+}
+
+// Free-running edge timer count (GPT2)
+inline uint32_t halEdgeTimerNow() {
+  return GPT2_CNT;
+}
+
+// Raise the edge timer interrupt when the count reaches tick
+inline void halEdgeTimerCompare(uint32_t tick) {
+  GPT2_OCR1 = tick;
+}
+
+// Clear the compare flag, first thing in the ISR
+inline void halEdgeTimerAck() {
+  GPT2_SR = GPT_SR_OF1;
+}
+
+inline void halEdgeTimerEnable(bool enable) {
+  if (enable) {
+    GPT2_IR |= GPT_IR_OF1IE;
+  } else {
+    GPT2_IR &= ~GPT_IR_OF1IE;
+  }
+}
+
+// Run the ISR as soon as interrupts allow
+inline void halEdgeTimerPend() {
+  NVIC_SET_PENDING(IRQ_GPT2);
+}
+
+// Input capture of both edges on PULSE_CAPTURE_PIN, a stale capture is discarded when enabling
+inline void halEdgeTimerCaptureEnable(bool enable) {
+  if (enable) {
+    GPT2_SR = GPT_SR_IF1;
+    GPT2_IR |= GPT_IR_IF1IE;
+  } else {
+    GPT2_IR &= ~GPT_IR_IF1IE;
+  }
+}
+
+// Latched capture count, if a new one arrived
+inline bool halEdgeTimerCaptured(uint32_t &tick) {
+  if (!(GPT2_SR & GPT_SR_IF1)) return false;
+  GPT2_SR = GPT_SR_IF1;
+  tick = GPT2_ICR1;
+  return true;
+}
+
+#endif
+
+// Start the edge timer free-running at HAL_EDGE_TIMER_HZ with isr on its interrupt, which shares
+// the compare and the capture
+void halEdgeTimerBegin(void (*isr)(), uint8_t priority);
+
+#endif
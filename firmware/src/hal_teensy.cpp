@@ -0,0 +1,23 @@
+#include "hal.h"
+
+// Teensy 4.1 backend of hal.h, the rest is inline. The native env builds firmware/host instead.
+
+void halEdgeTimerBegin(void (*isr)(), uint8_t priority) {
+  // Free-running 32-bit count at 150MHz, capture 1 latches both edges of the loopback
+  CCM_CCGR0 |= CCM_CCGR0_GPT2_BUS(CCM_CCGR_ON) | CCM_CCGR0_GPT2_SERIAL(CCM_CCGR_ON);
+  GPT2_CR = 0;
+  GPT2_IR = 0;
+  GPT2_CR = GPT_CR_SWR;
+  while (GPT2_CR & GPT_CR_SWR) ;
+  GPT2_PR = 0;
+  GPT2_SR = 0x3F;
+  GPT2_CR = GPT_CR_CLKSRC(1) | GPT_CR_FRR | GPT_CR_ENMOD | GPT_CR_IM1(3);
+  GPT2_CR |= GPT_CR_EN;
+
+  IOMUXC_SW_MUX_CTL_PAD_GPIO_AD_B1_03 = 8;  // Pin 15 as GPT2_CAPTURE1
+  IOMUXC_GPT2_IPP_IND_CAPIN1_SELECT_INPUT = 1;
+
+  attachInterruptVector(IRQ_GPT2, isr);
+  NVIC_SET_PRIORITY(IRQ_GPT2, priority);
+  NVIC_ENABLE_IRQ(IRQ_GPT2);
+}
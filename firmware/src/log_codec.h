@@ -0,0 +1,218 @@
+#ifndef LOG_CODEC_H
+#define LOG_CODEC_H
+
+#include <stdint.h>
+#include <string.h>
+#include "log_format.h"
+
+// Lossless compression of sample records, shared by the firmware and the host tools.
+//
+// A run of records is stored stream by stream: the timestamps as the second difference
+// (the change in sample interval, nearly always 0), each ADC channel and the supply code
+// as the difference from the previous code, and the injector mask with the flags as runs
+// of equal values. Differences are zig-zag mapped to unsigned and Rice coded with a k
+// picked per stream from its mean, so a quiet channel costs a bit or two per sample.
+// Quotients of 16 or more are escaped to a 5-bit length and the value itself, which keeps
+// gaps and steps from blowing up the output.
+//
+// Payload layout, bits LSB first:
+//   timestamp[0] (32), k (5), Rice(zigzag(interval change)) x count-1
+//   per adc channel then aux: code[0] (16), k (5), Rice(zigzag(code change)) x count-1
+//   k (5), then until count records are covered: mask | flags << 8 (16), Rice(run - 1)
+
+const int LOG_RICE_ESCAPE = 16;   // Quotient that switches to the escaped form
+const int LOG_RICE_MAX_K = 24;
+
+struct LogBitWriter {
+  uint8_t *data;
+  uint32_t capacity;
+  uint32_t bytes;
+  uint64_t acc;
+  int bits;
+  bool overflow;
+};
+
+struct LogBitReader {
+  const uint8_t *data;
+  uint32_t size;
+  uint32_t pos;
+  uint64_t acc;
+  int bits;
+  bool overrun;
+};
+
+inline void logBitsPut(LogBitWriter &w, uint32_t value, int n) {
+  w.acc |= (uint64_t)value << w.bits;
+  w.bits += n;
+  while (w.bits >= 8) {
+    if (w.bytes < w.capacity) w.data[w.bytes++] = (uint8_t)w.acc;
+    else w.overflow = true;
+    w.acc >>= 8;
+    w.bits -= 8;
+  }
+}
+
+// Pad the last partial byte, returns the bytes written or 0 if they didn't fit
+inline uint32_t logBitsFinish(LogBitWriter &w) {
+  if (w.bits > 0) logBitsPut(w, 0, 8 - w.bits);
+  return w.overflow ? 0 : w.bytes;
+}
+
+inline uint32_t logBitsGet(LogBitReader &r, int n) {
+  while (r.bits < n) {
+    if (r.pos < r.size) r.acc |= (uint64_t)r.data[r.pos++] << r.bits;
+    else r.overrun = true;
+    r.bits += 8;
+  }
+  uint32_t value = (uint32_t)(r.acc & ((n == 32) ? 0xFFFFFFFFULL : ((1ULL << n) - 1)));
+  r.acc >>= n;
+  r.bits -= n;
+  return value;
+}
+
+inline uint32_t logZigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t logUnzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// Rice parameter close to log2 of the mean value
+inline int logRiceK(uint64_t sum, uint32_t count) {
+  int k = 0;
+  while (k < LOG_RICE_MAX_K && ((uint64_t)count << (k + 1)) <= sum) k++;
+  return k;
+}
+
+inline void logRicePut(LogBitWriter &w, uint32_t value, int k) {
+  uint32_t q = value >> k;
+  if (q < (uint32_t)LOG_RICE_ESCAPE) {
+    logBitsPut(w, (1U << q) - 1, q + 1);  // q ones and a zero
+    if (k > 0) logBitsPut(w, value & ((1U << k) - 1), k);
+    return;
+  }
+  int length = 32 - __builtin_clz(value);
+  logBitsPut(w, (1U << LOG_RICE_ESCAPE) - 1, LOG_RICE_ESCAPE);
+  logBitsPut(w, length - 1, 5);
+  logBitsPut(w, value, length);
+}
+
+inline uint32_t logRiceGet(LogBitReader &r, int k) {
+  uint32_t q = 0;
+  while (q < (uint32_t)LOG_RICE_ESCAPE && logBitsGet(r, 1)) q++;
+  if (q == (uint32_t)LOG_RICE_ESCAPE) {
+    int length = logBitsGet(r, 5) + 1;
+    return logBitsGet(r, length);
+  }
+  return (q << k) | (k > 0 ? logBitsGet(r, k) : 0);
+}
+
+// Unsigned view of one 16-bit stream of a record
+inline uint16_t logCodecField(const LogSampleRecord &record, int stream) {
+  return stream < LOG_CHANNELS ? record.adc[stream] : record.aux;
+}
+
+inline void logCodecSetField(LogSampleRecord &record, int stream, uint16_t value) {
+  if (stream < LOG_CHANNELS) record.adc[stream] = value;
+  else record.aux = value;
+}
+
+inline uint16_t logCodecState(const LogSampleRecord &record) {
+  return record.injectorMask | (uint16_t)record.flags << 8;
+}
+
+// Compress count records into out, returns the bytes used or 0 if they didn't fit in capacity
+inline uint32_t logCompressRecords(const LogSampleRecord *records, int count, uint8_t *out, uint32_t capacity) {
+  LogBitWriter w = {out, capacity, 0, 0, 0, false};
+  if (count <= 0) return 0;
+
+  // Timestamps, change of the interval
+  uint64_t sum = 0;
+  int32_t lastDelta = 0;
+  for (int i = 1; i < count; i++) {
+    int32_t delta = (int32_t)(records[i].timestamp - records[i - 1].timestamp);
+    sum += logZigzag(delta - lastDelta);
+    lastDelta = delta;
+  }
+  int k = logRiceK(sum, count);
+  logBitsPut(w, records[0].timestamp, 32);
+  logBitsPut(w, k, 5);
+  lastDelta = 0;
+  for (int i = 1; i < count; i++) {
+    int32_t delta = (int32_t)(records[i].timestamp - records[i - 1].timestamp);
+    logRicePut(w, logZigzag(delta - lastDelta), k);
+    lastDelta = delta;
+  }
+
+  // Codes, change from the previous sample
+  for (int stream = 0; stream <= LOG_CHANNELS; stream++) {
+    sum = 0;
+    for (int i = 1; i < count; i++) {
+      sum += logZigzag((int32_t)logCodecField(records[i], stream) - logCodecField(records[i - 1], stream));
+    }
+    k = logRiceK(sum, count);
+    logBitsPut(w, logCodecField(records[0], stream), 16);
+    logBitsPut(w, k, 5);
+    for (int i = 1; i < count; i++) {
+      logRicePut(w, logZigzag((int32_t)logCodecField(records[i], stream) - logCodecField(records[i - 1], stream)), k);
+    }
+    if (w.overflow) return 0;
+  }
+
+  // Mask and flags, runs of equal values
+  sum = 0;
+  uint32_t runs = 0;
+  for (int i = 0; i < count; runs++) {
+    int start = i;
+    while (i < count && logCodecState(records[i]) == logCodecState(records[start])) i++;
+    sum += i - start - 1;
+  }
+  k = logRiceK(sum, runs);
+  logBitsPut(w, k, 5);
+  for (int i = 0; i < count;) {
+    int start = i;
+    while (i < count && logCodecState(records[i]) == logCodecState(records[start])) i++;
+    logBitsPut(w, logCodecState(records[start]), 16);
+    logRicePut(w, i - start - 1, k);
+  }
+  return logBitsFinish(w);
+}
+
+// Expand a payload written by logCompressRecords, returns false if it was short or inconsistent
+inline bool logDecompressRecords(const uint8_t *in, uint32_t size, LogSampleRecord *records, int count) {
+  LogBitReader r = {in, size, 0, 0, 0, false};
+  if (count <= 0) return false;
+
+  records[0].timestamp = logBitsGet(r, 32);
+  int k = logBitsGet(r, 5);
+  int32_t delta = 0;
+  for (int i = 1; i < count; i++) {
+    delta += logUnzigzag(logRiceGet(r, k));
+    records[i].timestamp = records[i - 1].timestamp + delta;
+  }
+
+  for (int stream = 0; stream <= LOG_CHANNELS; stream++) {
+    logCodecSetField(records[0], stream, logBitsGet(r, 16));
+    k = logBitsGet(r, 5);
+    for (int i = 1; i < count; i++) {
+      int32_t change = logUnzigzag(logRiceGet(r, k));
+      logCodecSetField(records[i], stream, (uint16_t)(logCodecField(records[i - 1], stream) + change));
+    }
+    if (r.overrun) return false;
+  }
+
+  k = logBitsGet(r, 5);
+  for (int i = 0; i < count;) {
+    uint16_t state = logBitsGet(r, 16);
+    uint32_t run = logRiceGet(r, k) + 1;
+    if (r.overrun || run > (uint32_t)(count - i)) return false;
+    for (uint32_t n = 0; n < run; n++, i++) {
+      records[i].injectorMask = (uint8_t)state;
+      records[i].flags = (uint8_t)(state >> 8);
+    }
+  }
+  return !r.overrun;
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+// Binary current log format, shared by the firmware and the host tools in tools/.
+//
+// A .BIN log is one header sector followed by fixed-size blocks. Every block
+// starts with a LogBlockHeader and is a whole number of SD sectors, so the
+// firmware only ever issues sector-aligned writes. All fields are little-endian.
+
+#include <stdint.h>
+
+const uint32_t LOG_FILE_MAGIC = 0x4C434946;   // "FICL"
+const uint32_t LOG_BLOCK_MAGIC = 0x4B4C4246;  // "FBLK"
+const uint16_t LOG_FORMAT_VERSION = 7;      // 2: gain correction table, 3: P&H profile text, 4: supply voltage,
+                                            // 5: capture windows, 6: adaptive rate records, 7: packed blocks
+
+const uint32_t LOG_HEADER_SIZE = 512;         // Header is padded to one sector
+const uint32_t LOG_BLOCK_SIZE = 8192;         // Every block is 16 sectors
+const int LOG_CHANNELS = 4;
+const int LOG_GAIN_POINTS = 4;                // Breakpoints in the gain correction table
+const int LOG_PROFILE_TEXT = 128;             // P&H segment table as text, NUL terminated
+
+enum LogBlockType {
+  LOG_BLOCK_SAMPLES = 1,  // LogSampleRecord[recordCount]
+  LOG_BLOCK_WINDOW = 2,   // Version 5+: one LogWindowInfo, the window's samples follow in the next sample blocks
+  LOG_BLOCK_PACKED = 3,   // Version 7+: LogChunkHeader and its payload, repeated until payloadBytes
+};
+
+enum LogCompression {
+  LOG_COMPRESSION_NONE = 0,
+  LOG_COMPRESSION_RICE = 1,  // Sample blocks are packed as chunks coded by log_codec.h
+};
+
+// Injector drive states, bit n = injector n+1
+const uint8_t LOG_MASK_DRIVE = 0x0F;
+// Shot gates, bit n+4 set from the first to the last edge of a shot on injector n+1 (covers P&H off periods)
+const uint8_t LOG_MASK_SHOT = 0xF0;
+
+// Record kinds in the low bits of LogSampleRecord.flags, version 6+. Adaptive logs keep samples near
+// edges and replace each steady run of header.decimation samples with a mean, min and max record,
+// all stamped with the run's first timestamp. The injector mask of those is the OR over the run.
+const uint8_t LOG_FLAG_KIND = 0x03;
+enum LogRecordKind {
+  LOG_RECORD_SAMPLE = 0,  // One acquired sample
+  LOG_RECORD_MEAN = 1,
+  LOG_RECORD_MIN = 2,
+  LOG_RECORD_MAX = 3,
+};
+
+struct __attribute__((packed)) LogFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;              // Offset of the first block
+  uint32_t blockSize;
+  uint32_t sampleIntervalNs;        // Nominal acquisition period
+  uint8_t adcBits;                  // Resolution of the raw codes
+  uint8_t channelCount;
+  uint16_t reserved0;
+  float adcReferenceVolts;          // ADC full scale
+  float sensorZeroVolts;            // ACS712 output at zero current
+  float sensorVoltsPerAmp;          // ACS712 sensitivity
+  float offsetVolts[LOG_CHANNELS];  // Per-channel zero calibration at start of log
+  uint32_t pulseWidthUs;
+  uint32_t peakTimeUs;
+  uint32_t holdTimeUs;
+  uint32_t holdPeriodUs;
+  uint32_t holdOnUs;
+  uint32_t startMillis;             // millis() when the log was opened
+  float gainPointAmps[LOG_GAIN_POINTS];             // Version 2+: ascending breakpoints (A)
+  float gain[LOG_CHANNELS][LOG_GAIN_POINTS];        // Version 2+: gain at each breakpoint
+  char peakHoldProfile[LOG_PROFILE_TEXT];           // Version 3+: e.g. "ON 2000;PWM 1800 2000 50"
+  float supplyDividerRatio;                         // Version 4+: supply volts per volt at the ADC pin
+  uint16_t decimation;                              // Version 6+: samples per mean/min/max record, 0 if none
+  uint16_t compression;                             // Version 7+: LogCompression
+  uint32_t fullRateHoldUs;                          // Version 6+: full rate kept this long after an edge
+};
+
+struct __attribute__((packed)) LogBlockHeader {
+  uint32_t magic;
+  uint16_t type;
+  uint16_t recordCount;
+  uint32_t sequence;       // Increments per block, a gap means blocks were dropped
+  uint32_t payloadBytes;   // Valid bytes after this header
+};
+
+struct __attribute__((packed)) LogSampleRecord {
+  uint32_t timestamp;           // micros()
+  uint16_t adc[LOG_CHANNELS];   // Raw ADC codes
+  uint8_t injectorMask;         // LOG_MASK_DRIVE bits
+  uint8_t flags;                // Version 6+: LOG_FLAG_KIND, 0 before
+  uint16_t aux;                 // Version 4+: raw ADC code of the supply divider, 0 before
+};
+
+// Capture mode saves only the samples around shots. Each window is a LOG_BLOCK_WINDOW block
+// followed by sample blocks holding recordCount records, the last one may be partial. If the
+// capture ring lapped the window while it was being written, the next window block (or the
+// end of the file) comes before all recordCount records did.
+struct __attribute__((packed)) LogWindowInfo {
+  uint32_t window;             // Index within the file, from 0
+  uint32_t triggerTimestamp;   // micros() of the first sample inside a shot
+  uint32_t recordCount;        // Sample records that follow
+  uint32_t preTriggerRecords;  // Records before the trigger sample
+  uint32_t postTriggerUs;      // Configured hold-off after the last shot ended
+  uint16_t shots;              // Shots that started inside the window
+  uint8_t triggerMask;         // Injectors with a shot in the window, bit n = injector n+1
+  uint8_t truncated;           // 1 if the window hit the length limit before its shots ended
+  uint32_t shotSequence;       // Shots started since logging began, before this window's first
+  uint32_t droppedRecords;     // Overwritten in the capture ring before they could be written
+};
+
+// One block as it was queued by the acquisition side. A LOG_BLOCK_SAMPLES chunk holds its records
+// compressed, a LOG_BLOCK_WINDOW chunk the window info as is. A block whose records don't compress
+// into one packed block is written unpacked instead.
+struct __attribute__((packed)) LogChunkHeader {
+  uint16_t type;           // LogBlockType of the original block
+  uint16_t recordCount;
+  uint32_t sequence;       // Sequence number of the original block
+  uint32_t bytes;          // Payload after this header
+};
+
+const int LOG_SAMPLE_BLOCK_RECORDS = (LOG_BLOCK_SIZE - sizeof(LogBlockHeader)) / sizeof(LogSampleRecord);
+
+struct __attribute__((packed)) LogSampleBlock {
+  LogBlockHeader header;
+  LogSampleRecord records[LOG_SAMPLE_BLOCK_RECORDS];
+};
+
+// Log store. LOG_INDEX_FILE holds one LogRunEntry per log, run n (from 1) at (n - 1) *
+// LOG_RUN_ENTRY_SIZE, so listing the card is one sequential read and any run is one seek.
+// Every .BIN log opened with a store also gets a shot table, the log's name with a .SHT
+// extension: one LogShotEntry per shot start, shot k (from 1) at (k - 1) * sizeof(LogShotEntry).
+const char *const LOG_INDEX_FILE = "LOGINDEX.BIN";
+const uint32_t LOG_RUN_MAGIC = 0x4E555246;    // "FRUN"
+const uint32_t LOG_RUN_ENTRY_SIZE = 512;      // Entries are padded to one sector
+const int LOG_NAME_SIZE = 32;                 // CURRENT_LOG_<millis>.BIN plus terminator
+
+enum LogRunState {
+  LOG_RUN_OPEN = 1,        // Still being written, or the device lost power first
+  LOG_RUN_CLOSED = 2,      // Totals and shot table complete
+  LOG_RUN_IMPORTED = 3,    // Found on the card when the index was built, no totals or shot table
+  LOG_RUN_INCOMPLETE = 4,  // Was open at power up - size and shot count recovered from the files
+};
+
+struct __attribute__((packed)) LogRunEntry {
+  uint32_t magic;
+  uint32_t run;                // Position in the index, from 1
+  uint8_t state;               // LogRunState
+  uint8_t logMode;             // 0 continuous, 1 capture, 2 adaptive
+  uint16_t reserved;
+  char name[LOG_NAME_SIZE];    // Log file in the card root
+  uint32_t fileBytes;
+  uint32_t recordCount;        // Records written, every kind
+  uint32_t firstTimestamp;     // micros() of the first and last record
+  uint32_t lastTimestamp;
+  uint32_t shotCount;          // Entries in the shot table
+  uint32_t droppedBlocks;
+  uint32_t durationMs;         // Logging on to logging off
+  LogFileHeader header;        // Copy of the log's header - parameters and calibration
+};
+
+// Where a shot's first gated record is. In a packed log blockOffset is the packed block and chunk
+// counts the chunks before the one holding the record, in an unpacked log chunk is 0.
+struct __attribute__((packed)) LogShotEntry {
+  uint32_t blockOffset;        // File offset of the block
+  uint16_t chunk;
+  uint16_t record;             // Index within the chunk's (or block's) records
+  uint32_t timestamp;          // micros() of the record
+  uint8_t injector;            // 1-4
+  uint8_t reserved[3];
+};
+
+// Summary pyramid. Alongside a .BIN log (and its .SHT), <name>.PY1, .PY2 and .PY3 hold one
+// LogSummaryEntry per LOG_SUMMARY_FACTOR, LOG_SUMMARY_FACTOR^2 and LOG_SUMMARY_FACTOR^3
+// records, entry i of a level at i * sizeof(LogSummaryEntry). Entries are in time order, the
+// last one of each level may cover fewer records. Samples and mean records count towards an
+// entry and its mean; the min and max records of adaptive logs only widen its range.
+const int LOG_SUMMARY_LEVELS = 3;
+const uint32_t LOG_SUMMARY_FACTOR = 64;       // 64x, 4096x, 262144x
+
+struct __attribute__((packed)) LogSummaryEntry {
+  uint32_t timestamp;          // micros() of the first record
+  uint32_t records;            // Records covered
+  uint16_t min[LOG_CHANNELS];  // Raw ADC codes
+  uint16_t max[LOG_CHANNELS];
+  uint16_t mean[LOG_CHANNELS];
+  uint8_t injectorMask;        // OR over the records
+  uint8_t reserved[3];
+};
+
+static_assert(sizeof(LogFileHeader) <= LOG_HEADER_SIZE, "Log header must fit in one sector");
+static_assert(sizeof(LogSampleRecord) == 16, "Sample records must stay 16 bytes");
+static_assert(sizeof(LogSampleBlock) == LOG_BLOCK_SIZE, "Sample blocks must fill the block exactly");
+static_assert(sizeof(LogRunEntry) <= LOG_RUN_ENTRY_SIZE, "Run entries must fit in one sector");
+static_assert(sizeof(LogShotEntry) == 16, "Shot entries must stay 16 bytes, 32 to a sector");
+static_assert(sizeof(LogSummaryEntry) == 36, "Summary entries must stay 36 bytes");
+
+// Convert a raw code to amps using the calibration captured in the header
+// Gain interpolated linearly between breakpoints, held flat outside them
+inline float logGainAt(const LogFileHeader &header, int channel, float amps) {
+  if (header.version < 2) return 1.0f;
+  if (amps <= header.gainPointAmps[0]) return header.gain[channel][0];
+  for (int i = 1; i < LOG_GAIN_POINTS; i++) {
+    if (amps <= header.gainPointAmps[i]) {
+      float t = (amps - header.gainPointAmps[i - 1]) / (header.gainPointAmps[i] - header.gainPointAmps[i - 1]);
+      return header.gain[channel][i - 1] + t * (header.gain[channel][i] - header.gain[channel][i - 1]);
+    }
+  }
+  return header.gain[channel][LOG_GAIN_POINTS - 1];
+}
+
+inline float logCodeToCurrent(const LogFileHeader &header, int channel, uint16_t code) {
+  float volts = code * header.adcReferenceVolts / (1 << header.adcBits);
+  float amps = (volts - header.sensorZeroVolts - header.offsetVolts[channel]) / header.sensorVoltsPerAmp;
+  if (amps <= 0) return 0;
+  return amps * logGainAt(header, channel, amps);
+}
+
+// Supply voltage of a version 4+ record, 0 for older logs
+inline float logCodeToSupplyVolts(const LogFileHeader &header, uint16_t code) {
+  if (header.version < 4) return 0;
+  return code * header.adcReferenceVolts / (1 << header.adcBits) * header.supplyDividerRatio;
+}
+
+#endif
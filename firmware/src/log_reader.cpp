@@ -0,0 +1,55 @@
+#include "log_reader.h"
+#include "log_codec.h"
+
+static LogSampleBlock block;
+static LogSampleRecord unpacked[LOG_SAMPLE_BLOCK_RECORDS];
+static bool inPacked = false;
+static uint32_t chunkOffset = 0;  // Next chunk header within the packed block's payload
+static uint16_t pendingSkip = 0;  // For the first block read after logReaderStart()
+static uint16_t skipChunks = 0;
+
+void logReaderStart(File &file, uint32_t blockOffset, uint16_t skip) {
+  file.seek(blockOffset);
+  inPacked = false;
+  chunkOffset = 0;
+  pendingSkip = skip;
+}
+
+bool logReaderNext(File &file, const LogSampleRecord *&records, int &count) {
+  while (true) {
+    // Rest of the packed block, one chunk per original block
+    const uint8_t *payload = (const uint8_t *)block.records;
+    while (inPacked && chunkOffset + sizeof(LogChunkHeader) <= block.header.payloadBytes) {
+      LogChunkHeader chunk;
+      memcpy(&chunk, payload + chunkOffset, sizeof(chunk));
+      uint32_t data = chunkOffset + sizeof(chunk);
+      if (data + chunk.bytes > block.header.payloadBytes) break;
+      chunkOffset = data + chunk.bytes;
+      if (skipChunks > 0) {
+        skipChunks--;
+        continue;
+      }
+      if (chunk.type == LOG_BLOCK_SAMPLES && chunk.recordCount <= LOG_SAMPLE_BLOCK_RECORDS &&
+          logDecompressRecords(payload + data, chunk.bytes, unpacked, chunk.recordCount)) {
+        records = unpacked;
+        count = chunk.recordCount;
+        return true;
+      }
+    }
+    inPacked = false;
+
+    if (file.read(&block, sizeof(block)) != sizeof(block)) return false;
+    skipChunks = pendingSkip;
+    pendingSkip = 0;
+    if (block.header.magic != LOG_BLOCK_MAGIC) continue;
+    if (block.header.type == LOG_BLOCK_SAMPLES) {
+      records = block.records;
+      count = block.header.recordCount;
+      return true;
+    }
+    if (block.header.type == LOG_BLOCK_PACKED) {
+      inPacked = true;
+      chunkOffset = 0;
+    }
+  }
+}
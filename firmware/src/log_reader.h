@@ -0,0 +1,19 @@
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "log_format.h"
+
+// Reads the sample records of a .BIN log back in file order, a source block at a time. Packed
+// chunks are decompressed, window and other non-sample blocks are skipped. One reader at a time,
+// the buffers are static.
+
+// Start at a block boundary, skipping skip chunks of the first block if it is packed - the way
+// a LogShotEntry locates its record.
+void logReaderStart(File &file, uint32_t blockOffset, uint16_t skip = 0);
+
+// Next source block's records, false at the end of the file
+bool logReaderNext(File &file, const LogSampleRecord *&records, int &count);
+
+#endif
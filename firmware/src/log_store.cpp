@@ -0,0 +1,134 @@
+#include "log_store.h"
+
+static File indexFile;
+static bool ready = false;
+static uint32_t runCount = 0;
+
+static bool isLogName(const char *name) {
+  size_t length = strlen(name);
+  if (strncmp(name, "CURRENT_LOG_", 12) != 0 || length < 4 || length >= (size_t)LOG_NAME_SIZE) return false;
+  return strcasecmp(name + length - 4, ".BIN") == 0 || strcasecmp(name + length - 4, ".CSV") == 0;
+}
+
+// Entries are written a whole sector at a time, the tail after the struct zeroed
+static bool writeEntry(const LogRunEntry &entry) {
+  uint8_t sector[LOG_RUN_ENTRY_SIZE];
+  memset(sector, 0, sizeof(sector));
+  memcpy(sector, &entry, sizeof(entry));
+  if (!indexFile.seek((uint64_t)(entry.run - 1) * LOG_RUN_ENTRY_SIZE)) return false;
+  if (indexFile.write(sector, sizeof(sector)) != sizeof(sector)) return false;
+  indexFile.flush();
+  return true;
+}
+
+// Add every log already on the card, in directory order
+static void importLogs() {
+  File root = SD.open("/");
+  if (!root) return;
+  while (true) {
+    File file = root.openNextFile();
+    if (!file) break;
+    const char *name = file.name();
+    if (!file.isDirectory() && isLogName(name)) {
+      LogRunEntry entry;
+      memset(&entry, 0, sizeof(entry));
+      entry.magic = LOG_RUN_MAGIC;
+      entry.run = runCount + 1;
+      entry.state = LOG_RUN_IMPORTED;
+      strcpy(entry.name, name);
+      entry.fileBytes = file.size();
+      // Binary logs keep their parameters, CSV logs have none to offer
+      LogFileHeader header;
+      if (file.read(&header, sizeof(header)) == sizeof(header) && header.magic == LOG_FILE_MAGIC) {
+        entry.header = header;
+      }
+      if (writeEntry(entry)) runCount++;
+    }
+    file.close();
+  }
+  root.close();
+}
+
+// A run still open at power up lost its closing write - take what the files show
+static void recoverLastRun() {
+  LogRunEntry entry;
+  if (runCount == 0 || !logStoreReadRun(runCount, entry) || entry.state != LOG_RUN_OPEN) return;
+  File log = SD.open(entry.name);
+  if (log) {
+    entry.fileBytes = log.size();
+    log.close();
+  }
+  char shotName[LOG_NAME_SIZE];
+  logStoreShotTableName(entry.name, shotName, sizeof(shotName));
+  File shots = SD.open(shotName);
+  if (shots) {
+    entry.shotCount = shots.size() / sizeof(LogShotEntry);
+    shots.close();
+  }
+  entry.state = LOG_RUN_INCOMPLETE;
+  writeEntry(entry);
+}
+
+bool logStoreBegin() {
+  if (ready) indexFile.close();
+  ready = false;
+  runCount = 0;
+  bool exists = SD.exists(LOG_INDEX_FILE);
+  indexFile = SD.open(LOG_INDEX_FILE, FILE_WRITE_BEGIN);
+  if (!indexFile) return false;
+  ready = true;
+  if (exists) {
+    runCount = indexFile.size() / LOG_RUN_ENTRY_SIZE;
+    recoverLastRun();
+  } else {
+    importLogs();
+  }
+  return true;
+}
+
+uint32_t logStoreRunCount() {
+  return runCount;
+}
+
+uint32_t logStoreOpenRun(const char *name, const LogFileHeader &header, uint8_t logMode) {
+  if (!ready || strlen(name) >= (size_t)LOG_NAME_SIZE) return 0;
+  LogRunEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.magic = LOG_RUN_MAGIC;
+  entry.run = runCount + 1;
+  entry.state = LOG_RUN_OPEN;
+  entry.logMode = logMode;
+  strcpy(entry.name, name);
+  entry.header = header;
+  if (!writeEntry(entry)) return 0;
+  return ++runCount;
+}
+
+bool logStoreReadRun(uint32_t run, LogRunEntry &entry) {
+  if (!ready || run == 0 || run > runCount) return false;
+  if (!indexFile.seek((uint64_t)(run - 1) * LOG_RUN_ENTRY_SIZE)) return false;
+  return indexFile.read(&entry, sizeof(entry)) == sizeof(entry) && entry.magic == LOG_RUN_MAGIC;
+}
+
+bool logStoreWriteRun(const LogRunEntry &entry) {
+  if (!ready || entry.run == 0 || entry.run > runCount) return false;
+  return writeEntry(entry);
+}
+
+void logStoreShotTableName(const char *logName, char *out, size_t size) {
+  snprintf(out, size, "%s", logName);
+  char *dot = strrchr(out, '.');
+  if (dot && (size_t)(dot - out) + 4 < size) strcpy(dot, ".SHT");
+}
+
+bool logStoreReadShot(const LogRunEntry &entry, uint32_t shot, LogShotEntry &out) {
+  if (shot == 0 || shot > entry.shotCount) return false;
+  char shotName[LOG_NAME_SIZE];
+  logStoreShotTableName(entry.name, shotName, sizeof(shotName));
+  File shots = SD.open(shotName);
+  if (!shots) return false;
+  bool found = shots.seek((uint64_t)(shot - 1) * sizeof(LogShotEntry)) &&
+               shots.read(&out, sizeof(out)) == sizeof(out);
+  shots.close();
+  return found;
+}
@@ -0,0 +1,34 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "log_format.h"
+
+// Index of the logs on the SD card (LOG_INDEX_FILE, see log_format.h).
+//
+// Every log gets a LogRunEntry when it is opened and again when it is closed, with its run
+// parameters, calibration, totals and time span. Listing the card reads the index instead of
+// walking the directory, and run n or shot k of it are found with one seek each. A card without
+// an index gets one built from the logs already on it, once, at power up.
+
+// Open the index, building it if the card has none and recovering a run left open by a power
+// loss. Returns false if the index can't be opened or created.
+bool logStoreBegin();
+
+uint32_t logStoreRunCount();
+
+// Add an open entry for a new log, returns its run number or 0 on failure
+uint32_t logStoreOpenRun(const char *name, const LogFileHeader &header, uint8_t logMode);
+
+// Read or rewrite run entry.run (from 1)
+bool logStoreReadRun(uint32_t run, LogRunEntry &entry);
+bool logStoreWriteRun(const LogRunEntry &entry);
+
+// Shot table file name for a log, the log's name with a .SHT extension
+void logStoreShotTableName(const char *logName, char *out, size_t size);
+
+// Read shot (from 1) of a closed or recovered run
+bool logStoreReadShot(const LogRunEntry &entry, uint32_t shot, LogShotEntry &out);
+
+#endif
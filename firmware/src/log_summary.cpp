@@ -0,0 +1,208 @@
+#include "log_summary.h"
+
+// One level's entry being accumulated, wide enough for a full level 3 entry
+struct SummaryAccumulator {
+  uint32_t timestamp;
+  uint32_t children;  // Samples and means (level 1) or entries of the level below folded in
+  uint32_t weight;    // Samples and means under the entry, the divisor of its mean
+  uint32_t covered;   // Every record under the entry
+  uint16_t min[LOG_CHANNELS];
+  uint16_t max[LOG_CHANNELS];
+  uint64_t sum[LOG_CHANNELS];
+  uint8_t mask;
+};
+
+static File *levelFiles[LOG_SUMMARY_LEVELS];
+static SummaryAccumulator levels[LOG_SUMMARY_LEVELS];
+static LogSummaryEntry buffers[LOG_SUMMARY_LEVELS][LOG_SUMMARY_BUFFER_ENTRIES];
+static int buffered[LOG_SUMMARY_LEVELS];
+static bool active = false;
+
+static void resetLevel(SummaryAccumulator &level) {
+  memset(&level, 0, sizeof(level));
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) level.min[ch] = 0xFFFF;
+}
+
+static void flushLevel(int index) {
+  if (levelFiles[index] && buffered[index] > 0) {
+    levelFiles[index]->write((const uint8_t *)buffers[index], buffered[index] * sizeof(LogSummaryEntry));
+  }
+  buffered[index] = 0;
+}
+
+static void emitLevel(int index);
+
+// Fold a finished entry of the level below in, closing this level's entry first if it is full
+static void foldEntry(int index, const LogSummaryEntry &entry, uint32_t weight) {
+  SummaryAccumulator &level = levels[index];
+  if (level.children == LOG_SUMMARY_FACTOR) emitLevel(index);
+  if (level.covered == 0) level.timestamp = entry.timestamp;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    if (entry.min[ch] < level.min[ch]) level.min[ch] = entry.min[ch];
+    if (entry.max[ch] > level.max[ch]) level.max[ch] = entry.max[ch];
+    level.sum[ch] += (uint64_t)entry.mean[ch] * weight;
+  }
+  level.mask |= entry.injectorMask;
+  level.children++;
+  level.weight += weight;
+  level.covered += entry.records;
+}
+
+// Write out a level's entry and pass it up to the next level
+static void emitLevel(int index) {
+  SummaryAccumulator &level = levels[index];
+  if (level.covered == 0) return;
+  LogSummaryEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.timestamp = level.timestamp;
+  entry.records = level.covered;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    entry.min[ch] = level.min[ch];
+    entry.max[ch] = level.max[ch];
+    // An entry of only min and max records has no mean of its own
+    entry.mean[ch] = level.weight ? (level.sum[ch] + level.weight / 2) / level.weight
+                                  : (level.min[ch] + level.max[ch]) / 2;
+  }
+  entry.injectorMask = level.mask;
+  uint32_t weight = level.weight;
+  resetLevel(level);
+
+  buffers[index][buffered[index]++] = entry;
+  if (buffered[index] == LOG_SUMMARY_BUFFER_ENTRIES) flushLevel(index);
+  if (index + 1 < LOG_SUMMARY_LEVELS) foldEntry(index + 1, entry, weight);
+}
+
+void logSummaryFileName(const char *logName, int level, char *out, size_t size) {
+  snprintf(out, size, "%s", logName);
+  char *dot = strrchr(out, '.');
+  if (dot && (size_t)(dot - out) + 4 < size) snprintf(dot, 5, ".PY%d", level);
+}
+
+void logSummaryStart(File *files[LOG_SUMMARY_LEVELS]) {
+  for (int i = 0; i < LOG_SUMMARY_LEVELS; i++) {
+    levelFiles[i] = files[i];
+    resetLevel(levels[i]);
+    buffered[i] = 0;
+  }
+  active = true;
+}
+
+void logSummaryAdd(const LogSampleRecord *records, int count) {
+  if (!active) return;
+  SummaryAccumulator &level = levels[0];
+  for (int i = 0; i < count; i++) {
+    const LogSampleRecord &record = records[i];
+    uint8_t kind = record.flags & LOG_FLAG_KIND;
+    bool value = kind == LOG_RECORD_SAMPLE || kind == LOG_RECORD_MEAN;
+    // Closed lazily, so an adaptive run's min and max records stay with its mean
+    if (value && level.children == LOG_SUMMARY_FACTOR) emitLevel(0);
+    if (level.covered == 0) level.timestamp = record.timestamp;
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      uint16_t code = record.adc[ch];
+      if (kind != LOG_RECORD_MAX && code < level.min[ch]) level.min[ch] = code;
+      if (kind != LOG_RECORD_MIN && code > level.max[ch]) level.max[ch] = code;
+      if (value) level.sum[ch] += code;
+    }
+    level.mask |= record.injectorMask;
+    level.covered++;
+    if (value) {
+      level.children++;
+      level.weight++;
+    }
+  }
+}
+
+void logSummaryStop() {
+  if (!active) return;
+  // Finest first, each partial entry is folded into the level above before that one closes
+  for (int i = 0; i < LOG_SUMMARY_LEVELS; i++) {
+    emitLevel(i);
+    flushLevel(i);
+    if (levelFiles[i]) levelFiles[i]->flush();
+  }
+  active = false;
+}
+
+// Index of the first entry at or after us (relative to first), entries are in time order
+static uint32_t findEntry(File &file, uint32_t entries, uint32_t first, uint32_t us) {
+  uint32_t lo = 0;
+  uint32_t hi = entries;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    LogSummaryEntry entry;
+    if (!file.seek((uint64_t)mid * sizeof(entry)) || file.read(&entry, sizeof(entry)) != sizeof(entry)) break;
+    if (entry.timestamp - first < us) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+int logSummaryQuery(const char *logName, uint32_t firstTimestamp, uint32_t fromUs, uint32_t toUs,
+                    LogSummaryEntry *out, int maxPoints, int &level) {
+  level = -1;
+  if (maxPoints <= 0 || toUs <= fromUs) return 0;
+  char name[LOG_NAME_SIZE + 4];
+  File file;
+  uint32_t start = 0;
+  uint32_t end = 0;
+  for (int i = 1; i <= LOG_SUMMARY_LEVELS; i++) {
+    logSummaryFileName(logName, i, name, sizeof(name));
+    File candidate = SD.open(name);
+    if (!candidate) continue;
+    uint32_t entries = candidate.size() / sizeof(LogSummaryEntry);
+    // The entry before the range start still covers part of it
+    uint32_t first = findEntry(candidate, entries, firstTimestamp, fromUs);
+    if (first > 0) first--;
+    uint32_t last = findEntry(candidate, entries, firstTimestamp, toUs);
+    if (file) file.close();
+    file = candidate;
+    start = first;
+    end = last;
+    level = i;
+    if (last - first <= (uint32_t)maxPoints * LOG_SUMMARY_READ_FACTOR) break;
+  }
+  if (level < 0) return 0;
+
+  // Merge runs of entries into points, reading a buffer at a time
+  uint32_t total = end - start;
+  uint32_t group = (total + maxPoints - 1) / maxPoints;
+  int points = 0;
+  SummaryAccumulator merged;
+  resetLevel(merged);
+  file.seek((uint64_t)start * sizeof(LogSummaryEntry));
+  LogSummaryEntry chunk[LOG_SUMMARY_BUFFER_ENTRIES];
+  for (uint32_t done = 0; done < total;) {
+    uint32_t want = min(total - done, (uint32_t)LOG_SUMMARY_BUFFER_ENTRIES);
+    int got = file.read(chunk, want * sizeof(LogSummaryEntry)) / (int)sizeof(LogSummaryEntry);
+    if (got <= 0) break;
+    for (int i = 0; i < got; i++, done++) {
+      const LogSummaryEntry &entry = chunk[i];
+      if (merged.covered == 0) merged.timestamp = entry.timestamp;
+      for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+        if (entry.min[ch] < merged.min[ch]) merged.min[ch] = entry.min[ch];
+        if (entry.max[ch] > merged.max[ch]) merged.max[ch] = entry.max[ch];
+        merged.sum[ch] += (uint64_t)entry.mean[ch] * entry.records;
+      }
+      merged.mask |= entry.injectorMask;
+      merged.covered += entry.records;
+      if (++merged.children < group && done + 1 < total) continue;
+
+      LogSummaryEntry &point = out[points++];
+      memset(&point, 0, sizeof(point));
+      point.timestamp = merged.timestamp;
+      point.records = merged.covered;
+      for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+        point.min[ch] = merged.min[ch];
+        point.max[ch] = merged.max[ch];
+        point.mean[ch] = (merged.sum[ch] + merged.covered / 2) / merged.covered;
+      }
+      point.injectorMask = merged.mask;
+      resetLevel(merged);
+    }
+  }
+  file.close();
+  return points;
+}
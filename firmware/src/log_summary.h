@@ -0,0 +1,39 @@
+#ifndef LOG_SUMMARY_H
+#define LOG_SUMMARY_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "log_format.h"
+
+// Min/max/mean summary pyramid of a log, kept up as its blocks are written (see log_format.h).
+//
+// The log writer feeds every block it writes through logSummaryAdd() from its idle-time service,
+// so the pyramid costs the sampling path nothing. Each level folds LOG_SUMMARY_FACTOR entries of
+// the one below, and entries go to their level's file a buffer at a time. A client asking for an
+// overview reads the coarsest level that still gives it enough points, from a binary searched
+// start, instead of every record in the range.
+
+// Summary Configuration
+const int LOG_SUMMARY_BUFFER_ENTRIES = 32;  // Entries buffered per level before a write
+const int LOG_SUMMARY_READ_FACTOR = 16;     // A level is used if it has at most this many entries per point
+
+// Level file name for a log, level 1 to LOG_SUMMARY_LEVELS
+void logSummaryFileName(const char *logName, int level, char *out, size_t size);
+
+// Start a pyramid, levels[i] receives level i + 1. Files may be null (that level is not kept).
+void logSummaryStart(File *levels[LOG_SUMMARY_LEVELS]);
+
+// Writer side - fold one written block's records in
+void logSummaryAdd(const LogSampleRecord *records, int count);
+
+// Write the partial entries of every level and stop
+void logSummaryStop();
+
+// Overview of [fromUs, toUs) of a log, in µs from firstTimestamp (its first record). Picks the
+// finest level with no more than LOG_SUMMARY_READ_FACTOR entries per point in the range and merges
+// them into at most maxPoints. Returns the points written to out, level is set to the level used,
+// or -1 if the log has no pyramid.
+int logSummaryQuery(const char *logName, uint32_t firstTimestamp, uint32_t fromUs, uint32_t toUs,
+                    LogSummaryEntry *out, int maxPoints, int &level);
+
+#endif
@@ -0,0 +1,313 @@
+#include "log_writer.h"
+#include "log_codec.h"
+#include "log_summary.h"
+#include "perf_probe.h"
+
+// Blocks are written straight from RAM2, so they are aligned for the SD DMA engine
+DMAMEM static LogSampleBlock logBlocks[LOG_BUFFER_COUNT] __attribute__((aligned(32)));
+
+// Packed output block being filled with compressed chunks, and one chunk's worth of scratch
+DMAMEM static LogSampleBlock packBlock __attribute__((aligned(32)));
+static uint8_t chunkScratch[LOG_BLOCK_SIZE - sizeof(LogBlockHeader)];
+static bool packing = false;
+static uint32_t packBytes = 0;
+static uint64_t sourceBytes = 0;
+
+static File *logFile = nullptr;
+
+// Shot table, filled as blocks are written and flushed a sector at a time
+static File *shotFile = nullptr;
+const int SHOT_BUFFER_ENTRIES = 32;  // One sector
+static LogShotEntry shotBuffer[SHOT_BUFFER_ENTRIES];
+static int shotBuffered = 0;
+static uint32_t shotCount = 0;
+static uint8_t lastMask = 0;
+static uint32_t recordCount = 0;
+static uint32_t firstTimestamp = 0;
+static uint32_t lastTimestamp = 0;
+
+// File offset of the packed block being filled and the chunks already in it
+static uint32_t packOffset = 0;
+static uint16_t packChunks = 0;
+
+// Blocks are used round-robin: fillIndex is being filled, the ones behind it are queued
+static int fillIndex = 0;
+static int writeIndex = 0;
+static int queuedBuffers = 0;
+static uint32_t blockSequence = 0;
+
+static uint32_t droppedBuffers = 0;
+static uint64_t bytesWritten = 0;
+static uint64_t writeMicros = 0;
+
+static void resetBlock(LogSampleBlock &block) {
+  block.header.magic = LOG_BLOCK_MAGIC;
+  block.header.type = LOG_BLOCK_SAMPLES;
+  block.header.recordCount = 0;
+  block.header.sequence = blockSequence++;
+  block.header.payloadBytes = 0;
+}
+
+static void writeBytes(const void *data, size_t length) {
+  PERF_SCOPE(PERF_SD_WRITE);
+  unsigned long start = micros();
+  logFile->write((const uint8_t *)data, length);
+  writeMicros += micros() - start;
+  bytesWritten += length;
+}
+
+void logWriterStart(File *file, const LogFileHeader &header, File *shots) {
+  logFile = file;
+  shotFile = shots;
+  shotBuffered = 0;
+  shotCount = 0;
+  lastMask = 0;
+  recordCount = 0;
+  firstTimestamp = 0;
+  lastTimestamp = 0;
+  fillIndex = 0;
+  writeIndex = 0;
+  queuedBuffers = 0;
+  blockSequence = 0;
+  droppedBuffers = 0;
+  bytesWritten = 0;
+  writeMicros = 0;
+  sourceBytes = 0;
+  packing = header.version >= 7 && header.compression == LOG_COMPRESSION_RICE;
+  packBytes = 0;
+  resetBlock(logBlocks[fillIndex]);
+
+  // Header is padded to a full sector so every block that follows is sector aligned
+  uint8_t sector[LOG_HEADER_SIZE];
+  memset(sector, 0, sizeof(sector));
+  memcpy(sector, &header, sizeof(header));
+  writeBytes(sector, sizeof(sector));
+  logFile->flush();
+}
+
+void logWriterMakeRecord(const RawSample &sample, LogSampleRecord &record) {
+  record.timestamp = sample.timestamp;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    record.adc[ch] = sample.adc[ch];
+  }
+  record.injectorMask = sample.injectorMask;
+  record.flags = 0;
+  record.aux = sample.supply;
+}
+
+// Hand the filling block to the writer and start the next one, if a free one is waiting behind it
+static void queueBlock() {
+  if (queuedBuffers < LOG_BUFFER_COUNT - 1) {
+    queuedBuffers++;
+    fillIndex = (fillIndex + 1) % LOG_BUFFER_COUNT;
+  } else {
+    // Writer has fallen behind - discard this block rather than stall acquisition,
+    // the skipped sequence number marks the gap in the file
+    droppedBuffers++;
+  }
+  resetBlock(logBlocks[fillIndex]);
+}
+
+void logWriterAppend(const RawSample &sample) {
+  LogSampleRecord record;
+  logWriterMakeRecord(sample, record);
+  logWriterAppendRecord(record);
+}
+
+void logWriterAppendRecord(const LogSampleRecord &record) {
+  LogSampleBlock &block = logBlocks[fillIndex];
+  block.records[block.header.recordCount++] = record;
+  if (block.header.recordCount < LOG_SAMPLE_BLOCK_RECORDS) return;
+  block.header.payloadBytes = block.header.recordCount * sizeof(LogSampleRecord);
+  queueBlock();
+}
+
+void logWriterAppendWindow(const LogWindowInfo &window) {
+  // A window's samples never share a block with the previous window's
+  LogSampleBlock &partial = logBlocks[fillIndex];
+  if (partial.header.recordCount > 0) {
+    partial.header.payloadBytes = partial.header.recordCount * sizeof(LogSampleRecord);
+    memset(&partial.records[partial.header.recordCount], 0,
+           (LOG_SAMPLE_BLOCK_RECORDS - partial.header.recordCount) * sizeof(LogSampleRecord));
+    queueBlock();
+  }
+
+  // Same block buffer, the payload is the window info instead of records
+  LogSampleBlock &block = logBlocks[fillIndex];
+  block.header.type = LOG_BLOCK_WINDOW;
+  block.header.payloadBytes = sizeof(window);
+  memset(block.records, 0, sizeof(block.records));
+  memcpy(block.records, &window, sizeof(window));
+  queueBlock();
+}
+
+int logWriterFreeBuffers() {
+  return LOG_BUFFER_COUNT - 1 - queuedBuffers;
+}
+
+// Write the packed block, unused tail zeroed
+static void writePackBlock() {
+  if (packBytes == 0) return;
+  packBlock.header.payloadBytes = packBytes;
+  memset((uint8_t *)packBlock.records + packBytes, 0, sizeof(packBlock.records) - packBytes);
+  writeBytes(&packBlock, LOG_BLOCK_SIZE);
+  packBytes = 0;
+}
+
+static void flushShots() {
+  if (!shotFile || shotBuffered == 0) return;
+  shotFile->write((const uint8_t *)shotBuffer, shotBuffered * sizeof(LogShotEntry));
+  shotBuffered = 0;
+}
+
+// Count a written block's records, fold them into the summary pyramid and add its shot starts to
+// the table - a shot starts where a record's shot gate bit is set and the previous record's wasn't
+static void indexBlock(const LogSampleBlock &block, uint32_t offset, uint16_t chunk) {
+  if (block.header.type != LOG_BLOCK_SAMPLES) return;
+  logSummaryAdd(block.records, block.header.recordCount);
+  for (int i = 0; i < block.header.recordCount; i++) {
+    const LogSampleRecord &record = block.records[i];
+    if (recordCount++ == 0) firstTimestamp = record.timestamp;
+    lastTimestamp = record.timestamp;
+    uint8_t started = record.injectorMask & ~lastMask & LOG_MASK_SHOT;
+    lastMask = record.injectorMask;
+    for (int ch = 0; started && ch < LOG_CHANNELS; ch++) {
+      if (!(started & (0x10 << ch))) continue;
+      shotCount++;
+      if (!shotFile) continue;
+      LogShotEntry &entry = shotBuffer[shotBuffered++];
+      memset(&entry, 0, sizeof(entry));
+      entry.blockOffset = offset;
+      entry.chunk = chunk;
+      entry.record = i;
+      entry.timestamp = record.timestamp;
+      entry.injector = ch + 1;
+      if (shotBuffered == SHOT_BUFFER_ENTRIES) flushShots();
+    }
+  }
+}
+
+// Compress one queued block into the packed block, writing whatever fills up
+static void packSourceBlock(const LogSampleBlock &block) {
+  uint32_t bytes = block.header.payloadBytes;
+  const uint8_t *payload = (const uint8_t *)block.records;
+  if (block.header.type == LOG_BLOCK_SAMPLES) {
+    bytes = logCompressRecords(block.records, block.header.recordCount, chunkScratch, sizeof(chunkScratch));
+    payload = chunkScratch;
+  }
+
+  // Didn't compress into one packed block - it goes out unpacked, in order
+  uint32_t chunkBytes = sizeof(LogChunkHeader) + bytes;
+  if (bytes == 0 || chunkBytes > sizeof(packBlock.records)) {
+    writePackBlock();
+    indexBlock(block, bytesWritten, 0);
+    writeBytes(&block, LOG_BLOCK_SIZE);
+    return;
+  }
+
+  if (packBytes + chunkBytes > sizeof(packBlock.records)) writePackBlock();
+  if (packBytes == 0) {
+    // Nothing else is written until this block is, so it lands where the file ends now
+    packOffset = bytesWritten;
+    packChunks = 0;
+    packBlock.header.magic = LOG_BLOCK_MAGIC;
+    packBlock.header.type = LOG_BLOCK_PACKED;
+    packBlock.header.recordCount = 0;
+    packBlock.header.sequence = block.header.sequence;
+  }
+  LogChunkHeader chunk;
+  chunk.type = block.header.type;
+  chunk.recordCount = block.header.recordCount;
+  chunk.sequence = block.header.sequence;
+  chunk.bytes = bytes;
+  uint8_t *out = (uint8_t *)packBlock.records + packBytes;
+  memcpy(out, &chunk, sizeof(chunk));
+  memcpy(out + sizeof(chunk), payload, bytes);
+  packBytes += chunkBytes;
+  packBlock.header.recordCount += block.header.recordCount;
+  indexBlock(block, packOffset, packChunks++);
+}
+
+// Write or pack one block
+static void outputBlock(const LogSampleBlock &block) {
+  sourceBytes += LOG_BLOCK_SIZE;
+  if (packing) {
+    packSourceBlock(block);
+  } else {
+    indexBlock(block, bytesWritten, 0);
+    writeBytes(&block, LOG_BLOCK_SIZE);
+  }
+}
+
+bool logWriterService() {
+  if (!logFile || queuedBuffers == 0) return false;
+  PERF_SCOPE(PERF_LOG_SERVICE);
+
+  outputBlock(logBlocks[writeIndex]);
+  writeIndex = (writeIndex + 1) % LOG_BUFFER_COUNT;
+  queuedBuffers--;
+
+  // Commit directory entry once the queue is empty so a power loss keeps everything written
+  if (queuedBuffers == 0) {
+    unsigned long start = micros();
+    logFile->flush();
+    writeMicros += micros() - start;
+  }
+  return true;
+}
+
+void logWriterStop() {
+  if (!logFile) return;
+
+  while (logWriterService()) {
+  }
+
+  // Final partial block is still written whole, the unused tail is zeroed
+  LogSampleBlock &block = logBlocks[fillIndex];
+  if (block.header.recordCount > 0) {
+    block.header.payloadBytes = block.header.recordCount * sizeof(LogSampleRecord);
+    memset(&block.records[block.header.recordCount], 0,
+           (LOG_SAMPLE_BLOCK_RECORDS - block.header.recordCount) * sizeof(LogSampleRecord));
+    outputBlock(block);
+  }
+  writePackBlock();
+  logFile->flush();
+  logFile = nullptr;
+  flushShots();
+  if (shotFile) shotFile->flush();
+  shotFile = nullptr;
+}
+
+uint32_t logWriterDroppedBuffers() {
+  return droppedBuffers;
+}
+
+uint32_t logWriterRecordCount() {
+  return recordCount;
+}
+
+uint32_t logWriterShotCount() {
+  return shotCount;
+}
+
+uint32_t logWriterFirstTimestamp() {
+  return firstTimestamp;
+}
+
+uint32_t logWriterLastTimestamp() {
+  return lastTimestamp;
+}
+
+uint32_t logWriterPendingBuffers() {
+  return queuedBuffers;
+}
+
+float logWriterCompressionRatio() {
+  if (bytesWritten <= LOG_HEADER_SIZE) return 1;
+  return (float)sourceBytes / (bytesWritten - LOG_HEADER_SIZE);
+}
+
+float logWriterThroughputMBps() {
+  if (writeMicros == 0) return 0;
+  return (float)bytesWritten / writeMicros;  // bytes/us == MB/s
+}
@@ -0,0 +1,45 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "sampler.h"
+#include "log_format.h"
+
+// Log Writer Configuration
+const int LOG_BUFFER_COUNT = 4;  // Blocks in the pipeline (one filling, the rest queued)
+
+// Begin a pipeline writing to file; the header sector is written immediately. With shots set, a
+// LogShotEntry is written there for every shot start as the blocks holding them are written.
+void logWriterStart(File *file, const LogFileHeader &header, File *shots = nullptr);
+
+// Acquisition side - copies into the filling block, never blocks on the SD card
+void logWriterAppend(const RawSample &sample);
+void logWriterAppendRecord(const LogSampleRecord &record);
+void logWriterMakeRecord(const RawSample &sample, LogSampleRecord &record);
+
+// Close the partial block and queue a window info block, the window's records follow
+void logWriterAppendWindow(const LogWindowInfo &window);
+
+// Blocks that can still be queued before the next one would be dropped
+int logWriterFreeBuffers();
+
+// Write side - writes one queued block, returns false when idle. Packed logs compress the block
+// here, so the work happens in idle time and a full packed block is written when it fills up.
+bool logWriterService();
+
+// Drain all blocks, including the partially filled one
+void logWriterStop();
+
+// Totals of the blocks written so far, for the log store's run entry
+uint32_t logWriterRecordCount();
+uint32_t logWriterShotCount();
+uint32_t logWriterFirstTimestamp();
+uint32_t logWriterLastTimestamp();
+
+uint32_t logWriterDroppedBuffers();
+uint32_t logWriterPendingBuffers();
+float logWriterThroughputMBps();
+float logWriterCompressionRatio();  // Block bytes queued per byte written, 1 when not packing
+
+#endif
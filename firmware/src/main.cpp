@@ -1,6 +1,29 @@
 #include <Arduino.h>
 #include <SD.h>
 #include <SPI.h>
+#include "sampler.h"
+#include "log_writer.h"
+#include "log_codec.h"
+#include "log_store.h"
+#include "log_reader.h"
+#include "log_summary.h"
+#include "bulk_transfer.h"
+#include "telemetry.h"
+#include "capture_buffer.h"
+#include "adaptive_log.h"
+#include "current_lut.h"
+#include "pulse_engine.h"
+#include "fire_scheduler.h"
+#include "waveform.h"
+#include "current_control.h"
+#include "command_parser.h"
+#include "shot_features.h"
+#include "shot_stats.h"
+#include "coil_thermal.h"
+#include "sweep.h"
+#include "protection.h"
+#include "ring_buffer.h"
+#include "perf_probe.h"
 
 // Injector driver outputs
 const int INJ1_DRV = 2;
@@ -16,23 +39,43 @@ const int INJ3_ISENS = 19;  // A5
 const int INJ4_ISENS = 18;  // A4
 const int CURRENT_PINS[4] = {INJ1_ISENS, INJ2_ISENS, INJ3_ISENS, INJ4_ISENS};
 
+// Supply voltage sensing (divider to an ADC1 pin, sampled with the currents)
+const int SUPPLY_SENSE = 24;               // A10
+const float SUPPLY_DIVIDER_RATIO = 11.0;   // 100k/10k divider, 36V full scale
+
 // === CONFIGURABLE PARAMETERS ===
 
 // Timing Configuration
 unsigned long pulseWidth = 20000;        // Default pulse width in microseconds
-const unsigned long peakTime = 2000;     // Peak phase duration in microseconds
-const unsigned long holdTime = 1800;     // Hold phase duration in microseconds
-const unsigned long holdPeriod = 500;    // Hold PWM period (2kHz = 500us)
-const unsigned long holdDuty = 250;      // Hold PWM duty cycle (250us on, 250us off)
+
+// Drive Profiles (segment tables, see waveform.h)
+// Default peak & hold: 2ms full on, then 1.8ms of 2kHz PWM at 50% duty. Replace at runtime with 'W'.
+const WaveProfile DEFAULT_PEAK_HOLD = PeakHoldProfile<2000, 1800, 2000, 50>::profile();
+// Current regulated alternative ('W' then REGULATED): 4A peak, then 1A +/-0.1A for the rest of 3.8ms
+const WaveProfile DEFAULT_REGULATED = RegulatedProfile<3800, 4000, 1000, 200>::profile();
+WaveProfile normalProfile = NormalProfile<20000>::profile();  // Rebuilt from pulseWidth
+WaveProfile peakHoldProfile = DEFAULT_PEAK_HOLD;
+WaveProgram normalProgram;                // Compiled profiles the pulse engine interprets
+WaveProgram peakHoldProgram;
 
 // Current Sensing Configuration (ACS712 20A, scaled to 3.3V)
 const float ACS712_SENSITIVITY = 0.066;  // 66mV/A for 20A version
 const float ACS712_VREF = 1.65;          // 3.3V/2 = 1.65V zero current
-const float ADC_RESOLUTION = 3.3 / 1024.0;  // 10-bit ADC resolution
+const float ADC_REFERENCE = 3.3;         // ADC full scale voltage
+const float ADC_RESOLUTION = ADC_REFERENCE / 4096.0;  // 12-bit ADC resolution
+const float SUPPLY_MV_PER_CODE = ADC_RESOLUTION * SUPPLY_DIVIDER_RATIO * 1000;
 float currentOffsets[4] = {0, 0, 0, 0};  // Zero current calibration offsets
 
+// Gain correction, interpolated between breakpoints and baked into the current LUT
+const float GAIN_POINT_AMPS[LOG_GAIN_POINTS] = {0.0, 2.0, 5.0, 15.0};  // Breakpoints (A)
+float channelGain[4][LOG_GAIN_POINTS] = {  // 1.0 = ACS712 nominal sensitivity
+  {1.0, 1.0, 1.0, 1.0},
+  {1.0, 1.0, 1.0, 1.0},
+  {1.0, 1.0, 1.0, 1.0},
+  {1.0, 1.0, 1.0, 1.0},
+};
+
 // Sampling Configuration
-const unsigned long PERFORMANCE_SAMPLE_INTERVAL = 50;  // Performance monitoring sample interval (50us)
 const int CALIBRATION_SAMPLES = 100;                   // Number of samples for sensor calibration
 const unsigned long CALIBRATION_DELAY = 10;            // Delay between calibration samples (ms)
 const unsigned long CALIBRATION_WAIT = 2000;           // Wait time before calibration starts (ms)
@@ -42,62 +85,169 @@ const unsigned long PULSE_DELAY = 20;          // Delay between multiple pulses
 const unsigned long INJECTOR_DELAY = 20;      // Delay between injectors in sequential firing (ms)
 const unsigned long SEQUENTIAL_INJ_DELAY = 20; // Delay between each injector in sequential (ms)
 const unsigned long SEQUENTIAL_CYCLE_DELAY = 50; // Delay between complete cycles (ms)
+const unsigned long PULSE_START_DELAY = 50;    // Lead between arming a shot and its first edge (us)
 
-// User Input Timeouts
+// User Input Timeouts - prompts stay open this long for the next line, nothing waits on them
 const unsigned long PULSE_WIDTH_TIMEOUT = 10000;  // Pulse width input timeout (ms)
 const unsigned long FILE_SELECT_TIMEOUT = 30000;  // File selection timeout (ms)
+const unsigned long PROFILE_INPUT_TIMEOUT = 30000; // Drive profile upload timeout (ms)
+
+// Prompts opened by the single-character commands p, W and m, answered by the next line
+enum PromptType {
+  PROMPT_NONE,
+  PROMPT_PULSE_WIDTH,
+  PROMPT_PROFILE,
+  PROMPT_FILE,
+};
+PromptType pendingPrompt = PROMPT_NONE;
+unsigned long promptStart = 0;
+unsigned long promptTimeout = 0;
+
+// Command Queue - lines are acknowledged on receipt and run in order from loop()
+const uint32_t COMMAND_QUEUE_SIZE = 32;   // Lines waiting to run (power of two)
+const long MAX_FIRE_COUNT = 10000;        // Largest n accepted by fire
+SpscRing<CommandLine, COMMAND_QUEUE_SIZE> commandQueue;
+bool stopRequested = false;               // Set by stop/0, ends fire loops after the current shot
 
 // Pulse Width Limits
 const float MIN_PULSE_WIDTH = 0.1;   // Minimum pulse width (ms)
 const float MAX_PULSE_WIDTH = 100.0; // Maximum pulse width (ms)
 
+// Parameter Sweeps
+const long SWEEP_DEFAULT_SHOTS = 10;          // Shots per point
+const long SWEEP_MAX_GAP_MS = 60000;          // Longest gap between shots
+const uint32_t SWEEP_DEFAULT_PEAK_US = 2000;  // Peak & hold shape when the P&H profile isn't one
+const uint32_t SWEEP_DEFAULT_FREQ = 2000;     // (Hz)
+const uint32_t SWEEP_DEFAULT_DUTY = 50;       // (%)
+
 // Repeat Counts
 const int SINGLE_REPEAT_COUNT = 1;      // Single fire repeat count
 const int MULTI_REPEAT_COUNT = 50;     // Multiple fire repeat count (qwer, zxcv)
 const int SEQUENTIAL_REPEAT_COUNT = 50; // Sequential fire repeat count (tgb)
 
+// Pulse generation
+const int EDGE_TEST_INJECTOR = 0;       // Injector whose drive pin is looped back to PULSE_CAPTURE_PIN
+
+// Engine run - all injectors firing once per 720° cycle in firing order, cycled RPM with '8'
+const int FIRING_ORDER[4] = {1, 3, 4, 2};           // Injector numbers in firing order
+int phaseTrimDeg[4] = {0, 0, 0, 0};                 // Per-injector offset from its firing order slot, engine trim=
+const int ENGINE_MAX_TRIM_DEG = 180;                // Trim either way, beyond that it is another slot
+const uint32_t ENGINE_RPM_PRESETS[] = {1000, 3000, 6000};
+const int ENGINE_RPM_PRESET_COUNT = sizeof(ENGINE_RPM_PRESETS) / sizeof(ENGINE_RPM_PRESETS[0]);
+const uint32_t ENGINE_CYCLES = 200;                 // Engine cycles per run
+uint32_t engineRpm = 3000;                          // engine rpm= takes any speed, '8' steps through the presets
+bool engineRunActive = false;
+bool engineRunPeakHold = false;
+uint32_t engineRefTick = 0;                         // Pulse engine tick at micros() engineRefUs
+unsigned long engineRefUs = 0;
+
 // SD Card and logging
 const int chipSelect = BUILTIN_SDCARD;  // Teensy 4.1 built-in SD card
 bool sdLogging = false;
 bool logCurrentData = false;
 File dataFile;
+File shotTableFile;
+File summaryFiles[LOG_SUMMARY_LEVELS];  // Summary pyramid levels of the open log
 String currentLogFile = "";
-const unsigned long SAMPLE_INTERVAL_US = 100;  // 10kHz = 100us interval
+uint32_t currentLogRun = 0;  // Log store run number of the open log, 0 if it has none
+
+// Continuous logs every sample, capture only the windows around shots, adaptive decimates steady stretches
+enum LogMode {
+  LOG_CONTINUOUS,
+  LOG_CAPTURE,
+  LOG_ADAPTIVE,
+};
+const char *const LOG_MODE_NAMES[] = {"continuous", "capture", "adaptive"};
+LogMode logMode = LOG_CONTINUOUS;
+uint32_t capturePreUs = CAPTURE_DEFAULT_PRE_US;
+uint32_t capturePostUs = CAPTURE_DEFAULT_POST_US;
+int adaptiveDecimation = ADAPTIVE_DEFAULT_DECIMATION;
+uint32_t adaptiveHoldUs = ADAPTIVE_DEFAULT_HOLD_US;
+bool logPacked = true;  // Compress sample blocks as they are written
 
-// Current data structure for high-speed logging
-struct CurrentSample {
-  unsigned long timestamp;
-  float current[4];
-  bool injectorState[4];
+// Acquisition presets, cycled with 'u' (scan = dual-ADC DMA, timer = IntervalTimer + analogRead)
+struct SamplerPreset {
+  SamplerMode mode;
+  uint32_t rateHz;
 };
+const SamplerPreset SAMPLER_PRESETS[] = {
+  {SAMPLER_SCAN, 10000},
+  {SAMPLER_SCAN, 50000},
+  {SAMPLER_SCAN, 100000},
+  {SAMPLER_TIMER, 10000},
+};
+const int SAMPLER_PRESET_COUNT = sizeof(SAMPLER_PRESETS) / sizeof(SAMPLER_PRESETS[0]);
+int samplerPreset = 0;  // Default: 10kHz dual-ADC scan
+const uint32_t REG_MIN_SAMPLE_RATE = 50000;  // Slowest scan that can hold a 200mA hysteresis band
 
 // SD Logging Configuration
-const int BUFFER_SIZE = 200;              // Buffer size for high-speed data logging
-const int MAX_LOG_FILES = 50;             // Maximum number of log files to display
 const int LOG_DUMP_PAUSE_LINES = 50;      // Lines to display before pausing (not used currently)
+const uint32_t SHOT_DUMP_TAIL_US = 2000;  // A shot dump runs on this long after its gate closes
+const int OVERVIEW_MAX_POINTS = 2048;     // Points an overview request may ask for
+const int OVERVIEW_DEFAULT_POINTS = 1000;
 
 // Progress Indicators
 const int PROGRESS_DOT_INTERVAL = 10;     // Show progress dot every N operations
-const int ADC_RESOLUTION_BITS = 10;       // ADC resolution in bits
+const int ADC_RESOLUTION_BITS = 12;       // ADC resolution in bits (matches ADC_SCAN_BITS)
+
+// Conversion Benchmark
+const int BENCHMARK_PASSES = 16;          // Passes over all ADC codes per method
 
 // Serial Communication
 const unsigned long SERIAL_BAUD_RATE = 115200;  // Serial communication baud rate
 const unsigned long SERIAL_WAIT_TIMEOUT = 3000; // Wait for serial connection timeout (ms)
 
-CurrentSample sampleBuffer[BUFFER_SIZE];
-int bufferIndex = 0;
-bool bufferFull = false;
+// Function prototypes
+void sendStatusUpdate();
+void fillLogHeader(LogFileHeader &header);
+bool engineRunBlocks();
+void dumpLogFile(const char *filename);
+void serviceCommandInput();
+void stopEngineRun();
+void serviceProtection();
+
+// Per-shot current accumulated in integer milliamps, converted to amps only for reporting.
+// Supply charge and energy only count samples with the drive on, when the supply feeds the coil.
+struct PulseCurrent {
+  uint32_t peakMa;
+  uint32_t sumMa;
+  int samples;
+  uint32_t driveSamples;
+  uint64_t driveSumMa;
+  uint64_t supplySumMv;
+  uint64_t powerSum;     // mA x mV = uW per sample
+};
+
+// Shots in progress, split on the mask's shot gate bits. A shot is recorded once its closing decay
+// has been followed, so its current stays open past the gate.
+struct ShotSplitter {
+  PulseCurrent current[4];
+  FeatureTracker features[4];
+  ShotFeatures last[4];       // Features of each injector's latest recorded shot
+};
+
+// Run statistics - one summary per injector per run, per-shot records only when enabled
+ShotStats runStats[4];
+bool shotRecords = false;  // Print a [SHOT] record for every shot (set shots=1)
 
-// Function to read current from ACS712 sensor
-float readCurrent(int channel) {
-  int adcValue = analogRead(CURRENT_PINS[channel]);
+// Function to convert a raw ADC code to current in float - the per-sample path the LUT replaced,
+// kept as the baseline for the conversion benchmark
+float adcToCurrent(int channel, int adcValue) {
   float voltage = adcValue * ADC_RESOLUTION;
   float current = (voltage - ACS712_VREF - currentOffsets[channel]) / ACS712_SENSITIVITY;
   return max(0.0, current);  // Don't return negative current
 }
 
+// Function to rebuild the ADC-to-current tables from the current calibration
+void buildCurrentLut() {
+  LogFileHeader calibration;
+  fillLogHeader(calibration);
+  currentLutBuild(calibration);
+}
+
 // Function to calibrate current sensors
 void calibrateCurrentSensors() {
+  if (engineRunBlocks()) return;
   Serial.println("Calibrating current sensors...");
   Serial.println("Ensure no current is flowing through any injector.");
   delay(CALIBRATION_WAIT);
@@ -123,53 +273,118 @@ void calibrateCurrentSensors() {
     Serial.println(" V");
   }
   
+  buildCurrentLut();
   Serial.println("Calibration complete!\n");
 }
 
-// Function to set pulse width
+// Function to compile the drive profiles after a parameter change
+void compileProfiles() {
+  normalProfile = makeNormalProfile(pulseWidth);
+  waveCompile(normalProfile, normalProgram);
+  waveCompile(peakHoldProfile, peakHoldProgram);
+}
+
+// Function to replace the peak & hold profile from text, DEFAULT or REGULATED; returns nullptr or the reason
+const char *applyPeakHoldProfile(const char *text) {
+  if (strcasecmp(text, "DEFAULT") == 0) {
+    peakHoldProfile = DEFAULT_PEAK_HOLD;
+  } else if (strcasecmp(text, "REGULATED") == 0) {
+    peakHoldProfile = DEFAULT_REGULATED;
+  } else {
+    const char *error = waveParseProfile(text, peakHoldProfile);
+    if (error) return error;
+  }
+  
+  compileProfiles();
+  char profileText[WAVE_TEXT_SIZE];
+  waveFormatProfile(peakHoldProfile, profileText, sizeof(profileText));
+  Serial.print("[LOG]P&H profile set to: ");
+  Serial.println(profileText);
+  sendStatusUpdate();
+  return nullptr;
+}
+
+// Function to change the pulse width, returns false if it is out of range
+bool applyPulseWidth(float newWidth) {
+  if (!(newWidth >= MIN_PULSE_WIDTH && newWidth <= MAX_PULSE_WIDTH)) return false;
+  pulseWidth = (unsigned long)(newWidth * 1000);
+  compileProfiles();
+  Serial.print("[LOG]Pulse width set to: ");
+  Serial.print(newWidth, 1);
+  Serial.println(" ms");
+  sendStatusUpdate();
+  return true;
+}
+
+// Function to open a prompt, the next received line answers it
+void openPrompt(PromptType prompt, unsigned long timeout) {
+  pendingPrompt = prompt;
+  promptStart = millis();
+  promptTimeout = timeout;
+}
+
+// Function to prompt for a peak & hold segment table, e.g. "ON 2000;PWM 1800 2000 50"
+void uploadPeakHoldProfile() {
+  if (engineRunBlocks()) return;
+  Serial.println("Enter P&H profile (ON <us>;OFF <us>;PWM <us> <Hz> <duty%>;REG <us> <peak mA> <hold mA> <band mA>),");
+  Serial.println("DEFAULT or REGULATED: ");
+  openPrompt(PROMPT_PROFILE, PROFILE_INPUT_TIMEOUT);
+}
+
+// Function to prompt for a new pulse width
 void setPulseWidth() {
+  if (engineRunBlocks()) return;
   Serial.print("Current pulse width: ");
   Serial.print(pulseWidth / 1000.0, 1);
   Serial.println(" ms");
   Serial.print("Enter new pulse width (ms): ");
+  openPrompt(PROMPT_PULSE_WIDTH, PULSE_WIDTH_TIMEOUT);
+}
+
+// Function to hand a received line to the open prompt
+void answerPrompt(const char *reply) {
+  PromptType prompt = pendingPrompt;
+  pendingPrompt = PROMPT_NONE;
+  Serial.println(reply);  // Echo
   
-  unsigned long timeout = millis() + PULSE_WIDTH_TIMEOUT;
-  String input = "";
-  
-  while (millis() < timeout) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      if (c == '\n' || c == '\r') {
-        break;
-      }
-      if ((c >= '0' && c <= '9') || c == '.') {
-        input += c;
-        Serial.print(c);  // Echo the character
-      }
-    }
-  }
-  
-  if (input.length() > 0) {
-    float newWidth = input.toFloat();
-    if (newWidth >= MIN_PULSE_WIDTH && newWidth <= MAX_PULSE_WIDTH) {
-      pulseWidth = (unsigned long)(newWidth * 1000);
-      Serial.println();
-      Serial.print("[LOG]Pulse width set to: ");
-      Serial.print(newWidth, 1);
-      Serial.println(" ms");
-      sendStatusUpdate();
-    } else {
-      Serial.println();
+  if (prompt == PROMPT_PULSE_WIDTH) {
+    char *end;
+    float newWidth = strtof(reply, &end);
+    if (end == reply || *end || !applyPulseWidth(newWidth)) {
       Serial.print("Invalid pulse width. Must be between ");
       Serial.print(MIN_PULSE_WIDTH);
       Serial.print(" and ");
       Serial.print(MAX_PULSE_WIDTH);
       Serial.println(" ms");
     }
-  } else {
-    Serial.println();
+  } else if (prompt == PROMPT_PROFILE) {
+    const char *error = applyPeakHoldProfile(reply);
+    if (error) {
+      Serial.print("[ERROR]Profile rejected: ");
+      Serial.println(error);
+    }
+  } else if (prompt == PROMPT_FILE) {
+    LogRunEntry entry;
+    if (!logStoreReadRun(atoi(reply), entry)) {
+      Serial.println("Invalid selection.");
+      return;
+    }
+    dumpLogFile(entry.name);
+  }
+}
+
+// Function to close a prompt nobody answered, called from loop()
+void servicePromptTimeout() {
+  if (pendingPrompt == PROMPT_NONE || millis() - promptStart < promptTimeout) return;
+  Serial.println();
+  if (pendingPrompt == PROMPT_PULSE_WIDTH) {
     Serial.println("No input received. Pulse width unchanged.");
+  } else if (pendingPrompt == PROMPT_PROFILE) {
+    Serial.println("No input received. Profile unchanged.");
+  } else {
+    Serial.println("No selection made - cancelled.");
   }
+  pendingPrompt = PROMPT_NONE;
 }
 
 // SD Card Functions
@@ -178,30 +393,87 @@ void initializeSD() {
   if (SD.begin(chipSelect)) {
     Serial.println("SD card initialized successfully!");
     sdLogging = true;
+    if (logStoreBegin()) {
+      Serial.print("Log index: ");
+      Serial.print(logStoreRunCount());
+      Serial.println(" runs");
+    } else {
+      Serial.println("[ERROR]Log index could not be opened - logs will not be listed");
+    }
   } else {
     Serial.println("SD card initialization failed - continuing without SD logging");
     sdLogging = false;
   }
 }
 
-void flushBuffer() {
-  if (!logCurrentData || bufferIndex == 0) return;
-  
-  for (int i = 0; i < bufferIndex; i++) {
-    dataFile.print(sampleBuffer[i].timestamp);
-    for (int ch = 0; ch < 4; ch++) {
-      dataFile.print(",");
-      dataFile.print(sampleBuffer[i].current[ch], 4);
-    }
-    for (int ch = 0; ch < 4; ch++) {
-      dataFile.print(",");
-      dataFile.print(sampleBuffer[i].injectorState[ch] ? "1" : "0");
+// Function to describe the current configuration in a binary log header
+void fillLogHeader(LogFileHeader &header) {
+  memset(&header, 0, sizeof(header));
+  header.magic = LOG_FILE_MAGIC;
+  header.version = LOG_FORMAT_VERSION;
+  header.headerSize = LOG_HEADER_SIZE;
+  header.blockSize = LOG_BLOCK_SIZE;
+  header.sampleIntervalNs = 1000000000UL / SAMPLER_PRESETS[samplerPreset].rateHz;
+  header.adcBits = ADC_RESOLUTION_BITS;
+  header.channelCount = LOG_CHANNELS;
+  header.adcReferenceVolts = ADC_REFERENCE;
+  header.sensorZeroVolts = ACS712_VREF;
+  header.sensorVoltsPerAmp = ACS712_SENSITIVITY;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    header.offsetVolts[ch] = currentOffsets[ch];
+  }
+  header.pulseWidthUs = pulseWidth;
+  const WaveSegment *peak = waveFirstSegment(peakHoldProfile, WAVE_ON);
+  const WaveSegment *hold = waveFirstSegment(peakHoldProfile, WAVE_PWM);
+  header.peakTimeUs = peak ? peak->durationUs : 0;
+  if (hold) {
+    header.holdTimeUs = hold->durationUs;
+    header.holdPeriodUs = 1000000 / hold->freqHz;
+    header.holdOnUs = header.holdPeriodUs * hold->dutyPercent / 100;
+  }
+  waveFormatProfile(peakHoldProfile, header.peakHoldProfile, sizeof(header.peakHoldProfile));
+  header.startMillis = millis();
+  header.supplyDividerRatio = SUPPLY_DIVIDER_RATIO;
+  header.compression = logPacked ? LOG_COMPRESSION_RICE : LOG_COMPRESSION_NONE;
+  if (logMode == LOG_ADAPTIVE) {
+    header.decimation = adaptiveDecimation;
+    header.fullRateHoldUs = adaptiveHoldUs;
+  }
+  for (int i = 0; i < LOG_GAIN_POINTS; i++) {
+    header.gainPointAmps[i] = GAIN_POINT_AMPS[i];
+  }
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    for (int i = 0; i < LOG_GAIN_POINTS; i++) {
+      header.gain[ch][i] = channelGain[ch][i];
     }
-    dataFile.println();
   }
-  
-  dataFile.flush();
-  bufferIndex = 0;
+}
+
+// Function to wait between shots while writing queued log buffers to the SD card
+void idleDelay(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    serviceProtection();
+    captureService();
+    logWriterService();
+    telemetryService();
+    serviceCommandInput();
+  }
+}
+
+// Function to report what a capture log saved
+void printCaptureSummary() {
+  Serial.print("[LOG]Capture: ");
+  Serial.print(captureWindowCount());
+  Serial.print(" windows written");
+  if (captureDroppedWindows() > 0 || captureDroppedRecords() > 0) {
+    Serial.print(", ");
+    Serial.print(captureDroppedWindows());
+    Serial.print(" windows and ");
+    Serial.print(captureDroppedRecords());
+    Serial.print(" samples lost");
+  }
+  Serial.println();
 }
 
 void startCurrentLogging() {
@@ -209,56 +481,129 @@ void startCurrentLogging() {
     Serial.println("SD card not available!");
     return;
   }
+  if (bulkTransferActive()) {
+    Serial.println("[ERROR]File transfer in progress");
+    return;
+  }
   
   // Create new log file with timestamp
   String filename = "CURRENT_LOG_";
   filename += millis();
-  filename += ".CSV";
+  filename += ".BIN";
   currentLogFile = filename;
   
+  if (logMode == LOG_CAPTURE &&
+      !captureStart(SAMPLER_PRESETS[samplerPreset].rateHz, capturePreUs, capturePostUs)) {
+    Serial.println("[ERROR]Capture logging needs PSRAM fitted");
+    return;
+  }
+  
   dataFile = SD.open(filename.c_str(), FILE_WRITE);
   if (dataFile) {
-    // Write CSV header
-    dataFile.println("Timestamp_us,Current1_A,Current2_A,Current3_A,Current4_A,Inj1_State,Inj2_State,Inj3_State,Inj4_State");
-    dataFile.flush();
+    // Binary header with calibration and pulse parameters, then sample blocks
+    LogFileHeader header;
+    fillLogHeader(header);
+    char shotName[LOG_NAME_SIZE];
+    logStoreShotTableName(filename.c_str(), shotName, sizeof(shotName));
+    shotTableFile = SD.open(shotName, FILE_WRITE);
+    File *levels[LOG_SUMMARY_LEVELS];
+    for (int i = 0; i < LOG_SUMMARY_LEVELS; i++) {
+      char levelName[LOG_NAME_SIZE];
+      logSummaryFileName(filename.c_str(), i + 1, levelName, sizeof(levelName));
+      summaryFiles[i] = SD.open(levelName, FILE_WRITE);
+      levels[i] = summaryFiles[i] ? &summaryFiles[i] : nullptr;
+    }
+    logSummaryStart(levels);
+    logWriterStart(&dataFile, header, shotTableFile ? &shotTableFile : nullptr);
+    currentLogRun = logStoreOpenRun(filename.c_str(), header, logMode);
+    if (logMode == LOG_ADAPTIVE) adaptiveLogStart(adaptiveDecimation, adaptiveHoldUs);
     logCurrentData = true;
-    bufferIndex = 0;
-    bufferFull = false;
-    Serial.print("Started logging to: ");
-    Serial.println(filename);
+    Serial.print("Started ");
+    if (logMode != LOG_CONTINUOUS) {
+      Serial.print(LOG_MODE_NAMES[logMode]);
+      Serial.print(" ");
+    }
+    Serial.print("logging to: ");
+    Serial.print(filename);
+    if (currentLogRun) {
+      Serial.print(" (run ");
+      Serial.print(currentLogRun);
+      Serial.print(")");
+    }
+    Serial.println();
   } else {
     Serial.println("Error creating log file");
   }
 }
 
+// Function to record the closing totals of the open log in the log store
+void closeLogRun() {
+  LogRunEntry entry;
+  if (!currentLogRun || !logStoreReadRun(currentLogRun, entry)) return;
+  entry.state = shotTableFile ? LOG_RUN_CLOSED : LOG_RUN_INCOMPLETE;
+  entry.fileBytes = dataFile.size();
+  entry.recordCount = logWriterRecordCount();
+  entry.firstTimestamp = logWriterFirstTimestamp();
+  entry.lastTimestamp = logWriterLastTimestamp();
+  entry.shotCount = logWriterShotCount();
+  entry.droppedBlocks = logWriterDroppedBuffers();
+  entry.durationMs = millis() - entry.header.startMillis;
+  if (!logStoreWriteRun(entry)) {
+    Serial.println("[ERROR]Log index update failed");
+    return;
+  }
+  Serial.print("[LOG]Run ");
+  Serial.print(entry.run);
+  Serial.print(": ");
+  Serial.print(entry.recordCount);
+  Serial.print(" records, ");
+  Serial.print(entry.shotCount);
+  Serial.println(" shots indexed");
+  currentLogRun = 0;
+}
+
 void stopCurrentLogging() {
   if (logCurrentData) {
-    flushBuffer();  // Write any remaining data
+    if (logMode == LOG_CAPTURE) {
+      captureStop();  // Close the open window and queue everything still in the ring
+      printCaptureSummary();
+    } else if (logMode == LOG_ADAPTIVE) {
+      adaptiveLogStop();  // Held back run and the partial one go out as samples
+      adaptiveLogPrintSummary();
+    }
+    logWriterStop();  // Write any remaining data
+    logSummaryStop();
+    closeLogRun();
     if (dataFile) {
       dataFile.close();
     }
+    if (shotTableFile) {
+      shotTableFile.close();
+    }
+    for (int i = 0; i < LOG_SUMMARY_LEVELS; i++) {
+      if (summaryFiles[i]) summaryFiles[i].close();
+    }
     logCurrentData = false;
+    if (logPacked) {
+      Serial.print("[LOG]Packed ");
+      Serial.print(logWriterCompressionRatio(), 2);
+      Serial.println(":1");
+    }
     Serial.println("Current logging stopped");
   }
 }
 
-void logCurrentSample(bool injectorStates[4]) {
+void logCurrentSample(const RawSample &sample) {
   if (!logCurrentData) return;
+  PERF_SCOPE(PERF_LOG_APPEND);
   
-  unsigned long timestamp = micros();
-  
-  // Add sample to buffer
-  sampleBuffer[bufferIndex].timestamp = timestamp;
-  for (int i = 0; i < 4; i++) {
-    sampleBuffer[bufferIndex].current[i] = readCurrent(i);
-    sampleBuffer[bufferIndex].injectorState[i] = injectorStates[i];
-  }
-  
-  bufferIndex++;
-  
-  // Flush buffer when full
-  if (bufferIndex >= BUFFER_SIZE) {
-    flushBuffer();
+  // Buffered only - full buffers are written from idleDelay() and loop()
+  if (logMode == LOG_CAPTURE) {
+    captureAppend(sample);
+  } else if (logMode == LOG_ADAPTIVE) {
+    adaptiveLogAppend(sample);
+  } else {
+    logWriterAppend(sample);
   }
 }
 
@@ -270,13 +615,192 @@ void toggleSDLogging() {
   }
 }
 
-void dumpLogFile(String filename) {
+// Function to print decoded records as CSV rows, returns lines printed
+int dumpLogRecords(const LogFileHeader &header, const LogSampleRecord *records, int count) {
+  bool hasSupply = header.version >= 4;
+  bool hasKinds = header.version >= 6;
+  int lineCount = 0;
+  for (int i = 0; i < count; i++) {
+    const LogSampleRecord &record = records[i];
+    // Decimated runs are dumped as their mean, stamped at the start of the run
+    uint8_t kind = hasKinds ? record.flags & LOG_FLAG_KIND : LOG_RECORD_SAMPLE;
+    if (kind == LOG_RECORD_MIN || kind == LOG_RECORD_MAX) continue;
+    Serial.print(record.timestamp);
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      Serial.print(",");
+      Serial.print(logCodeToCurrent(header, ch, record.adc[ch]), 4);
+    }
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      Serial.print(",");
+      Serial.print((record.injectorMask >> ch) & 1 ? "1" : "0");
+    }
+    if (hasSupply) {
+      Serial.print(",");
+      Serial.print(logCodeToSupplyVolts(header, record.aux), 2);
+    }
+    Serial.println();
+    lineCount++;
+  }
+  return lineCount;
+}
+
+// Function to read and check a binary log's header
+bool readLogHeader(File &logFile, LogFileHeader &header) {
+  if (logFile.read(&header, sizeof(header)) != sizeof(header) ||
+      header.magic != LOG_FILE_MAGIC || header.version == 0 || header.version > LOG_FORMAT_VERSION) {
+    Serial.println("[ERROR]Not a supported binary log");
+    return false;
+  }
+  return true;
+}
+
+// Function to print the CSV column names for a binary log
+void printLogColumns(const LogFileHeader &header) {
+  Serial.print("Timestamp_us,Current1_A,Current2_A,Current3_A,Current4_A,Inj1_State,Inj2_State,Inj3_State,Inj4_State");
+  Serial.println(header.version >= 4 ? ",Supply_V" : "");
+}
+
+// Function to decode a binary log to CSV rows on the serial port, returns lines printed
+int dumpBinaryLog(File &logFile) {
+  LogFileHeader header;
+  if (!readLogHeader(logFile, header)) return 0;
+  printLogColumns(header);
+  int lineCount = 1;
+  
+  const LogSampleRecord *records;
+  int count;
+  logReaderStart(logFile, header.headerSize);
+  while (logReaderNext(logFile, records, count)) {
+    lineCount += dumpLogRecords(header, records, count);
+  }
+  return lineCount;
+}
+
+// Function to dump one shot of a run, from its first gated record to SHOT_DUMP_TAIL_US after
+// the gate closes, found through the shot table without reading the log up to it
+void dumpLogShot(const LogRunEntry &run, uint32_t shot) {
+  LogShotEntry entry;
+  if (!logStoreReadShot(run, shot, entry)) {
+    Serial.println("[ERROR]Shot not in the run's shot table");
+    return;
+  }
+  File logFile = SD.open(run.name);
+  if (!logFile) {
+    Serial.println("Error opening log file!");
+    return;
+  }
+  LogFileHeader header;
+  if (!readLogHeader(logFile, header)) {
+    logFile.close();
+    return;
+  }
+  
+  Serial.println("\n=== SHOT DUMP ===");
+  Serial.print("Run ");
+  Serial.print(run.run);
+  Serial.print(" (");
+  Serial.print(run.name);
+  Serial.print(") shot ");
+  Serial.print(shot);
+  Serial.print(" of ");
+  Serial.print(run.shotCount);
+  Serial.print(", injector ");
+  Serial.println(entry.injector);
+  printLogColumns(header);
+  
+  uint8_t gate = 0x10 << (entry.injector - 1);
+  bool closed = false;
+  uint32_t closedAt = 0;
+  int lineCount = 1;
+  const LogSampleRecord *records;
+  int count;
+  int first = entry.record;
+  logReaderStart(logFile, entry.blockOffset, entry.chunk);
+  while (logReaderNext(logFile, records, count)) {
+    int end = first;
+    bool done = false;
+    for (; end < count; end++) {
+      const LogSampleRecord &record = records[end];
+      if (!closed && !(record.injectorMask & gate)) {
+        closed = true;
+        closedAt = record.timestamp;
+      }
+      if (closed && record.timestamp - closedAt >= SHOT_DUMP_TAIL_US) {
+        done = true;
+        break;
+      }
+    }
+    if (end > first) lineCount += dumpLogRecords(header, records + first, end - first);
+    if (done) break;
+    first = 0;
+  }
+  logFile.close();
+  Serial.println("=== END OF SHOT ===");
+  Serial.print("Total lines: ");
+  Serial.println(lineCount);
+}
+
+// Function to print an overview of part of a run from its summary pyramid as one [OVERVIEW] line,
+// min/max/mean amps per channel for each point
+const char *printOverview(const LogRunEntry &run, uint32_t fromUs, uint32_t toUs, int maxPoints) {
+  DMAMEM static LogSummaryEntry points[OVERVIEW_MAX_POINTS];
+  int level;
+  unsigned long start = micros();
+  int count = logSummaryQuery(run.name, run.firstTimestamp, fromUs, toUs, points, maxPoints, level);
+  if (level < 0) return "run has no summary pyramid";
+  unsigned long elapsed = micros() - start;
+
+  const LogFileHeader &header = run.header;
+  Serial.print("[OVERVIEW]{\"run\":");
+  Serial.print(run.run);
+  Serial.print(",\"level\":");
+  Serial.print(level);
+  Serial.print(",\"fromUs\":");
+  Serial.print(fromUs);
+  Serial.print(",\"toUs\":");
+  Serial.print(toUs);
+  Serial.print(",\"queryUs\":");
+  Serial.print(elapsed);
+  Serial.print(",\"points\":[");
+  // Each point: [us from the first record, records, mask, then min, max, mean per channel]
+  for (int i = 0; i < count; i++) {
+    const LogSummaryEntry &point = points[i];
+    if (i > 0) Serial.print(",");
+    Serial.print("[");
+    Serial.print(point.timestamp - run.firstTimestamp);
+    Serial.print(",");
+    Serial.print(point.records);
+    Serial.print(",");
+    Serial.print(point.injectorMask);
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      Serial.print(",");
+      Serial.print(logCodeToCurrent(header, ch, point.min[ch]), 3);
+      Serial.print(",");
+      Serial.print(logCodeToCurrent(header, ch, point.max[ch]), 3);
+      Serial.print(",");
+      Serial.print(logCodeToCurrent(header, ch, point.mean[ch]), 3);
+    }
+    Serial.print("]");
+  }
+  Serial.print("]}");
+  Serial.println();
+  return nullptr;
+}
+
+// Function to check a file name's extension
+bool hasExtension(const char *filename, const char *extension) {
+  size_t nameLength = strlen(filename);
+  size_t extLength = strlen(extension);
+  return nameLength >= extLength && strcasecmp(filename + nameLength - extLength, extension) == 0;
+}
+
+void dumpLogFile(const char *filename) {
   if (!sdLogging) {
     Serial.println("SD card not available!");
     return;
   }
   
-  File logFile = SD.open(filename.c_str());
+  File logFile = SD.open(filename);
   if (!logFile) {
     Serial.println("Error opening log file!");
     return;
@@ -292,10 +816,14 @@ void dumpLogFile(String filename) {
   
   // Read and output file contents
   int lineCount = 0;
-  while (logFile.available()) {
-    String line = logFile.readStringUntil('\n');
-    Serial.println(line);
-    lineCount++;
+  if (hasExtension(filename, ".BIN")) {
+    lineCount = dumpBinaryLog(logFile);
+  } else {
+    while (logFile.available()) {
+      int c = logFile.read();
+      Serial.write(c);
+      if (c == '\n') lineCount++;
+    }
   }
   
   logFile.close();
@@ -304,105 +832,174 @@ void dumpLogFile(String filename) {
   Serial.println(lineCount);
 }
 
-void listLogFiles() {
-  if (!sdLogging) {
-    Serial.println("SD card not available!");
-    return;
-  }
-  
-  File root = SD.open("/");
-  if (!root) {
-    Serial.println("Error opening root directory");
-    return;
-  }
+// Function to print the runs in the log index, returns how many
+uint32_t collectLogFiles() {
+  uint32_t runs = logStoreRunCount();
+  static const char *const STATE_NAMES[] = {"", "open", "closed", "imported", "recovered"};
   
+  // One pass over the index, printed for people and collected as JSON for the GUI
   Serial.println("\n=== Available Log Files ===");
-  int fileCount = 0;
-  String fileList[MAX_LOG_FILES];  // Store up to MAX_LOG_FILES files
-  
-  while (true) {
-    File entry = root.openNextFile();
-    if (!entry) break;
-    
-    String filename = entry.name();
-    if (filename.startsWith("CURRENT_LOG_") && filename.endsWith(".CSV")) {
-      fileList[fileCount] = filename;
-      Serial.print(fileCount + 1);
-      Serial.print(". ");
-      Serial.print(filename);
-      Serial.print(" (");
-      Serial.print(entry.size());
-      Serial.println(" bytes)");
-      fileCount++;
-      
-      if (fileCount >= MAX_LOG_FILES) break;  // Limit to MAX_LOG_FILES files
+  LogRunEntry entry;
+  for (uint32_t run = 1; run <= runs; run++) {
+    if (!logStoreReadRun(run, entry)) continue;
+    Serial.print(run);
+    Serial.print(". ");
+    Serial.print(entry.name);
+    Serial.print(" (");
+    Serial.print(entry.fileBytes);
+    Serial.print(" bytes");
+    if (entry.state != LOG_RUN_IMPORTED) {
+      Serial.print(", ");
+      Serial.print(entry.shotCount);
+      Serial.print(" shots, ");
+      Serial.print(entry.durationMs / 1000.0f, 1);
+      Serial.print(" s, ");
+      Serial.print(LOG_MODE_NAMES[entry.logMode < 3 ? entry.logMode : 0]);
     }
-    entry.close();
+    if (entry.header.magic == LOG_FILE_MAGIC) {
+      Serial.print(", pw ");
+      Serial.print(entry.header.pulseWidthUs / 1000.0f, 1);
+      Serial.print(" ms");
+    }
+    if (entry.state != LOG_RUN_CLOSED && entry.state <= LOG_RUN_INCOMPLETE) {
+      Serial.print(", ");
+      Serial.print(STATE_NAMES[entry.state]);
+    }
+    Serial.println(")");
   }
-  root.close();
-  
-  if (fileCount == 0) {
+  if (runs == 0) {
     Serial.println("No log files found.");
-    return;
   }
   
-  Serial.println("============================");
-  Serial.print("Enter file number (1-");
-  Serial.print(fileCount);
-  Serial.print("): ");
-  
-  // Wait for user input
-  unsigned long timeout = millis() + FILE_SELECT_TIMEOUT;
-  String input = "";
-  
-  while (millis() < timeout) {
-    if (Serial.available()) {
-      char c = Serial.read();
-      if (c == '\n' || c == '\r') {
-        break;
-      }
-      if (c >= '0' && c <= '9') {
-        input += c;
-        Serial.print(c);  // Echo the character
-      }
-    }
+  Serial.print("[FILES]{\"files\":[");
+  bool firstEntry = true;
+  for (uint32_t run = 1; run <= runs; run++) {
+    if (!logStoreReadRun(run, entry)) continue;
+    if (!firstEntry) Serial.print(",");
+    firstEntry = false;
+    Serial.print("{\"run\":");
+    Serial.print(run);
+    Serial.print(",\"name\":\"");
+    Serial.print(entry.name);
+    Serial.print("\",\"size\":");
+    Serial.print(entry.fileBytes);
+    Serial.print(",\"state\":\"");
+    Serial.print(entry.state <= LOG_RUN_INCOMPLETE ? STATE_NAMES[entry.state] : "");
+    Serial.print("\",\"mode\":\"");
+    Serial.print(LOG_MODE_NAMES[entry.logMode < 3 ? entry.logMode : 0]);
+    Serial.print("\",\"shots\":");
+    Serial.print(entry.shotCount);
+    Serial.print(",\"records\":");
+    Serial.print(entry.recordCount);
+    Serial.print(",\"spanUs\":");
+    Serial.print(entry.lastTimestamp - entry.firstTimestamp);
+    Serial.print(",\"durationMs\":");
+    Serial.print(entry.durationMs);
+    Serial.print(",\"pulseWidthUs\":");
+    Serial.print(entry.header.pulseWidthUs);
+    Serial.print(",\"sampleIntervalNs\":");
+    Serial.print(entry.header.sampleIntervalNs);
+    Serial.print("}");
   }
-  
+  Serial.print("]}");
   Serial.println();
-  
-  if (input.length() == 0) {
-    Serial.println("No selection made - cancelled.");
-    return;
-  }
-  
-  int selection = input.toInt();
-  if (selection < 1 || selection > fileCount) {
-    Serial.println("Invalid selection.");
+  return runs;
+}
+
+// Function to list log files and prompt for one to dump
+void listLogFiles() {
+  if (engineRunBlocks()) return;
+  if (!sdLogging) {
+    Serial.println("SD card not available!");
     return;
   }
+  if (collectLogFiles() == 0) return;
   
-  // Read and output the selected file
-  dumpLogFile(fileList[selection - 1]);
+  Serial.println("============================");
+  Serial.print("Enter run number (1-");
+  Serial.print(logStoreRunCount());
+  Serial.print("): ");
+  openPrompt(PROMPT_FILE, FILE_SELECT_TIMEOUT);
 }
 
 // Function to send JSON status update
 void sendStatusUpdate() {
+  PERF_SCOPE(PERF_STATUS);
   Serial.print("[STATUS]{");
+  const WaveSegment *peak = waveFirstSegment(peakHoldProfile, WAVE_ON);
+  const WaveSegment *hold = waveFirstSegment(peakHoldProfile, WAVE_PWM);
+  char profileText[WAVE_TEXT_SIZE];
+  waveFormatProfile(peakHoldProfile, profileText, sizeof(profileText));
+  
   Serial.print("\"pulseWidth\":");
   Serial.print(pulseWidth / 1000.0, 1);
   Serial.print(",\"peakTime\":");
-  Serial.print(peakTime / 1000.0, 1);
-  Serial.print(",\"holdFreq\":2000");
-  Serial.print(",\"holdDuty\":50");
+  Serial.print(peak ? peak->durationUs / 1000.0 : 0, 1);
+  Serial.print(",\"holdFreq\":");
+  Serial.print(hold ? hold->freqHz : 0);
+  Serial.print(",\"holdDuty\":");
+  Serial.print(hold ? hold->dutyPercent : 0);
+  Serial.print(",\"holdProfile\":\"");
+  Serial.print(profileText);
+  Serial.print("\"");
   Serial.print(",\"sdAvailable\":");
   Serial.print(sdLogging ? "true" : "false");
   Serial.print(",\"logging\":");
   Serial.print(logCurrentData ? "true" : "false");
+  Serial.print(",\"logMode\":\"");
+  Serial.print(LOG_MODE_NAMES[logMode]);
+  Serial.print("\"");
+  if (logMode == LOG_CAPTURE) {
+    Serial.print(",\"capturePreUs\":");
+    Serial.print(capturePreUs);
+    Serial.print(",\"capturePostUs\":");
+    Serial.print(capturePostUs);
+    Serial.print(",\"captureWindows\":");
+    Serial.print(captureWindowCount());
+  } else if (logMode == LOG_ADAPTIVE) {
+    Serial.print(",\"decimation\":");
+    Serial.print(adaptiveDecimation);
+    Serial.print(",\"fullRateHoldUs\":");
+    Serial.print(adaptiveHoldUs);
+  }
+  Serial.print(",\"sampleRate\":");
+  Serial.print(SAMPLER_PRESETS[samplerPreset].rateHz);
+  Serial.print(",\"sampleMode\":\"");
+  Serial.print(SAMPLER_PRESETS[samplerPreset].mode == SAMPLER_SCAN ? "scan" : "timer");
+  Serial.print("\"");
+  Serial.print(",\"engineRpm\":");
+  Serial.print(engineRpm);
+  Serial.print(",\"engineRunning\":");
+  Serial.print(engineRunActive ? "true" : "false");
+  Serial.print(",\"shotRecords\":");
+  Serial.print(shotRecords ? "true" : "false");
+  Serial.print(",\"thermalLimitC\":");
+  Serial.print(coilThermalRiseLimit(), 1);
+  Serial.print(",\"powerLimitW\":");
+  Serial.print(coilThermalPowerLimit(), 2);
+  Serial.print(",\"logDropped\":");
+  Serial.print(logWriterDroppedBuffers());
+  Serial.print(",\"logMBps\":");
+  Serial.print(logWriterThroughputMBps(), 3);
+  Serial.print(",\"logPacked\":");
+  Serial.print(logPacked ? "true" : "false");
+  Serial.print(",\"logRatio\":");
+  Serial.print(logWriterCompressionRatio(), 2);
+  Serial.print(",\"live\":");
+  Serial.print(telemetryActive() ? "true" : "false");
+  Serial.print(",\"liveDecimation\":");
+  Serial.print(telemetryDecimation());
+  Serial.print(",\"liveDropped\":");
+  Serial.print(telemetryDroppedFrames());
   if (currentLogFile.length() > 0) {
     Serial.print(",\"logFile\":\"");
     Serial.print(currentLogFile);
     Serial.print("\"");
   }
+  Serial.print(",\"logRuns\":");
+  Serial.print(logStoreRunCount());
+  Serial.print(",\"protectFaults\":");
+  Serial.print(protectionFaults());
   Serial.print(",\"offsets\":[");
   for (int i = 0; i < 4; i++) {
     Serial.print(currentOffsets[i], 4);
@@ -412,6 +1009,80 @@ void sendStatusUpdate() {
   Serial.println();
 }
 
+// Function to step to the next sampling preset
+void cycleSamplerPreset() {
+  if (engineRunBlocks()) return;
+  if (logCurrentData) {
+    Serial.println("[ERROR]Stop logging before changing the sample rate");
+    return;
+  }
+  
+  samplerPreset = (samplerPreset + 1) % SAMPLER_PRESET_COUNT;
+  Serial.print("[LOG]Sampling: ");
+  Serial.print(SAMPLER_PRESETS[samplerPreset].mode == SAMPLER_SCAN ? "dual-ADC scan" : "timer");
+  Serial.print(" at ");
+  Serial.print(SAMPLER_PRESETS[samplerPreset].rateHz);
+  Serial.println(" Hz");
+  sendStatusUpdate();
+}
+
+// Function to compare cycles per conversion of the float path and the LUT over every ADC code
+void benchmarkConversion() {
+  const uint32_t conversions = (uint32_t)BENCHMARK_PASSES * 4 * CURRENT_LUT_CODES;
+  volatile float floatSink;
+  volatile uint32_t lutSink;
+  
+  float floatSum = 0;
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+    for (int ch = 0; ch < 4; ch++) {
+      for (int code = 0; code < CURRENT_LUT_CODES; code++) {
+        floatSum += adcToCurrent(ch, code);
+      }
+    }
+  }
+  uint32_t floatCycles = ARM_DWT_CYCCNT - start;
+  floatSink = floatSum;
+  
+  uint32_t lutSum = 0;
+  start = ARM_DWT_CYCCNT;
+  for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+    for (int ch = 0; ch < 4; ch++) {
+      for (int code = 0; code < CURRENT_LUT_CODES; code++) {
+        lutSum += currentLutMilliamps(ch, code);
+      }
+    }
+  }
+  uint32_t lutCycles = ARM_DWT_CYCCNT - start;
+  lutSink = lutSum;
+  (void)floatSink;
+  (void)lutSink;
+  
+  // Differences are rounding plus any gain correction, which the float path doesn't apply
+  int maxErrorMa = 0;
+  for (int ch = 0; ch < 4; ch++) {
+    for (int code = 0; code < CURRENT_LUT_CODES; code++) {
+      int reference = (int)(adcToCurrent(ch, code) * 1000.0f + 0.5f);
+      int error = abs((int)currentLutMilliamps(ch, code) - reference);
+      if (error > maxErrorMa) maxErrorMa = error;
+    }
+  }
+  
+  Serial.print("[BENCH]{");
+  Serial.print("\"conversions\":");
+  Serial.print(conversions);
+  Serial.print(",\"floatCycles\":");
+  Serial.print((float)floatCycles / conversions, 2);
+  Serial.print(",\"lutCycles\":");
+  Serial.print((float)lutCycles / conversions, 2);
+  Serial.print(",\"speedup\":");
+  Serial.print(lutCycles > 0 ? (float)floatCycles / lutCycles : 0, 1);
+  Serial.print(",\"maxErrorMa\":");
+  Serial.print(maxErrorMa);
+  Serial.print("}");
+  Serial.println();
+}
+
 // Function to print help menu
 void printHelp() {
   Serial.println("\n=== Commands ===");
@@ -437,23 +1108,61 @@ void printHelp() {
   Serial.print(SEQUENTIAL_REPEAT_COUNT);
   Serial.println("x (P&H)");
   Serial.println();
+  Serial.println("Engine Run (firing order 1-3-4-2):");
+  Serial.print("  6 - All injectors concurrently, ");
+  Serial.print(ENGINE_CYCLES);
+  Serial.println(" cycles (normal)");
+  Serial.print("  7 - All injectors concurrently, ");
+  Serial.print(ENGINE_CYCLES);
+  Serial.println(" cycles (P&H)");
+  Serial.println("  8 - Cycle engine RPM presets (1000/3000/6000)");
+  Serial.println("  0 - Stop engine run");
+  Serial.println();
   Serial.println("Configuration:");
   Serial.println("  p - Set pulse width");
   Serial.println("  k - Calibrate current sensors");
-  Serial.println("  l - Toggle SD current logging (10kHz)");
+  Serial.println("  l - Toggle SD current logging (at sample rate)");
   Serial.println("  m - Dump log files from SD card");
   Serial.println("  i - Get status info (JSON)");
   Serial.println("  o - Get sensor offsets");
+  Serial.println("  j - Get sampler jitter/overrun stats (JSON)");
+  Serial.println("  u - Cycle sample rate/mode (10k/50k/100k scan, 10k timer)");
+  Serial.println("  n - Benchmark ADC-to-current conversion (JSON)");
+  Serial.println("  y - Edge timing self-test (loopback to capture pin, JSON)");
+  Serial.println("  W - Upload P&H drive profile (segment table, DEFAULT or REGULATED)");
   Serial.println("  h - Show this help");
   Serial.println();
+  Serial.println("Line Commands (key=value, optional id=<n> for [ACK]/[DONE]):");
+  Serial.println("  fire ch=<1-4|all> [n=<count>] [mode=normal|ph] [pw=<ms>]");
+  Serial.println("  engine [mode=normal|ph] [rpm=<100-20000>] [trim=<deg,deg,deg,deg>]");
+  Serial.println("  sweep ch=<1-4,..|all> [mode=normal|ph|both] [pw=<ms>|<first>:<last>:<step>] [peak=..] [freq=..]");
+  Serial.println("        [duty=..] [n=<shots>] [gap=<ms>] [shuffle=<seed>] [from=<point>] - One [SWEEP] row per point");
+  Serial.println("  stop - Abort firing or engine run, flush queued commands");
+  Serial.println("  set [pw=<ms>] [rate=<Hz>] [sampler=scan|timer] [shots=0|1] [tlimit=<C>] [plimit=<W>]");
+  Serial.println("  profile ph=\"<segments>\"|default|regulated");
+  Serial.println("  log on=0|1 [mode=continuous|capture|adaptive] [pre=<us>] [post=<us>] [decim=<n>] [hold=<us>] [pack=0|1]");
+  Serial.println("  files, dump file=<name>|run=<n> [shot=<k>], get file=<name>|run=<n> [offset=<n>] (binary frames), get abort=1");
+  Serial.println("  overview run=<n> [from=<us>] [to=<us>] [points=<n>] - min/max/mean from the summary pyramid");
+  Serial.println("  live on=0|1 [decim=<n>] - Decimated samples as binary frames while firing");
+  Serial.println("  perf [reset=1] - Hot path timings and sample lateness histograms (JSON)");
+  Serial.println("  protect [clear=1] [test=<1-4>] [ch=<1-4|all> [trip=<A>] [slope=<mA/us>] [open=<A>] [idle=<A>]]");
+  Serial.println("  cal, status, stats, thermal, offsets, bench, edgetest, help");
+  Serial.println();
   Serial.print("Current pulse width: ");
   Serial.print(pulseWidth / 1000.0, 1);
   Serial.println(" ms");
+  const WaveSegment *peak = waveFirstSegment(peakHoldProfile, WAVE_ON);
+  const WaveSegment *hold = waveFirstSegment(peakHoldProfile, WAVE_PWM);
   Serial.print("Peak time: ");
-  Serial.print(peakTime / 1000.0, 1);
+  Serial.print(peak ? peak->durationUs / 1000.0 : 0, 1);
   Serial.println(" ms");
-  Serial.print("Hold frequency: 2000 Hz");
-  Serial.println();
+  Serial.print("Hold frequency: ");
+  Serial.print(hold ? hold->freqHz : 0);
+  Serial.println(" Hz");
+  char profileText[WAVE_TEXT_SIZE];
+  waveFormatProfile(peakHoldProfile, profileText, sizeof(profileText));
+  Serial.print("P&H profile: ");
+  Serial.println(profileText);
   Serial.print("SD logging: ");
   Serial.println(sdLogging ? "AVAILABLE" : "NOT AVAILABLE");
   Serial.print("Current logging: ");
@@ -461,136 +1170,379 @@ void printHelp() {
   Serial.println("================\n");
 }
 
-// Function to fire injector with normal pulse
-void fireInjectorNormal(int injNum, float *peakCurrent, float *avgCurrent, int *samples) {
-  unsigned long startTime = micros();
-  unsigned long nextSample = startTime;
-  bool injectorStates[4] = {false, false, false, false};
-  
-  digitalWrite(INJ_PINS[injNum], HIGH);
-  injectorStates[injNum] = true;
-  
-  *peakCurrent = 0;
-  *avgCurrent = 0;
-  *samples = 0;
-  
-  // Sample current during pulse
-  while (micros() - startTime < pulseWidth) {
-    unsigned long currentTime = micros();
-    
-    // High-speed logging at 10kHz
-    if (currentTime >= nextSample) {
-      logCurrentSample(injectorStates);
-      nextSample += SAMPLE_INTERVAL_US;
+// Function to add one sample to the statistics of every injector inside a shot
+inline void accumulateSample(const RawSample &sample, PulseCurrent *currents) {
+  uint8_t shots = sample.injectorMask >> 4;
+  if (!shots) return;
+  uint32_t supplyMv = sample.supply * SUPPLY_MV_PER_CODE;
+  while (shots) {
+    int ch = __builtin_ctz(shots);
+    shots &= shots - 1;
+    uint32_t milliamps = currentLutMilliamps(ch, sample.adc[ch]);
+    PulseCurrent &current = currents[ch];
+    if (milliamps > current.peakMa) current.peakMa = milliamps;
+    current.sumMa += milliamps;
+    current.samples++;
+    if (sample.injectorMask & (1 << ch)) {
+      current.driveSamples++;
+      current.driveSumMa += milliamps;
+      current.supplySumMv += supplyMv;
+      current.powerSum += (uint64_t)milliamps * supplyMv;
     }
-    
-    // Performance monitoring (slower rate)
-    float current = readCurrent(injNum);
-    if (current > *peakCurrent) *peakCurrent = current;
-    *avgCurrent += current;
-    (*samples)++;
-    delayMicroseconds(PERFORMANCE_SAMPLE_INTERVAL);
   }
-  
-  digitalWrite(INJ_PINS[injNum], LOW);
-  injectorStates[injNum] = false;
-  
-  // Log final state
-  logCurrentSample(injectorStates);
-  
-  if (*samples > 0) {
-    *avgCurrent /= *samples;
+}
+
+// Function to integrate a shot's supply charge (uC) and energy (mJ) over the sample period
+void shotEnergy(const PulseCurrent &pulse, float &chargeUc, float &energyMj) {
+  float periodUs = 1000000.0f / SAMPLER_PRESETS[samplerPreset].rateHz;
+  chargeUc = pulse.driveSumMa * periodUs * 1e-3f;   // mA x us = nC
+  energyMj = pulse.powerSum * periodUs * 1e-9f;     // uW x us = pJ
+}
+
+// Function to print a shot's supply voltage, charge and energy as JSON members
+void printShotEnergy(const PulseCurrent &pulse) {
+  float chargeUc, energyMj;
+  shotEnergy(pulse, chargeUc, energyMj);
+  Serial.print(",\"supplyVoltage\":");
+  Serial.print(pulse.driveSamples > 0 ? pulse.supplySumMv / pulse.driveSamples * 0.001f : 0, 2);
+  Serial.print(",\"chargeUc\":");
+  Serial.print(chargeUc, 1);
+  Serial.print(",\"energyMj\":");
+  Serial.print(energyMj, 2);
+}
+
+// Function to print a microsecond feature as a JSON member, null when it wasn't found
+void printFeatureUs(const char *key, bool found, uint32_t us) {
+  Serial.print(",\"");
+  Serial.print(key);
+  Serial.print("\":");
+  if (found) {
+    Serial.print(us);
+  } else {
+    Serial.print("null");
   }
 }
 
-// Function to fire injector with peak and hold
-void fireInjectorPeakHold(int injNum, float *peakCurrent, float *avgCurrent, int *samples) {
-  unsigned long totalStartTime = micros();
-  unsigned long nextSample = totalStartTime;
-  unsigned long nextLogSample = totalStartTime;
-  bool injectorStates[4] = {false, false, false, false};
-  
-  *peakCurrent = 0;
-  *avgCurrent = 0;
-  *samples = 0;
-  
-  // Peak phase - full voltage
-  digitalWrite(INJ_PINS[injNum], HIGH);
-  injectorStates[injNum] = true;
-  
-  while (micros() - totalStartTime < peakTime) {
-    unsigned long currentTime = micros();
-    
-    // High-speed logging at 10kHz
-    if (currentTime >= nextLogSample) {
-      logCurrentSample(injectorStates);
-      nextLogSample += SAMPLE_INTERVAL_US;
-    }
-    
-    // Performance monitoring
-    if (currentTime >= nextSample) {
-      float current = readCurrent(injNum);
-      if (current > *peakCurrent) *peakCurrent = current;
-      *avgCurrent += current;
-      (*samples)++;
-      nextSample += PERFORMANCE_SAMPLE_INTERVAL;
-    }
+// Function to print a shot's waveform features as JSON members
+void printShotFeatures(const ShotFeatures &features) {
+  printFeatureUs("openingDelayUs", features.opened, features.openingDelayUs);
+  printFeatureUs("timeToPeakUs", true, features.timeToPeakUs);
+  Serial.print(",\"holdCurrent\":");
+  if (features.holdSamples > 0) {
+    Serial.print(features.holdMeanMa * 0.001f, 3);
+  } else {
+    Serial.print("null");
   }
+  printFeatureUs("closingDecayUs", features.closed, features.closingDecayUs);
+}
+
+// Function to add a shot to its injector's run statistics and thermal model, printing a [SHOT]
+// record if enabled. Crossing a thermal limit stops the run after this shot.
+void recordShot(int injNum, const PulseCurrent &pulse, const ShotFeatures &features) {
+  if (pulse.samples == 0) return;
+  float peakAmps = currentMilliampsToAmps(pulse.peakMa);
+  float avgAmps = (float)pulse.sumMa / pulse.samples * 0.001f;
+  float chargeUc, energyMj;
+  shotEnergy(pulse, chargeUc, energyMj);
+  shotStatsAdd(runStats[injNum], peakAmps, avgAmps, energyMj, features);
   
-  // Hold phase - PWM at 2kHz, 50% duty
-  unsigned long holdStart = micros();
-  unsigned long holdEnd = holdStart + holdTime;
-  unsigned long nextToggle = holdStart;
-  bool holdOn = true;
-  // Use global constants for PWM timing
+  if (coilThermalAddShot(injNum, energyMj * 0.001f, millis())) {
+    Serial.print("[ERROR]Injector ");
+    Serial.print(injNum + 1);
+    Serial.println(" over its thermal limit - stopping");
+    coilThermalPrint();
+    stopRequested = true;
+  }
+  if (!shotRecords) return;
   
-  while (micros() < holdEnd) {
-    unsigned long currentTime = micros();
-    
-    // PWM control
-    if (currentTime >= nextToggle) {
-      if (holdOn) {
-        digitalWrite(INJ_PINS[injNum], HIGH);
-        injectorStates[injNum] = true;
-        nextToggle += holdDuty;
-      } else {
-        digitalWrite(INJ_PINS[injNum], LOW);
-        injectorStates[injNum] = false;
-        nextToggle += (holdPeriod - holdDuty);
-      }
-      holdOn = !holdOn;
-    }
-    
-    // High-speed logging at 10kHz
-    if (currentTime >= nextLogSample) {
-      logCurrentSample(injectorStates);
-      nextLogSample += SAMPLE_INTERVAL_US;
-    }
+  Serial.print("[SHOT]{\"injector\":");
+  Serial.print(injNum + 1);
+  Serial.print(",\"shot\":");
+  Serial.print(runStats[injNum].peakCurrent.count);
+  Serial.print(",\"peakCurrent\":");
+  Serial.print(peakAmps, 3);
+  Serial.print(",\"avgCurrent\":");
+  Serial.print(avgAmps, 3);
+  printShotEnergy(pulse);
+  printShotFeatures(features);
+  Serial.println("}");
+}
+
+// Function to record a finished shot and start accumulating the injector's next one
+void closeShot(ShotSplitter &splitter, int ch, const ShotFeatures &features) {
+  recordShot(ch, splitter.current[ch], features);
+  splitter.last[ch] = features;
+  splitter.current[ch] = PulseCurrent();
+}
+
+// Function to run the feature trackers over a sample, recording the shots they complete
+void splitShots(const RawSample &sample, ShotSplitter &splitter) {
+  for (int ch = 0; ch < 4; ch++) {
+    bool gate = sample.injectorMask & (0x10 << ch);
+    FeatureTracker &tracker = splitter.features[ch];
+    if (!gate && !featureTrackerActive(tracker)) continue;
     
-    // Performance monitoring
-    if (currentTime >= nextSample) {
-      float current = readCurrent(injNum);
-      if (current > *peakCurrent) *peakCurrent = current;
-      *avgCurrent += current;
-      (*samples)++;
-      nextSample += PERFORMANCE_SAMPLE_INTERVAL;
+    bool drive = sample.injectorMask & (1 << ch);
+    uint32_t milliamps = currentLutMilliamps(ch, sample.adc[ch]);
+    ShotFeatures features;
+    if (featureTrackerAdd(tracker, sample.timestamp, milliamps, drive, gate, features)) {
+      closeShot(splitter, ch, features);
     }
   }
-  
-  // Ensure injector is off
-  digitalWrite(INJ_PINS[injNum], LOW);
-  injectorStates[injNum] = false;
-  
-  // Log final state
-  logCurrentSample(injectorStates);
-  
-  if (*samples > 0) {
-    *avgCurrent /= *samples;
-  }
+  accumulateSample(sample, splitter.current);
+}
+
+// Function to record shots still open when sampling stopped
+void flushShots(ShotSplitter &splitter) {
+  for (int ch = 0; ch < 4; ch++) {
+    ShotFeatures features;
+    if (featureTrackerFlush(splitter.features[ch], features)) closeShot(splitter, ch, features);
+  }
+}
+
+// Function to drain timer-driven samples into the logger and pulse statistics
+void consumeSamples(PulseCurrent *currents, ShotSplitter *splitter = nullptr) {
+  RawSample sample;
+  while (samplerRead(sample)) {
+    PERF_SCOPE(PERF_CONSUME);
+    logCurrentSample(sample);
+    telemetryAppend(sample);
+    accumulateSample(sample, currents);
+    if (splitter) splitShots(sample, *splitter);
+  }
+}
+
+// Function to start acquisition with the selected preset
+void startSampling() {
+  const SamplerPreset &preset = SAMPLER_PRESETS[samplerPreset];
+  telemetrySetRate(preset.rateHz);
+  samplerStart(preset.mode, preset.rateHz);
+}
+
+// Function to stop sampling once a sample from after the last edge (micros() endUs) has been consumed
+void finishSampling(unsigned long endUs, PulseCurrent *currents, ShotSplitter *splitter = nullptr) {
+  // Scan samples arrive a DMA block at a time, so allow for that plus two periods
+  unsigned long timeout = samplerLatencyUs() + 2000000UL / SAMPLER_PRESETS[samplerPreset].rateHz;
+  RawSample sample;
+  while ((long)(micros() - endUs) < (long)timeout) {
+    if (!samplerRead(sample)) continue;
+    logCurrentSample(sample);
+    telemetryAppend(sample);
+    accumulateSample(sample, currents);
+    if (splitter) splitShots(sample, *splitter);
+    if ((long)(sample.timestamp - endUs) >= 0) break;
+  }
+  samplerStop();
+  
+  // Anything left was taken after the pulse ended - log it but keep it out of the stats
+  while (samplerRead(sample)) {
+    logCurrentSample(sample);
+    telemetryAppend(sample);
+  }
+}
+
+// Function to refuse current regulated profiles unless samples arrive per conversion
+bool regulationBlocks(const WaveProgram &program) {
+  const SamplerPreset &preset = SAMPLER_PRESETS[samplerPreset];
+  if (!waveRegulated(program) || (preset.mode == SAMPLER_SCAN && preset.rateHz >= REG_MIN_SAMPLE_RATE)) return false;
+  Serial.println("[ERROR]REG segments need dual-ADC scan sampling at 50kHz or more - set rate=50000 or 100000");
+  return true;
+}
+
+// Function to fire one shot from the pulse engine while consuming samples, the shot is recorded in
+// the run statistics
+void fireShot(int injNum, const WaveProgram &program, PulseCurrent *pulse, ShotFeatures *features) {
+  PulseCurrent currents[4] = {};
+  ShotSplitter shots = {};
+  *pulse = PulseCurrent();
+  *features = ShotFeatures();
+  if (regulationBlocks(program)) return;
+  
+  // Sampling runs from the hardware timer and edges from the pulse engine, this loop only consumes.
+  // It carries on past the last edge for the closing decay.
+  startSampling();
+  uint32_t startTick = pulseEngineNow() + pulseUsToTicks(PULSE_START_DELAY);
+  unsigned long endUs = micros() + PULSE_START_DELAY + program.totalTicks / PULSE_TICKS_PER_US +
+                        FEATURE_DECAY_TIMEOUT_US;
+  
+  if (!pulseEngineArm(injNum, startTick, program)) {
+    Serial.println("[ERROR]Pulse engine could not arm the shot");
+    samplerStop();
+    return;
+  }
+  
+  while (pulseEngineBusy(injNum)) {
+    consumeSamples(currents, &shots);
+    serviceProtection();
+    yield();
+  }
+  finishSampling(endUs, currents, &shots);
+  flushShots(shots);
+  *pulse = currents[injNum];
+  *features = shots.last[injNum];
+  currentControlPrintResults();
+}
+
+// Function to fire injector with normal pulse
+void fireInjectorNormal(int injNum, PulseCurrent *pulse, ShotFeatures *features) {
+  fireShot(injNum, normalProgram, pulse, features);
+}
+
+// Function to fire injector with peak and hold
+void fireInjectorPeakHold(int injNum, PulseCurrent *pulse, ShotFeatures *features) {
+  fireShot(injNum, peakHoldProgram, pulse, features);
+}
+
+// Function to refuse bench commands that need the injectors while an engine run owns them
+bool engineRunBlocks() {
+  if (!engineRunActive) return false;
+  Serial.println("[ERROR]Engine run in progress - press 0 to stop it");
+  return true;
+}
+
+// Function to refuse firing while any of the given injectors is still over a thermal limit
+bool thermalBlocks(uint8_t channelMask) {
+  for (int ch = 0; ch < 4; ch++) {
+    if (!(channelMask & (1 << ch)) || !coilThermalOverLimit(ch, millis())) continue;
+    Serial.print("[ERROR]Injector ");
+    Serial.print(ch + 1);
+    Serial.println(" is cooling below its thermal limit - try again later");
+    return true;
+  }
+  return false;
+}
+
+// Function to refuse firing while protection has any channel latched off
+bool protectionBlocks() {
+  if (!protectionFaults()) return false;
+  Serial.println("[ERROR]Protection fault latched - check the injector wiring, then protect clear=1");
+  return true;
+}
+
+// Function to report a protection trip and stop firing, the channel is already off
+void serviceProtection() {
+  static ProtectFault fault;  // Carries the pre-fault history, too big for the stack
+  if (!protectionTakeFault(fault)) return;
+  stopRequested = true;
+  protectionPrintFault(fault);
+  if (!fault.test) {
+    Serial.print("[ERROR]Injector ");
+    Serial.print(fault.channel + 1);
+    Serial.println(" tripped - firing stopped and latched until protect clear=1");
+  }
+}
+
+// Function to release the protection latch and let the pulse engine and regulator drive again
+uint8_t clearProtection() {
+  uint8_t faults = protectionClear();
+  pulseEngineInhibit(0);
+  currentControlInhibit(0);
+  return faults;
+}
+
+// Function to trip protection on purpose with one low-threshold shot, measuring the real trip path
+const char *runProtectionTest(int injNum) {
+  if (engineRunBlocks() || protectionBlocks() || thermalBlocks(1 << injNum)) return nullptr;
+  
+  PulseCurrent pulse;
+  ShotFeatures features;
+  protectionStartTest(injNum);
+  fireInjectorNormal(injNum, &pulse, &features);
+  serviceProtection();
+  stopRequested = false;
+  if (!(clearProtection() & (1 << injNum))) return "test shot did not trip - is the injector connected?";
+  return nullptr;
+}
+
+// Function to measure achieved edge timing through the capture loopback
+void runEdgeSelfTest() {
+  if (engineRunBlocks()) return;
+  
+  Serial.print("[LOG]Edge self-test on injector ");
+  Serial.print(EDGE_TEST_INJECTOR + 1);
+  Serial.print(" - drive pin ");
+  Serial.print(INJ_PINS[EDGE_TEST_INJECTOR]);
+  Serial.print(" must be jumpered to pin ");
+  Serial.println(PULSE_CAPTURE_PIN);
+  
+  pulseEngineSelfTest(EDGE_TEST_INJECTOR, "normal", normalProgram);
+  idleDelay(PULSE_DELAY);
+  pulseEngineSelfTest(EDGE_TEST_INJECTOR, "peakHold", peakHoldProgram);
+}
+
+// Function to print one shot's current and waveform features as [RESULT] JSON
+void printShotResult(int injNum, const PulseCurrent &pulse, const ShotFeatures &features, bool peakHold) {
+  float avgMa = pulse.samples > 0 ? (float)pulse.sumMa / pulse.samples : 0;
+  Serial.print("[RESULT]{\"injector\":");
+  Serial.print(injNum + 1);
+  Serial.print(",\"peakCurrent\":");
+  Serial.print(currentMilliampsToAmps(pulse.peakMa), 2);
+  Serial.print(",\"avgCurrent\":");
+  Serial.print(avgMa * 0.001f, 2);
+  printShotEnergy(pulse);
+  printShotFeatures(features);
+  Serial.print(",\"peakHold\":");
+  Serial.print(peakHold ? "true" : "false");
+  Serial.println("}");
+}
+
+// Function to print a feature's run statistics as a JSON member, skipped when no shot had it
+void printFeatureStat(const char *key, const RunningStat &stat, int decimals) {
+  if (stat.count == 0) return;
+  Serial.print(",\"");
+  Serial.print(key);
+  Serial.print("\":");
+  runningStatPrint(stat, decimals);
+}
+
+// Function to print an injector's run statistics with the parameters they were taken at as [SUMMARY] JSON
+void printRunSummary(const char *run, int injNum, bool peakHold, uint32_t rpm) {
+  const ShotStats &stats = runStats[injNum];
+  if (stats.peakCurrent.count == 0) return;
+  
+  Serial.print("[SUMMARY]{\"run\":\"");
+  Serial.print(run);
+  Serial.print("\",\"injector\":");
+  Serial.print(injNum + 1);
+  Serial.print(",\"mode\":\"");
+  Serial.print(peakHold ? "ph" : "normal");
+  Serial.print("\"");
+  if (peakHold) {
+    char profileText[WAVE_TEXT_SIZE];
+    waveFormatProfile(peakHoldProfile, profileText, sizeof(profileText));
+    Serial.print(",\"profile\":\"");
+    Serial.print(profileText);
+    Serial.print("\"");
+  } else {
+    Serial.print(",\"pulseWidth\":");
+    Serial.print(pulseWidth / 1000.0, 3);
+  }
+  if (rpm > 0) {
+    Serial.print(",\"rpm\":");
+    Serial.print(rpm);
+  }
+  Serial.print(",\"sampleRate\":");
+  Serial.print(SAMPLER_PRESETS[samplerPreset].rateHz);
+  Serial.print(",\"shots\":");
+  Serial.print(stats.peakCurrent.count);
+  Serial.print(",\"peakCurrent\":");
+  runningStatPrint(stats.peakCurrent, 3);
+  Serial.print(",\"avgCurrent\":");
+  runningStatPrint(stats.avgCurrent, 3);
+  printFeatureStat("energyMj", stats.energy, 2);
+  printFeatureStat("openingDelayUs", stats.openingDelay, 1);
+  printFeatureStat("timeToPeakUs", stats.timeToPeak, 1);
+  printFeatureStat("holdCurrent", stats.holdCurrent, 3);
+  printFeatureStat("closingDecayUs", stats.closingDecay, 1);
+  Serial.print("}");
+  Serial.println();
 }
 
 // Function to fire a single injector multiple times
 void fireInjector(int injNum, int count, bool peakHold) {
+  if (engineRunBlocks() || protectionBlocks() || thermalBlocks(1 << injNum)) return;
+  if (peakHold && regulationBlocks(peakHoldProgram)) return;
+  
   Serial.print("Firing injector ");
   Serial.print(injNum + 1);
   Serial.print(" x");
@@ -598,33 +1550,25 @@ void fireInjector(int injNum, int count, bool peakHold) {
   if (peakHold) Serial.print(" (Peak & Hold)");
   Serial.println();
   
-  for (int i = 0; i < count; i++) {
-    float peakCurrent = 0;
-    float avgCurrent = 0;
-    int samples = 0;
+  shotStatsReset(runStats[injNum]);
+  for (int i = 0; i < count && !stopRequested; i++) {
+    PulseCurrent pulse;
+    ShotFeatures features;
     
     if (peakHold) {
-      fireInjectorPeakHold(injNum, &peakCurrent, &avgCurrent, &samples);
+      fireInjectorPeakHold(injNum, &pulse, &features);
     } else {
-      fireInjectorNormal(injNum, &peakCurrent, &avgCurrent, &samples);
+      fireInjectorNormal(injNum, &pulse, &features);
     }
     
-    // Print current data for single shots
+    // Print current data for single shots, multi-shot runs get a summary at the end
     if (count == 1) {
-      Serial.print("[RESULT]{\"injector\":");
-      Serial.print(injNum + 1);
-      Serial.print(",\"peakCurrent\":");
-      Serial.print(peakCurrent, 2);
-      Serial.print(",\"avgCurrent\":");
-      Serial.print(avgCurrent, 2);
-      Serial.print(",\"peakHold\":");
-      Serial.print(peakHold ? "true" : "false");
-      Serial.println("}");
+      printShotResult(injNum, pulse, features, peakHold);
     }
     
     // Delay between pulses (except for last pulse)
     if (i < count - 1) {
-      delay(PULSE_DELAY);
+      idleDelay(PULSE_DELAY);
     }
     
     // Progress indicator for multiple shots
@@ -635,29 +1579,38 @@ void fireInjector(int injNum, int count, bool peakHold) {
   
   if (count > 1) {
     Serial.println(" Done!");
+    printRunSummary("fire", injNum, peakHold, 0);
+    coilThermalPrint();
   }
 }
 
 // Function to fire all injectors sequentially
 void fireAllSequential(int count, bool peakHold) {
+  if (engineRunBlocks() || protectionBlocks() || thermalBlocks(0x0F)) return;
+  if (peakHold && regulationBlocks(peakHoldProgram)) return;
+  
   Serial.print("Firing all injectors sequentially x");
   Serial.print(count);
   if (peakHold) Serial.print(" (Peak & Hold)");
   Serial.println(" (cycling 1-2-3-4)");
   
-  for (int cycle = 0; cycle < count; cycle++) {
+  for (int inj = 0; inj < 4; inj++) {
+    shotStatsReset(runStats[inj]);
+  }
+  
+  for (int cycle = 0; cycle < count && !stopRequested; cycle++) {
     for (int inj = 0; inj < 4; inj++) {
-      float peakCurrent = 0;
-      float avgCurrent = 0;
-      int samples = 0;
+      PulseCurrent pulse;
+      ShotFeatures features;
       
       if (peakHold) {
-        fireInjectorPeakHold(inj, &peakCurrent, &avgCurrent, &samples);
+        fireInjectorPeakHold(inj, &pulse, &features);
       } else {
-        fireInjectorNormal(inj, &peakCurrent, &avgCurrent, &samples);
+        fireInjectorNormal(inj, &pulse, &features);
       }
+      if (count == 1) printShotResult(inj, pulse, features, peakHold);
       
-      delay(SEQUENTIAL_INJ_DELAY);
+      idleDelay(SEQUENTIAL_INJ_DELAY);
     }
     
     // Progress indicator
@@ -665,10 +1618,271 @@ void fireAllSequential(int count, bool peakHold) {
       Serial.print(".");
     }
     
-    delay(SEQUENTIAL_CYCLE_DELAY);
+    idleDelay(SEQUENTIAL_CYCLE_DELAY);
   }
   
   Serial.println(" Sequential firing complete");
+  if (count > 1) {
+    for (int inj = 0; inj < 4; inj++) {
+      printRunSummary("sequential", inj, peakHold, 0);
+    }
+    coilThermalPrint();
+  }
+}
+
+// Function to print the mean of a run statistic as a JSON member, null when no shot had it
+void printStatMean(const char *key, const RunningStat &stat, int decimals) {
+  Serial.print(",\"");
+  Serial.print(key);
+  Serial.print("\":");
+  if (stat.count > 0) {
+    Serial.print(stat.mean, decimals);
+  } else {
+    Serial.print("null");
+  }
+}
+
+// Function to print one sweep point's parameters and, unless it couldn't be fired, its results as [SWEEP] JSON
+void printSweepRow(uint32_t position, const SweepPoint &point, float supplyVolts, const char *error) {
+  Serial.print("[SWEEP]{\"point\":");
+  Serial.print(position + 1);
+  Serial.print(",\"of\":");
+  Serial.print(sweepPointCount());
+  Serial.print(",\"injector\":");
+  Serial.print(point.channel + 1);
+  Serial.print(",\"mode\":\"");
+  Serial.print(point.peakHold ? "ph" : "normal");
+  Serial.print("\",\"pulseWidth\":");
+  Serial.print(point.pulseUs / 1000.0, 3);
+  if (point.peakHold) {
+    Serial.print(",\"peakTime\":");
+    Serial.print(point.peakUs / 1000.0, 3);
+    Serial.print(",\"holdFreq\":");
+    Serial.print(point.holdFreqHz);
+    Serial.print(",\"holdDuty\":");
+    Serial.print(point.holdDuty);
+  }
+  if (error) {
+    Serial.print(",\"error\":\"");
+    Serial.print(error);
+    Serial.println("\"}");
+    return;
+  }
+  
+  const ShotStats &stats = runStats[point.channel];
+  Serial.print(",\"shots\":");
+  Serial.print(stats.peakCurrent.count);
+  Serial.print(",\"supplyVoltage\":");
+  Serial.print(supplyVolts, 2);
+  printStatMean("peakCurrent", stats.peakCurrent, 3);
+  printStatMean("avgCurrent", stats.avgCurrent, 3);
+  printStatMean("energyMj", stats.energy, 2);
+  printStatMean("openingDelayUs", stats.openingDelay, 1);
+  Serial.print(",\"openingDelaySdUs\":");
+  if (stats.openingDelay.count > 0) {
+    Serial.print(runningStatSd(stats.openingDelay), 1);
+  } else {
+    Serial.print("null");
+  }
+  printStatMean("holdCurrent", stats.holdCurrent, 3);
+  printStatMean("closingDecayUs", stats.closingDecay, 1);
+  Serial.println("}");
+}
+
+// Function to run the sweep plan from run position first, shots per point with gapMs between every shot
+void runSweep(uint32_t first, int shots, unsigned long gapMs) {
+  uint32_t total = sweepPointCount();
+  uint32_t position = first;
+  for (; position < total && !stopRequested; position++) {
+    SweepPoint point;
+    WaveProfile profile;
+    WaveProgram program;
+    sweepPoint(position, point);
+    const char *error = sweepProfile(point, profile);
+    if (error) {
+      printSweepRow(position, point, 0, error);
+      continue;
+    }
+    waveCompile(profile, program);
+    
+    shotStatsReset(runStats[point.channel]);
+    float supplySum = 0;
+    int supplyShots = 0;
+    for (int i = 0; i < shots && !stopRequested; i++) {
+      PulseCurrent pulse;
+      ShotFeatures features;
+      idleDelay(gapMs);
+      fireShot(point.channel, program, &pulse, &features);
+      if (pulse.driveSamples > 0) {
+        supplySum += pulse.supplySumMv / pulse.driveSamples * 0.001f;
+        supplyShots++;
+      }
+    }
+    if (stopRequested) break;  // A part-done point is run again on resume
+    printSweepRow(position, point, supplyShots > 0 ? supplySum / supplyShots : 0, nullptr);
+  }
+  
+  if (position < total) {
+    Serial.print("[LOG]Sweep stopped before point ");
+    Serial.print(position + 1);
+    Serial.print(" of ");
+    Serial.print(total);
+    Serial.print(" - resume with from=");
+    Serial.println(position + 1);
+  } else {
+    Serial.println("[LOG]Sweep complete");
+  }
+  coilThermalPrint();
+}
+
+// Per-injector statistics of the current engine run
+PulseCurrent engineCurrents[4];
+ShotSplitter engineShots;
+
+// Function to start all injectors firing in engine order at the selected RPM
+void startEngineRun(bool peakHold) {
+  if (engineRunBlocks() || protectionBlocks() || thermalBlocks(0x0F)) return;
+  
+  FiringPlan plan;
+  plan.rpm = engineRpm;
+  plan.cycles = ENGINE_CYCLES;
+  plan.channelMask = 0x0F;
+  for (int slot = 0; slot < 4; slot++) {
+    int inj = FIRING_ORDER[slot] - 1;
+    plan.phaseDeg[inj] = (slot * 180 + phaseTrimDeg[inj] + 720) % 720;
+  }
+  
+  const WaveProgram &program = peakHold ? peakHoldProgram : normalProgram;
+  if (regulationBlocks(program)) return;
+  for (int ch = 0; ch < 4; ch++) {
+    engineCurrents[ch] = PulseCurrent();
+    shotStatsReset(runStats[ch]);
+  }
+  engineShots = ShotSplitter();
+  
+  startSampling();
+  engineRefTick = pulseEngineNow();
+  engineRefUs = micros();
+  if (!schedulerStart(plan, program)) {
+    samplerStop();
+    Serial.println("[ERROR]Firing plan rejected - each pulse must end before its injector's next cycle");
+    return;
+  }
+  
+  engineRunActive = true;
+  engineRunPeakHold = peakHold;
+  Serial.print("[LOG]Engine run: ");
+  Serial.print(plan.rpm);
+  Serial.print(" RPM, firing order 1-3-4-2, ");
+  Serial.print(ENGINE_CYCLES);
+  Serial.print(peakHold ? " cycles (P&H)" : " cycles");
+  if (phaseTrimDeg[0] || phaseTrimDeg[1] || phaseTrimDeg[2] || phaseTrimDeg[3]) {
+    Serial.print(", trim");
+    for (int ch = 0; ch < 4; ch++) {
+      Serial.print(ch == 0 ? " " : ",");
+      Serial.print(phaseTrimDeg[ch]);
+    }
+    Serial.print(" deg");
+  }
+  Serial.println();
+}
+
+// Function to print the per-injector results of an engine run
+void printEngineResult() {
+  Serial.print("[ENGINE]{\"rpm\":");
+  Serial.print(engineRpm);
+  Serial.print(",\"cycles\":");
+  Serial.print(ENGINE_CYCLES);
+  Serial.print(",\"peakHold\":");
+  Serial.print(engineRunPeakHold ? "true" : "false");
+  Serial.print(",\"skipped\":");
+  Serial.print(schedulerSkippedShots());
+  Serial.print(",\"trimDeg\":[");
+  for (int ch = 0; ch < 4; ch++) {
+    if (ch > 0) Serial.print(",");
+    Serial.print(phaseTrimDeg[ch]);
+  }
+  Serial.print("],\"injectors\":[");
+  for (int ch = 0; ch < 4; ch++) {
+    const PulseCurrent &current = engineCurrents[ch];
+    float avgMa = current.samples > 0 ? (float)current.sumMa / current.samples : 0;
+    if (ch > 0) Serial.print(",");
+    Serial.print("{\"injector\":");
+    Serial.print(ch + 1);
+    Serial.print(",\"shots\":");
+    Serial.print(schedulerShots(ch));
+    Serial.print(",\"peakCurrent\":");
+    Serial.print(currentMilliampsToAmps(current.peakMa), 2);
+    Serial.print(",\"avgCurrent\":");
+    Serial.print(avgMa * 0.001f, 2);
+    Serial.print("}");
+  }
+  Serial.print("]}");
+  Serial.println();
+  
+  for (int ch = 0; ch < 4; ch++) {
+    printRunSummary("engine", ch, engineRunPeakHold, engineRpm);
+  }
+  coilThermalPrint();
+}
+
+// Function to keep an engine run armed and its samples consumed, called from loop()
+void serviceEngineRun() {
+  if (!engineRunActive) return;
+  
+  bool active = schedulerService();
+  consumeSamples(engineCurrents, &engineShots);
+  currentControlPrintResults();
+  if (stopRequested) {
+    stopEngineRun();  // Thermal trip
+    return;
+  }
+  if (active) return;
+  
+  unsigned long endUs = engineRefUs + (schedulerEndTick() - engineRefTick) / PULSE_TICKS_PER_US +
+                        FEATURE_DECAY_TIMEOUT_US;
+  finishSampling(endUs, engineCurrents, &engineShots);
+  flushShots(engineShots);
+  engineRunActive = false;
+  printEngineResult();
+}
+
+// Function to abort an engine run, all injectors off
+void stopEngineRun() {
+  if (!engineRunActive) return;
+  schedulerStop();
+  finishSampling(micros(), engineCurrents, &engineShots);
+  flushShots(engineShots);
+  currentControlPrintResults();
+  engineRunActive = false;
+  Serial.println("[LOG]Engine run stopped");
+  printEngineResult();
+}
+
+// Function to step to the next engine run RPM
+void cycleEngineRpm() {
+  if (engineRunBlocks()) return;
+  // Next preset above the current speed, wrapping round to the first
+  uint32_t next = ENGINE_RPM_PRESETS[0];
+  for (int i = ENGINE_RPM_PRESET_COUNT - 1; i >= 0; i--) {
+    if (ENGINE_RPM_PRESETS[i] > engineRpm) next = ENGINE_RPM_PRESETS[i];
+  }
+  engineRpm = next;
+  Serial.print("[LOG]Engine run RPM: ");
+  Serial.println(engineRpm);
+  sendStatusUpdate();
+}
+
+// Function to print the current sensor offsets
+void printOffsets() {
+  Serial.println("[LOG]Current sensor offsets:");
+  for (int i = 0; i < 4; i++) {
+    Serial.print("[LOG]Channel ");
+    Serial.print(i + 1);
+    Serial.print(": ");
+    Serial.print(currentOffsets[i], 4);
+    Serial.println(" V");
+  }
 }
 
 // Function to process serial commands
@@ -711,6 +1925,12 @@ void processCommand(char cmd) {
     case 'g': fireAllSequential(SINGLE_REPEAT_COUNT, true); break;
     case 'b': fireAllSequential(SEQUENTIAL_REPEAT_COUNT, true); break;
     
+    // Engine run - all injectors concurrently in firing order
+    case '6': startEngineRun(false); break;
+    case '7': startEngineRun(true); break;
+    case '8': cycleEngineRpm(); break;
+    case '0': stopEngineRun(); break;
+    
     // Configuration
     case 'p': setPulseWidth(); break;
     case 'k': calibrateCurrentSensors(); break;
@@ -718,16 +1938,12 @@ void processCommand(char cmd) {
     case 'm': listLogFiles(); break;
     case 'h': printHelp(); break;
     case 'i': sendStatusUpdate(); break;
-    case 'o': 
-      Serial.println("[LOG]Current sensor offsets:");
-      for (int i = 0; i < 4; i++) {
-        Serial.print("[LOG]Channel ");
-        Serial.print(i + 1);
-        Serial.print(": ");
-        Serial.print(currentOffsets[i], 4);
-        Serial.println(" V");
-      }
-      break;
+    case 'j': samplerPrintStats(); break;
+    case 'u': cycleSamplerPreset(); break;
+    case 'n': benchmarkConversion(); break;
+    case 'y': runEdgeSelfTest(); break;
+    case 'W': uploadPeakHoldProfile(); break;
+    case 'o': printOffsets(); break;
     
     default:
       if (cmd >= 32 && cmd <= 126) {  // Printable characters only
@@ -738,15 +1954,591 @@ void processCommand(char cmd) {
   }
 }
 
+// Function to read an optional integer argument, false if it was given but invalid or out of range
+bool optionalLongArg(const CommandLine &line, const char *key, long minValue, long maxValue, long &value) {
+  if (!commandArg(line, key)) return true;
+  return commandArgLong(line, key, value) && value >= minValue && value <= maxValue;
+}
+
+// Function to read an optional drive mode argument (normal or ph)
+bool optionalModeArg(const CommandLine &line, bool &peakHold) {
+  const char *mode = commandArg(line, "mode");
+  if (!mode) return true;
+  if (strcasecmp(mode, "ph") == 0) {
+    peakHold = true;
+  } else if (strcasecmp(mode, "normal") == 0) {
+    peakHold = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// fire ch=<1-4|all> [n=<count>] [mode=normal|ph] [pw=<ms>]
+const char *commandFire(const CommandLine &line) {
+  const char *channel = commandArg(line, "ch");
+  long injector = 0;
+  long count = SINGLE_REPEAT_COUNT;
+  bool peakHold = false;
+  float newWidth = 0;
+  bool all = channel && strcasecmp(channel, "all") == 0;
+  
+  if (!channel) return "ch required";
+  if (!all && !(commandArgLong(line, "ch", injector) && injector >= 1 && injector <= 4)) return "ch must be 1-4 or all";
+  if (!optionalLongArg(line, "n", 1, MAX_FIRE_COUNT, count)) return "n must be 1-10000";
+  if (!optionalModeArg(line, peakHold)) return "mode must be normal or ph";
+  if (commandArg(line, "pw")) {
+    if (!commandArgFloat(line, "pw", newWidth) || !applyPulseWidth(newWidth)) return "pw must be 0.1-100 ms";
+  }
+  
+  if (all) {
+    fireAllSequential(count, peakHold);
+  } else {
+    fireInjector(injector - 1, count, peakHold);
+  }
+  return nullptr;
+}
+
+// Function to read a sweep range argument, the default is kept when it wasn't given
+const char *optionalRangeArg(const CommandLine &line, const char *key, float scale, uint32_t min, uint32_t max,
+                             SweepRange &range) {
+  const char *text = commandArg(line, key);
+  if (!text) return nullptr;
+  return sweepParseRange(text, scale, min, max, range);
+}
+
+// sweep ch=<1-4,...|all> [mode=normal|ph|both] [pw=<ms range>] [peak=<ms range>] [freq=<Hz range>]
+//       [duty=<% range>] [n=<shots>] [gap=<ms>] [shuffle=<seed>] [from=<point>]
+const char *commandSweep(const CommandLine &line) {
+  SweepPlan plan;
+  const char *channels = commandArg(line, "ch");
+  if (!channels) return "ch required";
+  if (strcasecmp(channels, "all") == 0) {
+    plan.channelMask = 0x0F;
+  } else {
+    plan.channelMask = 0;
+    for (const char *p = channels; *p; p++) {
+      if (*p >= '1' && *p <= '4' && (p[1] == ',' || p[1] == '\0')) {
+        plan.channelMask |= 1 << (*p - '1');
+      } else if (*p != ',') {
+        return "ch must be a list of 1-4 or all";
+      }
+    }
+  }
+  
+  const char *mode = commandArg(line, "mode");
+  if (!mode || strcasecmp(mode, "normal") == 0) {
+    plan.modes = SWEEP_NORMAL;
+  } else if (strcasecmp(mode, "ph") == 0) {
+    plan.modes = SWEEP_PEAK_HOLD;
+  } else if (strcasecmp(mode, "both") == 0) {
+    plan.modes = SWEEP_NORMAL | SWEEP_PEAK_HOLD;
+  } else {
+    return "mode must be normal, ph or both";
+  }
+  
+  // Unswept parameters stay at the current pulse width and P&H profile
+  const WaveSegment *peak = waveFirstSegment(peakHoldProfile, WAVE_ON);
+  const WaveSegment *hold = waveFirstSegment(peakHoldProfile, WAVE_PWM);
+  plan.pulseUs.first = plan.pulseUs.last = pulseWidth;
+  plan.peakUs.first = plan.peakUs.last = peak ? peak->durationUs : SWEEP_DEFAULT_PEAK_US;
+  plan.holdFreqHz.first = plan.holdFreqHz.last = hold ? hold->freqHz : SWEEP_DEFAULT_FREQ;
+  plan.holdDuty.first = plan.holdDuty.last = hold ? hold->dutyPercent : SWEEP_DEFAULT_DUTY;
+  plan.pulseUs.step = plan.peakUs.step = plan.holdFreqHz.step = plan.holdDuty.step = 0;
+  
+  const char *error = optionalRangeArg(line, "pw", 1000, MIN_PULSE_WIDTH * 1000, MAX_PULSE_WIDTH * 1000, plan.pulseUs);
+  if (error) return error;
+  error = optionalRangeArg(line, "peak", 1000, WAVE_MIN_SEGMENT_US, WAVE_MAX_TOTAL_US, plan.peakUs);
+  if (error) return error;
+  error = optionalRangeArg(line, "freq", 1, WAVE_MIN_PWM_HZ, WAVE_MAX_PWM_HZ, plan.holdFreqHz);
+  if (error) return error;
+  error = optionalRangeArg(line, "duty", 1, 1, 99, plan.holdDuty);
+  if (error) return error;
+  
+  long shots = SWEEP_DEFAULT_SHOTS;
+  long gap = PULSE_DELAY;
+  long seed = 0;
+  long from = 1;
+  if (!optionalLongArg(line, "n", 1, MAX_FIRE_COUNT, shots)) return "n must be 1-10000";
+  if (!optionalLongArg(line, "gap", 0, SWEEP_MAX_GAP_MS, gap)) return "gap must be 0-60000 ms";
+  if (!optionalLongArg(line, "shuffle", 0, 0x7FFFFFFF, seed)) return "shuffle must be a seed, 0 for grid order";
+  plan.seed = seed;
+  if (engineRunBlocks() || protectionBlocks() || thermalBlocks(plan.channelMask)) return nullptr;
+  error = sweepStart(plan);
+  if (error) return error;
+  if (!optionalLongArg(line, "from", 1, sweepPointCount(), from)) return "from must be a point of the sweep";
+  
+  Serial.print("[LOG]Sweep: ");
+  Serial.print(sweepPointCount());
+  Serial.print(" points x ");
+  Serial.print(shots);
+  Serial.print(" shots, ");
+  if (seed) {
+    Serial.print("shuffled with seed ");
+    Serial.print(seed);
+  } else {
+    Serial.print("grid order");
+  }
+  if (from > 1) {
+    Serial.print(", from point ");
+    Serial.print(from);
+  }
+  Serial.println();
+  runSweep(from - 1, shots, gap);
+  return nullptr;
+}
+
+// Function to read a protection current in amps, 0 disables the check
+bool optionalAmpsArg(const CommandLine &line, const char *key, uint16_t &milliamps) {
+  if (!commandArg(line, key)) return true;
+  float amps;
+  if (!commandArgFloat(line, key, amps) || amps < 0 || amps * 1000 > PROTECT_MAX_TRIP_MA) return false;
+  milliamps = (uint16_t)(amps * 1000 + 0.5f);
+  return true;
+}
+
+// protect [clear=1] [test=<1-4>] [ch=<1-4|all> [trip=<A>] [slope=<mA/us>] [open=<A>] [idle=<A>]]
+const char *commandProtect(const CommandLine &line) {
+  long clear = 0;
+  long test = 0;
+  if (!optionalLongArg(line, "clear", 0, 1, clear)) return "clear must be 0 or 1";
+  if (!optionalLongArg(line, "test", 1, 4, test)) return "test must be 1-4";
+  
+  const char *channels = commandArg(line, "ch");
+  if (channels) {
+    long injector = 0;
+    bool all = strcasecmp(channels, "all") == 0;
+    if (!all && !(commandArgLong(line, "ch", injector) && injector >= 1 && injector <= 4)) return "ch must be 1-4 or all";
+    
+    // Limits not given stay as they are, checked against the first channel's when all
+    ProtectLimits limits = protectionLimits(all ? 0 : injector - 1);
+    long slope = limits.slopeMaPerUs;
+    if (!optionalAmpsArg(line, "trip", limits.tripMa)) return "trip must be 0-20 A";
+    if (!optionalLongArg(line, "slope", 0, 1000, slope)) return "slope must be 0-1000 mA/us";
+    if (!optionalAmpsArg(line, "open", limits.openMa)) return "open must be 0-20 A";
+    if (!optionalAmpsArg(line, "idle", limits.idleMa)) return "idle must be 0-20 A";
+    limits.slopeMaPerUs = slope;
+    for (int ch = 0; ch < 4; ch++) {
+      if (all || ch == injector - 1) protectionSetLimits(ch, limits);
+    }
+  }
+  
+  if (clear) {
+    uint8_t faults = clearProtection();
+    Serial.print("[LOG]Protection cleared, faults were ");
+    Serial.println(faults);
+  }
+  if (test) {
+    const char *error = runProtectionTest(test - 1);
+    if (error) return error;
+  }
+  protectionPrintStatus();
+  return nullptr;
+}
+
+// Function to read four comma separated phase trims, one per injector, in degrees
+bool parseTrimList(const char *text, int trims[4]) {
+  const char *p = text;
+  for (int ch = 0; ch < 4; ch++) {
+    char *end;
+    long value = strtol(p, &end, 10);
+    if (end == p || value < -ENGINE_MAX_TRIM_DEG || value > ENGINE_MAX_TRIM_DEG) return false;
+    if (*end != (ch < 3 ? ',' : '\0')) return false;
+    trims[ch] = value;
+    p = end + 1;
+  }
+  return true;
+}
+
+// engine [mode=normal|ph] [rpm=<100-20000>] [trim=<deg,deg,deg,deg>]
+const char *commandEngine(const CommandLine &line) {
+  bool peakHold = false;
+  long rpm = engineRpm;
+  int trims[4];
+  if (!optionalModeArg(line, peakHold)) return "mode must be normal or ph";
+  const char *trimText = commandArg(line, "trim");
+  if (trimText && !parseTrimList(trimText, trims)) return "trim must be four degrees -180 to 180, injectors 1-4";
+  if (!optionalLongArg(line, "rpm", SCHEDULER_MIN_RPM, SCHEDULER_MAX_RPM, rpm)) return "rpm must be 100-20000";
+  engineRpm = rpm;
+  if (trimText) memcpy(phaseTrimDeg, trims, sizeof(phaseTrimDeg));
+  startEngineRun(peakHold);
+  return nullptr;
+}
+
+// set [pw=<ms>] [rate=<Hz>] [sampler=scan|timer]
+const char *commandSet(const CommandLine &line) {
+  float newWidth = 0;
+  if (commandArg(line, "pw")) {
+    if (!commandArgFloat(line, "pw", newWidth) || newWidth < MIN_PULSE_WIDTH || newWidth > MAX_PULSE_WIDTH) {
+      return "pw must be 0.1-100 ms";
+    }
+  }
+  
+  int preset = samplerPreset;
+  const char *sampler = commandArg(line, "sampler");
+  if (commandArg(line, "rate") || sampler) {
+    long rate = SAMPLER_PRESETS[samplerPreset].rateHz;
+    SamplerMode mode = SAMPLER_SCAN;
+    if (!optionalLongArg(line, "rate", 1, 1000000, rate)) return "rate must be a number of Hz";
+    if (sampler && strcasecmp(sampler, "timer") == 0) {
+      mode = SAMPLER_TIMER;
+    } else if (sampler && strcasecmp(sampler, "scan") != 0) {
+      return "sampler must be scan or timer";
+    }
+    
+    preset = -1;
+    for (int i = 0; i < SAMPLER_PRESET_COUNT; i++) {
+      if (SAMPLER_PRESETS[i].mode == mode && SAMPLER_PRESETS[i].rateHz == (uint32_t)rate) preset = i;
+    }
+    if (preset < 0) return "rate must be 10000, 50000 or 100000 (scan) or 10000 (timer)";
+    if (preset != samplerPreset && logCurrentData) return "stop logging before changing the sample rate";
+  }
+  
+  long records = shotRecords;
+  if (!optionalLongArg(line, "shots", 0, 1, records)) return "shots must be 0 or 1";
+  
+  float riseLimit = coilThermalRiseLimit();
+  float powerLimit = coilThermalPowerLimit();
+  if (commandArg(line, "tlimit") && (!commandArgFloat(line, "tlimit", riseLimit) || riseLimit <= 0)) {
+    return "tlimit must be a positive temperature rise in C";
+  }
+  if (commandArg(line, "plimit") && (!commandArgFloat(line, "plimit", powerLimit) || powerLimit < 0)) {
+    return "plimit must be a power in W, 0 for off";
+  }
+  shotRecords = records;
+  coilThermalSetLimits(riseLimit, powerLimit);
+  
+  if (commandArg(line, "pw")) applyPulseWidth(newWidth);
+  if (preset != samplerPreset) {
+    samplerPreset = preset;
+    sendStatusUpdate();
+  }
+  return nullptr;
+}
+
+// log on=0|1 [mode=continuous|capture|adaptive] [pre=<us>] [post=<us>] [decim=<n>] [hold=<us>] [pack=0|1]
+const char *commandLog(const CommandLine &line) {
+  long on = 0;
+  if (!commandArg(line, "on") || !optionalLongArg(line, "on", 0, 1, on)) return "on must be 0 or 1";
+  
+  LogMode mode = logMode;
+  const char *modeText = commandArg(line, "mode");
+  if (modeText && strcasecmp(modeText, "capture") == 0) {
+    mode = LOG_CAPTURE;
+  } else if (modeText && strcasecmp(modeText, "continuous") == 0) {
+    mode = LOG_CONTINUOUS;
+  } else if (modeText && strcasecmp(modeText, "adaptive") == 0) {
+    mode = LOG_ADAPTIVE;
+  } else if (modeText) {
+    return "mode must be continuous, capture or adaptive";
+  }
+  long preUs = capturePreUs;
+  long postUs = capturePostUs;
+  if (!optionalLongArg(line, "pre", 0, CAPTURE_MAX_PRE_US, preUs)) return "pre must be 0-100000 us";
+  if (!optionalLongArg(line, "post", 0, CAPTURE_MAX_POST_US, postUs)) return "post must be 0-100000 us";
+  long decimation = adaptiveDecimation;
+  long holdUs = adaptiveHoldUs;
+  if (!optionalLongArg(line, "decim", 2, ADAPTIVE_MAX_DECIMATION, decimation)) return "decim must be 2-64 samples";
+  if (!optionalLongArg(line, "hold", 0, ADAPTIVE_MAX_HOLD_US, holdUs)) return "hold must be 0-100000 us";
+  long packed = logPacked;
+  if (!optionalLongArg(line, "pack", 0, 1, packed)) return "pack must be 0 or 1";
+  
+  bool changed = mode != logMode || preUs != (long)capturePreUs || postUs != (long)capturePostUs ||
+                 decimation != adaptiveDecimation || holdUs != (long)adaptiveHoldUs || (packed != 0) != logPacked;
+  if (changed && logCurrentData) return "stop logging before changing the log mode";
+  logMode = mode;
+  capturePreUs = preUs;
+  capturePostUs = postUs;
+  adaptiveDecimation = decimation;
+  adaptiveHoldUs = holdUs;
+  logPacked = packed;
+  
+  if ((on != 0) != logCurrentData) toggleSDLogging();
+  return nullptr;
+}
+
+// Function to look up a run=<n> argument in the log store, returns nullptr or the reason
+const char *findRunArg(const CommandLine &line, LogRunEntry &entry) {
+  long run = 0;
+  if (!optionalLongArg(line, "run", 1, 0x7FFFFFFF, run)) return "run must be a run number";
+  if (!sdLogging) return "SD card not available";
+  if (!logStoreReadRun(run, entry)) return "run not in the log index";
+  return nullptr;
+}
+
+// dump file=<name> | dump run=<n> [shot=<k>]
+const char *commandDump(const CommandLine &line) {
+  const char *filename = commandArg(line, "file");
+  if (filename) {
+    dumpLogFile(filename);
+    return nullptr;
+  }
+  if (!commandArg(line, "run")) return "file or run required";
+  LogRunEntry entry;
+  const char *error = findRunArg(line, entry);
+  if (error) return error;
+  long shot = 0;
+  if (!optionalLongArg(line, "shot", 1, 0x7FFFFFFF, shot)) return "shot must be a shot number";
+  if (!commandArg(line, "shot")) {
+    dumpLogFile(entry.name);
+  } else if (shot > (long)entry.shotCount) {
+    return "shot not in the run's shot table";
+  } else {
+    dumpLogShot(entry, shot);
+  }
+  return nullptr;
+}
+
+// overview run=<n> [from=<us>] [to=<us>] [points=<n>] - times are from the run's first record
+const char *commandOverview(const CommandLine &line) {
+  if (!commandArg(line, "run")) return "run required";
+  LogRunEntry entry;
+  const char *error = findRunArg(line, entry);
+  if (error) return error;
+  if (entry.state != LOG_RUN_CLOSED) return "run has no summary pyramid";
+  uint32_t spanUs = entry.lastTimestamp - entry.firstTimestamp;
+  long fromUs = 0;
+  long toUs = spanUs < 0x7FFFFFFF ? spanUs + 1 : 0x7FFFFFFF;
+  long points = OVERVIEW_DEFAULT_POINTS;
+  if (!optionalLongArg(line, "from", 0, 0x7FFFFFFF, fromUs)) return "from must be us from the run start";
+  if (!optionalLongArg(line, "to", 1, 0x7FFFFFFF, toUs)) return "to must be us from the run start";
+  if (!optionalLongArg(line, "points", 1, OVERVIEW_MAX_POINTS, points)) return "points must be 1-2048";
+  if (toUs <= fromUs) return "to must be after from";
+  return printOverview(entry, fromUs, toUs, points);
+}
+
+// get file=<name>|run=<n> [offset=<n>] | get abort=1
+const char *commandGet(const CommandLine &line) {
+  long abort = 0;
+  if (!optionalLongArg(line, "abort", 0, 1, abort)) return "abort must be 0 or 1";
+  if (abort) {
+    bulkTransferAbort();
+    return nullptr;
+  }
+  
+  const char *filename = commandArg(line, "file");
+  LogRunEntry entry;
+  if (!filename && commandArg(line, "run")) {
+    const char *error = findRunArg(line, entry);
+    if (error) return error;
+    filename = entry.name;
+  }
+  if (!filename) return "file or run required";
+  if (!sdLogging) return "SD card not available";
+  if (logCurrentData) return "stop logging before a transfer";
+  long offset = 0;
+  if (!optionalLongArg(line, "offset", 0, 0x7FFFFFFF, offset)) return "offset must be a byte count";
+  return bulkTransferStart(filename, offset);
+}
+
+// live on=0|1 [decim=<n>] - decim 0 (default) follows the sample rate
+const char *commandLive(const CommandLine &line) {
+  long on = 0;
+  if (!commandArg(line, "on") || !optionalLongArg(line, "on", 0, 1, on)) return "on must be 0 or 1";
+  long decimation = 0;
+  if (!optionalLongArg(line, "decim", 0, TELEMETRY_MAX_DECIMATION, decimation)) return "decim must be 0-64 samples";
+  
+  if (on) {
+    telemetryStart(decimation, SAMPLER_PRESETS[samplerPreset].rateHz);
+  } else {
+    telemetryStop();
+  }
+  sendStatusUpdate();
+  return nullptr;
+}
+
+// Function to run one structured command, returns nullptr or the reason it was refused
+const char *runStructuredCommand(CommandLine &line) {
+  const char *error = commandParse(line);
+  if (error) return error;
+  const char *verb = commandVerb(line);
+  
+  // Everything below touches the injectors or their configuration, which an engine run owns
+  if (engineRunActive && strcasecmp(verb, "status") != 0 && strcasecmp(verb, "stats") != 0 &&
+      strcasecmp(verb, "thermal") != 0 && strcasecmp(verb, "live") != 0 && strcasecmp(verb, "perf") != 0 &&
+      strcasecmp(verb, "protect") != 0) {
+    return "engine run in progress";
+  }
+  
+  if (strcasecmp(verb, "fire") == 0) return commandFire(line);
+  if (strcasecmp(verb, "engine") == 0) return commandEngine(line);
+  if (strcasecmp(verb, "sweep") == 0) return commandSweep(line);
+  if (strcasecmp(verb, "set") == 0) return commandSet(line);
+  if (strcasecmp(verb, "profile") == 0) {
+    const char *text = commandArg(line, "ph");
+    if (!text) return "ph required";
+    return applyPeakHoldProfile(text);
+  }
+  if (strcasecmp(verb, "log") == 0) return commandLog(line);
+  if (strcasecmp(verb, "dump") == 0) return commandDump(line);
+  if (strcasecmp(verb, "get") == 0) return commandGet(line);
+  if (strcasecmp(verb, "overview") == 0) return commandOverview(line);
+  if (strcasecmp(verb, "live") == 0) return commandLive(line);
+  if (strcasecmp(verb, "perf") == 0) {
+    long reset = 0;
+    if (!optionalLongArg(line, "reset", 0, 1, reset)) return "reset must be 0 or 1";
+    perfPrint(reset);
+    return nullptr;
+  }
+  if (strcasecmp(verb, "protect") == 0) return commandProtect(line);
+  if (strcasecmp(verb, "files") == 0) {
+    if (!sdLogging) return "SD card not available";
+    collectLogFiles();
+    return nullptr;
+  }
+  if (strcasecmp(verb, "cal") == 0) calibrateCurrentSensors();
+  else if (strcasecmp(verb, "status") == 0) sendStatusUpdate();
+  else if (strcasecmp(verb, "stats") == 0) samplerPrintStats();
+  else if (strcasecmp(verb, "thermal") == 0) coilThermalPrint();
+  else if (strcasecmp(verb, "offsets") == 0) printOffsets();
+  else if (strcasecmp(verb, "bench") == 0) benchmarkConversion();
+  else if (strcasecmp(verb, "edgetest") == 0) runEdgeSelfTest();
+  else if (strcasecmp(verb, "help") == 0) printHelp();
+  else return "unknown command";
+  return nullptr;
+}
+
+// Function to report a command's outcome - [DONE] when it carried an id, otherwise only errors
+void sendCommandDone(const CommandLine &line, const char *error) {
+  if (!line.hasId) {
+    if (error) {
+      Serial.print("[ERROR]");
+      Serial.println(error);
+    }
+    return;
+  }
+  Serial.print("[DONE]{\"id\":");
+  Serial.print(line.id);
+  Serial.print(",\"ok\":");
+  Serial.print(error ? "false" : "true");
+  if (error) {
+    Serial.print(",\"error\":\"");
+    Serial.print(error);
+    Serial.print("\"");
+  }
+  Serial.print("}");
+  Serial.println();
+}
+
+// Function to acknowledge a received line that carried an id
+void sendCommandAck(const CommandLine &line, const char *error) {
+  if (!line.hasId) {
+    if (error) {
+      Serial.print("[ERROR]");
+      Serial.println(error);
+    }
+    return;
+  }
+  Serial.print(error ? "[NAK]{" : "[ACK]{");
+  Serial.print("\"id\":");
+  Serial.print(line.id);
+  if (error) {
+    Serial.print(",\"error\":\"");
+    Serial.print(error);
+    Serial.print("\"");
+  } else {
+    Serial.print(",\"queued\":");
+    Serial.print(commandQueue.size());
+  }
+  Serial.print("}");
+  Serial.println();
+}
+
+// Function to abort the current activity and everything queued behind it
+void stopEverything(const CommandLine &line) {
+  stopRequested = true;
+  pendingPrompt = PROMPT_NONE;
+  CommandLine flushed;
+  while (commandQueue.pop(flushed)) {
+    sendCommandDone(flushed, "flushed by stop");
+  }
+  if (engineRunActive) stopEngineRun();
+  sendCommandDone(line, nullptr);
+}
+
+// Function to receive serial bytes into the command queue, never blocks; also called while firing
+void serviceCommandInput() {
+  static CommandLine line;
+  while (Serial.available()) {
+    if (!commandReadByte(Serial.read(), line)) continue;
+    commandFindId(line);
+    
+    if (line.overflow) {
+      sendCommandAck(line, "line too long");
+      continue;
+    }
+    
+    // stop jumps the queue so it can end a long fire loop or an engine run
+    if (strcmp(line.text, "0") == 0 || strcasecmp(line.text, "stop") == 0 || strncasecmp(line.text, "stop ", 5) == 0) {
+      sendCommandAck(line, nullptr);
+      stopEverything(line);
+      continue;
+    }
+    
+    if (!commandQueue.push(line)) {
+      sendCommandAck(line, "queue full");
+      continue;
+    }
+    sendCommandAck(line, nullptr);
+  }
+}
+
+// Function to run the oldest queued line, held while an engine run owns the injectors
+void runNextCommand() {
+  if (engineRunActive) return;
+  CommandLine line;
+  if (!commandQueue.pop(line)) return;
+  stopRequested = false;
+  
+  const char *error = nullptr;
+  if (pendingPrompt != PROMPT_NONE) {
+    answerPrompt(line.text);
+  } else if (line.length == 1) {
+    processCommand(line.text[0]);
+  } else {
+    error = runStructuredCommand(line);
+  }
+  sendCommandDone(line, error);
+}
+
+// Function to track pulse engine edges - sampler mask, and the regulator for REG segments
+void onInjectorEdge(int channel, bool on, bool inShot, const WaveStep *regulate) {
+  samplerSetInjectorState(channel, on, inShot);
+  protectionDriveEdge(channel, on, inShot);
+  if (regulate) {
+    currentControlStart(channel, *regulate);
+  } else {
+    currentControlStop(channel);
+  }
+}
+
+// Function to track switches made by the current regulator, always inside a shot
+void onRegulatorEdge(int channel, bool on) {
+  samplerSetInjectorState(channel, on, true);
+  protectionDriveEdge(channel, on, true);
+}
+
+// Function to check every sample for faults, then regulate - ADC_ETC or sampler ISR
+FASTRUN void onSample(const uint16_t codes[4]) {
+  protectionSample(codes);
+  currentControlSample(codes);
+}
+
+// Function to keep a tripped channel off, called by protection before it cuts the pin
+void onProtectionTrip(int channel) {
+  uint8_t faults = protectionFaults() | (1 << channel);
+  pulseEngineInhibit(faults);
+  currentControlInhibit(faults);
+}
+
 // Setup function
 void setup() {
   Serial.begin(SERIAL_BAUD_RATE);
+  perfBegin();
   
-  // Initialize injector pins as outputs
-  for (int i = 0; i < 4; i++) {
-    pinMode(INJ_PINS[i], OUTPUT);
-    digitalWrite(INJ_PINS[i], LOW);
-  }
+  // Initialize injector pins as outputs, driven from the pulse engine timer
+  compileProfiles();
+  pulseEngineBegin(INJ_PINS, onInjectorEdge);
   
   // Initialize current sensing pins as inputs
   for (int i = 0; i < 4; i++) {
@@ -756,6 +2548,16 @@ void setup() {
   // Set ADC resolution
   analogReadResolution(ADC_RESOLUTION_BITS);
   
+  // Timer-driven sampling of all current channels
+  pinMode(SUPPLY_SENSE, INPUT);
+  samplerBegin(CURRENT_PINS, SUPPLY_SENSE);
+  coilThermalReset();
+  
+  // Per-sample fault checks, then current regulation for REG profile segments
+  currentControlBegin(INJ_PINS, onRegulatorEdge);
+  protectionBegin(INJ_PINS, onProtectionTrip);
+  samplerSetSampleHandler(onSample);
+  
   // Initialize SD card
   initializeSD();
   
@@ -768,8 +2570,22 @@ void setup() {
 
 // Main loop
 void loop() {
-  if (Serial.available()) {
-    char cmd = Serial.read();
-    processCommand(cmd);
-  }
+  PERF_SCOPE(PERF_LOOP);
+  
+  // Commands are queued as lines arrive and run one per pass
+  serviceProtection();
+  serviceCommandInput();
+  servicePromptTimeout();
+  runNextCommand();
+  
+  // Keep an engine run's shots armed and its samples drained
+  serviceEngineRun();
+  
+  // Idle time - copy captured windows and write any log buffers queued by the last shot
+  captureService();
+  logWriterService();
+  
+  // Frames of a bulk file transfer, a few per pass, and any live points still waiting
+  bulkTransferService();
+  telemetryService();
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef MIN_HEAP_H
+#define MIN_HEAP_H
+
+#include <stdint.h>
+
+// Fixed-capacity binary min-heap. Before(a, b) is true when a must come out first.
+// Not thread-safe - callers sharing it with an ISR mask interrupts around push().
+template <typename T, uint32_t N, typename Before>
+class MinHeap {
+public:
+  bool push(const T &item) {
+    if (size_ >= N) return false;
+    uint32_t i = size_++;
+    while (i > 0) {
+      uint32_t parent = (i - 1) / 2;
+      if (!Before()(item, items_[parent])) break;
+      items_[i] = items_[parent];
+      i = parent;
+    }
+    items_[i] = item;
+    return true;
+  }
+
+  bool pop(T &item) {
+    if (size_ == 0) return false;
+    item = items_[0];
+    T last = items_[--size_];
+    uint32_t i = 0;
+    while (true) {
+      uint32_t child = 2 * i + 1;
+      if (child >= size_) break;
+      if (child + 1 < size_ && Before()(items_[child + 1], items_[child])) child++;
+      if (!Before()(items_[child], last)) break;
+      items_[i] = items_[child];
+      i = child;
+    }
+    items_[i] = last;
+    return true;
+  }
+
+  const T &top() const { return items_[0]; }
+  uint32_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  static constexpr uint32_t capacity() { return N; }
+  void clear() { size_ = 0; }
+
+private:
+  T items_[N];
+  volatile uint32_t size_ = 0;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "perf_probe.h"
+
+#if PERF_PROBES
+
+static const char *const PROBE_NAMES[PERF_PROBE_COUNT] = {
+  "sampleIsr", "scanBlock", "pulseIsr", "consumeSample", "logAppend",
+  "logService", "sdWrite", "status", "loop",
+};
+
+static PerfStat probes[PERF_PROBE_COUNT];
+static PerfStat lateness;
+static const char *latenessMode = "";
+static uint32_t latenessPeriod = 0;
+static uint32_t latenessLimit = 0;
+static volatile uint32_t latenessLate = 0;
+static uint32_t overheadCycles = 0;
+
+static void clearStat(PerfStat &stat) {
+  memset(&stat, 0, sizeof(stat));
+  stat.minCycles = UINT32_MAX;
+}
+
+FASTRUN static void addStat(PerfStat &stat, uint32_t cycles) {
+  stat.count++;
+  stat.sumCycles += cycles;
+  if (cycles < stat.minCycles) stat.minCycles = cycles;
+  if (cycles > stat.maxCycles) stat.maxCycles = cycles;
+  int bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
+  if (bucket >= PERF_HIST_BUCKETS) bucket = PERF_HIST_BUCKETS - 1;
+  stat.hist[bucket]++;
+}
+
+void perfBegin() {
+  // Back to back counter reads through the same path as a probe, the fastest pass is the cost
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < PERF_OVERHEAD_PASSES; i++) {
+    volatile uint32_t start = ARM_DWT_CYCCNT;
+    uint32_t cycles = ARM_DWT_CYCCNT - start;
+    if (cycles < best) best = cycles;
+  }
+  overheadCycles = best;
+
+  for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+    clearStat(probes[i]);
+  }
+  perfLatenessReset("", 0, 0);
+}
+
+FASTRUN void perfRecord(PerfProbe probe, uint32_t cycles) {
+  addStat(probes[probe], cycles > overheadCycles ? cycles - overheadCycles : 0);
+}
+
+void perfLatenessReset(const char *mode, uint32_t periodCycles, uint32_t limitCycles) {
+  __disable_irq();
+  clearStat(lateness);
+  latenessMode = mode;
+  latenessPeriod = periodCycles;
+  latenessLimit = limitCycles;
+  latenessLate = 0;
+  __enable_irq();
+}
+
+FASTRUN void perfLateness(uint32_t cycles) {
+  addStat(lateness, cycles);
+  if (cycles > latenessLimit) latenessLate++;
+}
+
+// Durations in us, the histogram as counts per bucket up to the last one used
+static void printStat(const PerfStat &stat) {
+  const float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  uint32_t minCycles = stat.count ? stat.minCycles : 0;
+  Serial.print("\"count\":");
+  Serial.print(stat.count);
+  Serial.print(",\"minUs\":");
+  Serial.print(minCycles / cyclesPerUs, 3);
+  Serial.print(",\"meanUs\":");
+  Serial.print(stat.count ? stat.sumCycles / cyclesPerUs / stat.count : 0, 3);
+  Serial.print(",\"maxUs\":");
+  Serial.print(stat.maxCycles / cyclesPerUs, 3);
+  int used = PERF_HIST_BUCKETS;
+  while (used > 0 && stat.hist[used - 1] == 0) used--;
+  Serial.print(",\"hist\":[");
+  for (int b = 0; b < used; b++) {
+    if (b > 0) Serial.print(",");
+    Serial.print(stat.hist[b]);
+  }
+  Serial.print("]");
+}
+
+void perfPrint(bool reset) {
+  // Snapshot first, the ISR probes keep recording while this prints
+  static PerfStat snapshot[PERF_PROBE_COUNT];
+  PerfStat lateSnapshot;
+  __disable_irq();
+  memcpy(snapshot, probes, sizeof(snapshot));
+  lateSnapshot = lateness;
+  uint32_t late = latenessLate;
+  if (reset) {
+    for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+      clearStat(probes[i]);
+    }
+  }
+  __enable_irq();
+
+  Serial.print("[PERF]{");
+  Serial.print("\"enabled\":true,\"cpuMHz\":");
+  Serial.print(F_CPU_ACTUAL / 1000000);
+  Serial.print(",\"overheadCycles\":");
+  Serial.print(overheadCycles);
+  Serial.print(",\"histBuckets\":\"log2 cycles\",\"probes\":[");
+  for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+    if (i > 0) Serial.print(",");
+    Serial.print("{\"name\":\"");
+    Serial.print(PROBE_NAMES[i]);
+    Serial.print("\",");
+    printStat(snapshot[i]);
+    Serial.print("}");
+  }
+  Serial.print("],\"lateness\":{\"mode\":\"");
+  Serial.print(latenessMode);
+  Serial.print("\",\"periodUs\":");
+  Serial.print(latenessPeriod / (F_CPU_ACTUAL / 1000000.0), 3);
+  Serial.print(",\"limitUs\":");
+  Serial.print(latenessLimit / (F_CPU_ACTUAL / 1000000.0), 3);
+  Serial.print(",\"late\":");
+  Serial.print(late);
+  Serial.print(",");
+  printStat(lateSnapshot);
+  Serial.print("}}");
+  Serial.println();
+}
+
+#else
+
+void perfPrint(bool reset) {
+  (void)reset;
+  Serial.println("[PERF]{\"enabled\":false}");
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef PERF_PROBE_H
+#define PERF_PROBE_H
+
+#include <Arduino.h>
+
+// Hot path profiling on the DWT cycle counter.
+//
+// PERF_SCOPE(probe) at the top of a block times it from there to the end of the scope. Every
+// probe keeps a count, min, mean and max and a log2 histogram of its durations, so a rare slow
+// pass shows even when the mean hides it. The sampler adds how late each sample was taken or
+// delivered, restarted with every acquisition, which is what a claim like "10kHz logging" rests
+// on. The `perf` command prints it all as [PERF] JSON.
+//
+// A probe is only ever entered from one context (its ISR or the main loop), so recording needs
+// no locking. The cost of the two counter reads is measured at startup and taken off every
+// duration. Built with -D PERF_PROBES=0 the macros expand to nothing and the tables are gone.
+
+#ifndef PERF_PROBES
+#define PERF_PROBES 1
+#endif
+
+// Perf Probe Configuration
+const int PERF_HIST_BUCKETS = 28;       // Bucket b counts durations in [2^(b-1), 2^b) cycles
+const int PERF_OVERHEAD_PASSES = 16;    // Empty probes timed to find the probe cost
+
+enum PerfProbe {
+  PERF_SAMPLE_ISR,    // Timer sampler ISR, four currents and the supply through analogRead
+  PERF_SCAN_BLOCK,    // Scan DMA block handler, per half buffer
+  PERF_PULSE_ISR,     // Pulse engine ISR, including the spin to the edge
+  PERF_CONSUME,       // One sample into the log, telemetry and shot statistics
+  PERF_LOG_APPEND,    // logCurrentSample()
+  PERF_LOG_SERVICE,   // logWriterService() pass, packing and writing queued blocks
+  PERF_SD_WRITE,      // One write to the log file
+  PERF_STATUS,        // sendStatusUpdate()
+  PERF_LOOP,          // One pass of loop()
+  PERF_PROBE_COUNT,
+};
+
+struct PerfStat {
+  uint32_t count;
+  uint64_t sumCycles;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint32_t hist[PERF_HIST_BUCKETS];
+};
+
+#if PERF_PROBES
+
+// Measure the probe overhead and clear everything
+void perfBegin();
+
+void perfRecord(PerfProbe probe, uint32_t cycles);
+
+// Sample lateness - reset by samplerStart() with the new run's mode and sample period. Samples
+// later than limitCycles are counted as late: a period for the timer, a block for the scan.
+void perfLatenessReset(const char *mode, uint32_t periodCycles, uint32_t limitCycles);
+void perfLateness(uint32_t cycles);
+
+class PerfScope {
+ public:
+  explicit PerfScope(PerfProbe probe) : probe(probe), start(ARM_DWT_CYCCNT) {}
+  ~PerfScope() { perfRecord(probe, ARM_DWT_CYCCNT - start); }
+
+ private:
+  PerfProbe probe;
+  uint32_t start;
+};
+
+#define PERF_JOIN2(a, b) a##b
+#define PERF_JOIN(a, b) PERF_JOIN2(a, b)
+#define PERF_SCOPE(probe) PerfScope PERF_JOIN(perfScope, __LINE__)(probe)
+#define PERF_LATENESS(cycles) perfLateness(cycles)
+#define PERF_LATENESS_RESET(mode, periodCycles, limitCycles) perfLatenessReset(mode, periodCycles, limitCycles)
+
+#else
+
+inline void perfBegin() {}
+
+#define PERF_SCOPE(probe)
+#define PERF_LATENESS(cycles)
+#define PERF_LATENESS_RESET(mode, periodCycles, limitCycles)
+
+#endif
+
+// Print every probe and the lateness of the current acquisition as [PERF] JSON, then clear the
+// probes if reset is set. Prints {"enabled":false} when compiled out.
+void perfPrint(bool reset);
+
+#endif
@@ -0,0 +1,273 @@
+#include "protection.h"
+#include "sampler.h"
+#include "hal.h"
+#include "current_lut.h"
+
+static const char *const FAULT_NAMES[] = {"none", "overcurrent", "short", "open", "stuckOn"};
+
+struct ProtectChannel {
+  HalPin pin;
+  ProtectLimits limits;
+  uint8_t overCount;            // Consecutive samples over a limit
+  volatile uint32_t shotStartCycles;
+  volatile uint32_t driveOnCycles;
+  volatile uint32_t shotEndCycles;
+};
+
+static ProtectChannel channels[4];
+static ProtectTripHandler tripHandler = nullptr;
+static volatile uint8_t driveMask = 0;
+static volatile uint8_t faultMask = 0;
+static volatile int testChannel = -1;
+
+// Rolling pre-fault history, copied into the fault on the first trip of a latch
+static ProtectSample history[PROTECT_HISTORY];
+static int historyHead = 0;
+static int historyCount = 0;
+static ProtectFault fault;
+static volatile bool captureArmed = true;
+static volatile bool faultCaptured = false;
+
+// Latency statistics since boot, kept through clears so a self-test trip stays counted
+static volatile uint32_t checkedSamples = 0;
+static volatile uint32_t trips = 0;
+static volatile uint32_t maxTripCycles = 0;
+static volatile uint32_t maxDecisionCycles = 0;
+static volatile uint32_t lastPeriodCycles = 0;
+
+void protectionBegin(const int pins[4], ProtectTripHandler handler) {
+  tripHandler = handler;
+  for (int ch = 0; ch < 4; ch++) {
+    ProtectChannel &c = channels[ch];
+    halPinBegin(c.pin, pins[ch]);
+    c.limits.tripMa = PROTECT_DEFAULT_TRIP_MA;
+    c.limits.slopeMaPerUs = PROTECT_DEFAULT_SLOPE;
+    c.limits.openMa = PROTECT_DEFAULT_OPEN_MA;
+    c.limits.idleMa = PROTECT_DEFAULT_IDLE_MA;
+    c.overCount = 0;
+  }
+}
+
+// Channel's check that the sample fails, PROTECT_NONE if it passes
+static inline uint8_t checkChannel(int ch, uint16_t milliamps, uint8_t mask, uint32_t now, uint16_t &limitMa) {
+  const ProtectChannel &c = channels[ch];
+  const uint32_t cyclesPerUs = F_CPU_ACTUAL / 1000000;
+  uint32_t tripMa = ch == testChannel ? PROTECT_TEST_TRIP_MA : c.limits.tripMa;
+  if (tripMa && milliamps > tripMa) {
+    limitMa = tripMa;
+    return PROTECT_OVERCURRENT;
+  }
+
+  if (mask & (0x10 << ch)) {
+    if (c.limits.slopeMaPerUs) {
+      uint32_t envelope = PROTECT_ENVELOPE_OFFSET_MA + c.limits.slopeMaPerUs * ((now - c.shotStartCycles) / cyclesPerUs);
+      if (milliamps > envelope) {
+        limitMa = envelope;
+        return PROTECT_SHORT;
+      }
+    }
+    if (c.limits.openMa && (mask & (1 << ch)) && milliamps < c.limits.openMa &&
+        now - c.driveOnCycles >= PROTECT_OPEN_US * cyclesPerUs) {
+      limitMa = c.limits.openMa;
+      return PROTECT_OPEN;
+    }
+    return PROTECT_NONE;
+  }
+
+  if (c.limits.idleMa && milliamps > c.limits.idleMa &&
+      now - c.shotEndCycles >= PROTECT_IDLE_SETTLE_US * cyclesPerUs) {
+    limitMa = c.limits.idleMa;
+    return PROTECT_STUCK_ON;
+  }
+  return PROTECT_NONE;
+}
+
+// Stop the channel being driven again, then cut it, then capture the fault if it's the latch's first
+static void trip(int ch, uint8_t kind, uint16_t milliamps, uint16_t limitMa, uint8_t mask, uint32_t now) {
+  faultMask |= 1 << ch;
+  if (tripHandler) tripHandler(ch);
+  halPinWrite(channels[ch].pin, false);
+  uint32_t latency = samplerTriggerAgeCycles();
+
+  trips++;
+  if (latency > maxTripCycles) maxTripCycles = latency;
+  if (!captureArmed) return;
+  captureArmed = false;
+
+  fault.channel = ch;
+  fault.kind = kind;
+  fault.test = ch == testChannel;
+  fault.milliamps = milliamps;
+  fault.limitMa = limitMa;
+  fault.shotCycles = (mask & (0x10 << ch)) ? now - channels[ch].shotStartCycles : 0;
+  fault.latencyCycles = latency;
+  fault.periodCycles = lastPeriodCycles;
+  fault.historyCount = historyCount;
+  int start = (historyHead - historyCount + PROTECT_HISTORY) % PROTECT_HISTORY;
+  for (int i = 0; i < historyCount; i++) {
+    fault.history[i] = history[(start + i) % PROTECT_HISTORY];
+  }
+  faultCaptured = true;
+}
+
+FASTRUN void protectionSample(const uint16_t codes[4]) {
+  uint32_t now = ARM_DWT_CYCCNT;
+  uint8_t mask = driveMask;
+  lastPeriodCycles = samplerPeriodCycles();
+
+  ProtectSample &sample = history[historyHead];
+  memcpy(sample.adc, codes, sizeof(sample.adc));
+  sample.driveMask = mask;
+  historyHead = (historyHead + 1) % PROTECT_HISTORY;
+  if (historyCount < PROTECT_HISTORY) historyCount++;
+
+  for (int ch = 0; ch < 4; ch++) {
+    if (faultMask & (1 << ch)) continue;
+    ProtectChannel &c = channels[ch];
+    uint16_t milliamps = currentLutMilliamps(ch, codes[ch]);
+    uint16_t limitMa = 0;
+    uint8_t kind = checkChannel(ch, milliamps, mask, now, limitMa);
+    if (kind == PROTECT_NONE) {
+      c.overCount = 0;
+    } else if (++c.overCount >= PROTECT_CONFIRM_SAMPLES) {
+      trip(ch, kind, milliamps, limitMa, mask, now);
+    }
+  }
+
+  // Where a trip on this sample would have cut the pin, so the worst case is known without faults
+  uint32_t decision = samplerTriggerAgeCycles();
+  if (decision > maxDecisionCycles) maxDecisionCycles = decision;
+  checkedSamples++;
+}
+
+void protectionDriveEdge(int channel, bool on, bool inShot) {
+  ProtectChannel &c = channels[channel];
+  uint8_t mask = driveMask;
+  uint32_t now = ARM_DWT_CYCCNT;
+  if (on && !(mask & (1 << channel))) c.driveOnCycles = now;
+  if (inShot && !(mask & (0x10 << channel))) c.shotStartCycles = now;
+  if (!inShot && (mask & (0x10 << channel))) c.shotEndCycles = now;
+
+  // Timestamps first, the sample ISR reads the mask
+  mask &= ~((1 << channel) | (0x10 << channel));
+  if (on) mask |= 1 << channel;
+  if (inShot) mask |= 0x10 << channel;
+  driveMask = mask;
+}
+
+uint8_t protectionFaults() {
+  return faultMask;
+}
+
+bool protectionTakeFault(ProtectFault &out) {
+  if (!faultCaptured) return false;
+  out = fault;
+  faultCaptured = false;
+  return true;
+}
+
+uint8_t protectionClear() {
+  __disable_irq();
+  uint8_t faults = faultMask;
+  faultMask = 0;
+  testChannel = -1;
+  for (int ch = 0; ch < 4; ch++) {
+    channels[ch].overCount = 0;
+  }
+  faultCaptured = false;
+  captureArmed = true;
+  __enable_irq();
+  return faults;
+}
+
+void protectionSetLimits(int channel, const ProtectLimits &limits) {
+  __disable_irq();
+  channels[channel].limits = limits;
+  __enable_irq();
+}
+
+const ProtectLimits &protectionLimits(int channel) {
+  return channels[channel].limits;
+}
+
+void protectionStartTest(int channel) {
+  testChannel = channel;
+}
+
+void protectionPrintFault(const ProtectFault &f) {
+  const float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  Serial.print("[FAULT]{\"injector\":");
+  Serial.print(f.channel + 1);
+  Serial.print(",\"kind\":\"");
+  Serial.print(FAULT_NAMES[f.kind]);
+  Serial.print("\",\"test\":");
+  Serial.print(f.test ? "true" : "false");
+  Serial.print(",\"ma\":");
+  Serial.print(f.milliamps);
+  Serial.print(",\"limitMa\":");
+  Serial.print(f.limitMa);
+  Serial.print(",\"shotUs\":");
+  Serial.print(f.shotCycles / cyclesPerUs, 1);
+  Serial.print(",\"latencyUs\":");
+  Serial.print(f.latencyCycles / cyclesPerUs, 2);
+  Serial.print(",\"periodUs\":");
+  Serial.print(f.periodCycles / cyclesPerUs, 2);
+  Serial.print(",\"faults\":");
+  Serial.print(protectionFaults());
+
+  // Faulted channel only, the trip sample last
+  Serial.print(",\"preFaultMa\":[");
+  for (int i = 0; i < f.historyCount; i++) {
+    if (i > 0) Serial.print(",");
+    Serial.print(currentLutMilliamps(f.channel, f.history[i].adc[f.channel]));
+  }
+  Serial.print("],\"preFaultDrive\":[");
+  for (int i = 0; i < f.historyCount; i++) {
+    if (i > 0) Serial.print(",");
+    Serial.print((f.history[i].driveMask >> f.channel) & 1);
+  }
+  Serial.print("]}");
+  Serial.println();
+}
+
+void protectionPrintStatus() {
+  const float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  __disable_irq();
+  uint32_t samples = checkedSamples;
+  uint32_t tripCount = trips;
+  uint32_t tripCycles = maxTripCycles;
+  uint32_t decisionCycles = maxDecisionCycles;
+  uint32_t periodCycles = lastPeriodCycles;
+  __enable_irq();
+
+  Serial.print("[PROTECT]{\"faults\":");
+  Serial.print(protectionFaults());
+  Serial.print(",\"samples\":");
+  Serial.print(samples);
+  Serial.print(",\"trips\":");
+  Serial.print(tripCount);
+  Serial.print(",\"maxTripLatencyUs\":");
+  Serial.print(tripCycles / cyclesPerUs, 2);
+  Serial.print(",\"maxDecisionUs\":");
+  Serial.print(decisionCycles / cyclesPerUs, 2);
+  Serial.print(",\"periodUs\":");
+  Serial.print(periodCycles / cyclesPerUs, 2);
+  Serial.print(",\"worstCaseUs\":");
+  Serial.print((PROTECT_CONFIRM_SAMPLES * periodCycles + decisionCycles) / cyclesPerUs, 2);
+  Serial.print(",\"limits\":[");
+  for (int ch = 0; ch < 4; ch++) {
+    const ProtectLimits &l = channels[ch].limits;
+    if (ch > 0) Serial.print(",");
+    Serial.print("{\"tripA\":");
+    Serial.print(l.tripMa * 0.001f, 2);
+    Serial.print(",\"slopeMaPerUs\":");
+    Serial.print(l.slopeMaPerUs);
+    Serial.print(",\"openA\":");
+    Serial.print(l.openMa * 0.001f, 2);
+    Serial.print(",\"idleA\":");
+    Serial.print(l.idleMa * 0.001f, 2);
+    Serial.print("}");
+  }
+  Serial.print("]}");
+  Serial.println();
+}
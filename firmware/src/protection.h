@@ -0,0 +1,107 @@
+#ifndef PROTECTION_H
+#define PROTECTION_H
+
+#include <Arduino.h>
+
+// Overcurrent, short and open circuit protection on every current sample.
+//
+// protectionSample() runs from the per-sample handler (ADC_ETC done interrupt in scan mode, the
+// sampler ISR in timer mode) and checks each channel against:
+//   overcurrent - above the channel's trip current, at any time
+//   short       - above the envelope a coil can reach, offset + slope x time since the shot
+//                 started. A coil's current rises at most V/L while driven and falls while not,
+//                 so this holds through PWM and regulated hold as well as the peak.
+//   open        - driven without a break for PROTECT_OPEN_US and still below the open current
+//   stuck on    - above the idle current PROTECT_IDLE_SETTLE_US after the shot ended, a failed
+//                 MOSFET the firmware can't switch off
+// PROTECT_CONFIRM_SAMPLES in a row trip the check. The trip handler inhibits the channel's drive
+// first (pulse engine and regulator), then the pin is cut directly, and the fault is latched
+// until protectionClear(): firing is refused while any channel is faulted.
+//
+// The first fault of a latch is captured with PROTECT_HISTORY samples before it (all channels,
+// with the drive mask), kept until cleared. Trip latency is the conversion trigger to the pin
+// write, measured on every trip and, as the time the decision would take, on every sample.
+// The worst case from a fault starting to the cut is PROTECT_CONFIRM_SAMPLES periods plus that.
+
+// Protection Configuration
+const int PROTECT_CONFIRM_SAMPLES = 2;             // Consecutive samples over a limit that trip it
+const int PROTECT_HISTORY = 128;                   // Samples kept before a fault (1.3ms at 100kHz)
+const uint32_t PROTECT_DEFAULT_TRIP_MA = 8000;     // Overcurrent
+const uint32_t PROTECT_DEFAULT_SLOPE = 10;         // Short envelope slope (mA/us), 12V/3mH is 4
+const uint32_t PROTECT_ENVELOPE_OFFSET_MA = 1000;  // Envelope at the shot start, above sensor noise
+const uint32_t PROTECT_DEFAULT_OPEN_MA = 300;      // Open below this after PROTECT_OPEN_US driven
+const uint32_t PROTECT_OPEN_US = 1000;
+const uint32_t PROTECT_DEFAULT_IDLE_MA = 1000;     // Stuck on above this with no shot
+const uint32_t PROTECT_IDLE_SETTLE_US = 5000;      // Closing decay allowance after a shot
+const uint32_t PROTECT_TEST_TRIP_MA = 1000;        // Trip current of the self-test shot
+const uint32_t PROTECT_MAX_TRIP_MA = 20000;        // ACS712 20A range
+
+enum ProtectFaultKind : uint8_t {
+  PROTECT_NONE,
+  PROTECT_OVERCURRENT,
+  PROTECT_SHORT,
+  PROTECT_OPEN,
+  PROTECT_STUCK_ON,
+};
+
+// Per-channel limits, 0 disables a check
+struct ProtectLimits {
+  uint16_t tripMa;
+  uint16_t slopeMaPerUs;
+  uint16_t openMa;
+  uint16_t idleMa;
+};
+
+struct ProtectSample {
+  uint16_t adc[4];
+  uint8_t driveMask;      // Drive bits 0-3, shot bits 4-7, as RawSample::injectorMask
+};
+
+// First fault of a latch, with the samples leading up to it (oldest first, the trip sample last)
+struct ProtectFault {
+  uint8_t channel;
+  uint8_t kind;
+  bool test;              // Tripped by protectionStartTest()
+  uint16_t milliamps;     // Trip sample
+  uint16_t limitMa;       // Limit it crossed
+  uint32_t shotCycles;    // Since the shot started, 0 outside a shot
+  uint32_t latencyCycles; // Trip sample's conversion trigger to the pin cut
+  uint32_t periodCycles;  // Sample period at the time
+  int historyCount;
+  ProtectSample history[PROTECT_HISTORY];
+};
+
+// Called from the sample ISR before the channel's pin is cut, must stop anything driving it again
+typedef void (*ProtectTripHandler)(int channel);
+
+// Store the drive pins (already set up as outputs), limits to their defaults
+void protectionBegin(const int pins[4], ProtectTripHandler handler);
+
+// Per-sample check from the sampler's per-sample handler, codes in CURRENT_PINS order
+void protectionSample(const uint16_t codes[4]);
+
+// Drive state, called from the same edge hooks as samplerSetInjectorState()
+void protectionDriveEdge(int channel, bool on, bool inShot);
+
+// Bit n set while injector n+1 is latched off
+uint8_t protectionFaults();
+
+// True once per latch when a fault has been captured, copying it out
+bool protectionTakeFault(ProtectFault &fault);
+
+// Release the latch and re-arm the capture, returns the channels that were faulted
+uint8_t protectionClear();
+
+void protectionSetLimits(int channel, const ProtectLimits &limits);
+const ProtectLimits &protectionLimits(int channel);
+
+// Lower one channel's trip current to PROTECT_TEST_TRIP_MA until the next protectionClear()
+void protectionStartTest(int channel);
+
+// Print a captured fault as [FAULT] JSON, the faulted channel's pre-fault current and drive
+void protectionPrintFault(const ProtectFault &fault);
+
+// Print limits, latch and latency statistics as [PROTECT] JSON
+void protectionPrintStatus();
+
+#endif
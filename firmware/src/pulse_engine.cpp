@@ -0,0 +1,285 @@
+#include "pulse_engine.h"
+#include "hal.h"
+#include "perf_probe.h"
+#include "min_heap.h"
+#include "ring_buffer.h"
+
+struct PulseEvent {
+  uint32_t tick;   // Absolute GPT2 count
+  uint8_t channel;
+  bool on;
+  bool last;       // Closes the shot
+  const WaveStep *regulate;
+};
+
+// Wrap-safe while every queued event is within 2^31 ticks (14s) of the others
+struct EventBefore {
+  bool operator()(const PulseEvent &a, const PulseEvent &b) const {
+    return (int32_t)(a.tick - b.tick) < 0;
+  }
+};
+
+struct ShotRequest {
+  uint32_t startTick;
+  const WaveProgram *program;
+};
+
+struct PulseChannel {
+  HalPin pin;
+  SpscRing<ShotRequest, PULSE_SHOT_QUEUE> shots;  // Main loop arms, ISR runs the front shot
+  WaveCursor cursor;          // Interpreter state of the front shot
+  bool scheduled;             // Front shot has its next edge in the heap
+  uint32_t endTick;           // End of the last shot armed
+};
+
+static MinHeap<PulseEvent, 4, EventBefore> eventQueue;
+static PulseChannel channels[4];
+static PulseEdgeHandler edgeHandler = nullptr;
+static volatile uint8_t inhibitedChannels = 0;
+
+// Self-test loopback capture and edge lateness
+static volatile bool capturing = false;
+static volatile uint32_t captureTicks[PULSE_TEST_MAX_EDGES];
+static volatile int captureCount = 0;
+static volatile uint32_t lateEdges = 0;
+static volatile uint32_t maxLateTicks = 0;
+
+static void serviceCapture() {
+  uint32_t tick;
+  if (!halEdgeTimerCaptured(tick)) return;
+  if (capturing && captureCount < PULSE_TEST_MAX_EDGES) {
+    captureTicks[captureCount++] = tick;
+  }
+}
+
+// Put the channel's next edge in the heap, starting the next armed shot when needed
+static void scheduleChannel(int ch) {
+  PulseChannel &c = channels[ch];
+  ShotRequest shot;
+  if (!c.shots.peek(shot)) return;
+
+  WaveEdge edge;
+  if (!waveNextEdge(*shot.program, c.cursor, edge)) return;
+  PulseEvent event = {shot.startTick + edge.tick, (uint8_t)ch, edge.on, edge.last, edge.regulate};
+  eventQueue.push(event);
+  c.scheduled = true;
+}
+
+FASTRUN static void pulseISR() {
+  PERF_SCOPE(PERF_PULSE_ISR);
+  halEdgeTimerAck();
+  serviceCapture();
+
+  for (int ch = 0; ch < 4; ch++) {
+    if (!channels[ch].scheduled) scheduleChannel(ch);
+  }
+
+  while (!eventQueue.empty()) {
+    uint32_t tick = eventQueue.top().tick;
+    int32_t wait = (int32_t)(tick - halEdgeTimerNow());
+    if (wait > (int32_t)(PULSE_EDGE_LEAD_TICKS + PULSE_MIN_ARM_TICKS)) {
+      halEdgeTimerCompare(tick - PULSE_EDGE_LEAD_TICKS);
+      break;
+    }
+
+    // Spin the last stretch so ISR entry jitter never reaches the pin
+    while ((int32_t)(tick - halEdgeTimerNow()) > 0) ;
+    if (wait < 0) {
+      lateEdges++;
+      if ((uint32_t)-wait > maxLateTicks) maxLateTicks = -wait;
+    }
+
+    // Coincident edges on other channels switch in the same pass, handlers run after
+    PulseEvent due[4];
+    int dueCount = 0;
+    while (dueCount < 4 && !eventQueue.empty() && eventQueue.top().tick == tick) {
+      PulseEvent &event = due[dueCount++];
+      eventQueue.pop(event);
+      PulseChannel &c = channels[event.channel];
+      event.on = event.on && !(inhibitedChannels & (1 << event.channel));
+      halPinWrite(c.pin, event.on);
+    }
+    for (int i = 0; i < dueCount; i++) {
+      int ch = due[i].channel;
+      PulseChannel &c = channels[ch];
+      if (edgeHandler) edgeHandler(ch, due[i].on, !due[i].last, due[i].regulate);
+      if (due[i].last) {
+        ShotRequest done;
+        c.shots.pop(done);
+        waveStart(c.cursor);
+      }
+      c.scheduled = false;
+      scheduleChannel(ch);
+    }
+    serviceCapture();
+  }
+
+  if (eventQueue.empty()) halEdgeTimerEnable(false);
+  halIsrEnd();
+}
+
+void pulseEngineBegin(const int pins[4], PulseEdgeHandler handler) {
+  edgeHandler = handler;
+  for (int ch = 0; ch < 4; ch++) {
+    halPinBegin(channels[ch].pin, pins[ch]);
+    channels[ch].shots.clear();
+    channels[ch].scheduled = false;
+    channels[ch].endTick = 0;
+    waveStart(channels[ch].cursor);
+  }
+  halEdgeTimerBegin(pulseISR, PULSE_IRQ_PRIORITY);
+}
+
+uint32_t pulseEngineNow() {
+  return halEdgeTimerNow();
+}
+
+bool pulseEngineArm(int channel, uint32_t startTick, const WaveProgram &program) {
+  PulseChannel &c = channels[channel];
+  if (program.count == 0) return false;
+  if ((int32_t)(startTick - halEdgeTimerNow()) < (int32_t)PULSE_MIN_ARM_TICKS) return false;
+  if (!c.shots.empty() && (int32_t)(startTick - c.endTick) <= 0) return false;
+
+  ShotRequest shot = {startTick, &program};
+  if (!c.shots.push(shot)) return false;
+  c.endTick = startTick + program.totalTicks;
+
+  // The ISR loads the shot when the channel is free and sets the compare itself
+  __disable_irq();
+  halEdgeTimerEnable(true);
+  halEdgeTimerPend();
+  __enable_irq();
+  return true;
+}
+
+bool pulseEngineBusy(int channel) {
+  return !channels[channel].shots.empty();
+}
+
+bool pulseEngineIdle() {
+  for (int ch = 0; ch < 4; ch++) {
+    if (pulseEngineBusy(ch)) return false;
+  }
+  return true;
+}
+
+uint32_t pulseEngineQueueFree(int channel) {
+  return channels[channel].shots.capacity() - channels[channel].shots.size();
+}
+
+void pulseEngineStop() {
+  __disable_irq();
+  halEdgeTimerEnable(false);
+  eventQueue.clear();
+  for (int ch = 0; ch < 4; ch++) {
+    PulseChannel &c = channels[ch];
+    ShotRequest shot;
+    while (c.shots.pop(shot)) ;
+    c.scheduled = false;
+    waveStart(c.cursor);
+    halPinWrite(c.pin, false);
+    if (edgeHandler) edgeHandler(ch, false, false, nullptr);
+  }
+  __enable_irq();
+}
+
+void pulseEngineInhibit(uint8_t mask) {
+  inhibitedChannels = mask;
+}
+
+void pulseEngineSelfTest(int channel, const char *profile, const WaveProgram &program) {
+  if (pulseEngineBusy(channel)) {
+    Serial.println("[ERROR]Channel busy - edge self-test skipped");
+    return;
+  }
+
+  // Expected transitions from the same interpreter, the closing edge only if it switches the output
+  uint32_t expected[PULSE_TEST_MAX_EDGES];
+  int count = 0;
+  WaveCursor cursor;
+  WaveEdge edge;
+  bool level = false;
+  waveStart(cursor);
+  while (count < PULSE_TEST_MAX_EDGES && waveNextEdge(program, cursor, edge)) {
+    if (edge.on == level) continue;
+    level = edge.on;
+    expected[count++] = edge.tick;
+  }
+
+  __disable_irq();
+  captureCount = 0;
+  lateEdges = 0;
+  maxLateTicks = 0;
+  capturing = true;
+  halEdgeTimerCaptureEnable(true);
+  __enable_irq();
+
+  uint32_t startTick = halEdgeTimerNow() + pulseUsToTicks(PULSE_TEST_SETTLE_US);
+  bool armed = pulseEngineArm(channel, startTick, program);
+  while (pulseEngineBusy(channel)) yield();
+  delayMicroseconds(PULSE_TEST_SETTLE_US);
+
+  __disable_irq();
+  halEdgeTimerCaptureEnable(false);
+  capturing = false;
+  __enable_irq();
+
+  if (!armed) {
+    Serial.println("[ERROR]Edge self-test could not be armed");
+    return;
+  }
+
+  // Edge error is capture minus request, width error compares consecutive edges
+  int captured = min(captureCount, count);
+  int32_t minError = INT32_MAX;
+  int32_t maxError = INT32_MIN;
+  int64_t sumError = 0;
+  uint32_t maxWidthError = 0;
+  for (int i = 0; i < captured; i++) {
+    int32_t error = (int32_t)(captureTicks[i] - (startTick + expected[i]));
+    if (error < minError) minError = error;
+    if (error > maxError) maxError = error;
+    sumError += error;
+    if (i > 0) {
+      int32_t width = (int32_t)(captureTicks[i] - captureTicks[i - 1]);
+      int32_t requested = (int32_t)(expected[i] - expected[i - 1]);
+      uint32_t widthError = abs(width - requested);
+      if (widthError > maxWidthError) maxWidthError = widthError;
+    }
+  }
+  if (captured == 0) minError = maxError = 0;
+
+  const float nsPerTick = 1000.0 / PULSE_TICKS_PER_US;
+  Serial.print("[EDGETEST]{");
+  Serial.print("\"injector\":");
+  Serial.print(channel + 1);
+  Serial.print(",\"profile\":\"");
+  Serial.print(profile);
+  Serial.print("\",\"edges\":");
+  Serial.print(count);
+  Serial.print(",\"captured\":");
+  Serial.print(captureCount);
+  Serial.print(",\"minErrorNs\":");
+  Serial.print(minError * nsPerTick, 1);
+  Serial.print(",\"maxErrorNs\":");
+  Serial.print(maxError * nsPerTick, 1);
+  Serial.print(",\"meanErrorNs\":");
+  Serial.print(captured > 0 ? sumError * nsPerTick / captured : 0, 1);
+  Serial.print(",\"maxWidthErrorNs\":");
+  Serial.print(maxWidthError * nsPerTick, 1);
+  Serial.print(",\"lateEdges\":");
+  Serial.print(lateEdges);
+  Serial.print(",\"maxLateNs\":");
+  Serial.print(maxLateTicks * nsPerTick, 1);
+  Serial.print("}");
+  Serial.println();
+
+  if (captureCount != count) {
+    Serial.print("[ERROR]Captured ");
+    Serial.print(captureCount);
+    Serial.print(" of ");
+    Serial.print(count);
+    Serial.print(" edges - jumper the drive pin to pin ");
+    Serial.println(PULSE_CAPTURE_PIN);
+  }
+}
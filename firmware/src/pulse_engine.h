@@ -0,0 +1,68 @@
+#ifndef PULSE_ENGINE_H
+#define PULSE_ENGINE_H
+
+#include <Arduino.h>
+#include "waveform.h"
+
+// Timer-driven injector edges.
+//
+// The drive pins (2-5) are only reachable from FlexPWM, and injectors 1 and 2
+// share a submodule, so edges come from GPT2 output compare instead. Each channel
+// has a queue of armed shots (start tick + WaveProgram). The ISR interprets the
+// active program of every channel with waveNextEdge() and keeps each channel's
+// next edge in one min-heap ordered by tick. The compare is set
+// PULSE_EDGE_LEAD_TICKS before the earliest event, and the top-priority ISR
+// spins on the counter to the exact tick before writing the GPIO set/clear
+// register. Edge timing therefore doesn't depend on what the main loop is
+// doing. The CPU only arms shots. A REG segment is one on edge whose handler
+// call passes the step, the current regulator drives the pin until the
+// segment's closing edge.
+//
+// GPT2 input capture on PULSE_CAPTURE_PIN timestamps a loopback from a drive
+// pin on the same counter, which is how the self-test measures the edges.
+
+// Pulse Engine Configuration
+const uint32_t PULSE_TICKS_PER_US = 150;      // GPT2 runs from the 150MHz IPG clock
+const uint32_t PULSE_EDGE_LEAD_TICKS = 150;   // Compare fires 1us early, the ISR spins to the edge
+const uint32_t PULSE_MIN_ARM_TICKS = 15;      // Closer than this and the compare could be missed
+const uint32_t PULSE_SHOT_QUEUE = 8;          // Armed shots waiting per channel (power of two)
+const int PULSE_TEST_MAX_EDGES = 64;          // Edges compared by the self-test
+const uint8_t PULSE_IRQ_PRIORITY = 0;         // Above the sampler, nothing may delay an edge
+const int PULSE_CAPTURE_PIN = 15;             // GPT2 capture 1 (GPIO_AD_B1_03), self-test loopback
+const unsigned long PULSE_TEST_SETTLE_US = 100; // Wait after the last edge for its capture
+
+// Called from the ISR right after each edge is driven, inShot stays set from a shot's first edge to its last.
+// regulate is the REG step the edge starts, nullptr on every other edge.
+typedef void (*PulseEdgeHandler)(int channel, bool on, bool inShot, const WaveStep *regulate);
+
+// Configure GPT2 and the drive pins (left low)
+void pulseEngineBegin(const int pins[4], PulseEdgeHandler handler);
+
+// Free-running GPT2 count, the timebase for arming
+uint32_t pulseEngineNow();
+
+inline uint32_t pulseUsToTicks(uint32_t us) {
+  return us * PULSE_TICKS_PER_US;
+}
+
+// Queue a shot at least PULSE_MIN_ARM_TICKS ahead and after the channel's previous shot has ended.
+// Shots on different channels may overlap freely. The program is read by the ISR while the shot
+// runs, so it must stay unchanged until pulseEngineBusy() clears.
+bool pulseEngineArm(int channel, uint32_t startTick, const WaveProgram &program);
+bool pulseEngineBusy(int channel);
+bool pulseEngineIdle();
+
+// Shot slots still free on a channel
+uint32_t pulseEngineQueueFree(int channel);
+
+// Drop all queued edges and drive every channel low
+void pulseEngineStop();
+
+// Channels in mask keep running their shots with every edge driven low, until the mask is
+// cleared. Safe from any ISR, it is how protection keeps a tripped channel off.
+void pulseEngineInhibit(uint8_t mask);
+
+// Fire the program on channel with the loopback captured, print achieved timing as [EDGETEST] JSON
+void pulseEngineSelfTest(int channel, const char *profile, const WaveProgram &program);
+
+#endif
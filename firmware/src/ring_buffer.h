@@ -0,0 +1,55 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+
+// Compiler barrier so index updates are never reordered around the payload copy
+#define RING_BARRIER() __asm__ volatile("" ::: "memory")
+
+// Single-producer/single-consumer lock-free ring buffer.
+// The producer (normally an ISR) only writes head, the consumer only writes tail,
+// so neither side needs to disable interrupts. N must be a power of two.
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  bool push(const T &item) {
+    uint32_t head = head_;
+    if (head - tail_ >= N) return false;  // Full - caller counts the overrun
+    items_[head & (N - 1)] = item;
+    RING_BARRIER();
+    head_ = head + 1;
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t tail = tail_;
+    if (tail == head_) return false;
+    item = items_[tail & (N - 1)];
+    RING_BARRIER();
+    tail_ = tail + 1;
+    return true;
+  }
+
+  bool peek(T &item) const {
+    uint32_t tail = tail_;
+    if (tail == head_) return false;
+    item = items_[tail & (N - 1)];
+    return true;
+  }
+
+  uint32_t size() const { return head_ - tail_; }
+  bool empty() const { return head_ == tail_; }
+  static constexpr uint32_t capacity() { return N; }
+
+  // Only safe while the producer is stopped
+  void clear() { tail_ = head_; }
+
+private:
+  T items_[N];
+  volatile uint32_t head_ = 0;
+  volatile uint32_t tail_ = 0;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "sampler.h"
+#include "ring_buffer.h"
+#include "adc_scan.h"
+#include "hal.h"
+#include "perf_probe.h"
+
+// Injector edge awaiting the scan block that covers it
+struct MaskChange {
+  uint32_t cycles;
+  uint8_t mask;
+};
+
+static IntervalTimer sampleTimer;
+static SpscRing<RawSample, SAMPLER_RING_SIZE> sampleRing;
+static SpscRing<MaskChange, SAMPLER_MASK_HISTORY> maskHistory;
+static int samplePins[4] = {0, 0, 0, 0};
+static int supplyPin = 0;
+static volatile uint8_t injectorMask = 0;
+static volatile bool running = false;
+static SamplerMode activeMode = SAMPLER_TIMER;
+static uint32_t sampleRateHz = 0;
+static ScanSampleHandler sampleHandler = nullptr;
+
+// Scan mode timebase - sample n was triggered at scanStartCycles + n * periodCycles
+static uint32_t scanStartCycles = 0;
+static uint32_t scanStartMicros = 0;
+static uint64_t scanElapsedCycles = 0;
+static uint8_t scanMask = 0;
+
+// Timing statistics, written only by the producer while running
+static uint32_t periodCycles = 0;
+static uint32_t nextDeadline = 0;             // Cycle count when the next tick is due
+static volatile uint32_t statSamples = 0;
+static volatile uint32_t statOverruns = 0;     // Ring full, sample dropped
+static volatile uint32_t statMissed = 0;       // Samples lost to a late ISR
+static volatile uint32_t statMinLatency = UINT32_MAX;
+static volatile uint32_t statMaxLatency = 0;
+static volatile uint32_t statMaxDepth = 0;
+
+static void pushSample(const RawSample &sample) {
+  if (!sampleRing.push(sample)) {
+    statOverruns++;
+  }
+  statSamples++;
+  uint32_t depth = sampleRing.size();
+  if (depth > statMaxDepth) statMaxDepth = depth;
+}
+
+static void sampleISR() {
+  PERF_SCOPE(PERF_SAMPLE_ISR);
+  uint32_t now = ARM_DWT_CYCCNT;
+  uint32_t latency = now - nextDeadline;
+  PERF_LATENESS(latency);
+
+  // The PIT only latches one pending tick, so anything later than a full period lost samples
+  if (latency >= periodCycles) {
+    uint32_t skipped = latency / periodCycles;
+    statMissed += skipped;
+    nextDeadline += skipped * periodCycles;
+    latency -= skipped * periodCycles;
+  }
+  nextDeadline += periodCycles;
+
+  RawSample sample;
+  sample.timestamp = micros();
+  for (int ch = 0; ch < 4; ch++) {
+    sample.adc[ch] = analogRead(samplePins[ch]);
+  }
+  sample.supply = analogRead(supplyPin);
+  sample.injectorMask = injectorMask;
+  if (sampleHandler) sampleHandler(sample.adc);
+  pushSample(sample);
+
+  if (latency < statMinLatency) statMinLatency = latency;
+  if (latency > statMaxLatency) statMaxLatency = latency;
+}
+
+// Scan blocks arrive up to a block late, so the injector mask is replayed from edge history
+static void scanBlockHandler(const uint16_t (*codes)[ADC_SCAN_CODES], int samples) {
+  PERF_SCOPE(PERF_SCAN_BLOCK);
+  const uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+  for (int i = 0; i < samples; i++) {
+    uint32_t sampleCycles = scanStartCycles + (uint32_t)scanElapsedCycles;
+    PERF_LATENESS(ARM_DWT_CYCCNT - sampleCycles);  // Trigger to the sample reaching the ring
+
+    MaskChange change;
+    while (maskHistory.peek(change) && (int32_t)(change.cycles - sampleCycles) <= 0) {
+      maskHistory.pop(change);
+      scanMask = change.mask;
+    }
+
+    RawSample sample;
+    sample.timestamp = scanStartMicros + (uint32_t)(scanElapsedCycles / cyclesPerMicro);
+    for (int ch = 0; ch < 4; ch++) {
+      sample.adc[ch] = codes[i][ch];
+    }
+    sample.supply = codes[i][4];
+    sample.injectorMask = scanMask;
+    pushSample(sample);
+    scanElapsedCycles += periodCycles;
+  }
+}
+
+void samplerBegin(const int pins[4], int supply) {
+  for (int ch = 0; ch < 4; ch++) {
+    samplePins[ch] = pins[ch];
+  }
+  supplyPin = supply;
+  sampleTimer.priority(SAMPLER_IRQ_PRIORITY);
+  if (!adcScanBegin(pins, supply)) {
+    Serial.println("[ERROR]Current pins are not on both ADCs or the supply pin is not on ADC1 - scan mode unavailable");
+  }
+}
+
+void samplerSetSampleHandler(ScanSampleHandler handler) {
+  sampleHandler = handler;
+  adcScanSetSampleHandler(handler);
+}
+
+bool samplerStart(SamplerMode mode, uint32_t rateHz) {
+  if (running) samplerStop();
+  if (mode == SAMPLER_TIMER && rateHz > SAMPLER_TIMER_MAX_RATE) return false;
+
+  sampleRing.clear();
+  maskHistory.clear();
+  activeMode = mode;
+  sampleRateHz = rateHz;
+  running = true;
+
+  if (mode == SAMPLER_SCAN) {
+    scanElapsedCycles = 0;
+    scanMask = injectorMask;
+    uint32_t refCycles = ARM_DWT_CYCCNT;
+    uint32_t refMicros = micros();
+    scanStartCycles = adcScanStart(rateHz, scanBlockHandler);
+    periodCycles = adcScanPeriodCycles();
+    scanStartMicros = refMicros + (scanStartCycles - refCycles) / (F_CPU_ACTUAL / 1000000);
+    PERF_LATENESS_RESET("scan", periodCycles, periodCycles * (adcScanBlockSamples() + 1));
+  } else {
+    periodCycles = F_CPU_ACTUAL / rateHz;
+    PERF_LATENESS_RESET("timer", periodCycles, periodCycles);
+    sampleTimer.begin(sampleISR, 1000000.0f / rateHz);
+    nextDeadline = ARM_DWT_CYCCNT + periodCycles;
+  }
+  return true;
+}
+
+void samplerStop() {
+  if (activeMode == SAMPLER_SCAN) {
+    adcScanStop();
+    statMissed += adcScanMissedBlocks() * adcScanBlockSamples();
+  } else {
+    sampleTimer.end();
+  }
+  running = false;
+}
+
+bool samplerRunning() {
+  return running;
+}
+
+unsigned long samplerLatencyUs() {
+  if (activeMode != SAMPLER_SCAN || sampleRateHz == 0) return 0;
+  return (unsigned long)adcScanBlockSamples() * 1000000 / sampleRateHz;
+}
+
+uint32_t samplerTriggerAgeCycles() {
+  if (activeMode == SAMPLER_SCAN) return adcScanTriggerAgeCycles();
+  return ARM_DWT_CYCCNT - (nextDeadline - periodCycles);
+}
+
+uint32_t samplerPeriodCycles() {
+  return periodCycles;
+}
+
+bool samplerRead(RawSample &sample) {
+  return sampleRing.pop(sample);
+}
+
+void samplerSetInjectorState(int channel, bool on, bool inShot) {
+  // Two ISR priorities update the mask, so the read-modify-write and history push can't be split
+  uint32_t irqState = halIrqSave();
+  uint8_t mask = injectorMask & ~((1 << channel) | (0x10 << channel));
+  if (on) mask |= (1 << channel);
+  if (inShot) mask |= (0x10 << channel);
+  injectorMask = mask;
+
+  if (running && activeMode == SAMPLER_SCAN) {
+    MaskChange change = {ARM_DWT_CYCCNT, injectorMask};
+    maskHistory.push(change);
+  }
+  halIrqRestore(irqState);
+}
+
+uint8_t samplerInjectorMask() {
+  return injectorMask;
+}
+
+void samplerPrintStats() {
+  __disable_irq();
+  uint32_t samples = statSamples;
+  uint32_t overruns = statOverruns;
+  uint32_t missed = statMissed;
+  uint32_t minLatency = statMinLatency;
+  uint32_t maxLatency = statMaxLatency;
+  uint32_t maxDepth = statMaxDepth;
+  statSamples = 0;
+  statOverruns = 0;
+  statMissed = 0;
+  statMinLatency = UINT32_MAX;
+  statMaxLatency = 0;
+  statMaxDepth = 0;
+  __enable_irq();
+
+  // Scan mode is paced in hardware, there is no ISR latency to measure
+  const float cyclesPerUs = F_CPU_ACTUAL / 1000000.0;
+  if (minLatency > maxLatency) minLatency = maxLatency = 0;
+
+  Serial.print("[SAMPLER]{");
+  Serial.print("\"mode\":\"");
+  Serial.print(activeMode == SAMPLER_SCAN ? "scan" : "timer");
+  Serial.print("\",\"rateHz\":");
+  Serial.print(sampleRateHz);
+  Serial.print(",\"samples\":");
+  Serial.print(samples);
+  Serial.print(",\"overruns\":");
+  Serial.print(overruns);
+  Serial.print(",\"missed\":");
+  Serial.print(missed);
+  Serial.print(",\"minLatencyUs\":");
+  Serial.print(minLatency / cyclesPerUs, 2);
+  Serial.print(",\"maxLatencyUs\":");
+  Serial.print(maxLatency / cyclesPerUs, 2);
+  Serial.print(",\"jitterUs\":");
+  Serial.print((maxLatency - minLatency) / cyclesPerUs, 2);
+  Serial.print(",\"maxRingDepth\":");
+  Serial.print(maxDepth);
+  Serial.print("}");
+  Serial.println();
+}
@@ -0,0 +1,56 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <Arduino.h>
+#include "adc_scan.h"
+
+// One acquisition of all four current channels
+struct RawSample {
+  uint32_t timestamp;    // micros() of the conversion trigger
+  uint16_t adc[4];       // Raw ADC codes, channel order matches CURRENT_PINS
+  uint8_t injectorMask;  // Bit n set while injector n+1 is driven, bit n+4 while it is inside a shot
+  uint16_t supply;       // Raw ADC code of the supply voltage divider
+};
+
+enum SamplerMode {
+  SAMPLER_TIMER,  // IntervalTimer ISR with analogRead() per channel
+  SAMPLER_SCAN,   // Hardware-paced dual-ADC scan with DMA (see adc_scan.h)
+};
+
+// Sampler Configuration
+const uint32_t SAMPLER_RING_SIZE = 4096;      // Raw samples buffered between producer and consumer (41ms at 100kHz)
+const uint32_t SAMPLER_MASK_HISTORY = 256;    // Injector edges awaiting a scan block (regulated hold switches fast)
+const uint8_t SAMPLER_IRQ_PRIORITY = 32;      // Above USB and SD so flushing can't delay a sample
+const uint32_t SAMPLER_TIMER_MAX_RATE = 10000; // analogRead() of four channels can't keep up beyond this
+
+// Store the ADC pins and prepare the scan engine
+void samplerBegin(const int pins[4], int supplyPin);
+
+// Run handler on every sample of all four channels as it is converted - the ADC_ETC done ISR in
+// scan mode, the sampler ISR in timer mode. Takes effect from the next samplerStart().
+void samplerSetSampleHandler(ScanSampleHandler handler);
+
+// Start fixed-rate sampling in the given mode
+bool samplerStart(SamplerMode mode, uint32_t rateHz);
+void samplerStop();
+bool samplerRunning();
+
+// Worst-case delay between a conversion and it reaching the ring
+unsigned long samplerLatencyUs();
+
+// Inside the sample handler: CPU cycles since the sample was triggered, and the sample period
+uint32_t samplerTriggerAgeCycles();
+uint32_t samplerPeriodCycles();
+
+// Pop the oldest sample from the ring, returns false when empty
+bool samplerRead(RawSample &sample);
+
+// Injector drive and shot state recorded alongside every sample, called from the pulse engine and
+// current regulator ISRs
+void samplerSetInjectorState(int channel, bool on, bool inShot);
+uint8_t samplerInjectorMask();
+
+// Print and reset jitter/overrun counters as [SAMPLER] JSON
+void samplerPrintStats();
+
+#endif
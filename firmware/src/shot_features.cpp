@@ -0,0 +1,132 @@
+#include "shot_features.h"
+
+void featureTrackerReset(FeatureTracker &tracker) {
+  tracker = FeatureTracker();
+  tracker.phase = FEATURE_IDLE;
+}
+
+// Time from start to t less a filter lag, never negative
+static uint32_t lagCorrected(uint32_t t, uint32_t start, float lagUs) {
+  float elapsed = (float)(uint32_t)(t - start) - lagUs;
+  return elapsed > 0 ? (uint32_t)(elapsed + 0.5f) : 0;
+}
+
+// Hand the finished shot over and wait for the next one
+static void completeShot(FeatureTracker &tracker, ShotFeatures &done) {
+  if (tracker.phase != FEATURE_DECAY && tracker.features.holdSamples > 0) {
+    tracker.features.holdMeanMa = tracker.holdSumMa / tracker.features.holdSamples;
+  }
+  done = tracker.features;
+  tracker.phase = FEATURE_IDLE;
+}
+
+static void startShot(FeatureTracker &tracker, uint32_t timestampUs, uint32_t milliamps) {
+  tracker.phase = FEATURE_RISE;
+  tracker.startUs = timestampUs;
+  tracker.lastUs = timestampUs;
+  tracker.current = milliamps;
+  tracker.slope = 0;
+  tracker.slopeMax = 0;
+  tracker.slopeMin = 0;
+  tracker.slopeMinUs = timestampUs;
+  tracker.holdSumMa = 0;
+  tracker.features = ShotFeatures();
+  tracker.features.peakMa = milliamps;
+}
+
+// Step both filters, returns the sample interval in us
+static float smooth(FeatureTracker &tracker, uint32_t timestampUs, uint32_t milliamps) {
+  float dt = (float)(uint32_t)(timestampUs - tracker.lastUs);
+  if (dt < 1) dt = 1;
+  tracker.lastUs = timestampUs;
+
+  float alpha = dt / (FEATURE_SMOOTHING_US + dt);
+  float previous = tracker.current;
+  tracker.current += alpha * ((float)milliamps - tracker.current);
+  tracker.slope += alpha * ((tracker.current - previous) / dt - tracker.slope);
+  return dt;
+}
+
+// Track the slope dip during the first drive-on stretch
+static void findOpening(FeatureTracker &tracker, uint32_t timestampUs, float dt) {
+  if (tracker.features.opened) return;
+  if (tracker.slope > tracker.slopeMax) {
+    tracker.slopeMax = tracker.slope;
+    tracker.slopeMin = tracker.slope;
+  } else if (tracker.slope < tracker.slopeMin) {
+    tracker.slopeMin = tracker.slope;
+    tracker.slopeMinUs = timestampUs;
+  } else if (tracker.slopeMax >= FEATURE_MIN_SLOPE &&
+             tracker.slope - tracker.slopeMin > FEATURE_DIP_HYSTERESIS * tracker.slopeMax) {
+    // Both filters and the difference delay the slope
+    tracker.features.opened = true;
+    tracker.features.openingDelayUs = lagCorrected(tracker.slopeMinUs, tracker.startUs,
+                                                   2 * FEATURE_SMOOTHING_US + dt / 2);
+  }
+}
+
+bool featureTrackerAdd(FeatureTracker &tracker, uint32_t timestampUs, uint32_t milliamps, bool drive, bool gate,
+                       ShotFeatures &done) {
+  bool completed = false;
+
+  if (tracker.phase == FEATURE_DECAY) {
+    if (gate) {
+      completed = true;
+    } else {
+      smooth(tracker, timestampUs, milliamps);
+      if (tracker.current <= tracker.offMa * FEATURE_DECAY_FRACTION) {
+        tracker.features.closed = true;
+        tracker.features.closingDecayUs = lagCorrected(timestampUs, tracker.offUs, FEATURE_SMOOTHING_US);
+        completed = true;
+      } else if (timestampUs - tracker.offUs >= FEATURE_DECAY_TIMEOUT_US) {
+        completed = true;
+      }
+    }
+    if (!completed) return false;
+    completeShot(tracker, done);
+  }
+
+  if (tracker.phase == FEATURE_IDLE) {
+    if (gate) startShot(tracker, timestampUs, milliamps);
+    return completed;
+  }
+
+  // The gate drops with the last edge, the current at the previous sample is the switch-off current
+  if (!gate) {
+    if (tracker.features.holdSamples > 0) {
+      tracker.features.holdMeanMa = tracker.holdSumMa / tracker.features.holdSamples;
+    }
+    tracker.phase = FEATURE_DECAY;
+    tracker.offUs = timestampUs;
+    tracker.offMa = tracker.current;
+    smooth(tracker, timestampUs, milliamps);
+    return completed;
+  }
+
+  float dt = smooth(tracker, timestampUs, milliamps);
+  if (milliamps > tracker.features.peakMa) {
+    tracker.features.peakMa = milliamps;
+    tracker.features.timeToPeakUs = timestampUs - tracker.startUs;
+  }
+
+  if (tracker.phase == FEATURE_RISE) {
+    if (drive) {
+      findOpening(tracker, timestampUs, dt);
+      return completed;
+    }
+    tracker.phase = FEATURE_SETTLE;
+  }
+  if (tracker.phase == FEATURE_SETTLE) {
+    if (!drive) return completed;
+    tracker.phase = FEATURE_HOLD;
+  }
+  tracker.holdSumMa += milliamps;
+  tracker.features.holdSamples++;
+  return completed;
+}
+
+bool featureTrackerFlush(FeatureTracker &tracker, ShotFeatures &done) {
+  if (tracker.phase == FEATURE_IDLE) return false;
+  completeShot(tracker, done);
+  return true;
+}
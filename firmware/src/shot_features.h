@@ -0,0 +1,79 @@
+#ifndef SHOT_FEATURES_H
+#define SHOT_FEATURES_H
+
+#include <stdint.h>
+
+// Per-shot features of the coil current, extracted from the sample stream as it is consumed.
+//
+// The current and its derivative are each smoothed by a single-pole filter with a
+// time constant in microseconds, so the result doesn't depend on the sample rate,
+// and reported times are corrected for the filters' lag. While the drive is first
+// on the current of an RL coil rises with an ever smaller slope. The moving
+// armature's back-EMF pulls the slope down further, and once the pintle reaches its
+// stop the slope recovers. The minimum of the smoothed slope (the inflection of the
+// current) is taken as the opening point. A dip has to recover by a fraction of the
+// peak slope before it counts, which keeps sensor noise from being read as one.
+//
+// A shot runs from the first sample with its gate bit set. When the drive first switches
+// off the current falls from the peak towards the hold level. The hold phase starts when
+// the drive switches back on (the first PWM or regulator on edge), so that fall isn't
+// averaged into the hold current. After the gate drops, the closing
+// decay is followed until the current falls below a fraction of its switch-off
+// value, the next shot starts, or the timeout passes. The shot only completes then.
+
+// Feature Extraction Configuration
+const float FEATURE_SMOOTHING_US = 20.0;          // Time constant of the current and slope filters
+const float FEATURE_MIN_SLOPE = 0.2;              // Rise the slope must reach before a dip counts (mA/us)
+const float FEATURE_DIP_HYSTERESIS = 0.1;         // Recovery that confirms a dip, fraction of the peak slope
+const float FEATURE_DECAY_FRACTION = 0.1;         // Closing ends below this fraction of the switch-off current
+const uint32_t FEATURE_DECAY_TIMEOUT_US = 2000;   // Longest closing decay followed
+
+enum FeaturePhase {
+  FEATURE_IDLE,
+  FEATURE_RISE,   // Drive on since the shot started
+  FEATURE_SETTLE, // Drive has switched off after the peak, not yet back on
+  FEATURE_HOLD,   // Drive has switched back on at least once, gate still set
+  FEATURE_DECAY,  // Gate dropped, following the current down
+};
+
+struct ShotFeatures {
+  bool opened;                // Slope dip found while the drive was first on
+  uint32_t openingDelayUs;    // Shot start to the slope dip
+  uint32_t timeToPeakUs;      // Shot start to the highest sample
+  uint32_t peakMa;
+  uint32_t holdSamples;       // Zero for a single pulse
+  uint32_t holdMeanMa;
+  bool closed;                // Decay reached the threshold before the timeout or next shot
+  uint32_t closingDecayUs;    // Last edge to the decay threshold
+};
+
+struct FeatureTracker {
+  uint8_t phase;
+  uint32_t startUs;
+  uint32_t lastUs;
+  uint32_t offUs;
+  float current;              // Smoothed mA
+  float slope;                // Smoothed mA/us
+  float slopeMax;
+  float slopeMin;
+  uint32_t slopeMinUs;
+  float offMa;
+  uint64_t holdSumMa;
+  ShotFeatures features;
+};
+
+void featureTrackerReset(FeatureTracker &tracker);
+
+inline bool featureTrackerActive(const FeatureTracker &tracker) {
+  return tracker.phase != FEATURE_IDLE;
+}
+
+// Feed one sample of the tracker's channel. Returns true with the features in done when this sample
+// completed the previous shot (a new shot it starts is tracked from this sample on).
+bool featureTrackerAdd(FeatureTracker &tracker, uint32_t timestampUs, uint32_t milliamps, bool drive, bool gate,
+                       ShotFeatures &done);
+
+// Complete a shot still being tracked when sampling stops, returns false if there was none
+bool featureTrackerFlush(FeatureTracker &tracker, ShotFeatures &done);
+
+#endif
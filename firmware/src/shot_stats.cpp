@@ -0,0 +1,155 @@
+#include "shot_stats.h"
+
+static void p2Reset(P2Quantile &q, float p) {
+  memset(&q, 0, sizeof(q));
+  q.p = p;
+}
+
+static void p2Add(P2Quantile &q, float x) {
+  if (q.count < 5) {
+    // Insertion sort the first five samples, they become the initial markers
+    int i = q.count++;
+    while (i > 0 && q.heights[i - 1] > x) {
+      q.heights[i] = q.heights[i - 1];
+      i--;
+    }
+    q.heights[i] = x;
+    if (q.count == 5) {
+      for (int m = 0; m < 5; m++) q.positions[m] = m;
+      q.desired[0] = 0;
+      q.desired[1] = 2 * q.p;
+      q.desired[2] = 4 * q.p;
+      q.desired[3] = 2 + 2 * q.p;
+      q.desired[4] = 4;
+    }
+    return;
+  }
+
+  int cell;
+  if (x < q.heights[0]) {
+    q.heights[0] = x;
+    cell = 0;
+  } else if (x >= q.heights[4]) {
+    q.heights[4] = x;
+    cell = 3;
+  } else {
+    cell = 0;
+    while (x >= q.heights[cell + 1]) cell++;
+  }
+  for (int m = cell + 1; m < 5; m++) q.positions[m]++;
+  const float increment[5] = {0, q.p / 2, q.p, (1 + q.p) / 2, 1};
+  for (int m = 0; m < 5; m++) q.desired[m] += increment[m];
+  q.count++;
+
+  // Move the middle markers towards their desired positions, parabolic when it stays ordered
+  for (int m = 1; m < 4; m++) {
+    float d = q.desired[m] - q.positions[m];
+    if ((d >= 1 && q.positions[m + 1] - q.positions[m] > 1) || (d <= -1 && q.positions[m - 1] - q.positions[m] < -1)) {
+      int s = d > 0 ? 1 : -1;
+      float nm = q.positions[m - 1], n = q.positions[m], np = q.positions[m + 1];
+      float hm = q.heights[m - 1], h = q.heights[m], hp = q.heights[m + 1];
+      float parabolic = h + s / (np - nm) * ((n - nm + s) * (hp - h) / (np - n) + (np - n - s) * (h - hm) / (n - nm));
+      if (hm < parabolic && parabolic < hp) {
+        q.heights[m] = parabolic;
+      } else {
+        q.heights[m] = h + s * (q.heights[m + s] - h) / (q.positions[m + s] - n);
+      }
+      q.positions[m] += s;
+    }
+  }
+}
+
+float runningStatQuantile(const P2Quantile &q) {
+  if (q.count == 0) return 0;
+  if (q.count < 5) return q.heights[(int)(q.p * (q.count - 1) + 0.5f)];  // Nearest rank of the sorted few
+  return q.heights[2];
+}
+
+void runningStatReset(RunningStat &stat) {
+  stat.count = 0;
+  stat.mean = 0;
+  stat.m2 = 0;
+  stat.indexMean = 0;
+  stat.indexM2 = 0;
+  stat.coMoment = 0;
+  stat.min = 0;
+  stat.max = 0;
+  p2Reset(stat.p5, 0.05f);
+  p2Reset(stat.p50, 0.5f);
+  p2Reset(stat.p95, 0.95f);
+}
+
+void runningStatAdd(RunningStat &stat, float value) {
+  double index = stat.count;
+  stat.count++;
+  if (stat.count == 1 || value < stat.min) stat.min = value;
+  if (stat.count == 1 || value > stat.max) stat.max = value;
+
+  // Welford, with the co-moment against shot index for the drift fit
+  double delta = value - stat.mean;
+  double indexDelta = index - stat.indexMean;
+  stat.mean += delta / stat.count;
+  stat.indexMean += indexDelta / stat.count;
+  stat.m2 += delta * (value - stat.mean);
+  stat.indexM2 += indexDelta * (index - stat.indexMean);
+  stat.coMoment += indexDelta * (value - stat.mean);
+
+  p2Add(stat.p5, value);
+  p2Add(stat.p50, value);
+  p2Add(stat.p95, value);
+}
+
+float runningStatSd(const RunningStat &stat) {
+  return stat.count > 1 ? sqrt(stat.m2 / (stat.count - 1)) : 0;
+}
+
+float runningStatDriftPerShot(const RunningStat &stat) {
+  return stat.indexM2 > 0 ? stat.coMoment / stat.indexM2 : 0;
+}
+
+float runningStatDriftPercent(const RunningStat &stat) {
+  if (stat.count < 2 || stat.mean == 0) return 0;
+  return runningStatDriftPerShot(stat) * (stat.count - 1) / stat.mean * 100;
+}
+
+void runningStatPrint(const RunningStat &stat, int decimals) {
+  Serial.print("{\"mean\":");
+  Serial.print(stat.mean, decimals);
+  Serial.print(",\"sd\":");
+  Serial.print(runningStatSd(stat), decimals + 1);
+  Serial.print(",\"min\":");
+  Serial.print(stat.min, decimals);
+  Serial.print(",\"max\":");
+  Serial.print(stat.max, decimals);
+  Serial.print(",\"p5\":");
+  Serial.print(runningStatQuantile(stat.p5), decimals);
+  Serial.print(",\"p50\":");
+  Serial.print(runningStatQuantile(stat.p50), decimals);
+  Serial.print(",\"p95\":");
+  Serial.print(runningStatQuantile(stat.p95), decimals);
+  Serial.print(",\"driftPerShot\":");
+  Serial.print(runningStatDriftPerShot(stat), decimals + 3);
+  Serial.print(",\"driftPct\":");
+  Serial.print(runningStatDriftPercent(stat), 2);
+  Serial.print("}");
+}
+
+void shotStatsReset(ShotStats &stats) {
+  runningStatReset(stats.peakCurrent);
+  runningStatReset(stats.avgCurrent);
+  runningStatReset(stats.energy);
+  runningStatReset(stats.openingDelay);
+  runningStatReset(stats.timeToPeak);
+  runningStatReset(stats.holdCurrent);
+  runningStatReset(stats.closingDecay);
+}
+
+void shotStatsAdd(ShotStats &stats, float peakAmps, float avgAmps, float energyMj, const ShotFeatures &features) {
+  runningStatAdd(stats.peakCurrent, peakAmps);
+  runningStatAdd(stats.avgCurrent, avgAmps);
+  runningStatAdd(stats.energy, energyMj);
+  runningStatAdd(stats.timeToPeak, features.timeToPeakUs);
+  if (features.opened) runningStatAdd(stats.openingDelay, features.openingDelayUs);
+  if (features.holdSamples > 0) runningStatAdd(stats.holdCurrent, features.holdMeanMa * 0.001f);
+  if (features.closed) runningStatAdd(stats.closingDecay, features.closingDecayUs);
+}
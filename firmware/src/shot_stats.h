@@ -0,0 +1,62 @@
+#ifndef SHOT_STATS_H
+#define SHOT_STATS_H
+
+#include <Arduino.h>
+#include "shot_features.h"
+
+// Streaming statistics over the shots of a run, constant memory per metric.
+//
+// Each RunningStat keeps Welford mean/variance, min/max, P-square estimates of
+// the 5th/50th/95th percentiles (Jain & Chlamtac, five markers each, no sample
+// storage) and a least-squares slope of value against shot index for drift.
+
+// P-square estimator of one quantile
+struct P2Quantile {
+  float p;
+  uint32_t count;
+  float heights[5];     // Marker heights, exact samples until five have been seen
+  float positions[5];
+  float desired[5];
+};
+
+struct RunningStat {
+  uint32_t count;
+  double mean;
+  double m2;            // Sum of squared deviations (Welford)
+  double indexMean;     // Shot index moments for the drift slope
+  double indexM2;
+  double coMoment;
+  float min;
+  float max;
+  P2Quantile p5;
+  P2Quantile p50;
+  P2Quantile p95;
+};
+
+void runningStatReset(RunningStat &stat);
+void runningStatAdd(RunningStat &stat, float value);
+float runningStatSd(const RunningStat &stat);
+float runningStatQuantile(const P2Quantile &quantile);
+
+// Change per shot from a straight-line fit, and over the whole run as a percentage of the mean
+float runningStatDriftPerShot(const RunningStat &stat);
+float runningStatDriftPercent(const RunningStat &stat);
+
+// Print as a JSON object, values with the given decimals
+void runningStatPrint(const RunningStat &stat, int decimals);
+
+// Per-shot metrics summarised for one injector, features only over the shots they were found in
+struct ShotStats {
+  RunningStat peakCurrent;    // A
+  RunningStat avgCurrent;     // A
+  RunningStat energy;         // mJ drawn from the supply
+  RunningStat openingDelay;   // us
+  RunningStat timeToPeak;     // us
+  RunningStat holdCurrent;    // A
+  RunningStat closingDecay;   // us
+};
+
+void shotStatsReset(ShotStats &stats);
+void shotStatsAdd(ShotStats &stats, float peakAmps, float avgAmps, float energyMj, const ShotFeatures &features);
+
+#endif
@@ -0,0 +1,140 @@
+#include "sweep.h"
+
+static SweepPlan plan;
+static uint32_t pointCount = 0;
+static uint32_t normalPoints = 0;     // Per channel
+static uint32_t peakHoldPoints = 0;   // Per channel
+static uint16_t runOrder[SWEEP_MAX_POINTS];
+
+// Parse one scaled value, returns the character after it
+static const char *parseValue(const char *text, float scale, uint32_t &value, bool &ok) {
+  char *end;
+  float parsed = strtof(text, &end);
+  ok = end != text && parsed >= 0;
+  value = (uint32_t)(parsed * scale + 0.5f);
+  return end;
+}
+
+const char *sweepParseRange(const char *text, float scale, uint32_t min, uint32_t max, SweepRange &range) {
+  SweepRange parsed = {0, 0, 0};
+  bool ok;
+  const char *p = parseValue(text, scale, parsed.first, ok);
+  if (!ok) return "range must be <value> or <first>:<last>:<step>";
+  parsed.last = parsed.first;
+  if (*p == ':') {
+    p = parseValue(p + 1, scale, parsed.last, ok);
+    if (!ok || *p != ':') return "range must be <value> or <first>:<last>:<step>";
+    p = parseValue(p + 1, scale, parsed.step, ok);
+    if (!ok || parsed.step == 0) return "range step must be above zero";
+    if (parsed.last < parsed.first) return "range must go upwards";
+  }
+  if (*p != '\0') return "range must be <value> or <first>:<last>:<step>";
+  if (parsed.first < min || parsed.last > max) return "range outside the allowed values";
+  if (sweepRangeCount(parsed) > SWEEP_MAX_RANGE_STEPS) return "range has more than 256 values";
+  range = parsed;
+  return nullptr;
+}
+
+uint32_t sweepRangeCount(const SweepRange &range) {
+  if (range.step == 0) return 1;
+  return (range.last - range.first) / range.step + 1;
+}
+
+static uint32_t rangeValue(const SweepRange &range, uint32_t index) {
+  return range.first + index * range.step;
+}
+
+// xorshift32, only needs to be repeatable for a seed
+static uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+const char *sweepStart(const SweepPlan &newPlan) {
+  int channels = __builtin_popcount(newPlan.channelMask & 0x0F);
+  if (channels == 0) return "no channels in the sweep";
+  if (!(newPlan.modes & (SWEEP_NORMAL | SWEEP_PEAK_HOLD))) return "no drive mode in the sweep";
+
+  // Counted in 64 bits, four ranges of 256 values overflow 32
+  uint64_t normal = (newPlan.modes & SWEEP_NORMAL) ? sweepRangeCount(newPlan.pulseUs) : 0;
+  uint64_t peakHold = 0;
+  if (newPlan.modes & SWEEP_PEAK_HOLD) {
+    peakHold = (uint64_t)sweepRangeCount(newPlan.pulseUs) * sweepRangeCount(newPlan.peakUs) *
+               sweepRangeCount(newPlan.holdFreqHz) * sweepRangeCount(newPlan.holdDuty);
+  }
+  uint64_t total = (normal + peakHold) * channels;
+  if (total > SWEEP_MAX_POINTS) return "sweep has more than 1024 points";
+
+  plan = newPlan;
+  normalPoints = normal;
+  peakHoldPoints = peakHold;
+  pointCount = total;
+
+  // Fisher-Yates shuffle of the grid indices
+  for (uint32_t i = 0; i < pointCount; i++) {
+    runOrder[i] = i;
+  }
+  if (plan.seed != 0) {
+    uint32_t state = plan.seed;
+    for (uint32_t i = pointCount - 1; i > 0; i--) {
+      uint32_t j = nextRandom(state) % (i + 1);
+      uint16_t swap = runOrder[i];
+      runOrder[i] = runOrder[j];
+      runOrder[j] = swap;
+    }
+  }
+  return nullptr;
+}
+
+uint32_t sweepPointCount() {
+  return pointCount;
+}
+
+void sweepPoint(uint32_t position, SweepPoint &point) {
+  uint32_t index = runOrder[position];
+  uint32_t perChannel = normalPoints + peakHoldPoints;
+  uint32_t channelIndex = index / perChannel;
+  index %= perChannel;
+
+  // channelIndex-th set bit of the mask
+  uint8_t mask = plan.channelMask & 0x0F;
+  for (uint32_t i = 0; i < channelIndex; i++) {
+    mask &= mask - 1;
+  }
+  point.channel = __builtin_ctz(mask);
+
+  point.peakHold = index >= normalPoints;
+  if (point.peakHold) index -= normalPoints;
+  point.peakUs = 0;
+  point.holdFreqHz = 0;
+  point.holdDuty = 0;
+  if (!point.peakHold) {
+    point.pulseUs = rangeValue(plan.pulseUs, index);
+    return;
+  }
+
+  // Mixed radix, duty varies fastest
+  uint32_t duties = sweepRangeCount(plan.holdDuty);
+  uint32_t freqs = sweepRangeCount(plan.holdFreqHz);
+  uint32_t peaks = sweepRangeCount(plan.peakUs);
+  point.holdDuty = rangeValue(plan.holdDuty, index % duties);
+  index /= duties;
+  point.holdFreqHz = rangeValue(plan.holdFreqHz, index % freqs);
+  index /= freqs;
+  point.peakUs = rangeValue(plan.peakUs, index % peaks);
+  index /= peaks;
+  point.pulseUs = rangeValue(plan.pulseUs, index);
+}
+
+const char *sweepProfile(const SweepPoint &point, WaveProfile &profile) {
+  if (!point.peakHold) {
+    profile = makeNormalProfile(point.pulseUs);
+  } else if (point.peakUs >= point.pulseUs) {
+    return "peak time not shorter than the pulse width";
+  } else {
+    profile = makePeakHoldProfile(point.peakUs, point.pulseUs - point.peakUs, point.holdFreqHz, point.holdDuty);
+  }
+  return waveProfileError(profile);
+}
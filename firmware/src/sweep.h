@@ -0,0 +1,71 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <Arduino.h>
+#include "waveform.h"
+
+// Parameter sweeps for characterization curves.
+//
+// A sweep plan is a grid over channel, drive mode, pulse width and, for peak & hold points, the
+// peak time and the hold PWM frequency and duty. Normal points only span channel and pulse
+// width. Points are numbered channel first, then mode, then pulse width, peak, frequency and
+// duty, and run either in that order or in a seeded shuffle so slow drift (coil temperature,
+// supply sag) spreads over the whole curve instead of tilting it. The same seed always gives the
+// same order, so a stopped sweep can be resumed part way through.
+//
+// This module only holds the plan and turns run positions into points and waveforms. Firing
+// the shots and reporting each point is main.cpp's, like every other run.
+
+// Sweep Configuration
+const uint32_t SWEEP_MAX_POINTS = 1024;      // Grid size limit (run order table is 2 bytes each)
+const uint32_t SWEEP_MAX_RANGE_STEPS = 256;  // Values in one range
+
+// Inclusive range, a single value when step is 0
+struct SweepRange {
+  uint32_t first;
+  uint32_t last;
+  uint32_t step;
+};
+
+enum SweepModes : uint8_t {
+  SWEEP_NORMAL = 1,
+  SWEEP_PEAK_HOLD = 2,
+};
+
+struct SweepPlan {
+  uint8_t channelMask;    // Bit n set if injector n+1 takes part
+  uint8_t modes;          // SweepModes bits
+  SweepRange pulseUs;     // Total pulse width, peak & hold included
+  SweepRange peakUs;      // Peak & hold only
+  SweepRange holdFreqHz;
+  SweepRange holdDuty;    // Percent
+  uint32_t seed;          // 0 runs the grid in order
+};
+
+struct SweepPoint {
+  int channel;
+  bool peakHold;
+  uint32_t pulseUs;
+  uint32_t peakUs;
+  uint32_t holdFreqHz;
+  uint8_t holdDuty;
+};
+
+// Parse "<value>" or "<first>:<last>:<step>". Values are multiplied by scale (1000 for ms to us)
+// and must lie in min-max.
+const char *sweepParseRange(const char *text, float scale, uint32_t min, uint32_t max, SweepRange &range);
+
+uint32_t sweepRangeCount(const SweepRange &range);
+
+// Check the plan's size and build its run order, returns nullptr or the reason it can't run
+const char *sweepStart(const SweepPlan &plan);
+
+uint32_t sweepPointCount();
+
+// Point at run position 0 to sweepPointCount() - 1
+void sweepPoint(uint32_t position, SweepPoint &point);
+
+// Drive waveform of a point, returns nullptr or why the point can't be fired (waveProfileError)
+const char *sweepProfile(const SweepPoint &point, WaveProfile &profile);
+
+#endif
@@ -0,0 +1,129 @@
+#include "telemetry.h"
+#include "bulk_transfer.h"
+#include "current_lut.h"
+
+static uint8_t frameData[sizeof(TelemetryFrameHeader) + TELEMETRY_FRAME_POINTS * sizeof(TelemetryPoint)];
+static TelemetryFrameHeader *const frameHeader = (TelemetryFrameHeader *)frameData;
+static TelemetryPoint *const framePoints = (TelemetryPoint *)(frameData + sizeof(TelemetryFrameHeader));
+
+static bool active = false;
+static int requestedDecimation = 0;
+static int decimation = 1;
+static uint8_t session = 0;
+static uint32_t sequence = 0;       // Of the next point
+static uint32_t frameStartMs = 0;
+static uint32_t lastPointUs = 0;
+
+// The point being averaged
+static uint32_t runSum[4];
+static uint8_t runMask = 0;
+static uint32_t runStartUs = 0;
+static int runCount = 0;
+
+static uint32_t sentFrames = 0;
+static uint32_t droppedFrames = 0;
+
+static void sendPending() {
+  uint16_t count = frameHeader->count;
+  if (count == 0) return;
+  uint16_t length = sizeof(TelemetryFrameHeader) + count * sizeof(TelemetryPoint);
+  if ((uint32_t)Serial.availableForWrite() >= bulkFrameWireBytes(length)) {
+    bulkSendFrame(BULK_FRAME_TELEMETRY, session, sequence - count, frameData, length);
+    sentFrames++;
+  } else {
+    droppedFrames++;
+  }
+  frameHeader->count = 0;
+}
+
+static void addPoint() {
+  // A point too far from the last for a 16-bit delta starts a frame of its own
+  uint32_t dt = runStartUs - lastPointUs;
+  if (frameHeader->count > 0 && dt > 0xFFFF) sendPending();
+  if (frameHeader->count == 0) {
+    frameHeader->firstTimestamp = runStartUs;
+    frameHeader->decimation = decimation;
+    frameStartMs = millis();
+    dt = 0;
+  }
+
+  TelemetryPoint &point = framePoints[frameHeader->count++];
+  point.dtUs = dt;
+  for (int ch = 0; ch < 4; ch++) {
+    point.milliamps[ch] = currentLutMilliamps(ch, (runSum[ch] + runCount / 2) / runCount);
+  }
+  point.injectorMask = runMask;
+  lastPointUs = runStartUs;
+  sequence++;
+  if (frameHeader->count == TELEMETRY_FRAME_POINTS) sendPending();
+}
+
+static void resetRun() {
+  memset(runSum, 0, sizeof(runSum));
+  runMask = 0;
+  runCount = 0;
+}
+
+void telemetrySetRate(uint32_t rateHz) {
+  int next = requestedDecimation;
+  if (next == 0) {
+    next = rateHz / TELEMETRY_TARGET_RATE_HZ;
+    next = constrain(next, 1, TELEMETRY_MAX_DECIMATION);
+  }
+  // A part-averaged point left from the last shot would span the gap between them
+  resetRun();
+  if (next == decimation) return;
+  // Points in one frame share a decimation
+  if (active) sendPending();
+  decimation = next;
+}
+
+void telemetryStart(int requested, uint32_t rateHz) {
+  requestedDecimation = requested;
+  decimation = 0;
+  telemetrySetRate(rateHz);
+  session++;
+  sequence = 0;
+  frameHeader->count = 0;
+  frameHeader->reserved = 0;
+  sentFrames = 0;
+  droppedFrames = 0;
+  active = true;
+}
+
+void telemetryStop() {
+  if (!active) return;
+  sendPending();
+  active = false;
+}
+
+bool telemetryActive() {
+  return active;
+}
+
+void telemetryAppend(const RawSample &sample) {
+  if (!active) return;
+  if (runCount == 0) runStartUs = sample.timestamp;
+  for (int ch = 0; ch < 4; ch++) runSum[ch] += sample.adc[ch];
+  runMask |= sample.injectorMask;
+  if (++runCount < decimation) return;
+  addPoint();
+  resetRun();
+}
+
+void telemetryService() {
+  if (!active || frameHeader->count == 0) return;
+  if (millis() - frameStartMs >= TELEMETRY_FLUSH_MS) sendPending();
+}
+
+int telemetryDecimation() {
+  return decimation;
+}
+
+uint32_t telemetrySentFrames() {
+  return sentFrames;
+}
+
+uint32_t telemetryDroppedFrames() {
+  return droppedFrames;
+}
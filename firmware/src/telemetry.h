@@ -0,0 +1,57 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "sampler.h"
+
+// Live telemetry: a decimated copy of the sample stream sent to the host while firing.
+//
+// Runs of `decimation` consumed samples become one point - the mean current of each channel in
+// mA (through the current LUT) and the OR of the injector masks, so a short drive pulse still
+// shows. Points go out as BULK_FRAME_TELEMETRY frames (bulk_transfer.h), which the host picks
+// out of the stream between the text lines the same way as file transfer frames.
+//
+// A frame is only handed to USB if the whole of it fits in the free transmit buffer, otherwise
+// it is dropped and counted - a slow host loses points, it never stalls the sample loop. The
+// frame offset is the sequence number of its first point, so the host sees every gap.
+
+// Telemetry Configuration
+const uint32_t TELEMETRY_TARGET_RATE_HZ = 10000;  // Automatic decimation aims for this point rate
+const int TELEMETRY_MAX_DECIMATION = 64;
+const int TELEMETRY_FRAME_POINTS = 96;            // Points per frame (~1KB on the wire)
+const uint32_t TELEMETRY_FLUSH_MS = 20;           // A part-filled frame goes out after this long
+
+// Frame data: a TelemetryFrameHeader then `count` TelemetryPoints
+struct __attribute__((packed)) TelemetryFrameHeader {
+  uint32_t firstTimestamp;  // micros() of the first sample of the first point
+  uint16_t count;           // Points in the frame
+  uint8_t decimation;       // Samples per point
+  uint8_t reserved;
+};
+
+struct __attribute__((packed)) TelemetryPoint {
+  uint16_t dtUs;            // Since the previous point in the frame, 0 for the first
+  uint16_t milliamps[4];    // Mean current per channel
+  uint8_t injectorMask;     // OR of the samples' masks, bits as RawSample::injectorMask
+};
+
+// decimation 0 picks one from the sample rate for about TELEMETRY_TARGET_RATE_HZ points
+void telemetryStart(int decimation, uint32_t rateHz);
+void telemetryStop();
+bool telemetryActive();
+
+// Called from startSampling() so an automatic decimation follows the rate, and so no point
+// averages across the gap between shots
+void telemetrySetRate(uint32_t rateHz);
+
+// Acquisition side - called with every consumed sample, sends a frame as soon as one fills
+void telemetryAppend(const RawSample &sample);
+
+// Flush a part-filled frame once it is TELEMETRY_FLUSH_MS old, from loop() and idleDelay()
+void telemetryService();
+
+int telemetryDecimation();
+uint32_t telemetrySentFrames();
+uint32_t telemetryDroppedFrames();
+
+#endif
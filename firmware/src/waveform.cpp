@@ -0,0 +1,203 @@
+#include "waveform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+void waveCompile(const WaveProfile &profile, WaveProgram &program) {
+  program.count = profile.count;
+  program.totalTicks = 0;
+  for (int i = 0; i < profile.count; i++) {
+    const WaveSegment &seg = profile.segments[i];
+    WaveStep &step = program.steps[i];
+    step.type = seg.type;
+    step.durationTicks = seg.durationUs * WAVE_TICKS_PER_US;
+    step.periodTicks = 0;
+    step.onTicks = 0;
+    step.peakMa = seg.peakMa;
+    step.holdMa = seg.holdMa;
+    step.bandMa = seg.bandMa;
+    if (seg.type == WAVE_PWM) {
+      step.periodTicks = WAVE_TICKS_PER_US * 1000000 / seg.freqHz;
+      step.onTicks = step.periodTicks * seg.dutyPercent / 100;
+    }
+    program.totalTicks += step.durationTicks;
+  }
+}
+
+static const char *skipSpaces(const char *p) {
+  while (*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+// Parse one unsigned number, returns nullptr if there isn't one
+static const char *parseNumber(const char *p, uint32_t &value) {
+  p = skipSpaces(p);
+  if (!isdigit((unsigned char)*p)) return nullptr;
+  char *end;
+  value = strtoul(p, &end, 10);
+  return end;
+}
+
+const char *waveParseProfile(const char *text, WaveProfile &profile) {
+  WaveProfile parsed;
+  memset(&parsed, 0, sizeof(parsed));
+
+  const char *p = skipSpaces(text);
+  while (*p) {
+    if (parsed.count >= WAVE_MAX_SEGMENTS) return "too many segments";
+    WaveSegment &seg = parsed.segments[parsed.count];
+
+    if (strncasecmp(p, "ON", 2) == 0) {
+      seg.type = WAVE_ON;
+      p += 2;
+    } else if (strncasecmp(p, "OFF", 3) == 0) {
+      seg.type = WAVE_OFF;
+      p += 3;
+    } else if (strncasecmp(p, "PWM", 3) == 0) {
+      seg.type = WAVE_PWM;
+      p += 3;
+    } else if (strncasecmp(p, "REG", 3) == 0) {
+      seg.type = WAVE_REG;
+      p += 3;
+    } else {
+      return "expected ON, OFF, PWM or REG";
+    }
+
+    p = parseNumber(p, seg.durationUs);
+    if (!p) return "missing duration";
+    if (seg.type == WAVE_PWM) {
+      uint32_t duty;
+      p = parseNumber(p, seg.freqHz);
+      if (!p) return "missing PWM frequency";
+      p = parseNumber(p, duty);
+      if (!p) return "missing PWM duty";
+      seg.dutyPercent = duty > 100 ? 0 : duty;
+    } else if (seg.type == WAVE_REG) {
+      uint32_t peak, hold, band;
+      p = parseNumber(p, peak);
+      if (!p) return "missing REG peak current";
+      p = parseNumber(p, hold);
+      if (!p) return "missing REG hold current";
+      p = parseNumber(p, band);
+      if (!p) return "missing REG hold band";
+      if (peak > WAVE_MAX_CURRENT_MA || hold > WAVE_MAX_CURRENT_MA || band > WAVE_MAX_CURRENT_MA) {
+        return "REG current above 20A";
+      }
+      seg.peakMa = peak;
+      seg.holdMa = hold;
+      seg.bandMa = band;
+    }
+    parsed.count++;
+
+    p = skipSpaces(p);
+    if (*p == ';' || *p == ',') {
+      p = skipSpaces(p + 1);
+    } else if (*p) {
+      return "expected ';' between segments";
+    }
+  }
+
+  const char *error = waveProfileError(parsed);
+  if (error) return error;
+  profile = parsed;
+  return nullptr;
+}
+
+void waveFormatProfile(const WaveProfile &profile, char *buffer, int size) {
+  int used = 0;
+  buffer[0] = '\0';
+  for (int i = 0; i < profile.count && used < size; i++) {
+    const WaveSegment &seg = profile.segments[i];
+    const char *sep = i > 0 ? ";" : "";
+    if (seg.type == WAVE_PWM) {
+      used += snprintf(buffer + used, size - used, "%sPWM %lu %lu %u", sep, (unsigned long)seg.durationUs,
+                       (unsigned long)seg.freqHz, seg.dutyPercent);
+    } else if (seg.type == WAVE_REG) {
+      used += snprintf(buffer + used, size - used, "%sREG %lu %u %u %u", sep, (unsigned long)seg.durationUs,
+                       seg.peakMa, seg.holdMa, seg.bandMa);
+    } else {
+      used += snprintf(buffer + used, size - used, "%s%s %lu", sep, seg.type == WAVE_ON ? "ON" : "OFF",
+                       (unsigned long)seg.durationUs);
+    }
+  }
+}
+
+uint32_t waveDurationUs(const WaveProfile &profile) {
+  uint32_t total = 0;
+  for (int i = 0; i < profile.count; i++) {
+    total += profile.segments[i].durationUs;
+  }
+  return total;
+}
+
+const WaveSegment *waveFirstSegment(const WaveProfile &profile, uint8_t type) {
+  for (int i = 0; i < profile.count; i++) {
+    if (profile.segments[i].type == type) return &profile.segments[i];
+  }
+  return nullptr;
+}
+
+bool waveRegulated(const WaveProgram &program) {
+  for (int i = 0; i < program.count; i++) {
+    if (program.steps[i].type == WAVE_REG) return true;
+  }
+  return false;
+}
+
+void waveStart(WaveCursor &cursor) {
+  memset(&cursor, 0, sizeof(cursor));
+}
+
+bool waveNextEdge(const WaveProgram &program, WaveCursor &cursor, WaveEdge &edge) {
+  while (cursor.seg < program.count) {
+    const WaveStep &step = program.steps[cursor.seg];
+    uint32_t segEnd = cursor.segStart + step.durationTicks;
+    if (cursor.t >= segEnd) {
+      if (step.type == WAVE_REG) cursor.forceEdge = true;  // Take the pin back from the regulator
+      cursor.seg++;
+      cursor.segStart = segEnd;
+      cursor.t = segEnd;
+      cursor.offPending = false;
+      continue;
+    }
+
+    uint32_t at = cursor.t;
+    bool want;
+    if (step.type != WAVE_PWM) {
+      want = step.type != WAVE_OFF;
+      cursor.t = segEnd;
+      if (step.type == WAVE_REG) cursor.forceEdge = true;
+    } else if (!cursor.offPending) {
+      // Start of a PWM period, the off edge is cut short by the segment end
+      want = true;
+      cursor.cycleStart = at;
+      cursor.offPending = true;
+      cursor.t = at + step.onTicks;
+    } else {
+      want = false;
+      cursor.offPending = false;
+      cursor.t = cursor.cycleStart + step.periodTicks;
+    }
+
+    if (want != cursor.level || cursor.forceEdge) {
+      cursor.level = want;
+      cursor.forceEdge = false;
+      edge.tick = at;
+      edge.on = want;
+      edge.last = false;
+      edge.regulate = step.type == WAVE_REG ? &step : nullptr;
+      return true;
+    }
+  }
+
+  // Shot over - always report the end so the gate closes, and leave the output off
+  if (cursor.done) return false;
+  cursor.done = true;
+  cursor.level = false;
+  edge.tick = cursor.segStart;
+  edge.on = false;
+  edge.last = true;
+  edge.regulate = nullptr;
+  return true;
+}
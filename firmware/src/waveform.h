@@ -0,0 +1,183 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdint.h>
+
+// Drive waveforms as segment tables.
+//
+// A WaveProfile is the user-facing description (microseconds, Hz, percent) that
+// is validated and uploaded over serial. waveCompile() turns it into a
+// WaveProgram in pulse engine ticks, and waveNextEdge() interprets the program
+// one edge at a time, so the ISR never needs the whole edge list.
+//
+// Text form, segments separated by ';':
+//   ON <us> | OFF <us> | PWM <us> <Hz> <duty%> | REG <us> <peak mA> <hold mA> <band mA>
+// e.g. peak & hold: "ON 2000;PWM 1800 2000 50", current regulated: "REG 3800 4000 1000 200"
+//
+// REG segments switch on and hand the pin to the current regulator (see
+// current_control.h) until the segment ends.
+
+// Waveform Configuration
+const int WAVE_MAX_SEGMENTS = 8;
+const uint32_t WAVE_TICKS_PER_US = 150;        // Matches PULSE_TICKS_PER_US
+const uint32_t WAVE_MIN_SEGMENT_US = 5;        // Shortest segment
+const uint32_t WAVE_MAX_TOTAL_US = 100000;     // Longest shot, matches MAX_PULSE_WIDTH
+const uint32_t WAVE_MIN_PWM_HZ = 100;
+const uint32_t WAVE_MAX_PWM_HZ = 50000;
+const uint32_t WAVE_MIN_EDGE_US = 2;           // Shortest PWM on or off time the pulse engine can hold
+const int WAVE_TEXT_SIZE = 128;                // Longest profile line accepted or printed
+const uint32_t WAVE_MAX_CURRENT_MA = 20000;    // REG thresholds, ACS712 20A range
+const uint32_t WAVE_MIN_BAND_MA = 50;          // Narrowest hold band, ~4 ADC codes
+
+enum WaveSegmentType : uint8_t {
+  WAVE_OFF = 0,
+  WAVE_ON = 1,
+  WAVE_PWM = 2,
+  WAVE_REG = 3,
+};
+
+struct WaveSegment {
+  uint8_t type;
+  uint8_t dutyPercent;  // PWM only, 1-99
+  uint32_t durationUs;
+  uint32_t freqHz;      // PWM only
+  uint16_t peakMa;      // REG only: switch to hold at this current
+  uint16_t holdMa;      // REG only: hold band centre
+  uint16_t bandMa;      // REG only: hold band width
+};
+
+struct WaveProfile {
+  uint8_t count;
+  WaveSegment segments[WAVE_MAX_SEGMENTS];
+};
+
+// Compiled segment, all times in ticks
+struct WaveStep {
+  uint8_t type;
+  uint32_t durationTicks;
+  uint32_t periodTicks;
+  uint32_t onTicks;
+  uint16_t peakMa;
+  uint16_t holdMa;
+  uint16_t bandMa;
+};
+
+struct WaveProgram {
+  uint8_t count;
+  uint32_t totalTicks;
+  WaveStep steps[WAVE_MAX_SEGMENTS];
+};
+
+// One drive transition relative to the shot start. The last edge of a shot is always
+// reported (even if the output is already off) so it can close the shot gate.
+struct WaveEdge {
+  uint32_t tick;
+  bool on;
+  bool last;
+  const WaveStep *regulate;  // Set when the edge starts a REG segment
+};
+
+// Interpreter position within a program
+struct WaveCursor {
+  uint8_t seg;
+  bool level;
+  bool offPending;      // PWM: next decision is the end of the on time
+  bool done;
+  bool forceEdge;       // Entering or leaving a REG segment always produces an edge
+  uint32_t segStart;
+  uint32_t cycleStart;
+  uint32_t t;           // Next decision point
+};
+
+// Built-in profiles. constexpr so the defaults are checked at compile time.
+constexpr WaveSegment waveSegment(uint8_t type, uint32_t durationUs, uint32_t freqHz = 0, uint8_t dutyPercent = 0) {
+  return WaveSegment{type, dutyPercent, durationUs, freqHz, 0, 0, 0};
+}
+
+constexpr WaveSegment regulatedSegment(uint32_t durationUs, uint16_t peakMa, uint16_t holdMa, uint16_t bandMa) {
+  return WaveSegment{WAVE_REG, 0, durationUs, 0, peakMa, holdMa, bandMa};
+}
+
+constexpr WaveProfile makeNormalProfile(uint32_t pulseUs) {
+  return WaveProfile{1, {waveSegment(WAVE_ON, pulseUs)}};
+}
+
+constexpr WaveProfile makePeakHoldProfile(uint32_t peakUs, uint32_t holdUs, uint32_t holdFreqHz,
+                                          uint8_t holdDutyPercent) {
+  return WaveProfile{2, {waveSegment(WAVE_ON, peakUs), waveSegment(WAVE_PWM, holdUs, holdFreqHz, holdDutyPercent)}};
+}
+
+constexpr WaveProfile makeRegulatedProfile(uint32_t pulseUs, uint16_t peakMa, uint16_t holdMa, uint16_t bandMa) {
+  return WaveProfile{1, {regulatedSegment(pulseUs, peakMa, holdMa, bandMa)}};
+}
+
+// nullptr when the profile can be run, otherwise the reason it can't
+constexpr const char *waveProfileError(const WaveProfile &profile) {
+  if (profile.count < 1 || profile.count > WAVE_MAX_SEGMENTS) return "1-8 segments required";
+  uint32_t total = 0;
+  for (int i = 0; i < profile.count; i++) {
+    const WaveSegment &seg = profile.segments[i];
+    if (seg.type > WAVE_REG) return "unknown segment type";
+    if (seg.durationUs < WAVE_MIN_SEGMENT_US) return "segment shorter than 5us";
+    // Checked before adding so a huge segment can't wrap the total past the limit
+    if (seg.durationUs > WAVE_MAX_TOTAL_US - total) return "profile longer than 100ms";
+    total += seg.durationUs;
+    if (seg.type == WAVE_REG) {
+      if (seg.peakMa > WAVE_MAX_CURRENT_MA) return "REG peak above 20A";
+      if (seg.bandMa < WAVE_MIN_BAND_MA) return "REG band narrower than 50mA";
+      if (seg.holdMa + seg.bandMa / 2 >= seg.peakMa) return "REG hold band must end below the peak";
+      if (seg.holdMa < seg.bandMa / 2 + WAVE_MIN_BAND_MA) return "REG hold band must stay above 50mA";
+      continue;
+    }
+    if (seg.type != WAVE_PWM) continue;
+    if (seg.freqHz < WAVE_MIN_PWM_HZ || seg.freqHz > WAVE_MAX_PWM_HZ) return "PWM frequency outside 100Hz-50kHz";
+    if (seg.dutyPercent < 1 || seg.dutyPercent > 99) return "PWM duty outside 1-99%";
+    uint32_t periodUs = 1000000 / seg.freqHz;
+    uint32_t onUs = periodUs * seg.dutyPercent / 100;
+    if (onUs < WAVE_MIN_EDGE_US || periodUs - onUs < WAVE_MIN_EDGE_US) return "PWM on or off time shorter than 2us";
+  }
+  return nullptr;
+}
+
+// Compile-time specializations of the built-in shapes
+template <uint32_t PulseUs>
+struct NormalProfile {
+  static_assert(waveProfileError(makeNormalProfile(PulseUs)) == nullptr, "Invalid normal profile");
+  static constexpr WaveProfile profile() { return makeNormalProfile(PulseUs); }
+};
+
+template <uint32_t PeakUs, uint32_t HoldUs, uint32_t HoldFreqHz, uint8_t HoldDutyPercent>
+struct PeakHoldProfile {
+  static_assert(waveProfileError(makePeakHoldProfile(PeakUs, HoldUs, HoldFreqHz, HoldDutyPercent)) == nullptr,
+                "Invalid peak & hold profile");
+  static constexpr WaveProfile profile() { return makePeakHoldProfile(PeakUs, HoldUs, HoldFreqHz, HoldDutyPercent); }
+};
+
+template <uint32_t PulseUs, uint16_t PeakMa, uint16_t HoldMa, uint16_t BandMa>
+struct RegulatedProfile {
+  static_assert(waveProfileError(makeRegulatedProfile(PulseUs, PeakMa, HoldMa, BandMa)) == nullptr,
+                "Invalid current regulated profile");
+  static constexpr WaveProfile profile() { return makeRegulatedProfile(PulseUs, PeakMa, HoldMa, BandMa); }
+};
+
+// Profile must have passed waveProfileError()
+void waveCompile(const WaveProfile &profile, WaveProgram &program);
+
+// Parse the text form, returns nullptr or an error message (profile untouched on error)
+const char *waveParseProfile(const char *text, WaveProfile &profile);
+
+// Write the text form into buffer (WAVE_TEXT_SIZE bytes)
+void waveFormatProfile(const WaveProfile &profile, char *buffer, int size);
+
+// Summary values for status reporting, 0 when the profile has no such segment
+uint32_t waveDurationUs(const WaveProfile &profile);
+const WaveSegment *waveFirstSegment(const WaveProfile &profile, uint8_t type);
+
+// True when any segment needs the current regulator (and so scan sampling)
+bool waveRegulated(const WaveProgram &program);
+
+// Interpreter - start a cursor, then pull edges until one comes back with last set
+void waveStart(WaveCursor &cursor);
+bool waveNextEdge(const WaveProgram &program, WaveCursor &cursor, WaveEdge &edge);
+
+#endif
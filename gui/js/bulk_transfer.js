@@ -0,0 +1,277 @@
+// Binary bulk transfer of log files (firmware/src/bulk_transfer.h)
+//
+// Frames arrive COBS encoded between 0x00 bytes, interleaved with the usual text lines.
+// Each decoded frame is an 8-byte header (type, transfer, length, offset), the data and
+// a CRC-32. Files are reassembled in order and offered as a download when complete. A bad
+// CRC, a gap or a stall restarts the file from the last good offset.
+
+const BULK_FRAME_OPEN = 1;
+const BULK_FRAME_DATA = 2;
+const BULK_FRAME_END = 3;
+const BULK_FRAME_ERROR = 4;
+const BULK_FRAME_TELEMETRY = 5;
+const BULK_HEADER_BYTES = 8;
+
+const CRC32_TABLE = (() => {
+    const table = new Uint32Array(256);
+    for (let i = 0; i < 256; i++) {
+        let c = i;
+        for (let bit = 0; bit < 8; bit++) {
+            c = (c & 1) ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+        }
+        table[i] = c >>> 0;
+    }
+    return table;
+})();
+
+function crc32(bytes) {
+    let crc = 0xFFFFFFFF;
+    for (let i = 0; i < bytes.length; i++) {
+        crc = CRC32_TABLE[(crc ^ bytes[i]) & 0xFF] ^ (crc >>> 8);
+    }
+    return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+// Undo COBS, returns null if the block codes don't fit the input
+function cobsDecode(input) {
+    const out = new Uint8Array(input.length);
+    let read = 0;
+    let write = 0;
+    while (read < input.length) {
+        const code = input[read++];
+        if (code === 0 || read + code - 1 > input.length) return null;
+        for (let i = 1; i < code; i++) out[write++] = input[read++];
+        if (code < 0xFF && read < input.length) out[write++] = 0;
+    }
+    return out.subarray(0, write);
+}
+
+// Decode and check one frame, returns null if it fails COBS, CRC or length checks
+function decodeBulkFrame(encoded) {
+    const frame = cobsDecode(encoded);
+    if (!frame || frame.length < BULK_HEADER_BYTES + 4) return null;
+    const view = new DataView(frame.buffer, frame.byteOffset, frame.byteLength);
+    const length = view.getUint16(2, true);
+    if (BULK_HEADER_BYTES + length + 4 !== frame.length ||
+        crc32(frame.subarray(0, frame.length - 4)) !== view.getUint32(frame.length - 4, true)) {
+        return null;
+    }
+    return {
+        type: frame[0],
+        transfer: frame[1],
+        offset: view.getUint32(4, true),
+        data: frame.subarray(BULK_HEADER_BYTES, BULK_HEADER_BYTES + length)
+    };
+}
+
+// Splits the serial byte stream into text lines and binary frames. Lines may span reads.
+class SerialStreamSplitter {
+    constructor(onLine, onFrame) {
+        this.onLine = onLine;
+        this.onFrame = onFrame;  // Returns false if the frame didn't check out
+        this.inFrame = false;
+        this.pending = [];
+        this.decoder = new TextDecoder();
+    }
+
+    push(chunk) {
+        let start = 0;
+        while (start < chunk.length) {
+            if (this.inFrame) {
+                const end = chunk.indexOf(0, start);
+                if (end < 0) {
+                    this.keep(chunk.subarray(start));
+                    return;
+                }
+                const frame = this.take(chunk.subarray(start, end));
+                start = end + 1;
+                // A frame that doesn't check out was most likely text read out of step - its
+                // closing zero is then really the opening one of the next frame
+                this.inFrame = frame.length === 0 || !this.onFrame(frame);
+                continue;
+            }
+
+            let end = start;
+            while (end < chunk.length && chunk[end] !== 10 && chunk[end] !== 0) end++;
+            if (end === chunk.length) {
+                this.keep(chunk.subarray(start));
+                return;
+            }
+            const line = this.decoder.decode(this.take(chunk.subarray(start, end))).trim();
+            if (line) this.onLine(line);
+            if (chunk[end] === 0) this.inFrame = true;
+            start = end + 1;
+        }
+    }
+
+    keep(part) {
+        this.pending.push(part.slice());
+    }
+
+    take(part) {
+        if (this.pending.length === 0) return part;
+        this.pending.push(part);
+        const total = this.pending.reduce((sum, p) => sum + p.length, 0);
+        const joined = new Uint8Array(total);
+        let offset = 0;
+        for (const p of this.pending) {
+            joined.set(p, offset);
+            offset += p.length;
+        }
+        this.pending = [];
+        return joined;
+    }
+}
+
+// Downloads log files one after another with `get file=<name> [offset=<n>]`
+class BulkReceiver {
+    constructor(connection) {
+        this.connection = connection;
+        this.queue = [];
+        this.current = null;
+        this.maxRetries = 5;
+        this.stallMs = 2000;
+        this.textDecoder = new TextDecoder();
+        this.progressElement = document.getElementById('downloadProgress');
+        this.watchdog = null;
+    }
+
+    download(names) {
+        this.queue.push(...names);
+        if (!this.current) this.startNext();
+    }
+
+    cancel() {
+        this.queue = [];
+        if (this.current) {
+            this.connection.sendCommand('get abort=1');
+            this.connection.logToConsole(`Download of ${this.current.name} cancelled`, 'system');
+        }
+        this.finishSession();
+    }
+
+    startNext() {
+        const name = this.queue.shift();
+        if (name === undefined) {
+            this.finishSession();
+            return;
+        }
+        this.current = {
+            name,
+            parts: [],
+            offset: 0,
+            size: null,
+            transfer: null,  // Set by the OPEN frame, null while a (re)start is pending
+            retries: 0,
+            started: performance.now(),
+            lastFrame: performance.now()
+        };
+        if (!this.watchdog) this.watchdog = setInterval(() => this.checkStall(), 500);
+        this.connection.sendCommand(`get file=${name}`);
+        this.updateProgress();
+    }
+
+    finishSession() {
+        this.current = null;
+        if (this.watchdog) {
+            clearInterval(this.watchdog);
+            this.watchdog = null;
+        }
+    }
+
+    // A frame failed its checks - whatever it held is lost
+    badFrame() {
+        this.resume('bad frame');
+    }
+
+    // Takes a frame from decodeBulkFrame()
+    handleFrame({ type, transfer, offset, data }) {
+        const length = data.length;
+        const cur = this.current;
+        if (!cur) return;
+        cur.lastFrame = performance.now();
+
+        if (type === BULK_FRAME_OPEN) {
+            const name = this.textDecoder.decode(data.subarray(4));
+            if (name !== cur.name || offset !== cur.offset) return;
+            cur.transfer = transfer;
+            cur.size = new DataView(data.buffer, data.byteOffset, data.byteLength).getUint32(0, true);
+            return;
+        }
+        if (transfer !== cur.transfer) return;  // Still in flight from an aborted transfer
+
+        if (type === BULK_FRAME_DATA) {
+            if (offset !== cur.offset) {
+                this.resume(`gap at ${cur.offset}`);
+                return;
+            }
+            cur.parts.push(data.slice());
+            cur.offset += length;
+            this.updateProgress();
+        } else if (type === BULK_FRAME_END) {
+            if (offset !== cur.offset) {
+                this.resume(`ended at ${offset}, have ${cur.offset}`);
+            } else {
+                this.saveFile();
+            }
+        } else if (type === BULK_FRAME_ERROR) {
+            this.connection.logToConsole(`${cur.name}: ${this.textDecoder.decode(data)}`, 'error');
+            this.startNext();
+        }
+    }
+
+    // Restart the current file from the last byte that arrived intact
+    resume(reason, force = false) {
+        const cur = this.current;
+        if (!cur || (cur.transfer === null && !force)) return;
+        if (++cur.retries > this.maxRetries) {
+            this.connection.sendCommand('get abort=1');
+            this.connection.logToConsole(`${cur.name}: ${reason}, giving up after ${this.maxRetries} retries`, 'error');
+            this.startNext();
+            return;
+        }
+        this.connection.logToConsole(`${cur.name}: ${reason}, resuming at ${cur.offset}`, 'system');
+        cur.transfer = null;
+        cur.lastFrame = performance.now();
+        this.connection.sendCommand(`get file=${cur.name} offset=${cur.offset}`);
+    }
+
+    checkStall() {
+        const cur = this.current;
+        if (cur && performance.now() - cur.lastFrame > this.stallMs) this.resume('stalled', true);
+    }
+
+    saveFile() {
+        const cur = this.current;
+        const seconds = (performance.now() - cur.started) / 1000;
+        const mbps = cur.offset / seconds / 1e6;
+        const blob = new Blob(cur.parts, { type: 'application/octet-stream' });
+        const url = URL.createObjectURL(blob);
+        const link = document.createElement('a');
+        link.href = url;
+        link.download = cur.name;
+        document.body.appendChild(link);
+        link.click();
+        link.remove();
+        setTimeout(() => URL.revokeObjectURL(url), 10000);
+
+        this.connection.logToConsole(`Downloaded ${cur.name}: ${cur.offset} bytes in ${seconds.toFixed(2)}s, ` +
+            `${mbps.toFixed(2)} MB/s${cur.retries ? `, ${cur.retries} resumes` : ''}`, 'result');
+        this.progressElement.textContent = `${cur.name} done, ${mbps.toFixed(2)} MB/s`;
+        this.startNext();
+    }
+
+    updateProgress() {
+        const cur = this.current;
+        if (!cur) return;
+        // A few updates a second, not one per frame
+        const now = performance.now();
+        if (cur.offset > 0 && now - (this.lastProgress || 0) < 200) return;
+        this.lastProgress = now;
+        const seconds = (performance.now() - cur.started) / 1000;
+        const mbps = seconds > 0 ? cur.offset / seconds / 1e6 : 0;
+        const percent = cur.size ? (100 * cur.offset / cur.size).toFixed(0) : '0';
+        const waiting = this.queue.length ? ` (+${this.queue.length} queued)` : '';
+        this.progressElement.textContent = `${cur.name} ${percent}% ${mbps.toFixed(2)} MB/s${waiting}`;
+    }
+}
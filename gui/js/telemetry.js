@@ -0,0 +1,239 @@
+// Live telemetry (firmware/src/telemetry.h) and the serial stream processing around it
+//
+// Loaded by telemetry_worker.js, so parsing and drawing stay off the UI thread, and by the
+// page itself as a fallback where workers can't start (index.html opened from file://).
+// Points are kept in typed-array rings and drawn as min/max per pixel column, so a redraw
+// costs the same however many points the plot window holds.
+
+const TELEMETRY_HEADER_BYTES = 8;
+const TELEMETRY_POINT_BYTES = 11;
+const TELEMETRY_CHANNEL_COLORS = ['#3498db', '#e74c3c', '#2ecc71', '#f39c12'];
+
+// The most recent points, oldest overwritten first
+class TelemetryRing {
+    constructor(capacity = 1 << 18) {
+        this.capacity = capacity;
+        this.time = new Float64Array(capacity);  // Seconds since the first point of the session
+        this.amps = [0, 1, 2, 3].map(() => new Float32Array(capacity));
+        this.mask = new Uint8Array(capacity);
+        this.clear();
+    }
+
+    clear() {
+        this.version = (this.version || 0) + 1;  // Changes whenever the contents do
+        this.head = 0;  // Next slot written
+        this.count = 0;
+        this.session = null;
+        this.nextSequence = 0;
+        this.lastRaw = 0;
+        this.lastTime = 0;
+        this.received = 0;
+        this.dropped = 0;
+        this.decimation = 0;
+    }
+
+    // Takes the data of a BULK_FRAME_TELEMETRY frame, returns false if it doesn't parse
+    addFrame(session, sequence, data) {
+        if (data.length < TELEMETRY_HEADER_BYTES) return false;
+        const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+        const first = view.getUint32(0, true);
+        const count = view.getUint16(4, true);
+        if (data.length !== TELEMETRY_HEADER_BYTES + count * TELEMETRY_POINT_BYTES) return false;
+
+        // A new `live on=1` starts the plot over
+        if (session !== this.session) {
+            this.clear();
+            this.session = session;
+            this.nextSequence = sequence;
+            this.lastRaw = first;
+        }
+        if (sequence !== this.nextSequence) {
+            this.dropped += (sequence - this.nextSequence) >>> 0;
+        }
+        this.nextSequence = (sequence + count) >>> 0;
+        this.decimation = data[6];
+
+        // micros() wraps every 71 minutes, unwrap from the last point
+        let raw = first;
+        let time = this.lastTime + ((raw - this.lastRaw) >>> 0) / 1e6;
+        let offset = TELEMETRY_HEADER_BYTES;
+        for (let i = 0; i < count; i++) {
+            const dt = view.getUint16(offset, true);
+            raw = (raw + dt) >>> 0;
+            time += dt / 1e6;
+            const slot = this.head;
+            this.time[slot] = time;
+            for (let ch = 0; ch < 4; ch++) {
+                this.amps[ch][slot] = view.getUint16(offset + 2 + ch * 2, true) / 1000;
+            }
+            this.mask[slot] = data[offset + 10];
+            this.head = (slot + 1) % this.capacity;
+            offset += TELEMETRY_POINT_BYTES;
+        }
+        this.count = Math.min(this.count + count, this.capacity);
+        this.received += count;
+        this.lastRaw = raw;
+        this.lastTime = time;
+        this.version++;
+        return true;
+    }
+}
+
+// Draws the last windowMs of device time ending at the newest point, like a scope left in
+// normal trigger - the last shot stays up until the next one arrives
+class TelemetryPlot {
+    constructor(canvas, ring) {
+        this.canvas = canvas;
+        this.context = canvas.getContext('2d');
+        this.ring = ring;
+        this.windowMs = 50;
+        this.dirty = true;
+        this.drawnVersion = -1;
+        this.columns = null;
+    }
+
+    resize(width, height) {
+        if (width === this.canvas.width && height === this.canvas.height) return;
+        this.canvas.width = width;
+        this.canvas.height = height;
+        this.columns = null;
+        this.dirty = true;
+    }
+
+    setWindow(windowMs) {
+        this.windowMs = windowMs;
+        this.dirty = true;
+    }
+
+    draw() {
+        const ring = this.ring;
+        if (!this.dirty && ring.version === this.drawnVersion) return;
+        this.dirty = false;
+        this.drawnVersion = ring.version;
+        const ctx = this.context;
+        const width = this.canvas.width;
+        const height = this.canvas.height;
+        ctx.fillStyle = '#1e1e1e';
+        ctx.fillRect(0, 0, width, height);
+        if (ring.count === 0 || width === 0) return;
+
+        // Per column and channel: min, max and whether the injector was driven
+        if (!this.columns || this.columns.width !== width) {
+            this.columns = {
+                width,
+                min: new Float32Array(width * 4),
+                max: new Float32Array(width * 4),
+                drive: new Uint8Array(width)
+            };
+        }
+        const { min, max, drive } = this.columns;
+        min.fill(Infinity);
+        max.fill(-Infinity);
+        drive.fill(0);
+
+        const end = ring.lastTime;
+        const span = this.windowMs / 1000;
+        const start = end - span;
+        let top = 1;
+        let slot = ring.head;
+        for (let n = 0; n < ring.count; n++) {
+            slot = slot === 0 ? ring.capacity - 1 : slot - 1;
+            const t = ring.time[slot];
+            if (t < start) break;
+            const x = Math.min(width - 1, Math.floor((t - start) / span * width));
+            for (let ch = 0; ch < 4; ch++) {
+                const value = ring.amps[ch][slot];
+                const i = x * 4 + ch;
+                if (value < min[i]) min[i] = value;
+                if (value > max[i]) max[i] = value;
+                if (value > top) top = value;
+            }
+            drive[x] |= ring.mask[slot];
+        }
+        top = Math.ceil(top);
+
+        // Grid and scale
+        const plotHeight = height - 12;
+        ctx.strokeStyle = '#333';
+        ctx.lineWidth = 1;
+        ctx.beginPath();
+        for (let amps = 0; amps <= top; amps++) {
+            const y = plotHeight - amps / top * plotHeight + 0.5;
+            ctx.moveTo(0, y);
+            ctx.lineTo(width, y);
+        }
+        ctx.stroke();
+        ctx.fillStyle = '#888';
+        ctx.font = '11px monospace';
+        ctx.fillText(`${top} A`, 4, 12);
+        ctx.fillText(`${this.windowMs} ms, 1/${ring.decimation}`, width - 110, 12);
+
+        // Drive gates as bars under the traces, one row per injector
+        for (let ch = 0; ch < 4; ch++) {
+            ctx.fillStyle = TELEMETRY_CHANNEL_COLORS[ch];
+            for (let x = 0; x < width; x++) {
+                if (drive[x] & (1 << ch)) ctx.fillRect(x, plotHeight + 2 + ch * 2.5, 1, 2);
+            }
+        }
+
+        // Each column is a vertical min-max stroke joined to the next
+        for (let ch = 0; ch < 4; ch++) {
+            ctx.strokeStyle = TELEMETRY_CHANNEL_COLORS[ch];
+            ctx.beginPath();
+            let open = false;
+            for (let x = 0; x < width; x++) {
+                const i = x * 4 + ch;
+                if (min[i] === Infinity) continue;
+                const yMin = plotHeight - min[i] / top * plotHeight;
+                const yMax = plotHeight - max[i] / top * plotHeight;
+                if (open) ctx.lineTo(x + 0.5, yMin); else ctx.moveTo(x + 0.5, yMin);
+                ctx.lineTo(x + 0.5, yMax);
+                open = true;
+            }
+            ctx.stroke();
+        }
+    }
+}
+
+// Splits raw serial reads into lines and frames, keeps telemetry and hands everything else
+// on in order as events: { line }, { frame } (decoded, see decodeBulkFrame) or { bad: true }
+class SerialStreamProcessor {
+    constructor(onEvents) {
+        this.onEvents = onEvents;
+        this.ring = new TelemetryRing();
+        this.events = [];
+        this.telemetryFrames = 0;
+        this.splitter = new SerialStreamSplitter(
+            line => this.events.push({ line }),
+            encoded => this.handleFrame(encoded));
+    }
+
+    push(chunk) {
+        this.splitter.push(chunk);
+        if (this.events.length === 0) return;
+        const events = this.events;
+        this.events = [];
+        this.onEvents(events);
+    }
+
+    handleFrame(encoded) {
+        const frame = decodeBulkFrame(encoded);
+        if (!frame) {
+            this.events.push({ bad: true });
+            return false;
+        }
+        if (frame.type === BULK_FRAME_TELEMETRY) {
+            if (this.ring.addFrame(frame.transfer, frame.offset, frame.data)) this.telemetryFrames++;
+        } else {
+            // Copied out so the frame can be transferred to the page on its own
+            frame.data = frame.data.slice();
+            this.events.push({ frame });
+        }
+        return true;
+    }
+
+    stats() {
+        const ring = this.ring;
+        return { received: ring.received, dropped: ring.dropped, frames: this.telemetryFrames };
+    }
+}
@@ -0,0 +1,32 @@
+// Serial stream worker - splits reads, keeps live telemetry and draws the plot off the UI thread
+//
+// Page -> worker: { chunk } raw serial data, { canvas } an OffscreenCanvas to draw on,
+//                 { resize: [width, height] }, { windowMs }, { reset: true }
+// Worker -> page: { events } lines and non-telemetry frames in stream order, { stats }
+
+importScripts('bulk_transfer.js', 'telemetry.js');
+
+const processor = new SerialStreamProcessor(events => postMessage({ events }));
+let plot = null;
+
+function drawLoop() {
+    plot.draw();
+    requestAnimationFrame(drawLoop);
+}
+
+onmessage = ({ data }) => {
+    if (data.chunk) {
+        processor.push(data.chunk);
+    } else if (data.canvas) {
+        plot = new TelemetryPlot(data.canvas, processor.ring);
+        requestAnimationFrame(drawLoop);
+    } else if (data.resize && plot) {
+        plot.resize(data.resize[0], data.resize[1]);
+    } else if (data.windowMs && plot) {
+        plot.setWindow(data.windowMs);
+    } else if (data.reset) {
+        processor.ring.clear();
+    }
+};
+
+setInterval(() => postMessage({ stats: processor.stats() }), 500);
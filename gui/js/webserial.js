@@ -4,7 +4,6 @@ class SerialConnection {
         this.reader = null;
         this.writer = null;
         this.isConnected = false;
-        this.decoder = new TextDecoder();
         this.encoder = new TextEncoder();
         
         // Parameter tracking
@@ -19,7 +18,89 @@ class SerialConnection {
             pot3: '---'
         };
         
+        // Tracked commands - sent with id=<n>, the device answers [ACK] on receipt and [DONE] when run
+        this.nextCommandId = 1;
+        this.inFlight = new Map();
+        this.sequence = [];
+        this.sequenceTotal = 0;
+        this.sequenceDone = 0;
+        this.sequenceWindow = 16;  // Half the device command queue, leaves room for manual commands
+        
+        // Log files listed by the device, and the binary download of them
+        this.logFiles = [];
+        this.bulk = new BulkReceiver(this);
+        
+        // Console lines are queued and added once per animation frame, a burst of output costs
+        // one layout instead of one per line
+        this.consoleQueue = [];
+        this.consoleFlushPending = false;
+        this.maxConsoleLines = 2000;
+        
         this.initializeUI();
+        this.startStreamProcessing();
+    }
+
+    // Serial reads are split and live telemetry parsed and drawn in a worker, with a fallback
+    // to this thread where workers can't start (the page opened from file://)
+    startStreamProcessing() {
+        const handleEvents = events => this.handleStreamEvents(events);
+        this.liveCanvas = document.getElementById('livePlot');
+        try {
+            this.streamWorker = new Worker('js/telemetry_worker.js');
+            const offscreen = this.liveCanvas.transferControlToOffscreen();
+            this.streamWorker.postMessage({ canvas: offscreen }, [offscreen]);
+            this.streamWorker.onmessage = ({ data }) => {
+                if (data.events) handleEvents(data.events);
+                else if (data.stats) this.updateLiveStats(data.stats);
+            };
+        } catch (error) {
+            this.streamWorker = null;
+            this.streamProcessor = new SerialStreamProcessor(handleEvents);
+            this.livePlot = new TelemetryPlot(this.liveCanvas, this.streamProcessor.ring);
+            const drawLoop = () => {
+                this.livePlot.draw();
+                requestAnimationFrame(drawLoop);
+            };
+            requestAnimationFrame(drawLoop);
+            setInterval(() => this.updateLiveStats(this.streamProcessor.stats()), 500);
+            console.warn('Stream worker unavailable, parsing on the page:', error);
+        }
+        this.resizeLivePlot();
+        window.addEventListener('resize', () => this.resizeLivePlot());
+    }
+
+    resizeLivePlot() {
+        const ratio = window.devicePixelRatio || 1;
+        const size = [Math.round(this.liveCanvas.clientWidth * ratio), Math.round(this.liveCanvas.clientHeight * ratio)];
+        if (this.streamWorker) this.streamWorker.postMessage({ resize: size });
+        else this.livePlot.resize(size[0], size[1]);
+    }
+
+    setLiveWindow() {
+        const windowMs = parseFloat(this.liveWindowInput.value);
+        if (!(windowMs > 0)) return;
+        if (this.streamWorker) this.streamWorker.postMessage({ windowMs });
+        else this.livePlot.setWindow(windowMs);
+    }
+
+    toggleLive() {
+        this.sendCommand(this.liveOn ? 'live on=0' : 'live on=1');
+    }
+
+    updateLiveStats({ received, dropped }) {
+        const rate = (received - (this.lastLiveReceived || 0)) * 2;  // Stats come every 500 ms
+        this.lastLiveReceived = received;
+        if (received === 0 && !this.liveOn) return;
+        this.liveStats.textContent = `${rate} pts/s, ${received} total, ${dropped} dropped`;
+    }
+
+    // Lines and frames from the stream, in the order they arrived
+    handleStreamEvents(events) {
+        for (const event of events) {
+            if (event.line !== undefined) this.parseMessage(event.line);
+            else if (event.frame) this.bulk.handleFrame(event.frame);
+            else this.bulk.badFrame();
+        }
     }
 
     initializeUI() {
@@ -30,10 +111,30 @@ class SerialConnection {
         this.connectionStatus = document.getElementById('connectionStatus');
         this.pulseWidthInput = document.getElementById('pulseWidthInput');
         this.setPulseWidthBtn = document.getElementById('setPulseWidthBtn');
+        this.profileInput = document.getElementById('profileInput');
+        this.setProfileBtn = document.getElementById('setProfileBtn');
+        this.sequenceInput = document.getElementById('sequenceInput');
+        this.runSequenceBtn = document.getElementById('runSequenceBtn');
+        this.stopSequenceBtn = document.getElementById('stopSequenceBtn');
+        this.downloadInput = document.getElementById('downloadInput');
+        this.downloadBtn = document.getElementById('downloadBtn');
+        this.downloadAllBtn = document.getElementById('downloadAllBtn');
+        this.cancelDownloadBtn = document.getElementById('cancelDownloadBtn');
+        this.liveBtn = document.getElementById('liveBtn');
+        this.liveWindowInput = document.getElementById('liveWindowInput');
+        this.liveStats = document.getElementById('liveStats');
 
         this.connectBtn.addEventListener('click', () => this.toggleConnection());
         this.sendBtn.addEventListener('click', () => this.sendCustomCommand());
         this.setPulseWidthBtn.addEventListener('click', () => this.setPulseWidth());
+        this.setProfileBtn.addEventListener('click', () => this.uploadProfile());
+        this.runSequenceBtn.addEventListener('click', () => this.runSequence());
+        this.stopSequenceBtn.addEventListener('click', () => this.stopSequence());
+        this.downloadBtn.addEventListener('click', () => this.downloadFiles());
+        this.downloadAllBtn.addEventListener('click', () => this.downloadAllFiles());
+        this.cancelDownloadBtn.addEventListener('click', () => this.bulk.cancel());
+        this.liveBtn.addEventListener('click', () => this.toggleLive());
+        this.liveWindowInput.addEventListener('change', () => this.setLiveWindow());
         
         // Add event listeners for all injector buttons
         document.querySelectorAll('.injector-btn').forEach(btn => {
@@ -74,7 +175,8 @@ class SerialConnection {
     async connect() {
         try {
             this.port = await navigator.serial.requestPort();
-            await this.port.open({ baudRate: 115200 });
+            // Native USB ignores the baud rate, a large buffer keeps bulk transfers from stalling
+            await this.port.open({ baudRate: 115200, bufferSize: 1 << 20 });
 
             this.writer = this.port.writable.getWriter();
             
@@ -120,12 +222,9 @@ class SerialConnection {
                     const { value, done } = await this.reader.read();
                     if (done) break;
                     
-                    const text = this.decoder.decode(value);
-                    const lines = text.split('\n').filter(line => line.trim());
-                    
-                    lines.forEach(line => {
-                        this.parseMessage(line);
-                    });
+                    // Text lines and binary frames, either may span reads
+                    if (this.streamWorker) this.streamWorker.postMessage({ chunk: value }, [value.buffer]);
+                    else this.streamProcessor.push(value);
                 }
             }
         } catch (error) {
@@ -174,6 +273,16 @@ class SerialConnection {
             this.commandInput.disabled = false;
             this.pulseWidthInput.disabled = false;
             this.setPulseWidthBtn.disabled = false;
+            this.profileInput.disabled = false;
+            this.setProfileBtn.disabled = false;
+            this.sequenceInput.disabled = false;
+            this.runSequenceBtn.disabled = false;
+            this.stopSequenceBtn.disabled = false;
+            this.downloadInput.disabled = false;
+            this.downloadBtn.disabled = false;
+            this.downloadAllBtn.disabled = false;
+            this.cancelDownloadBtn.disabled = false;
+            this.liveBtn.disabled = false;
             
             // Request initial status
             setTimeout(() => this.sendCommand('i'), 500);
@@ -190,14 +299,46 @@ class SerialConnection {
             this.commandInput.disabled = true;
             this.pulseWidthInput.disabled = true;
             this.setPulseWidthBtn.disabled = true;
+            this.profileInput.disabled = true;
+            this.setProfileBtn.disabled = true;
+            this.sequenceInput.disabled = true;
+            this.runSequenceBtn.disabled = true;
+            this.stopSequenceBtn.disabled = true;
+            this.downloadInput.disabled = true;
+            this.downloadBtn.disabled = true;
+            this.downloadAllBtn.disabled = true;
+            this.cancelDownloadBtn.disabled = true;
+            this.liveBtn.disabled = true;
+            this.liveOn = false;
+            this.liveBtn.textContent = 'Start Live';
+            this.sequence = [];
+            this.inFlight.clear();
+            this.bulk.finishSession();
         }
     }
 
     logToConsole(message, type = 'received') {
-        const line = document.createElement('div');
-        line.className = `console-line ${type}`;
-        line.textContent = `[${new Date().toLocaleTimeString()}] ${message}`;
-        this.consoleElement.appendChild(line);
+        this.consoleQueue.push({ text: `[${new Date().toLocaleTimeString()}] ${message}`, type });
+        if (this.consoleFlushPending) return;
+        this.consoleFlushPending = true;
+        requestAnimationFrame(() => this.flushConsole());
+    }
+
+    flushConsole() {
+        this.consoleFlushPending = false;
+        // Only the newest lines can stay anyway
+        const queued = this.consoleQueue.slice(-this.maxConsoleLines);
+        this.consoleQueue = [];
+        const fragment = document.createDocumentFragment();
+        for (const { text, type } of queued) {
+            const line = document.createElement('div');
+            line.className = `console-line ${type}`;
+            line.textContent = text;
+            fragment.appendChild(line);
+        }
+        this.consoleElement.appendChild(fragment);
+        let excess = this.consoleElement.childElementCount - this.maxConsoleLines;
+        while (excess-- > 0) this.consoleElement.firstElementChild.remove();
         this.consoleElement.scrollTop = this.consoleElement.scrollHeight;
     }
     
@@ -207,6 +348,22 @@ class SerialConnection {
             this.parseStatusMessage(line.substring(8));
         } else if (line.startsWith('[RESULT]')) {
             this.parseResultMessage(line.substring(8));
+        } else if (line.startsWith('[ENGINE]')) {
+            this.parseEngineMessage(line.substring(8));
+        } else if (line.startsWith('[ACK]')) {
+            // Receipt only, progress is counted on [DONE]
+        } else if (line.startsWith('[NAK]')) {
+            this.parseCommandReply(line.substring(5), false);
+        } else if (line.startsWith('[DONE]')) {
+            this.parseCommandReply(line.substring(6), true);
+        } else if (line.startsWith('[SUMMARY]')) {
+            this.parseSummaryMessage(line.substring(9));
+        } else if (line.startsWith('[THERMAL]')) {
+            this.parseThermalMessage(line.substring(9));
+        } else if (line.startsWith('[REGULATION]')) {
+            this.parseRegulationMessage(line.substring(12));
+        } else if (line.startsWith('[FILES]')) {
+            this.parseFilesMessage(line.substring(7));
         } else if (line.startsWith('[ERROR]')) {
             this.logToConsole(line.substring(7), 'error');
         } else if (line.startsWith('[LOG]')) {
@@ -226,11 +383,32 @@ class SerialConnection {
             this.parameters.holdFreq = status.holdFreq + ' Hz';
             this.parameters.holdDuty = status.holdDuty + ' %';
             this.pulseWidthInput.value = status.pulseWidth;
+            if (status.holdProfile !== undefined) {
+                this.profileInput.value = status.holdProfile;
+            }
             
             // Update SD status
             const sdStatus = status.sdAvailable ? 
                 (status.logging ? 'LOGGING' : 'READY') : 'NOT AVAILABLE';
-            this.logToConsole(`Status: Pulse=${status.pulseWidth}ms, SD=${sdStatus}`, 'system');
+            let sdDetail = '';
+            if (status.logMBps !== undefined) {
+                sdDetail = `, write=${status.logMBps.toFixed(2)}MB/s, dropped=${status.logDropped}`;
+                if (status.logPacked) {
+                    sdDetail += `, packed ${status.logRatio.toFixed(2)}:1`;
+                }
+            }
+            if (status.logMode === 'capture') {
+                sdDetail += `, capture ${status.capturePreUs}/${status.capturePostUs}us, windows=${status.captureWindows}`;
+            } else if (status.logMode === 'adaptive') {
+                sdDetail += `, adaptive 1/${status.decimation} hold=${status.fullRateHoldUs}us`;
+            }
+            let liveDetail = '';
+            if (status.live !== undefined) {
+                this.liveOn = status.live;
+                this.liveBtn.textContent = status.live ? 'Stop Live' : 'Start Live';
+                if (status.live) liveDetail = `, Live=1/${status.liveDecimation} dropped=${status.liveDropped}`;
+            }
+            this.logToConsole(`Status: Pulse=${status.pulseWidth}ms, SD=${sdStatus}${sdDetail}${liveDetail}`, 'system');
             
             this.updateParameterDisplay();
         } catch (e) {
@@ -246,24 +424,171 @@ class SerialConnection {
             document.getElementById(`avg${injNum}`).textContent = result.avgCurrent.toFixed(2);
             
             const mode = result.peakHold ? 'P&H' : 'Normal';
-            this.logToConsole(`Injector ${injNum} (${mode}): Peak=${result.peakCurrent.toFixed(2)}A, Avg=${result.avgCurrent.toFixed(2)}A`, 'result');
+            const opening = result.openingDelayUs !== null ? `${result.openingDelayUs}us` : 'n/a';
+            const decay = result.closingDecayUs !== null ? `${result.closingDecayUs}us` : 'n/a';
+            this.logToConsole(`Injector ${injNum} (${mode}): Peak=${result.peakCurrent.toFixed(2)}A, Avg=${result.avgCurrent.toFixed(2)}A, ` +
+                `Opening=${opening}, Peak at ${result.timeToPeakUs}us, Decay=${decay}, ` +
+                `Energy=${result.energyMj.toFixed(1)}mJ at ${result.supplyVoltage.toFixed(1)}V`, 'result');
         } catch (e) {
             console.error('Failed to parse result message:', e);
         }
     }
     
+    parseEngineMessage(jsonStr) {
+        try {
+            const run = JSON.parse(jsonStr);
+            const mode = run.peakHold ? 'P&H' : 'Normal';
+            this.logToConsole(`Engine run ${run.rpm} RPM (${mode}), ${run.cycles} cycles, skipped=${run.skipped}`, 'result');
+            for (const inj of run.injectors) {
+                document.getElementById(`peak${inj.injector}`).textContent = inj.peakCurrent.toFixed(2);
+                document.getElementById(`avg${inj.injector}`).textContent = inj.avgCurrent.toFixed(2);
+                this.logToConsole(`  Injector ${inj.injector}: ${inj.shots} shots, Peak=${inj.peakCurrent.toFixed(2)}A, Avg=${inj.avgCurrent.toFixed(2)}A`, 'result');
+            }
+        } catch (e) {
+            console.error('Failed to parse engine message:', e);
+        }
+    }
+    
+    parseSummaryMessage(jsonStr) {
+        try {
+            const run = JSON.parse(jsonStr);
+            const peak = run.peakCurrent;
+            const avg = run.avgCurrent;
+            document.getElementById(`peak${run.injector}`).textContent = peak.mean.toFixed(2);
+            document.getElementById(`avg${run.injector}`).textContent = avg.mean.toFixed(2);
+            const mode = run.mode === 'ph' ? 'P&H' : 'Normal';
+            this.logToConsole(`Injector ${run.injector} ${run.run} (${mode}), ${run.shots} shots: ` +
+                `Peak=${peak.mean.toFixed(3)}±${peak.sd.toFixed(4)}A [p5 ${peak.p5.toFixed(3)}, p95 ${peak.p95.toFixed(3)}], ` +
+                `Avg=${avg.mean.toFixed(3)}±${avg.sd.toFixed(4)}A, drift=${peak.driftPct.toFixed(2)}%`, 'result');
+            if (run.openingDelayUs) {
+                const opening = run.openingDelayUs;
+                this.logToConsole(`Injector ${run.injector} opening: ${opening.mean.toFixed(1)}±${opening.sd.toFixed(2)}us ` +
+                    `[p5 ${opening.p5.toFixed(1)}, p95 ${opening.p95.toFixed(1)}], drift=${opening.driftPct.toFixed(2)}%`, 'result');
+            }
+        } catch (e) {
+            console.error('Failed to parse summary message:', e);
+        }
+    }
+    
+    parseThermalMessage(jsonStr) {
+        try {
+            const thermal = JSON.parse(jsonStr);
+            const coils = thermal.injectors.map(inj =>
+                `${inj.injector}: +${inj.riseC.toFixed(1)}C ${inj.powerW.toFixed(2)}W${inj.overLimit ? ' OVER' : ''}`);
+            const over = thermal.injectors.some(inj => inj.overLimit);
+            this.logToConsole(`Coil thermal (limits +${thermal.riseLimitC}C, ${thermal.powerLimitW}W) - ${coils.join(', ')}`,
+                over ? 'error' : 'result');
+        } catch (e) {
+            console.error('Failed to parse thermal message:', e);
+        }
+    }
+    
+    parseRegulationMessage(jsonStr) {
+        try {
+            const reg = JSON.parse(jsonStr);
+            const peak = reg.peakReached ? `peak ${reg.timeToPeakUs}us, overshoot=${reg.overshootMa}mA` : 'peak not reached';
+            this.logToConsole(`Injector ${reg.injector} regulated: ${peak}, hold RMS error=${reg.holdRmsErrorMa}mA, switches=${reg.switches}, latency max=${reg.maxLatencyUs}us`, 'result');
+        } catch (e) {
+            console.error('Failed to parse regulation message:', e);
+        }
+    }
+    
+    parseFilesMessage(jsonStr) {
+        try {
+            this.logFiles = JSON.parse(jsonStr).files;
+            if (this.pendingDownloadAll) {
+                this.pendingDownloadAll = false;
+                this.bulk.download(this.logFiles.map(file => file.name));
+            }
+        } catch (e) {
+            console.error('Failed to parse files message:', e);
+        }
+    }
+    
+    downloadFiles() {
+        const names = this.downloadInput.value.split(/[\s,]+/).filter(name => name.length > 0);
+        if (names.length > 0) this.bulk.download(names);
+    }
+    
+    downloadAllFiles() {
+        // The listing arrives as [FILES], downloads start from there
+        this.pendingDownloadAll = true;
+        this.sendCommand('files');
+    }
+    
+    sendTracked(command) {
+        const id = this.nextCommandId++;
+        this.inFlight.set(id, command);
+        this.sendCommand(`${command} id=${id}`);
+        return id;
+    }
+    
+    parseCommandReply(jsonStr, done) {
+        try {
+            const reply = JSON.parse(jsonStr);
+            const command = this.inFlight.get(reply.id);
+            if (command === undefined) return;
+            this.inFlight.delete(reply.id);
+            if (!done || !reply.ok) {
+                this.logToConsole(`${command}: ${reply.error}`, 'error');
+                if (!done) this.sequence = [];  // Queue full or line rejected - don't run later steps out of order
+            }
+            if (this.sequenceTotal > 0) {
+                this.sequenceDone++;
+                this.updateSequenceProgress();
+                this.pumpSequence();
+            }
+        } catch (e) {
+            console.error('Failed to parse command reply:', e);
+        }
+    }
+    
+    runSequence() {
+        const lines = this.sequenceInput.value.split('\n')
+            .map(line => line.trim())
+            .filter(line => line.length > 0 && !line.startsWith('#'));
+        if (lines.length === 0) return;
+        this.sequence = lines;
+        this.sequenceTotal = lines.length;
+        this.sequenceDone = 0;
+        this.updateSequenceProgress();
+        this.pumpSequence();
+    }
+    
+    pumpSequence() {
+        // Keep the device queue fed without waiting for each step to finish
+        while (this.sequence.length > 0 && this.inFlight.size < this.sequenceWindow) {
+            this.sendTracked(this.sequence.shift());
+        }
+    }
+    
+    stopSequence() {
+        this.sequence = [];
+        this.sendCommand('stop');
+    }
+    
+    updateSequenceProgress() {
+        document.getElementById('sequenceProgress').textContent = `${this.sequenceDone} / ${this.sequenceTotal}`;
+    }
+    
     setPulseWidth() {
         const value = parseFloat(this.pulseWidthInput.value);
         if (value >= 0.1 && value <= 100) {
-            this.sendCommand('p');
-            setTimeout(() => {
-                this.sendCommand(value.toString());
-            }, 100);
+            this.sendCommand(`set pw=${value}`);
         } else {
             this.logToConsole('Invalid pulse width. Must be between 0.1 and 100 ms', 'error');
         }
     }
     
+    uploadProfile() {
+        const profile = this.profileInput.value.trim();
+        if (profile.length > 0 && profile.length < 100) {
+            this.sendCommand(`profile ph="${profile}"`);
+        } else {
+            this.logToConsole('Invalid profile. Use e.g. ON 2000;PWM 1800 2000 50', 'error');
+        }
+    }
+    
     parseParameterData(line) {
         // Parse initial values from help output
         if (line.includes('Current pulse width:')) {
@@ -0,0 +1,865 @@
+// Host-side shot analysis of CSV current logs (CURRENT_LOG_*.CSV, logdecode output, dumps)
+//
+// Memory-maps each log and parses it on every core: the body is cut into chunks at line
+// breaks and each thread turns its chunks into columns with a plain digit loop (no strtod,
+// no locale), which the compiler keeps branch-light, and memchr's vector scan for the line
+// ends. Shots are found from the InjN_State columns: a drive-on sample starts one, and on
+// periods less than --gap apart (peak & hold PWM) belong to the same shot. Each shot then
+// goes through the firmware's own feature extractor (shot_features.cpp), in parallel, so
+// peak, opening delay, hold mean and closing decay match what the device would report. The
+// supply charge and energy are integrated over the drive-on samples, from the Supply_V
+// column when the log has one, or --supply otherwise.
+//
+// Logs are grouped into modes (--mode before the files it names, e.g. 12V static, 12V P&H
+// and 24V P&H). Every mode is compared against the first one with shots showing the feature
+// (hold current needs a peak & hold mode), per injector and feature: Welch's
+// difference of means with a 90% interval, and a two one-sided t-test (TOST) against a
+// +/- --margin percent equivalence band around the reference mean.
+//
+// Build: g++ -std=c++17 -O2 -pthread -I../../firmware/src -o loganalyze loganalyze.cpp
+//          ../../firmware/src/shot_features.cpp
+//
+// Usage: loganalyze [--mode <name>] [--supply <V>] <log.CSV>... [-o shots.csv] [--modes modes.csv]
+//                   [--gap <us>] [--margin <%>] [--threads <n>]
+//        loganalyze --bench [--bench-mb <n>] [--threads <n>] [<log.CSV>...]
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shot_features.h"
+
+const int LOG_CHANNELS = 4;
+const uint32_t DEFAULT_GAP_US = 1000;     // Off time that still belongs to the same shot
+const float DEFAULT_MARGIN_PCT = 5.0f;    // Equivalence band, percent of the reference mean
+const float DEFAULT_SUPPLY_V = 12.0f;     // Logs without a Supply_V column
+const int CHUNKS_PER_THREAD = 4;          // Smaller chunks even out rows of different lengths
+const double TOST_ALPHA = 0.05;
+
+struct Options {
+  std::vector<std::string> inputs;
+  std::vector<int> inputModes;       // Index into modes, per input
+  std::vector<float> inputSupply;    // Nominal volts, per input
+  std::vector<std::string> modes;
+  std::string output;                // Shot CSV, stdout when empty
+  std::string modesPath;             // Mode comparison CSV
+  uint32_t gapUs = DEFAULT_GAP_US;
+  float marginPct = DEFAULT_MARGIN_PCT;
+  int threads = 0;                   // 0 uses every core
+  bool bench = false;
+  uint32_t benchMb = 256;
+};
+
+// Parsed log, one array per column
+struct LogColumns {
+  std::vector<uint32_t> timestamp;
+  std::vector<float> current[LOG_CHANNELS];
+  std::vector<uint8_t> mask;         // Bit n set while injector n+1 is driven
+  std::vector<float> supply;         // Empty without a Supply_V column
+  uint64_t skipped = 0;              // Lines that aren't sample rows
+};
+
+enum ColumnRole : uint8_t {
+  ROLE_SKIP,
+  ROLE_TIMESTAMP,
+  ROLE_CURRENT,      // + channel
+  ROLE_STATE = ROLE_CURRENT + LOG_CHANNELS,
+  ROLE_SUPPLY = ROLE_STATE + LOG_CHANNELS,
+  ROLE_KIND,
+};
+
+struct CsvLayout {
+  std::vector<uint8_t> roles;        // One per field
+  bool hasSupply = false;
+  bool hasKind = false;
+};
+
+struct LogFile {
+  std::string path;
+  int mode = 0;
+  float nominalSupply = DEFAULT_SUPPLY_V;
+  size_t bytes = 0;
+  double parseSeconds = 0;
+  LogColumns columns;
+};
+
+// Rows first..last are the shot's gate (first to last drive-on sample), tracking stops at limit
+struct ShotSpan {
+  int file;
+  int channel;
+  size_t first;
+  size_t last;
+  size_t limit;
+};
+
+struct ShotResult {
+  ShotFeatures features;
+  uint32_t startUs;
+  uint32_t pulseUs;                  // First edge to the last one
+  uint32_t samples;
+  float avgAmps;                     // Over the gate
+  float chargeUc;                    // Drive-on samples only, like the device
+  float energyMj;
+  float supplyVolts;                 // Mean while the drive was on
+};
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: loganalyze [--mode <name>] [--supply <V>] <log.CSV>... [-o shots.csv] [--modes modes.csv]\n"
+          "                  [--gap <us>] [--margin <%%>] [--threads <n>]\n"
+          "       loganalyze --bench [--bench-mb <n>] [--threads <n>] [<log.CSV>...]\n");
+}
+
+static bool parseArgs(int argc, char **argv, Options &options) {
+  int mode = -1;
+  float supply = DEFAULT_SUPPLY_V;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      options.output = argv[++i];
+    } else if (arg == "--modes" && i + 1 < argc) {
+      options.modesPath = argv[++i];
+    } else if (arg == "--mode" && i + 1 < argc) {
+      options.modes.push_back(argv[++i]);
+      mode = options.modes.size() - 1;
+    } else if (arg == "--supply" && i + 1 < argc) {
+      supply = atof(argv[++i]);
+      if (supply <= 0) return false;
+    } else if (arg == "--gap" && i + 1 < argc) {
+      options.gapUs = atoi(argv[++i]);
+    } else if (arg == "--margin" && i + 1 < argc) {
+      options.marginPct = atof(argv[++i]);
+      if (options.marginPct <= 0) return false;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.threads = atoi(argv[++i]);
+    } else if (arg == "--bench") {
+      options.bench = true;
+    } else if (arg == "--bench-mb" && i + 1 < argc) {
+      options.benchMb = atoi(argv[++i]);
+      if (options.benchMb == 0) return false;
+    } else if (arg[0] == '-') {
+      return false;
+    } else {
+      // Files before any --mode form a mode of their own
+      if (mode < 0) {
+        options.modes.push_back("all");
+        mode = 0;
+      }
+      options.inputs.push_back(arg);
+      options.inputModes.push_back(mode);
+      options.inputSupply.push_back(supply);
+    }
+  }
+  if (options.threads <= 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+  return options.bench || !options.inputs.empty();
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Run fn(index) for every index below count, spread over threads
+template <class Fn>
+static void parallelFor(int threads, size_t count, Fn fn) {
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) fn(i);
+  };
+  int workers = std::min<size_t>(threads, count);
+  std::vector<std::thread> pool;
+  for (int t = 1; t < workers; t++) pool.emplace_back(worker);
+  worker();
+  for (std::thread &thread : pool) thread.join();
+}
+
+// Read-only mapping of a whole file
+struct MappedFile {
+  const char *data = nullptr;
+  size_t size = 0;
+
+  bool open(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      fprintf(stderr, "%s is empty\n", path.c_str());
+      ::close(fd);
+      return false;
+    }
+    size = info.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+      fprintf(stderr, "Cannot map %s: %s\n", path.c_str(), strerror(errno));
+      return false;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    data = (const char *)mapped;
+    return true;
+  }
+
+  ~MappedFile() {
+    if (data) munmap((void *)data, size);
+  }
+};
+
+static inline const char *lineEnd(const char *p, const char *end) {
+  const char *eol = (const char *)memchr(p, '\n', end - p);
+  return eol ? eol : end;
+}
+
+// Find the column header and what each field holds, returns the first data byte or nullptr.
+// Dumps captured from the serial port have other lines before it.
+static const char *parseHeader(const char *p, const char *end, CsvLayout &layout) {
+  while (p < end) {
+    const char *eol = lineEnd(p, end);
+    if (eol - p >= 12 && memcmp(p, "Timestamp_us", 12) == 0) {
+      layout.roles.clear();
+      const char *field = p;
+      while (field < eol) {
+        const char *comma = (const char *)memchr(field, ',', eol - field);
+        if (!comma) comma = eol;
+        std::string name(field, comma - field);
+        if (!name.empty() && name.back() == '\r') name.pop_back();
+        uint8_t role = ROLE_SKIP;
+        int channel;
+        if (name == "Timestamp_us") {
+          role = ROLE_TIMESTAMP;
+        } else if (sscanf(name.c_str(), "Current%d_A", &channel) == 1 && channel >= 1 && channel <= LOG_CHANNELS) {
+          role = ROLE_CURRENT + channel - 1;
+        } else if (sscanf(name.c_str(), "Inj%d_State", &channel) == 1 && channel >= 1 && channel <= LOG_CHANNELS) {
+          role = ROLE_STATE + channel - 1;
+        } else if (name == "Supply_V") {
+          role = ROLE_SUPPLY;
+          layout.hasSupply = true;
+        } else if (name == "Kind") {
+          role = ROLE_KIND;
+          layout.hasKind = true;
+        }
+        layout.roles.push_back(role);
+        field = comma + 1;
+      }
+      return eol < end ? eol + 1 : end;
+    }
+    p = eol + 1;
+  }
+  return nullptr;
+}
+
+static const float INVERSE_POW10[] = {1e0f, 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f, 1e-8f, 1e-9f};
+
+// [-]digits[.digits] into value, returns the byte after it or nullptr. Digits past the ninth
+// decimal are read but dropped, logs print four.
+static inline const char *parseDecimal(const char *p, const char *end, float &value) {
+  bool negative = p < end && *p == '-';
+  p += negative;
+  const char *digits = p;
+  uint64_t mantissa = 0;
+  while (p < end && (unsigned)(*p - '0') < 10) mantissa = mantissa * 10 + (*p++ - '0');
+  int decimals = 0;
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+      if (decimals < 9) {
+        mantissa = mantissa * 10 + (*p - '0');
+        decimals++;
+      }
+      p++;
+    }
+  }
+  if (p == digits) return nullptr;
+  value = (negative ? -(float)mantissa : (float)mantissa) * INVERSE_POW10[decimals];
+  return p;
+}
+
+static inline const char *parseUnsigned(const char *p, const char *end, uint32_t &value) {
+  const char *digits = p;
+  uint32_t parsed = 0;
+  while (p < end && (unsigned)(*p - '0') < 10) parsed = parsed * 10 + (*p++ - '0');
+  if (p == digits) return nullptr;
+  value = parsed;
+  return p;
+}
+
+// One data row into the columns, false if it isn't one (log text, a cut line, min/max rows)
+static inline bool parseRow(const char *p, const char *end, const CsvLayout &layout, LogColumns &columns) {
+  uint32_t timestamp = 0;
+  float current[LOG_CHANNELS] = {};
+  float supply = 0;
+  uint32_t value;
+  uint8_t mask = 0;
+  size_t fields = layout.roles.size();
+  for (size_t f = 0; f < fields; f++) {
+    uint8_t role = layout.roles[f];
+    if (role == ROLE_TIMESTAMP) {
+      p = parseUnsigned(p, end, timestamp);
+    } else if (role >= ROLE_CURRENT && role < ROLE_STATE) {
+      p = parseDecimal(p, end, current[role - ROLE_CURRENT]);
+    } else if (role >= ROLE_STATE && role < ROLE_SUPPLY) {
+      p = parseUnsigned(p, end, value);
+      mask |= (value != 0) << (role - ROLE_STATE);
+    } else if (role == ROLE_SUPPLY) {
+      p = parseDecimal(p, end, supply);
+    } else if (role == ROLE_KIND) {
+      // Adaptive logs - keep samples and run means, drop the min/max rows
+      p = parseUnsigned(p, end, value);
+      if (p && value > 1) return false;
+    } else {
+      while (p < end && *p != ',') p++;
+    }
+    if (!p) return false;
+    if (f + 1 < fields) {
+      if (p >= end || *p != ',') return false;
+      p++;
+    }
+  }
+  if (p < end && *p != '\r') return false;
+
+  columns.timestamp.push_back(timestamp);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) columns.current[ch].push_back(current[ch]);
+  columns.mask.push_back(mask);
+  if (layout.hasSupply) columns.supply.push_back(supply);
+  return true;
+}
+
+static void parseChunk(const char *p, const char *end, const CsvLayout &layout, LogColumns &columns) {
+  // About 60 bytes a row in amps, a little over is fine
+  size_t estimate = (end - p) / 48;
+  columns.timestamp.reserve(estimate);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) columns.current[ch].reserve(estimate);
+  columns.mask.reserve(estimate);
+  if (layout.hasSupply) columns.supply.reserve(estimate);
+  while (p < end) {
+    const char *eol = lineEnd(p, end);
+    if (eol > p && !parseRow(p, eol, layout, columns)) columns.skipped++;
+    p = eol + 1;
+  }
+}
+
+template <class T>
+static void appendAt(std::vector<T> &to, size_t offset, const std::vector<T> &from) {
+  if (!from.empty()) memcpy(to.data() + offset, from.data(), from.size() * sizeof(T));
+}
+
+// Parse a CSV body in parallel chunks cut at line breaks, then join the chunks' columns in order
+static bool parseCsv(const char *data, size_t size, int threads, LogColumns &columns, bool &hasSupply) {
+  CsvLayout layout;
+  const char *end = data + size;
+  const char *body = parseHeader(data, end, layout);
+  if (!body) return false;
+  hasSupply = layout.hasSupply;
+
+  size_t chunkCount = threads > 1 ? threads * CHUNKS_PER_THREAD : 1;
+  std::vector<const char *> cuts(chunkCount + 1, end);
+  cuts[0] = body;
+  for (size_t c = 1; c < chunkCount; c++) {
+    const char *cut = body + (end - body) * c / chunkCount;
+    cut = std::max(cut, cuts[c - 1]);
+    cuts[c] = cut < end ? std::min(end, lineEnd(cut, end) + 1) : end;
+  }
+  std::vector<LogColumns> chunks(chunkCount);
+  parallelFor(threads, chunkCount, [&](size_t c) { parseChunk(cuts[c], cuts[c + 1], layout, chunks[c]); });
+
+  std::vector<size_t> offsets(chunkCount + 1, 0);
+  for (size_t c = 0; c < chunkCount; c++) {
+    offsets[c + 1] = offsets[c] + chunks[c].timestamp.size();
+    columns.skipped += chunks[c].skipped;
+  }
+  size_t rows = offsets[chunkCount];
+  columns.timestamp.resize(rows);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) columns.current[ch].resize(rows);
+  columns.mask.resize(rows);
+  if (layout.hasSupply) columns.supply.resize(rows);
+  parallelFor(threads, chunkCount, [&](size_t c) {
+    const LogColumns &chunk = chunks[c];
+    appendAt(columns.timestamp, offsets[c], chunk.timestamp);
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) appendAt(columns.current[ch], offsets[c], chunk.current[ch]);
+    appendAt(columns.mask, offsets[c], chunk.mask);
+    appendAt(columns.supply, offsets[c], chunk.supply);
+  });
+  return true;
+}
+
+// Shots of one channel: runs of drive-on samples with off periods shorter than gapUs merged
+static void findShots(const LogColumns &columns, int file, int channel, uint32_t gapUs, std::vector<ShotSpan> &shots) {
+  const uint8_t bit = 1 << channel;
+  size_t rows = columns.mask.size();
+  size_t first = 0;
+  size_t last = 0;
+  bool open = false;
+  size_t begin = shots.size();
+  for (size_t i = 0; i < rows; i++) {
+    if (!(columns.mask[i] & bit)) continue;
+    if (open && columns.timestamp[i] - columns.timestamp[last] > gapUs) {
+      shots.push_back({file, channel, first, last, 0});
+      open = false;
+    }
+    if (!open) {
+      first = i;
+      open = true;
+    }
+    last = i;
+  }
+  if (open) shots.push_back({file, channel, first, last, 0});
+
+  // Each shot's decay can run up to the next one
+  for (size_t s = begin; s < shots.size(); s++) {
+    shots[s].limit = s + 1 < shots.size() ? shots[s + 1].first : rows;
+  }
+}
+
+static uint32_t toMilliamps(float amps) {
+  return amps > 0 ? (uint32_t)(amps * 1000 + 0.5f) : 0;
+}
+
+static void analyzeShot(const LogFile &file, const ShotSpan &span, ShotResult &result) {
+  const LogColumns &columns = file.columns;
+  const std::vector<float> &current = columns.current[span.channel];
+  const uint8_t bit = 1 << span.channel;
+  bool hasSupply = !columns.supply.empty();
+
+  result = ShotResult();
+  result.startUs = columns.timestamp[span.first];
+  result.pulseUs = columns.timestamp[span.last] - result.startUs;
+  result.samples = span.last - span.first + 1;
+
+  // Drive-on samples are integrated over the interval to the next sample
+  double sumAmps = 0;
+  double charge = 0;
+  double energy = 0;
+  double supplySum = 0;
+  uint32_t driveSamples = 0;
+  for (size_t i = span.first; i <= span.last; i++) {
+    sumAmps += current[i];
+    if (!(columns.mask[i] & bit)) continue;
+    size_t next = i + 1 < columns.timestamp.size() ? i + 1 : i;
+    size_t previous = next == i && i > 0 ? i - 1 : i;
+    uint32_t dtUs = next != i ? columns.timestamp[next] - columns.timestamp[i]
+                              : columns.timestamp[i] - columns.timestamp[previous];
+    float volts = hasSupply ? columns.supply[i] : file.nominalSupply;
+    charge += current[i] * dtUs;
+    energy += current[i] * volts * dtUs;
+    supplySum += volts;
+    driveSamples++;
+  }
+  result.avgAmps = sumAmps / result.samples;
+  result.chargeUc = charge;              // A x us = uC
+  result.energyMj = energy * 1e-3;       // W x us = uJ
+  result.supplyVolts = driveSamples ? supplySum / driveSamples : 0;
+
+  FeatureTracker tracker;
+  featureTrackerReset(tracker);
+  ShotFeatures done;
+  for (size_t i = span.first; i < span.limit; i++) {
+    bool gate = i <= span.last;
+    bool drive = columns.mask[i] & bit;
+    if (featureTrackerAdd(tracker, columns.timestamp[i], toMilliamps(current[i]), drive, gate, done) && !gate) {
+      result.features = done;
+      return;
+    }
+  }
+  if (featureTrackerFlush(tracker, done)) result.features = done;
+}
+
+// Student's t distribution through the regularized incomplete beta function (Lentz's continued fraction)
+static double betaContinuedFraction(double a, double b, double x) {
+  const double tiny = 1e-300;
+  double c = 1;
+  double d = 1 - (a + b) * x / (a + 1);
+  if (fabs(d) < tiny) d = tiny;
+  d = 1 / d;
+  double h = d;
+  for (int m = 1; m <= 300; m++) {
+    double m2 = 2 * m;
+    double aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2));
+    d = 1 + aa * d;
+    if (fabs(d) < tiny) d = tiny;
+    c = 1 + aa / c;
+    if (fabs(c) < tiny) c = tiny;
+    d = 1 / d;
+    h *= d * c;
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1));
+    d = 1 + aa * d;
+    if (fabs(d) < tiny) d = tiny;
+    c = 1 + aa / c;
+    if (fabs(c) < tiny) c = tiny;
+    d = 1 / d;
+    double delta = d * c;
+    h *= delta;
+    if (fabs(delta - 1) < 1e-12) break;
+  }
+  return h;
+}
+
+static double incompleteBeta(double a, double b, double x) {
+  if (x <= 0) return 0;
+  if (x >= 1) return 1;
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+  if (x < (a + 1) / (a + b + 2)) return front * betaContinuedFraction(a, b, x) / a;
+  return 1 - front * betaContinuedFraction(b, a, 1 - x) / b;
+}
+
+// P(T <= t) for df degrees of freedom
+static double studentCdf(double t, double df) {
+  double tail = 0.5 * incompleteBeta(df / 2, 0.5, df / (df + t * t));
+  return t > 0 ? 1 - tail : tail;
+}
+
+// t with P(T <= t) = p, by bisection
+static double studentQuantile(double p, double df) {
+  double low = -1e3;
+  double high = 1e3;
+  for (int i = 0; i < 100; i++) {
+    double mid = (low + high) / 2;
+    if (studentCdf(mid, df) < p) low = mid;
+    else high = mid;
+  }
+  return (low + high) / 2;
+}
+
+struct Sample {
+  size_t count = 0;
+  double mean = 0;
+  double m2 = 0;
+
+  void add(double value) {
+    count++;
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+  }
+  double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+};
+
+struct Comparison {
+  double difference;    // Mode minus reference
+  double ciLow;         // 90% interval of the difference, the TOST one
+  double ciHigh;
+  double tostP;         // Larger of the two one-sided p values
+  bool equivalent;
+};
+
+// Welch's t and the two one-sided tests against +/- margin
+static bool compareSamples(const Sample &reference, const Sample &mode, double margin, Comparison &result) {
+  if (reference.count < 2 || mode.count < 2) return false;
+  double vr = reference.variance() / reference.count;
+  double vm = mode.variance() / mode.count;
+  double se = sqrt(vr + vm);
+  result.difference = mode.mean - reference.mean;
+  if (se == 0) {
+    result.ciLow = result.ciHigh = result.difference;
+    result.tostP = fabs(result.difference) < margin ? 0 : 1;
+  } else {
+    double df = (vr + vm) * (vr + vm) /
+                (vr * vr / (reference.count - 1) + vm * vm / (mode.count - 1));
+    double t = studentQuantile(1 - TOST_ALPHA, df);
+    result.ciLow = result.difference - t * se;
+    result.ciHigh = result.difference + t * se;
+    double pLower = 1 - studentCdf((result.difference + margin) / se, df);
+    double pUpper = studentCdf((result.difference - margin) / se, df);
+    result.tostP = std::max(pLower, pUpper);
+  }
+  result.equivalent = result.tostP < TOST_ALPHA;
+  return true;
+}
+
+enum ModeFeature {
+  MODE_PEAK,
+  MODE_HOLD,
+  MODE_ENERGY,
+  MODE_OPENING,
+  MODE_FEATURE_COUNT,
+};
+
+static const char *const MODE_FEATURE_NAMES[MODE_FEATURE_COUNT] = {"PeakA", "HoldMeanA", "EnergyMj", "OpeningDelayUs"};
+
+// Shot value of a feature, false when the shot doesn't have it
+static bool modeFeatureValue(const ShotResult &shot, int feature, double &value) {
+  switch (feature) {
+    case MODE_PEAK:
+      value = shot.features.peakMa * 0.001;
+      return true;
+    case MODE_HOLD:
+      value = shot.features.holdMeanMa * 0.001;
+      return shot.features.holdSamples > 0;
+    case MODE_ENERGY:
+      value = shot.energyMj;
+      return true;
+    case MODE_OPENING:
+      value = shot.features.openingDelayUs;
+      return shot.features.opened;
+  }
+  return false;
+}
+
+// Every mode against the first that has the feature, per injector and feature. Rows go to the CSV when one is open,
+// and a line per comparison to stderr.
+static void compareModes(const Options &options, const std::vector<LogFile> &files, const std::vector<ShotSpan> &spans,
+                         const std::vector<ShotResult> &results, FILE *out) {
+  size_t modeCount = options.modes.size();
+  std::vector<Sample> samples(modeCount * LOG_CHANNELS * MODE_FEATURE_COUNT);
+  auto sampleOf = [&](size_t mode, int channel, int feature) -> Sample & {
+    return samples[(mode * LOG_CHANNELS + channel) * MODE_FEATURE_COUNT + feature];
+  };
+  for (size_t s = 0; s < spans.size(); s++) {
+    int mode = files[spans[s].file].mode;
+    for (int feature = 0; feature < MODE_FEATURE_COUNT; feature++) {
+      double value;
+      if (modeFeatureValue(results[s], feature, value)) sampleOf(mode, spans[s].channel, feature).add(value);
+    }
+  }
+
+  if (out) {
+    fprintf(out, "Feature,Injector,Mode,Shots,Mean,Sd,Reference,ReferenceMean,Difference,DifferencePct,"
+                 "CiLow,CiHigh,MarginPct,TostP,Equivalent\n");
+  }
+  for (int feature = 0; feature < MODE_FEATURE_COUNT; feature++) {
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      // Hold current only exists in peak & hold modes, so the reference is the first mode with the feature
+      size_t referenceMode = 0;
+      while (referenceMode + 1 < modeCount && sampleOf(referenceMode, ch, feature).count < 2) referenceMode++;
+      const Sample &reference = sampleOf(referenceMode, ch, feature);
+      const std::string &referenceName = options.modes[referenceMode];
+      for (size_t mode = 0; mode < modeCount; mode++) {
+        const Sample &sample = sampleOf(mode, ch, feature);
+        if (sample.count == 0) continue;
+        Comparison comparison;
+        double margin = fabs(reference.mean) * options.marginPct / 100;
+        bool compared = mode > referenceMode && compareSamples(reference, sample, margin, comparison);
+        if (out) {
+          fprintf(out, "%s,%d,%s,%zu,%.6g,%.6g", MODE_FEATURE_NAMES[feature], ch + 1, options.modes[mode].c_str(),
+                  sample.count, sample.mean, sqrt(sample.variance()));
+          if (compared) {
+            fprintf(out, ",%s,%.6g,%.6g,%.3f,%.6g,%.6g,%.2f,%.4g,%d\n", referenceName.c_str(), reference.mean,
+                    comparison.difference, reference.mean != 0 ? 100 * comparison.difference / reference.mean : 0,
+                    comparison.ciLow, comparison.ciHigh, options.marginPct, comparison.tostP, comparison.equivalent);
+          } else {
+            fprintf(out, ",,,,,,,,,\n");
+          }
+        }
+        if (compared) {
+          fprintf(stderr, "%-14s inj %d  %s vs %s: %+.4g (%+.2f%%), 90%% CI %.4g to %.4g, TOST p %.3g - %s\n",
+                  MODE_FEATURE_NAMES[feature], ch + 1, options.modes[mode].c_str(), referenceName.c_str(),
+                  comparison.difference, reference.mean != 0 ? 100 * comparison.difference / reference.mean : 0,
+                  comparison.ciLow, comparison.ciHigh, comparison.tostP,
+                  comparison.equivalent ? "equivalent" : "not shown equivalent");
+        }
+      }
+    }
+  }
+}
+
+static void writeShotRow(FILE *out, const LogFile &file, const std::string &mode, const ShotSpan &span, int shot,
+                         const ShotResult &result) {
+  const ShotFeatures &f = result.features;
+  fprintf(out, "%s,%s,%d,%d,%u,%u,%u,%.4f,%.4f,%u,", file.path.c_str(), mode.c_str(), span.channel + 1, shot,
+          result.startUs, result.pulseUs, result.samples, f.peakMa * 0.001f, result.avgAmps, f.timeToPeakUs);
+  if (f.opened) fprintf(out, "%u", f.openingDelayUs);
+  fputc(',', out);
+  if (f.holdSamples > 0) fprintf(out, "%.4f", f.holdMeanMa * 0.001f);
+  fputc(',', out);
+  if (f.closed) fprintf(out, "%u", f.closingDecayUs);
+  fprintf(out, ",%.2f,%.3f,%.3f\n", result.supplyVolts, result.chargeUc, result.energyMj);
+}
+
+// Timings of one pass over the files, for the benchmark
+struct PassTimes {
+  size_t bytes = 0;
+  size_t rows = 0;
+  size_t shots = 0;
+  double parseSeconds = 0;
+  double totalSeconds = 0;
+};
+
+// Map and parse every file, find and analyze the shots. Files are parsed one at a time,
+// each across every thread, so memory holds one file's text at once.
+static bool analyzeFiles(const Options &options, int threads, std::vector<LogFile> &files,
+                         std::vector<ShotSpan> &spans, std::vector<ShotResult> &results, PassTimes &times) {
+  auto start = std::chrono::steady_clock::now();
+  files.assign(options.inputs.size(), LogFile());
+  for (size_t i = 0; i < files.size(); i++) {
+    LogFile &file = files[i];
+    file.path = options.inputs[i];
+    file.mode = options.inputModes[i];
+    file.nominalSupply = options.inputSupply[i];
+
+    auto parseStart = std::chrono::steady_clock::now();
+    MappedFile mapped;
+    if (!mapped.open(file.path)) return false;
+    bool hasSupply;
+    if (!parseCsv(mapped.data, mapped.size, threads, file.columns, hasSupply)) {
+      fprintf(stderr, "%s has no Timestamp_us column header\n", file.path.c_str());
+      return false;
+    }
+    file.bytes = mapped.size;
+    file.parseSeconds = secondsSince(parseStart);
+    times.bytes += file.bytes;
+    times.rows += file.columns.timestamp.size();
+    times.parseSeconds += file.parseSeconds;
+  }
+
+  spans.clear();
+  std::vector<std::vector<ShotSpan>> found(files.size() * LOG_CHANNELS);
+  parallelFor(threads, found.size(), [&](size_t i) {
+    findShots(files[i / LOG_CHANNELS].columns, i / LOG_CHANNELS, i % LOG_CHANNELS, options.gapUs, found[i]);
+  });
+  for (const std::vector<ShotSpan> &shots : found) spans.insert(spans.end(), shots.begin(), shots.end());
+
+  // Shots of a file in time order, injectors interleaved as they fired
+  std::stable_sort(spans.begin(), spans.end(), [](const ShotSpan &a, const ShotSpan &b) {
+    return a.file != b.file ? a.file < b.file : a.first < b.first;
+  });
+  results.assign(spans.size(), ShotResult());
+  parallelFor(threads, spans.size(), [&](size_t s) { analyzeShot(files[spans[s].file], spans[s], results[s]); });
+  times.shots = spans.size();
+  times.totalSeconds = secondsSince(start);
+  return true;
+}
+
+// Synthetic 100kHz log of peak & hold shots round the four injectors, about mb megabytes
+static std::string syntheticLog(uint32_t mb) {
+  std::string text = "Timestamp_us,Current1_A,Current2_A,Current3_A,Current4_A,"
+                     "Inj1_State,Inj2_State,Inj3_State,Inj4_State,Supply_V\n";
+  text.reserve((size_t)mb << 20);
+  char row[128];
+  uint32_t seed = 1;
+  for (uint32_t t = 0; text.size() < ((size_t)mb << 20); t += 10) {
+    // 5ms slots, a 3ms shot at the start of each: 1ms peak, then 2kHz 50% hold
+    uint32_t slot = t / 5000;
+    uint32_t inShot = t % 5000;
+    int channel = slot % LOG_CHANNELS;
+    bool drive = inShot < 1000 || (inShot < 3000 && inShot % 500 < 250);
+    float amps[LOG_CHANNELS] = {};
+    if (inShot < 3200) {
+      float rise = 4.0f * (1 - expf(-(float)inShot / 400));
+      amps[channel] = inShot < 1000 ? rise : (inShot < 3000 ? 1.0f + (drive ? 0.1f : -0.1f) : 1.0f - (inShot - 3000) / 200.0f);
+    }
+    for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      amps[ch] += ((int)(seed & 0xFF) - 128) * 0.0001f;
+    }
+    int length = snprintf(row, sizeof(row), "%u,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%d,12.00\n", t, amps[0], amps[1],
+                          amps[2], amps[3], drive && channel == 0, drive && channel == 1, drive && channel == 2,
+                          drive && channel == 3);
+    text.append(row, length);
+  }
+  return text;
+}
+
+// Parse and full-pass throughput for 1, 2, 4... threads up to --threads
+static int runBenchmark(Options &options) {
+  std::vector<int> threadCounts;
+  for (int t = 1; t < options.threads; t *= 2) threadCounts.push_back(t);
+  threadCounts.push_back(options.threads);
+
+  if (options.inputs.empty()) {
+    std::string text = syntheticLog(options.benchMb);
+    printf("Synthetic log: %.1f MB in memory\n", text.size() / 1048576.0);
+    for (int threads : threadCounts) {
+      double best = 1e30;
+      size_t rows = 0;
+      for (int pass = 0; pass < 3; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        LogColumns columns;
+        bool hasSupply;
+        parseCsv(text.data(), text.size(), threads, columns, hasSupply);
+        best = std::min(best, secondsSince(start));
+        rows = columns.timestamp.size();
+      }
+      printf("%2d threads: parse %.2f GB/s, %.1f M rows/s\n", threads, text.size() / best / 1e9, rows / best / 1e6);
+    }
+    return 0;
+  }
+
+  // Files are read once first so every pass runs from the page cache
+  std::vector<LogFile> files;
+  std::vector<ShotSpan> spans;
+  std::vector<ShotResult> results;
+  PassTimes warm;
+  if (!analyzeFiles(options, options.threads, files, spans, results, warm)) return 1;
+  printf("%zu files: %.1f MB, %zu rows, %zu shots\n", files.size(), warm.bytes / 1048576.0, warm.rows, warm.shots);
+  for (int threads : threadCounts) {
+    PassTimes best;
+    best.totalSeconds = 1e30;
+    for (int pass = 0; pass < 3; pass++) {
+      PassTimes times;
+      analyzeFiles(options, threads, files, spans, results, times);
+      if (times.totalSeconds < best.totalSeconds) best = times;
+    }
+    printf("%2d threads: parse %.2f GB/s, end to end %.2f GB/s (%.0f shots/s)\n", threads,
+           best.bytes / best.parseSeconds / 1e9, best.bytes / best.totalSeconds / 1e9, best.shots / best.totalSeconds);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseArgs(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+  if (options.bench) return runBenchmark(options);
+
+  std::vector<LogFile> files;
+  std::vector<ShotSpan> spans;
+  std::vector<ShotResult> results;
+  PassTimes times;
+  if (!analyzeFiles(options, options.threads, files, spans, results, times)) return 1;
+
+  FILE *out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+  if (!out) {
+    fprintf(stderr, "Cannot create %s: %s\n", options.output.c_str(), strerror(errno));
+    return 1;
+  }
+  fprintf(out, "File,Mode,Injector,Shot,Start_us,Pulse_us,Samples,Peak_A,Avg_A,TimeToPeak_us,OpeningDelay_us,"
+               "HoldMean_A,ClosingDecay_us,Supply_V,Charge_uC,Energy_mJ\n");
+  std::vector<int> shotNumbers(files.size() * LOG_CHANNELS, 0);
+  for (size_t s = 0; s < spans.size(); s++) {
+    const ShotSpan &span = spans[s];
+    int shot = ++shotNumbers[span.file * LOG_CHANNELS + span.channel];
+    writeShotRow(out, files[span.file], options.modes[files[span.file].mode], span, shot, results[s]);
+  }
+  if (out != stdout) fclose(out);
+
+  for (const LogFile &file : files) {
+    const LogColumns &columns = file.columns;
+    size_t rows = columns.timestamp.size();
+    fprintf(stderr, "%s: %zu rows, %llu other lines, span %.3f s, %.1f MB parsed in %.1f ms (%.2f GB/s)%s\n",
+            file.path.c_str(), rows, (unsigned long long)columns.skipped,
+            rows ? (columns.timestamp[rows - 1] - columns.timestamp[0]) / 1e6 : 0.0, file.bytes / 1048576.0,
+            file.parseSeconds * 1e3, file.bytes / file.parseSeconds / 1e9,
+            columns.supply.empty() ? ", no Supply_V column - energy at --supply" : "");
+  }
+  fprintf(stderr, "%zu shots from %.1f MB in %.1f ms on %d threads\n", spans.size(), times.bytes / 1048576.0,
+          times.totalSeconds * 1e3, options.threads);
+
+  if (options.modes.size() > 1 || !options.modesPath.empty()) {
+    FILE *modes = nullptr;
+    if (!options.modesPath.empty()) {
+      modes = fopen(options.modesPath.c_str(), "w");
+      if (!modes) {
+        fprintf(stderr, "Cannot create %s: %s\n", options.modesPath.c_str(), strerror(errno));
+        return 1;
+      }
+    }
+    compareModes(options, files, spans, results, modes);
+    if (modes) fclose(modes);
+  }
+  return 0;
+}
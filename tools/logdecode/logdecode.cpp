@@ -0,0 +1,390 @@
+// Host-side decoder for binary current logs (CURRENT_LOG_*.BIN)
+//
+// Converts the firmware's block format to CSV (same columns as the old on-device
+// CSV logs, plus the supply voltage from version 4) or to a columnar directory
+// with one little-endian array per column. Capture logs (version 5) hold only the
+// windows around shots; --windows lists each window and the row it starts at.
+// Adaptive logs (version 6) get a Kind column: 0 sample, 1 mean, 2 min, 3 max of a
+// run of header decimation samples starting at the row's timestamp. Packed logs
+// (version 7) are expanded with the firmware's own codec in log_codec.h.
+//
+// Build: g++ -std=c++17 -O2 -I../../firmware/src -o logdecode logdecode.cpp
+//
+// Usage: logdecode <log.BIN> [-o out.csv] [--raw] [--columns <dir>] [--windows <windows.csv>]
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "log_format.h"
+#include "log_codec.h"
+
+struct Options {
+  std::string input;
+  std::string output;      // CSV path, stdout when empty
+  std::string columnsDir;  // Columnar output instead of CSV
+  std::string windowsPath; // Capture window index, version 5+
+  bool rawCodes = false;   // CSV with ADC codes instead of amps
+};
+
+struct DecodeStats {
+  uint64_t records = 0;
+  uint64_t blocks = 0;
+  uint64_t droppedBlocks = 0;
+  uint64_t badBlocks = 0;
+  uint64_t windows = 0;
+  uint64_t packedChunks = 0;
+  uint64_t sourceBlocks = 0;   // Blocks as the firmware queued them
+  uint32_t firstTimestamp = 0;
+  uint32_t lastTimestamp = 0;
+};
+
+// Columnar sink - one open file per column
+struct ColumnWriter {
+  FILE *timestamp = nullptr;
+  FILE *current[LOG_CHANNELS] = {};
+  FILE *code[LOG_CHANNELS] = {};
+  FILE *mask = nullptr;
+  FILE *supply = nullptr;  // Version 4+
+  FILE *kind = nullptr;    // Adaptive logs
+};
+
+static void usage() {
+  fprintf(stderr, "Usage: logdecode <log.BIN> [-o out.csv] [--raw] [--columns <dir>] [--windows <windows.csv>]\n");
+}
+
+static bool parseArgs(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      options.output = argv[++i];
+    } else if (arg == "--columns" && i + 1 < argc) {
+      options.columnsDir = argv[++i];
+    } else if (arg == "--windows" && i + 1 < argc) {
+      options.windowsPath = argv[++i];
+    } else if (arg == "--raw") {
+      options.rawCodes = true;
+    } else if (arg[0] == '-') {
+      return false;
+    } else {
+      options.input = arg;
+    }
+  }
+  return !options.input.empty();
+}
+
+static FILE *openColumn(const std::string &dir, const char *name) {
+  std::string path = dir + "/" + name;
+  FILE *f = fopen(path.c_str(), "wb");
+  if (!f) fprintf(stderr, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+  return f;
+}
+
+static bool isAdaptive(const LogFileHeader &header) {
+  return header.version >= 6 && header.decimation > 0;
+}
+
+static bool openColumns(const std::string &dir, const LogFileHeader &header, ColumnWriter &columns) {
+  mkdir(dir.c_str(), 0755);
+  columns.timestamp = openColumn(dir, "timestamp_us.u32");
+  if (!columns.timestamp) return false;
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    char name[32];
+    snprintf(name, sizeof(name), "current%d_a.f32", ch + 1);
+    columns.current[ch] = openColumn(dir, name);
+    snprintf(name, sizeof(name), "adc%d.u16", ch + 1);
+    columns.code[ch] = openColumn(dir, name);
+    if (!columns.current[ch] || !columns.code[ch]) return false;
+  }
+  columns.mask = openColumn(dir, "injector_mask.u8");
+  if (!columns.mask) return false;
+  if (header.version >= 4) {
+    columns.supply = openColumn(dir, "supply_v.f32");
+    if (!columns.supply) return false;
+  }
+  if (isAdaptive(header)) {
+    columns.kind = openColumn(dir, "record_kind.u8");
+    if (!columns.kind) return false;
+  }
+  return true;
+}
+
+static void closeColumns(ColumnWriter &columns) {
+  if (columns.timestamp) fclose(columns.timestamp);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    if (columns.current[ch]) fclose(columns.current[ch]);
+    if (columns.code[ch]) fclose(columns.code[ch]);
+  }
+  if (columns.mask) fclose(columns.mask);
+  if (columns.supply) fclose(columns.supply);
+  if (columns.kind) fclose(columns.kind);
+}
+
+// Schema sidecar so any reader can map the column files without this tool
+static void writeSchema(const std::string &dir, const LogFileHeader &header, const DecodeStats &stats) {
+  std::string path = dir + "/schema.json";
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) return;
+  fprintf(f, "{\n  \"rows\": %llu,\n", (unsigned long long)stats.records);
+  if (stats.windows > 0) fprintf(f, "  \"windows\": %llu,\n", (unsigned long long)stats.windows);
+  fprintf(f, "  \"sampleIntervalNs\": %u,\n  \"adcBits\": %u,\n", header.sampleIntervalNs, header.adcBits);
+  fprintf(f, "  \"adcReferenceVolts\": %g,\n  \"sensorZeroVolts\": %g,\n  \"sensorVoltsPerAmp\": %g,\n",
+          header.adcReferenceVolts, header.sensorZeroVolts, header.sensorVoltsPerAmp);
+  fprintf(f, "  \"offsetVolts\": [%g, %g, %g, %g],\n", header.offsetVolts[0], header.offsetVolts[1],
+          header.offsetVolts[2], header.offsetVolts[3]);
+  fprintf(f, "  \"pulseWidthUs\": %u,\n  \"peakTimeUs\": %u,\n  \"holdTimeUs\": %u,\n", header.pulseWidthUs,
+          header.peakTimeUs, header.holdTimeUs);
+  fprintf(f, "  \"holdPeriodUs\": %u,\n  \"holdOnUs\": %u,\n", header.holdPeriodUs, header.holdOnUs);
+  if (header.version >= 3) {
+    fprintf(f, "  \"peakHoldProfile\": \"%.*s\",\n", LOG_PROFILE_TEXT, header.peakHoldProfile);
+  }
+  if (header.version >= 4) fprintf(f, "  \"supplyDividerRatio\": %g,\n", header.supplyDividerRatio);
+  if (isAdaptive(header)) {
+    fprintf(f, "  \"decimation\": %u,\n  \"fullRateHoldUs\": %u,\n", header.decimation, header.fullRateHoldUs);
+  }
+  fprintf(f, "  \"columns\": [\n");
+  fprintf(f, "    {\"name\": \"timestamp_us\", \"file\": \"timestamp_us.u32\", \"type\": \"uint32\"},\n");
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    fprintf(f, "    {\"name\": \"current%d_a\", \"file\": \"current%d_a.f32\", \"type\": \"float32\"},\n", ch + 1, ch + 1);
+    fprintf(f, "    {\"name\": \"adc%d\", \"file\": \"adc%d.u16\", \"type\": \"uint16\"},\n", ch + 1, ch + 1);
+  }
+  fprintf(f, "    {\"name\": \"injector_mask\", \"file\": \"injector_mask.u8\", \"type\": \"uint8\"}%s\n",
+          header.version >= 4 ? "," : "");
+  if (header.version >= 4) {
+    fprintf(f, "    {\"name\": \"supply_v\", \"file\": \"supply_v.f32\", \"type\": \"float32\"}%s\n",
+            isAdaptive(header) ? "," : "");
+  }
+  if (isAdaptive(header)) {
+    fprintf(f, "    {\"name\": \"record_kind\", \"file\": \"record_kind.u8\", \"type\": \"uint8\"}\n");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+}
+
+static void writeCsvRow(FILE *out, const LogFileHeader &header, const LogSampleRecord &record, bool rawCodes) {
+  fprintf(out, "%u", record.timestamp);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    if (rawCodes) {
+      fprintf(out, ",%u", record.adc[ch]);
+    } else {
+      fprintf(out, ",%.4f", logCodeToCurrent(header, ch, record.adc[ch]));
+    }
+  }
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    fprintf(out, ",%d", (record.injectorMask >> ch) & 1);
+  }
+  if (header.version >= 4) {
+    if (rawCodes) {
+      fprintf(out, ",%u", record.aux);
+    } else {
+      fprintf(out, ",%.2f", logCodeToSupplyVolts(header, record.aux));
+    }
+  }
+  if (isAdaptive(header)) fprintf(out, ",%u", record.flags & LOG_FLAG_KIND);
+  fputc('\n', out);
+}
+
+static void writeColumnRow(ColumnWriter &columns, const LogFileHeader &header, const LogSampleRecord &record) {
+  uint32_t timestamp = record.timestamp;
+  fwrite(&timestamp, sizeof(timestamp), 1, columns.timestamp);
+  for (int ch = 0; ch < LOG_CHANNELS; ch++) {
+    float amps = logCodeToCurrent(header, ch, record.adc[ch]);
+    uint16_t code = record.adc[ch];
+    fwrite(&amps, sizeof(amps), 1, columns.current[ch]);
+    fwrite(&code, sizeof(code), 1, columns.code[ch]);
+  }
+  fwrite(&record.injectorMask, 1, 1, columns.mask);
+  if (columns.supply) {
+    float volts = logCodeToSupplyVolts(header, record.aux);
+    fwrite(&volts, sizeof(volts), 1, columns.supply);
+  }
+  if (columns.kind) {
+    uint8_t kind = record.flags & LOG_FLAG_KIND;
+    fwrite(&kind, 1, 1, columns.kind);
+  }
+}
+
+// One index row per capture window, firstRow counts decoded rows before it
+static void writeWindowRow(FILE *out, const LogWindowInfo &window, uint64_t firstRow) {
+  fprintf(out, "%u,%u,%u,%u,%u,%u,%u,%llu,%u,%u\n", window.window, window.triggerTimestamp, window.triggerMask,
+          window.shots, window.shotSequence, window.preTriggerRecords, window.recordCount,
+          (unsigned long long)firstRow, window.truncated, window.droppedRecords);
+}
+
+// Output sinks and running state shared by plain blocks and packed chunks
+struct Decoder {
+  LogFileHeader header;
+  const Options *options = nullptr;
+  ColumnWriter *columns = nullptr;  // Columnar output, CSV when null
+  FILE *csv = nullptr;
+  FILE *windows = nullptr;
+  DecodeStats stats;
+  bool haveSequence = false;
+  uint32_t expectedSequence = 0;
+  LogSampleRecord records[LOG_SAMPLE_BLOCK_RECORDS];
+};
+
+static void decodeRecord(Decoder &decoder, const LogSampleRecord &record) {
+  DecodeStats &stats = decoder.stats;
+  if (stats.records == 0) stats.firstTimestamp = record.timestamp;
+  stats.lastTimestamp = record.timestamp;
+  stats.records++;
+
+  if (decoder.columns) {
+    writeColumnRow(*decoder.columns, decoder.header, record);
+  } else {
+    writeCsvRow(decoder.csv, decoder.header, record, decoder.options->rawCodes);
+  }
+}
+
+// One block as the firmware queued it, either straight from the file or unpacked from a chunk
+static void decodeBlock(Decoder &decoder, uint16_t type, uint16_t recordCount, uint32_t sequence,
+                        const uint8_t *payload, uint32_t bytes, bool compressed) {
+  DecodeStats &stats = decoder.stats;
+  stats.sourceBlocks++;
+  if (decoder.haveSequence && sequence != decoder.expectedSequence) {
+    stats.droppedBlocks += sequence - decoder.expectedSequence;
+  }
+  decoder.haveSequence = true;
+  decoder.expectedSequence = sequence + 1;
+
+  if (type == LOG_BLOCK_WINDOW) {
+    LogWindowInfo window;
+    memcpy(&window, payload, sizeof(window));
+    if (decoder.windows) writeWindowRow(decoder.windows, window, stats.records);
+    stats.windows++;
+    return;
+  }
+  if (type != LOG_BLOCK_SAMPLES || recordCount > LOG_SAMPLE_BLOCK_RECORDS) return;
+
+  if (compressed) {
+    stats.packedChunks++;
+    if (!logDecompressRecords(payload, bytes, decoder.records, recordCount)) {
+      stats.badBlocks++;
+      return;
+    }
+  } else {
+    memcpy(decoder.records, payload, recordCount * sizeof(LogSampleRecord));
+  }
+  for (int i = 0; i < recordCount; i++) {
+    decodeRecord(decoder, decoder.records[i]);
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseArgs(argc, argv, options)) {
+    usage();
+    return 2;
+  }
+
+  FILE *in = fopen(options.input.c_str(), "rb");
+  if (!in) {
+    fprintf(stderr, "Cannot open %s: %s\n", options.input.c_str(), strerror(errno));
+    return 1;
+  }
+
+  LogFileHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != LOG_FILE_MAGIC) {
+    fprintf(stderr, "%s is not a binary current log\n", options.input.c_str());
+    return 1;
+  }
+  if (header.version == 0 || header.version > LOG_FORMAT_VERSION || header.blockSize != LOG_BLOCK_SIZE) {
+    fprintf(stderr, "Unsupported log version %u (block size %u)\n", header.version, header.blockSize);
+    return 1;
+  }
+
+  bool columnar = !options.columnsDir.empty();
+  ColumnWriter columns;
+  FILE *csv = nullptr;
+  if (columnar) {
+    if (!openColumns(options.columnsDir, header, columns)) return 1;
+  } else {
+    csv = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (!csv) {
+      fprintf(stderr, "Cannot create %s: %s\n", options.output.c_str(), strerror(errno));
+      return 1;
+    }
+    fprintf(csv, options.rawCodes
+                     ? "Timestamp_us,Adc1,Adc2,Adc3,Adc4,Inj1_State,Inj2_State,Inj3_State,Inj4_State"
+                     : "Timestamp_us,Current1_A,Current2_A,Current3_A,Current4_A,Inj1_State,Inj2_State,Inj3_State,Inj4_State");
+    if (header.version >= 4) fprintf(csv, options.rawCodes ? ",SupplyAdc" : ",Supply_V");
+    if (isAdaptive(header)) fprintf(csv, ",Kind");
+    fputc('\n', csv);
+  }
+
+  FILE *windows = nullptr;
+  if (!options.windowsPath.empty()) {
+    windows = fopen(options.windowsPath.c_str(), "w");
+    if (!windows) {
+      fprintf(stderr, "Cannot create %s: %s\n", options.windowsPath.c_str(), strerror(errno));
+      return 1;
+    }
+    fprintf(windows, "Window,Trigger_us,Injectors,Shots,ShotSequence,PreTrigger,Records,FirstRow,Truncated,Dropped\n");
+  }
+
+  Decoder decoder;
+  decoder.header = header;
+  decoder.options = &options;
+  decoder.columns = columnar ? &columns : nullptr;
+  decoder.csv = csv;
+  decoder.windows = windows;
+  DecodeStats &stats = decoder.stats;
+  std::vector<uint8_t> buffer(header.blockSize);
+  fseek(in, header.headerSize, SEEK_SET);
+
+  while (fread(buffer.data(), buffer.size(), 1, in) == 1) {
+    LogBlockHeader block;
+    memcpy(&block, buffer.data(), sizeof(block));
+    if (block.magic != LOG_BLOCK_MAGIC) {
+      stats.badBlocks++;
+      continue;
+    }
+    stats.blocks++;
+    const uint8_t *payload = buffer.data() + sizeof(LogBlockHeader);
+    if (block.type != LOG_BLOCK_PACKED) {
+      decodeBlock(decoder, block.type, block.recordCount, block.sequence, payload, block.payloadBytes, false);
+      continue;
+    }
+
+    // Packed block - every chunk is one original block
+    uint32_t payloadBytes = block.payloadBytes;
+    if (payloadBytes > buffer.size() - sizeof(LogBlockHeader)) payloadBytes = buffer.size() - sizeof(LogBlockHeader);
+    uint32_t offset = 0;
+    while (offset + sizeof(LogChunkHeader) <= payloadBytes) {
+      LogChunkHeader chunk;
+      memcpy(&chunk, payload + offset, sizeof(chunk));
+      offset += sizeof(chunk);
+      if (chunk.bytes > payloadBytes - offset) {
+        stats.badBlocks++;
+        break;
+      }
+      decodeBlock(decoder, chunk.type, chunk.recordCount, chunk.sequence, payload + offset, chunk.bytes, true);
+      offset += chunk.bytes;
+    }
+  }
+  fclose(in);
+  if (windows) fclose(windows);
+
+  if (columnar) {
+    closeColumns(columns);
+    writeSchema(options.columnsDir, header, stats);
+  } else if (csv != stdout) {
+    fclose(csv);
+  }
+
+  fprintf(stderr, "%llu records in %llu blocks, %llu dropped, %llu unreadable, span %.3f s\n",
+          (unsigned long long)stats.records, (unsigned long long)stats.blocks,
+          (unsigned long long)stats.droppedBlocks, (unsigned long long)stats.badBlocks,
+          (stats.lastTimestamp - stats.firstTimestamp) / 1e6);
+  if (stats.windows > 0) fprintf(stderr, "%llu capture windows\n", (unsigned long long)stats.windows);
+  if (stats.packedChunks > 0) {
+    fprintf(stderr, "%llu packed sample blocks, %llu blocks packed into %llu (%.2f:1)\n",
+            (unsigned long long)stats.packedChunks, (unsigned long long)stats.sourceBlocks,
+            (unsigned long long)stats.blocks, (double)stats.sourceBlocks / stats.blocks);
+  }
+  return 0;
+}